@@ -0,0 +1,306 @@
+/*
+ * bench_batch.c
+ *
+ * @brief Host regression check of batch fusion over pairs of mixed sizes.
+ *
+ * Writes a directory of synthetic pairs into a scratch directory: six valid
+ * pairs from 64x48 to 512x384 (odd and tall sizes among them), one pair 2100
+ * pixels wide that only the 1-D mode accepts (the 2-D mode is limited to
+ * BEMD_MAX_LINE), one pair whose image B is cut off in the middle of its
+ * pixels and one pair whose images differ in size. Each pair is also fused
+ * on its own by a fresh emd_fusion_ctx and encoded to PGM, which is the
+ * reference.
+ *
+ * The batch then runs for each EMD mode, with 1, 2 and 4 workers, and with
+ * each I/O backend: synchronous (none), the I/O thread and io_uring. Every run
+ * must give every pair its expected status (ok, read for the cut-off file,
+ * size for the mismatch and for the wide pair in 2-D) and write outputs that
+ * are byte-identical to the references. The program reports each run in CSV,
+ * between the error lines the failing pairs print, and exits with 1 if a
+ * check fails. The scratch directory is removed at the end.
+ *
+ * Build and run on the host (from this directory):
+ *   gcc -O2 -pthread -I../src bench_batch.c ../src/batch_fusion.c ../src/async_io.c ../src/emd_fusion.c \
+ *       ../src/incremental_fusion.c ../src/pyramid_fusion.c ../src/precision_kernels.c \
+ *       ../src/parallel_fusion.c ../src/thread_pool.c ../src/emd.c ../src/decision_mask.c ../src/fusion.c \
+ *       ../src/pixel_kernels.c ../src/image_io.c ../src/trace.c ../src/led.c -o bench_batch
+ *   ./bench_batch [scratch parent directory]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include "batch_fusion.h"
+#include "image_io.h"
+
+/** @brief What a pair of the batch is made of. */
+#define PAIR_VALID     0  /**< Two images of the same size. */
+#define PAIR_TRUNCATED 1  /**< Image B loses the second half of its pixels. */
+#define PAIR_MISMATCH  2  /**< Image B is height x width. */
+
+typedef struct {
+    int width;
+    int height;
+    int kind;
+} bench_pair;
+
+static const bench_pair pairs[] = {
+    { 200, 200, PAIR_VALID },
+    { 64, 48, PAIR_VALID },
+    { 320, 240, PAIR_VALID },
+    { 97, 131, PAIR_VALID },
+    { 33, 700, PAIR_VALID },
+    { 512, 384, PAIR_VALID },
+    { 2100, 3, PAIR_VALID },
+    { 160, 120, PAIR_TRUNCATED },
+    { 120, 90, PAIR_MISMATCH },
+};
+
+#define NUM_PAIRS ((int)(sizeof(pairs) / sizeof(pairs[0])))
+
+/** @brief Encoded single-run output of a pair, or the status the single run ended with. */
+typedef struct {
+    int status;
+    unsigned char* data;
+    size_t size;
+} reference;
+
+static uint32_t xorshift32(uint32_t* state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+/** Multi-focus pair of a textured scene: sharp in the left half of A and the right half of B. */
+static void make_pair(unsigned char* a, unsigned char* b, int width, int height, uint32_t seed) {
+    unsigned char* sharp = malloc((size_t)width * height);
+    for (int i = 0; i < width * height; i++) {
+        sharp[i] = (unsigned char)(64 + (xorshift32(&seed) & 127));
+    }
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int sum = 0, count = 0;
+            for (int j = y - 1; j <= y + 1; j++) {
+                for (int k = x - 1; k <= x + 1; k++) {
+                    if (j >= 0 && j < height && k >= 0 && k < width) {
+                        sum += sharp[j * width + k];
+                        count++;
+                    }
+                }
+            }
+            int i = y * width + x;
+            unsigned char blurred = (unsigned char)(sum / count);
+            a[i] = (x < width / 2) ? sharp[i] : blurred;
+            b[i] = (x < width / 2) ? blurred : sharp[i];
+        }
+    }
+    free(sharp);
+}
+
+/** Write a PGM of width x height whose pixel data stops after pixel_bytes bytes. */
+static int write_pgm(const char* path, const unsigned char* pixels, int width, int height, size_t pixel_bytes) {
+    FILE* fp = fopen(path, "wb");
+    if (fp == NULL) {
+        return -1;
+    }
+    fprintf(fp, "P5\n%d %d\n255\n", width, height);
+    size_t written = fwrite(pixels, 1, pixel_bytes, fp);
+    return (fclose(fp) == 0 && written == pixel_bytes) ? 0 : -1;
+}
+
+static unsigned char* read_file(const char* path, size_t* size) {
+    FILE* fp = fopen(path, "rb");
+    unsigned char* data = NULL;
+    if (fp != NULL && fseek(fp, 0, SEEK_END) == 0) {
+        long n = ftell(fp);
+        rewind(fp);
+        data = malloc((size_t)n + 1);
+        if (data != NULL && fread(data, 1, (size_t)n, fp) == (size_t)n) {
+            *size = (size_t)n;
+        } else {
+            free(data);
+            data = NULL;
+        }
+    }
+    if (fp != NULL) {
+        fclose(fp);
+    }
+    return data;
+}
+
+static void remove_tree(const char* dir) {
+    char command[4300];
+    snprintf(command, sizeof(command), "rm -rf '%s'", dir);
+    if (system(command) != 0) {
+        printf("Error: Cannot remove %s.\n", dir);
+    }
+}
+
+/** Fuse one pair on its own, with a context created for it, and encode the result as PGM. */
+static void fuse_single(const batch_pair* pair, const emd_fusion_config* config, reference* ref) {
+    image_view view[2];
+    emd_fusion_ctx ctx;
+
+    memset(ref, 0, sizeof(*ref));
+    if (image_open(pair->image_a, &view[0]) != 0) {
+        ref->status = BATCH_ERROR_READ;
+        return;
+    }
+    if (image_open(pair->image_b, &view[1]) != 0) {
+        image_close(&view[0]);
+        ref->status = BATCH_ERROR_READ;
+        return;
+    }
+    ref->status = BATCH_ERROR_SIZE;
+    if (view[0].width == view[1].width && view[0].height == view[1].height &&
+        emd_fusion_init(&ctx, (int)view[0].width, (int)view[0].height, config, NULL, 0) == 0) {
+        size_t num_pixels = (size_t)view[0].width * view[0].height;
+        unsigned char* fused = malloc(num_pixels);
+        if (emd_fusion_run(&ctx, view[0].pixels, view[1].pixels, fused) == 0) {
+            ref->size = image_encoded_size(IMAGE_FORMAT_PGM, view[0].width, view[0].height);
+            ref->data = malloc(ref->size);
+            image_encode(IMAGE_FORMAT_PGM, view[0].width, view[0].height, fused, ref->data, ref->size);
+            ref->status = BATCH_OK;
+        }
+        free(fused);
+        emd_fusion_free(&ctx);
+    }
+    image_close(&view[0]);
+    image_close(&view[1]);
+}
+
+/** Status the batch must report for pair p of the manifest order. */
+static int expected_status(int p, int emd_mode) {
+    if (pairs[p].kind == PAIR_TRUNCATED) {
+        return BATCH_ERROR_READ;
+    }
+    if (pairs[p].kind == PAIR_MISMATCH) {
+        return BATCH_ERROR_SIZE;
+    }
+    if (emd_mode == EMD_MODE_2D && (pairs[p].width > BEMD_MAX_LINE || pairs[p].height > BEMD_MAX_LINE)) {
+        return BATCH_ERROR_SIZE;
+    }
+    return BATCH_OK;
+}
+
+int main(int argc, char** argv) {
+    static const int backends[] = { ASYNC_IO_NONE, ASYNC_IO_THREAD, ASYNC_IO_URING };
+    static const int worker_counts[] = { 1, 2, 4 };
+    const char* parent = (argc > 1) ? argv[1] : "/tmp";
+    char root[4096], in_dir[4200];
+    reference refs[NUM_PAIRS];
+    int failures = 0;
+
+    snprintf(root, sizeof(root), "%s/bench_batch.XXXXXX", parent);
+    if (mkdtemp(root) == NULL) {
+        printf("Error: Cannot create a directory in %s.\n", parent);
+        return 1;
+    }
+    snprintf(in_dir, sizeof(in_dir), "%s/in", root);
+    mkdir(in_dir, 0777);
+
+    for (int p = 0; p < NUM_PAIRS; p++) {
+        int width = pairs[p].width, height = pairs[p].height;
+        size_t n = (size_t)width * height;
+        unsigned char* a = malloc(n);
+        unsigned char* b = malloc(n);
+        char path[4300];
+
+        make_pair(a, b, width, height, 4321u + 13u * (uint32_t)p);
+        snprintf(path, sizeof(path), "%s/p%02da.pgm", in_dir, p);
+        int rc = write_pgm(path, a, width, height, n);
+        snprintf(path, sizeof(path), "%s/p%02db.pgm", in_dir, p);
+        if (pairs[p].kind == PAIR_TRUNCATED) {
+            rc |= write_pgm(path, b, width, height, n / 2);
+        } else if (pairs[p].kind == PAIR_MISMATCH) {
+            rc |= write_pgm(path, b, height, width, n);
+        } else {
+            rc |= write_pgm(path, b, width, height, n);
+        }
+        free(a);
+        free(b);
+        if (rc != 0) {
+            printf("Error: Cannot write the inputs to %s.\n", in_dir);
+            remove_tree(root);
+            return 1;
+        }
+    }
+
+    printf("mode,workers,backend,pairs,pairs_per_s,status_wrong,outputs_differing,pass\n");
+    for (int mode = EMD_MODE_1D; mode <= EMD_MODE_2D; mode++) {
+        const char* mode_name = (mode == EMD_MODE_1D) ? "1d" : "2d";
+        emd_fusion_config config;
+        batch_list list;
+
+        emd_fusion_config_default(&config);
+        config.emd_mode = mode;
+
+        // The references: each pair fused on its own. Their statuses are checked like the batch's.
+        char ref_dir[4300];
+        snprintf(ref_dir, sizeof(ref_dir), "%s/ref_%s", root, mode_name);
+        if (batch_list_load(in_dir, ref_dir, IMAGE_FORMAT_PGM, &list) != 0 || list.count != NUM_PAIRS) {
+            printf("Error: Expected %d pairs in %s.\n", NUM_PAIRS, in_dir);
+            remove_tree(root);
+            return 1;
+        }
+        int ref_wrong = 0;
+        for (int p = 0; p < NUM_PAIRS; p++) {
+            fuse_single(&list.pairs[p], &config, &refs[p]);
+            ref_wrong += refs[p].status != expected_status(p, mode);
+        }
+        batch_list_free(&list);
+        failures += ref_wrong > 0;
+        printf("%s,single,none,%d,,%d,,%s\n", mode_name, NUM_PAIRS, ref_wrong, ref_wrong == 0 ? "yes" : "NO");
+
+        for (int w = 0; w < (int)(sizeof(worker_counts) / sizeof(worker_counts[0])); w++) {
+            for (int k = 0; k < (int)(sizeof(backends) / sizeof(backends[0])); k++) {
+                char out_dir[4300];
+                batch_stats stats;
+
+                snprintf(out_dir, sizeof(out_dir), "%s/out_%s_%d_%s", root, mode_name, worker_counts[w],
+                         async_io_backend_name(backends[k]));
+                if (batch_list_load(in_dir, out_dir, IMAGE_FORMAT_PGM, &list) != 0) {
+                    remove_tree(root);
+                    return 1;
+                }
+                batch_result* results = calloc((size_t)list.count, sizeof(batch_result));
+                batch_fusion_run(&list, worker_counts[w], &config, IMAGE_FORMAT_PGM, backends[k], results, &stats);
+
+                int status_wrong = 0, differing = 0;
+                for (int p = 0; p < list.count; p++) {
+                    status_wrong += results[p].status != expected_status(p, mode);
+                    if (results[p].status == BATCH_OK) {
+                        size_t size;
+                        unsigned char* out = read_file(list.pairs[p].output, &size);
+                        differing += (out == NULL || refs[p].data == NULL || size != refs[p].size ||
+                                      memcmp(out, refs[p].data, size) != 0);
+                        free(out);
+                    }
+                }
+                int pass = status_wrong == 0 && differing == 0;
+                failures += !pass;
+                printf("%s,%d,%s,%d,%.2f,%d,%d,%s\n", mode_name, worker_counts[w],
+                       async_io_backend_name(stats.io_backend), list.count, stats.pairs_per_second, status_wrong,
+                       differing, pass ? "yes" : "NO");
+                free(results);
+                batch_list_free(&list);
+            }
+        }
+
+        for (int p = 0; p < NUM_PAIRS; p++) {
+            free(refs[p].data);
+        }
+    }
+
+    remove_tree(root);
+    if (failures > 0) {
+        printf("Error: %d batch runs gave a wrong status or output.\n", failures);
+        return 1;
+    }
+    return 0;
+}
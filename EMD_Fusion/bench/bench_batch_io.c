@@ -0,0 +1,237 @@
+/*
+ * bench_batch_io.c
+ *
+ * @brief Host benchmark of the batch mode's read-ahead and write-behind I/O.
+ *
+ * Writes BENCH_PAIRS synthetic multi-focus PGM pairs into a scratch directory
+ * and fuses them with one batch worker, once per I/O backend: synchronous
+ * (none), the I/O thread and io_uring. Each backend runs with the inputs in
+ * the page cache (warm) and with the inputs dropped from it beforehand
+ * (cold: fsync() and POSIX_FADV_DONTNEED, which the file system may ignore).
+ * Reported per run: pairs per second, and per pair the mean fusion time, I/O
+ * time (submission to completion), I/O time exposed on the worker's critical
+ * path, and the worker time outside fusion (exposed I/O, parsing, encoding).
+ * The share of the I/O hidden behind fusion is measured against the
+ * synchronous run with the same cache: its time outside fusion is all I/O
+ * work done in line, and what a backend saves of it was hidden. A negative
+ * share means the backend costs the worker more than it hides. With io_uring
+ * a completion is only stamped when the worker next looks at the ring, so its
+ * I/O time is an upper bound and is not printed.
+ *
+ * Every output must equal the synchronous run's; the program exits with 1
+ * otherwise. The scratch directory is removed at the end.
+ *
+ * Build and run on the host (from this directory):
+ *   gcc -O2 -pthread -I../src bench_batch_io.c ../src/batch_fusion.c ../src/async_io.c ../src/emd_fusion.c \
+ *       ../src/incremental_fusion.c ../src/pyramid_fusion.c ../src/precision_kernels.c \
+ *       ../src/parallel_fusion.c ../src/thread_pool.c ../src/emd.c ../src/decision_mask.c ../src/fusion.c \
+ *       ../src/pixel_kernels.c ../src/image_io.c ../src/trace.c ../src/led.c -o bench_batch_io
+ *   ./bench_batch_io [width height] [scratch parent directory]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "batch_fusion.h"
+#include "image_io.h"
+
+#define BENCH_PAIRS 12
+
+static uint32_t xorshift32(uint32_t* state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+/** Multi-focus pair of a textured scene: sharp in the left half of A and the right half of B. */
+static void make_pair(unsigned char* a, unsigned char* b, int width, int height, uint32_t seed) {
+    unsigned char* sharp = malloc((size_t)width * height);
+    for (int i = 0; i < width * height; i++) {
+        sharp[i] = (unsigned char)(64 + (xorshift32(&seed) & 127));
+    }
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int sum = 0, count = 0;
+            for (int j = y - 1; j <= y + 1; j++) {
+                for (int k = x - 1; k <= x + 1; k++) {
+                    if (j >= 0 && j < height && k >= 0 && k < width) {
+                        sum += sharp[j * width + k];
+                        count++;
+                    }
+                }
+            }
+            int i = y * width + x;
+            unsigned char blurred = (unsigned char)(sum / count);
+            a[i] = (x < width / 2) ? sharp[i] : blurred;
+            b[i] = (x < width / 2) ? blurred : sharp[i];
+        }
+    }
+    free(sharp);
+}
+
+static int write_pgm(const char* path, const unsigned char* pixels, int width, int height) {
+    FILE* fp = fopen(path, "wb");
+    if (fp == NULL) {
+        return -1;
+    }
+    fprintf(fp, "P5\n%d %d\n255\n", width, height);
+    size_t written = fwrite(pixels, 1, (size_t)width * height, fp);
+    return (fclose(fp) == 0 && written == (size_t)width * height) ? 0 : -1;
+}
+
+/** Ask the kernel to drop a file from the page cache. */
+static void evict(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+}
+
+static unsigned char* read_file(const char* path, size_t* size) {
+    FILE* fp = fopen(path, "rb");
+    unsigned char* data = NULL;
+    if (fp != NULL && fseek(fp, 0, SEEK_END) == 0) {
+        long n = ftell(fp);
+        rewind(fp);
+        data = malloc((size_t)n + 1);
+        if (data != NULL && fread(data, 1, (size_t)n, fp) == (size_t)n) {
+            *size = (size_t)n;
+        } else {
+            free(data);
+            data = NULL;
+        }
+    }
+    if (fp != NULL) {
+        fclose(fp);
+    }
+    return data;
+}
+
+/** Outputs of a run that differ from the reference run's. */
+static int count_differing(const batch_list* list, const char* out_dir, const char* ref_dir) {
+    int differing = 0;
+    for (int i = 0; i < list->count; i++) {
+        const char* name = strrchr(list->pairs[i].output, '/') + 1;
+        char path[8500];
+        size_t size, ref_size;
+        snprintf(path, sizeof(path), "%s/%s", out_dir, name);
+        unsigned char* out = read_file(path, &size);
+        snprintf(path, sizeof(path), "%s/%s", ref_dir, name);
+        unsigned char* ref = read_file(path, &ref_size);
+        differing += (out == NULL || ref == NULL || size != ref_size || memcmp(out, ref, size) != 0);
+        free(out);
+        free(ref);
+    }
+    return differing;
+}
+
+static void remove_tree(const char* dir) {
+    char command[4300];
+    snprintf(command, sizeof(command), "rm -rf '%s'", dir);
+    if (system(command) != 0) {
+        printf("Error: Cannot remove %s.\n", dir);
+    }
+}
+
+int main(int argc, char** argv) {
+    static const int backends[] = { ASYNC_IO_NONE, ASYNC_IO_THREAD, ASYNC_IO_URING };
+    static const char* const caches[] = { "warm", "cold" };
+    int width = (argc > 2) ? atoi(argv[1]) : 1024;
+    int height = (argc > 2) ? atoi(argv[2]) : 1024;
+    const char* parent = (argc > 3) ? argv[3] : (argc == 2) ? argv[1] : "/tmp";
+    char root[4096], in_dir[4200], ref_dir[4200];
+    size_t n = (size_t)width * height;
+    emd_fusion_config config;
+    int differing = 0;
+    double sync_outside_ms = 0.0;
+
+    snprintf(root, sizeof(root), "%s/bench_batch_io.XXXXXX", parent);
+    if (width < 8 || height < 8 || mkdtemp(root) == NULL) {
+        printf("Error: Invalid size or cannot create a directory in %s.\n", parent);
+        return 1;
+    }
+    snprintf(in_dir, sizeof(in_dir), "%s/in", root);
+    snprintf(ref_dir, sizeof(ref_dir), "%s/out_none_warm", root);
+    mkdir(in_dir, 0777);
+
+    unsigned char* a = malloc(n);
+    unsigned char* b = malloc(n);
+    for (int p = 0; p < BENCH_PAIRS; p++) {
+        char path[4300];
+        make_pair(a, b, width, height, 1234u + 77u * (uint32_t)p);
+        snprintf(path, sizeof(path), "%s/p%02da.pgm", in_dir, p);
+        int rc = write_pgm(path, a, width, height);
+        snprintf(path, sizeof(path), "%s/p%02db.pgm", in_dir, p);
+        if (rc != 0 || write_pgm(path, b, width, height) != 0) {
+            printf("Error: Cannot write the inputs to %s.\n", in_dir);
+            remove_tree(root);
+            return 1;
+        }
+    }
+    free(a);
+    free(b);
+
+    emd_fusion_config_default(&config);
+    printf("backend,cache,size,pairs,pairs_per_s,fuse_ms,io_ms,io_exposed_ms,outside_fuse_ms,io_hidden_pct,"
+           "outputs_differing\n");
+    for (int c = 0; c < 2; c++) {
+        for (int k = 0; k < (int)(sizeof(backends) / sizeof(backends[0])); k++) {
+            char out_dir[4200];
+            batch_list list;
+            batch_stats stats;
+
+            snprintf(out_dir, sizeof(out_dir), "%s/out_%s_%s", root, async_io_backend_name(backends[k]),
+                     caches[c]);
+            if (batch_list_load(in_dir, out_dir, IMAGE_FORMAT_PGM, &list) != 0) {
+                remove_tree(root);
+                return 1;
+            }
+            if (c == 1) {
+                for (int i = 0; i < list.count; i++) {
+                    evict(list.pairs[i].image_a);
+                    evict(list.pairs[i].image_b);
+                }
+            }
+            batch_result* results = calloc((size_t)list.count, sizeof(batch_result));
+            batch_fusion_run(&list, 1, &config, IMAGE_FORMAT_PGM, backends[k], results, &stats);
+
+            double fuse_ms = 0.0, outside_ms = 0.0;
+            for (int i = 0; i < list.count; i++) {
+                fuse_ms += results[i].fuse_ms;
+                outside_ms += results[i].total_ms - results[i].fuse_ms;
+            }
+            if (backends[k] == ASYNC_IO_NONE) {
+                sync_outside_ms = outside_ms;
+            }
+            double hidden_pct =
+                (sync_outside_ms > 0.0) ? 100.0 * (sync_outside_ms - outside_ms) / sync_outside_ms : 0.0;
+            char io_ms[32] = "";
+            if (stats.io_backend != ASYNC_IO_URING) {
+                snprintf(io_ms, sizeof(io_ms), "%.3f", stats.io_ms / list.count);
+            }
+            int diff = count_differing(&list, out_dir, ref_dir) + stats.failed;
+            printf("%s,%s,%dx%d,%d,%.2f,%.3f,%s,%.3f,%.3f,%.1f,%d\n", async_io_backend_name(stats.io_backend),
+                   caches[c], width, height, list.count, stats.pairs_per_second, fuse_ms / list.count, io_ms,
+                   stats.io_exposed_ms / list.count, outside_ms / list.count, hidden_pct, diff);
+            differing += diff;
+            free(results);
+            batch_list_free(&list);
+        }
+    }
+
+    remove_tree(root);
+    if (differing > 0) {
+        printf("Error: %d outputs differ from the synchronous run or failed.\n", differing);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,194 @@
+/*
+ * bench_color.c
+ *
+ * @brief Host benchmark of the colour fusion: luma decision applied to RGB.
+ *
+ * On a synthetic colour pair (random RGB texture, sharp in the left half of A
+ * and the right half of B) it times, per frame:
+ *   grayscale     emd_fusion_run() on the luma planes of the pair
+ *   color         emd_fusion_run_rgb(): luma conversion, the same EMD,
+ *                 variance and decision, the RGB select and stretch
+ *   per-channel   emd_fusion_run() on each of the R, G and B planes, the
+ *                 naive colour fusion with three decompositions
+ * and the select kernel alone, mask_select_rgb() of every kernel variant, in
+ * milliseconds per megapixel against the scalar kernel.
+ *
+ * It checks that the colour fusion of a gray pair stored as RGB (R = G = B)
+ * gives the grayscale fusion in every channel, and that every kernel variant
+ * matches the scalar one; the exit status is non-zero otherwise.
+ *
+ * Build and run on the host (from this directory):
+ *   gcc -O2 -pthread -I../src bench_color.c ../src/emd_fusion.c \
+ *       ../src/incremental_fusion.c ../src/pyramid_fusion.c \
+ *       ../src/precision_kernels.c ../src/parallel_fusion.c ../src/thread_pool.c ../src/emd.c \
+ *       ../src/decision_mask.c ../src/fusion.c ../src/pixel_kernels.c ../src/image_io.c \
+ *       ../src/trace.c ../src/led.c -o bench_color
+ *   ./bench_color [width height]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "emd_fusion.h"
+#include "fusion.h"
+#include "pixel_kernels.h"
+
+#define BENCH_FRAMES  3
+#define BENCH_REPEATS 20
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/** Synthetic RGB pair: random texture, sharp in the left half of A and the right half of B. */
+static void make_pair(unsigned char* a, unsigned char* b, int width, int height) {
+    srand(11);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            for (int c = 0; c < 3; c++) {
+                int i = 3 * (y * width + x) + c;
+                unsigned char sharp = (unsigned char)(48 + 40 * c + (rand() % 128));
+                unsigned char flat = (unsigned char)(80 + 30 * c + ((x + y) & 63));
+                a[i] = (x < width / 2) ? sharp : flat;
+                b[i] = (x < width / 2) ? flat : sharp;
+            }
+        }
+    }
+}
+
+/** Channel c of an interleaved RGB image. */
+static void extract_plane(const unsigned char* rgb, int num_pixels, int c, unsigned char* plane) {
+    for (int i = 0; i < num_pixels; i++) {
+        plane[i] = rgb[3 * i + c];
+    }
+}
+
+int main(int argc, char** argv) {
+    int width = (argc > 2) ? atoi(argv[1]) : 512;
+    int height = (argc > 2) ? atoi(argv[2]) : 512;
+    int n = width * height;
+    double mp = n / 1e6;
+    int failures = 0;
+    emd_fusion_config config;
+    emd_fusion_ctx gray_ctx, color_ctx;
+
+    unsigned char* a = malloc(3 * (size_t)n);
+    unsigned char* b = malloc(3 * (size_t)n);
+    unsigned char* out = malloc(3 * (size_t)n);
+    unsigned char* ref = malloc(3 * (size_t)n);
+    unsigned char* gray_a = malloc(3 * (size_t)n);
+    unsigned char* gray_b = malloc(3 * (size_t)n);
+    unsigned char* plane[3];
+    for (int i = 0; i < 3; i++) {
+        plane[i] = malloc(n);
+    }
+    char* mask = malloc(n);
+    emd_fusion_config_default(&config);
+    if (a == NULL || b == NULL || out == NULL || ref == NULL || gray_a == NULL || gray_b == NULL ||
+        plane[0] == NULL || plane[1] == NULL ||
+        plane[2] == NULL || mask == NULL || emd_fusion_init(&gray_ctx, width, height, &config, NULL, 0) != 0) {
+        printf("Error: Out of memory.\n");
+        return 1;
+    }
+    config.color = 1;
+    if (emd_fusion_init(&color_ctx, width, height, &config, NULL, 0) != 0) {
+        return 1;
+    }
+    make_pair(a, b, width, height);
+
+    // Gray pair as RGB: the colour fusion must reproduce the grayscale fusion in each channel.
+    rgb_to_luma(a, n, plane[0]);
+    rgb_to_luma(b, n, plane[1]);
+    emd_fusion_run(&gray_ctx, plane[0], plane[1], plane[2]);
+    for (int i = 0; i < 3 * n; i++) {
+        gray_a[i] = plane[0][i / 3];
+        gray_b[i] = plane[1][i / 3];
+    }
+    emd_fusion_run_rgb(&color_ctx, gray_a, gray_b, out);
+    int equivalent = 1;
+    for (int i = 0; i < 3 * n; i++) {
+        equivalent &= (out[i] == plane[2][i / 3]);
+    }
+    failures += !equivalent;
+
+    printf("size,variant,ms_per_frame,ms_per_mp,relative_to_grayscale,matches\n");
+    double gray_ms = 1e30, color_ms = 1e30, split_ms = 1e30;
+    for (int f = 0; f < BENCH_FRAMES; f++) {
+        double t0 = now_ms();
+        rgb_to_luma(a, n, plane[0]);
+        rgb_to_luma(b, n, plane[1]);
+        emd_fusion_run(&gray_ctx, plane[0], plane[1], plane[2]);
+        double t = now_ms() - t0;
+        if (t < gray_ms) gray_ms = t;
+
+        t0 = now_ms();
+        emd_fusion_run_rgb(&color_ctx, a, b, out);
+        t = now_ms() - t0;
+        if (t < color_ms) color_ms = t;
+
+        t0 = now_ms();
+        for (int c = 0; c < 3; c++) {
+            extract_plane(a, n, c, plane[0]);
+            extract_plane(b, n, c, plane[1]);
+            emd_fusion_run(&gray_ctx, plane[0], plane[1], plane[2]);
+            for (int i = 0; i < n; i++) {
+                ref[3 * i + c] = plane[2][i];
+            }
+        }
+        t = now_ms() - t0;
+        if (t < split_ms) split_ms = t;
+    }
+    printf("%dx%d,grayscale,%.3f,%.3f,1.00,n/a\n", width, height, gray_ms, gray_ms / mp);
+    printf("%dx%d,color,%.3f,%.3f,%.2f,%s\n", width, height, color_ms, color_ms / mp, color_ms / gray_ms,
+           equivalent ? "yes" : "no");
+    printf("%dx%d,per-channel,%.3f,%.3f,%.2f,n/a\n", width, height, split_ms, split_ms / mp, split_ms / gray_ms);
+
+    // The select kernel alone, with a mask of all three decisions.
+    for (int i = 0; i < n; i++) {
+        mask[i] = (char)(rand() % 3);
+    }
+    printf("size,kernel,ms_per_mp,speedup,matches_scalar\n");
+    double scalar_ms = 0;
+    unsigned char ref_lo = 0, ref_hi = 0;
+    for (int variant = 0; variant < PIXEL_KERNELS_COUNT; variant++) {
+        const pixel_kernels* k = pixel_kernels_variant(variant);
+        unsigned char lo, hi;
+        double best = 1e30;
+        if (k == NULL) {
+            continue;
+        }
+        for (int rep = 0; rep < BENCH_REPEATS; rep++) {
+            double t0 = now_ms();
+            k->mask_select_rgb(a, b, mask, out, n, &lo, &hi);
+            double t = now_ms() - t0;
+            if (t < best) best = t;
+        }
+        if (variant == PIXEL_KERNELS_SCALAR) {
+            memcpy(ref, out, 3 * (size_t)n);
+            ref_lo = lo;
+            ref_hi = hi;
+            scalar_ms = best;
+        }
+        int same = memcmp(ref, out, 3 * (size_t)n) == 0 && lo == ref_lo && hi == ref_hi;
+        failures += !same;
+        printf("%dx%d,%s,%.3f,%.2f,%s\n", width, height, k->name, best / mp, scalar_ms / best, same ? "yes" : "no");
+    }
+
+    emd_fusion_free(&gray_ctx);
+    emd_fusion_free(&color_ctx);
+    free(a);
+    free(b);
+    free(out);
+    free(ref);
+    free(gray_a);
+    free(gray_b);
+    for (int i = 0; i < 3; i++) {
+        free(plane[i]);
+    }
+    free(mask);
+    return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,143 @@
+/*
+ * bench_compact.c
+ *
+ * @brief Host benchmark of the compact intermediates (16-bit variance maps and
+ *        a packed 2-bit mask) against the Q16.16 maps and the char mask.
+ *
+ * For each frame size and scene, both layouts run variance, decision and
+ * fusion from the same Q16.16 signals. The program reports the wall time of
+ * each layout, the bytes of the intermediate buffers (variance maps plus mask),
+ * and how many decisions and fused pixels differ between the two layouts; it
+ * fails if any do.
+ *
+ * Build and run on the host (from this directory):
+ *   gcc -O2 -I../src bench_compact.c ../src/decision_mask.c ../src/fusion.c \
+ *       ../src/pixel_kernels.c ../src/image_io.c ../src/led.c ../src/emd.c -lm -o bench_compact
+ *   ./bench_compact
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "emd.h"
+#include "decision_mask.h"
+#include "fusion.h"
+#include "pixel_kernels.h"
+
+#define BENCH_REPEATS 10
+
+static const int bench_sizes[][2] = { { 200, 200 }, { 640, 480 }, { 1024, 1024 }, { 2048, 2048 } };
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/**
+ * Scene 0: textured multi-focus pair, sharp in the left half of A and the right
+ * half of B. Scene 1: independent noise, which puts many pixels near the threshold.
+ */
+static void make_pair(unsigned char* a, unsigned char* b, int width, int height, int scene) {
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            if (scene == 0) {
+                int sharp = ((x * 7) ^ (y * 13)) & 0xFF;
+                int blur = (((x & ~3) * 7) ^ ((y & ~3) * 13)) & 0xFF;
+                a[y * width + x] = (unsigned char)((x < width / 2) ? sharp : blur);
+                b[y * width + x] = (unsigned char)((x < width / 2) ? blur : sharp);
+            } else {
+                a[y * width + x] = (unsigned char)(rand() & 0xFF);
+                b[y * width + x] = (unsigned char)(rand() & 0xFF);
+            }
+        }
+    }
+}
+
+int main(void) {
+    int failed = 0;
+    printf("scene,width,height,full_ms,compact_ms,full_bytes,compact_bytes,mask_mismatches,pixel_mismatches\n");
+
+    for (int scene = 0; scene < 2; scene++) {
+        for (size_t s = 0; s < sizeof(bench_sizes) / sizeof(bench_sizes[0]); s++) {
+            int width = bench_sizes[s][0];
+            int height = bench_sizes[s][1];
+            int num_pixels = width * height;
+            int num_words = PACKED_MASK_WORDS(num_pixels);
+
+            unsigned char* a = malloc(num_pixels);
+            unsigned char* b = malloc(num_pixels);
+            int32_t* s1 = malloc((size_t)num_pixels * sizeof(int32_t));
+            int32_t* s2 = malloc((size_t)num_pixels * sizeof(int32_t));
+            int32_t* v1 = malloc((size_t)num_pixels * sizeof(int32_t));
+            int32_t* v2 = malloc((size_t)num_pixels * sizeof(int32_t));
+            char* mask = malloc(num_pixels);
+            uint16_t* c1 = malloc((size_t)num_pixels * sizeof(uint16_t));
+            uint16_t* c2 = malloc((size_t)num_pixels * sizeof(uint16_t));
+            uint32_t* packed = malloc((size_t)num_words * sizeof(uint32_t));
+            unsigned char* out_full = malloc(num_pixels);
+            unsigned char* out_compact = malloc(num_pixels);
+            if (!a || !b || !s1 || !s2 || !v1 || !v2 || !mask || !c1 || !c2 || !packed ||
+                !out_full || !out_compact) {
+                printf("Error: Out of memory.\n");
+                return 1;
+            }
+
+            make_pair(a, b, width, height, scene);
+            convert_to_q16_16(a, s1, num_pixels);
+            convert_to_q16_16(b, s2, num_pixels);
+
+            double best_full = 1e30, best_compact = 1e30;
+            unsigned char lo, hi;
+            for (int r = 0; r < BENCH_REPEATS; r++) {
+                double t0 = now_ms();
+                int64_t sum_var = calculate_local_variance(s1, width, height, WINDOW_SIZE, v1);
+                sum_var += calculate_local_variance(s2, width, height, WINDOW_SIZE, v2);
+                int32_t eps = decision_mask_epsilon(sum_var, 2 * (int64_t)num_pixels);
+                generate_decision_mask_eps(v1, v2, num_pixels, eps, mask);
+                fuse_images(a, b, mask, width, height, out_full);
+                double t1 = now_ms();
+                sum_var = calculate_local_variance_u16(s1, width, height, WINDOW_SIZE, c1);
+                sum_var += calculate_local_variance_u16(s2, width, height, WINDOW_SIZE, c2);
+                eps = decision_mask_epsilon(sum_var, 2 * (int64_t)num_pixels);
+                generate_decision_mask_packed(c1, c2, s1, s2, width, height, WINDOW_SIZE, eps, packed);
+                fuse_images_packed(a, b, packed, num_pixels, out_compact, &lo, &hi);
+                double t2 = now_ms();
+
+                if (t1 - t0 < best_full) best_full = t1 - t0;
+                if (t2 - t1 < best_compact) best_compact = t2 - t1;
+            }
+
+            int mask_mismatches = 0, pixel_mismatches = 0;
+            for (int i = 0; i < num_pixels; i++) {
+                int code = (packed[i / MASK_CODES_PER_WORD] >> (2 * (i % MASK_CODES_PER_WORD))) & 3;
+                mask_mismatches += (code != mask[i]);
+                pixel_mismatches += (out_full[i] != out_compact[i]);
+            }
+            failed |= (mask_mismatches != 0 || pixel_mismatches != 0);
+
+            unsigned long full_bytes = (unsigned long)num_pixels * (2 * sizeof(int32_t) + 1);
+            unsigned long compact_bytes = (unsigned long)num_pixels * 2 * sizeof(uint16_t) +
+                                          (unsigned long)num_words * sizeof(uint32_t);
+            printf("%s,%d,%d,%.3f,%.3f,%lu,%lu,%d,%d\n", scene == 0 ? "multifocus" : "noise",
+                   width, height, best_full, best_compact, full_bytes, compact_bytes,
+                   mask_mismatches, pixel_mismatches);
+
+            free(a);
+            free(b);
+            free(s1);
+            free(s2);
+            free(v1);
+            free(v2);
+            free(mask);
+            free(c1);
+            free(c2);
+            free(packed);
+            free(out_full);
+            free(out_compact);
+        }
+    }
+    return failed;
+}
@@ -0,0 +1,151 @@
+/*
+ * bench_contexts.c
+ *
+ * @brief Host benchmark of independent fusion contexts running concurrently.
+ *
+ * One context is created, timed for creation and for each reused frame, and
+ * its output is kept as the reference. Then 1..N threads each create their
+ * own context and fuse the same synthetic pair repeatedly. The program reports
+ * the aggregate frames per second and checks every output against the
+ * reference (non-zero exit otherwise).
+ *
+ * Build and run on the host (from this directory):
+ *   gcc -O2 -pthread -I../src bench_contexts.c ../src/emd_fusion.c \
+ *       ../src/incremental_fusion.c ../src/pyramid_fusion.c \
+ *       ../src/precision_kernels.c ../src/parallel_fusion.c ../src/thread_pool.c ../src/emd.c \
+ *       ../src/decision_mask.c ../src/fusion.c ../src/pixel_kernels.c ../src/image_io.c \
+ *       ../src/trace.c ../src/led.c -o bench_contexts
+ *   ./bench_contexts [max_contexts] [width height] [emd_mode]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "emd_fusion.h"
+
+#define BENCH_FRAMES 8
+
+typedef struct {
+    const unsigned char* a;
+    const unsigned char* b;
+    const unsigned char* ref;
+    int width;
+    int height;
+    int emd_mode;
+    int identical;
+} worker_args;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/** Synthetic pair: random texture, sharp in the left half of A and the right half of B. */
+static void make_pair(unsigned char* a, unsigned char* b, int width, int height) {
+    srand(11);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int i = y * width + x;
+            unsigned char sharp = (unsigned char)(64 + (rand() % 128));
+            unsigned char flat = (unsigned char)(96 + ((x + y) & 63));
+            a[i] = (x < width / 2) ? sharp : flat;
+            b[i] = (x < width / 2) ? flat : sharp;
+        }
+    }
+}
+
+/** One independent fusion: its own context and output, BENCH_FRAMES frames. */
+static void* worker_main(void* arg) {
+    worker_args* w = (worker_args*)arg;
+    emd_fusion_config config;
+    emd_fusion_ctx ctx;
+    unsigned char* out = malloc((size_t)w->width * w->height);
+
+    emd_fusion_config_default(&config);
+    config.emd_mode = w->emd_mode;
+    w->identical = 0;
+    if (out == NULL || emd_fusion_init(&ctx, w->width, w->height, &config, NULL, 0) != 0) {
+        free(out);
+        return NULL;
+    }
+    w->identical = 1;
+    for (int f = 0; f < BENCH_FRAMES; f++) {
+        memset(out, 0, (size_t)w->width * w->height);
+        emd_fusion_run(&ctx, w->a, w->b, out);
+        w->identical &= memcmp(out, w->ref, (size_t)w->width * w->height) == 0;
+    }
+    emd_fusion_free(&ctx);
+    free(out);
+    return NULL;
+}
+
+int main(int argc, char** argv) {
+    int max_contexts = (argc > 1) ? atoi(argv[1]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int width = (argc > 3) ? atoi(argv[2]) : 512;
+    int height = (argc > 3) ? atoi(argv[3]) : 512;
+    int emd_mode = (argc > 4) ? atoi(argv[4]) : EMD_MODE_1D;
+    size_t n = (size_t)width * height;
+    int all_identical = 1;
+
+    unsigned char* a = malloc(n);
+    unsigned char* b = malloc(n);
+    unsigned char* ref = malloc(n);
+    worker_args* args = malloc((size_t)max_contexts * sizeof(worker_args));
+    pthread_t* threads = malloc((size_t)max_contexts * sizeof(pthread_t));
+    if (!a || !b || !ref || !args || !threads) {
+        printf("Error: Out of memory.\n");
+        return 1;
+    }
+    make_pair(a, b, width, height);
+
+    // Creation cost against the cost of a reused frame.
+    emd_fusion_config config;
+    emd_fusion_ctx ctx;
+    emd_fusion_config_default(&config);
+    config.emd_mode = emd_mode;
+    double t0 = now_ms();
+    if (emd_fusion_init(&ctx, width, height, &config, NULL, 0) != 0) {
+        return 1;
+    }
+    double t1 = now_ms();
+    double best = 1e30;
+    for (int f = 0; f < BENCH_FRAMES; f++) {
+        double t2 = now_ms();
+        emd_fusion_run(&ctx, a, b, ref);
+        if (now_ms() - t2 < best) best = now_ms() - t2;
+    }
+    printf("context_bytes,%lu\n", (unsigned long)emd_fusion_memory_size(width, height, &config));
+    printf("init_ms,%.3f\nframe_ms,%.3f\n", t1 - t0, best);
+    emd_fusion_free(&ctx);
+
+    printf("contexts,frames,ms,frames_per_s,identical\n");
+    for (int contexts = 1; contexts <= max_contexts; contexts++) {
+        double start = now_ms();
+        for (int c = 0; c < contexts; c++) {
+            worker_args w = { a, b, ref, width, height, emd_mode, 0 };
+            args[c] = w;
+            pthread_create(&threads[c], NULL, worker_main, &args[c]);
+        }
+        int identical = 1;
+        for (int c = 0; c < contexts; c++) {
+            pthread_join(threads[c], NULL);
+            identical &= args[c].identical;
+        }
+        double ms = now_ms() - start;
+        all_identical &= identical;
+        printf("%d,%d,%.3f,%.1f,%s\n", contexts, contexts * BENCH_FRAMES, ms,
+               contexts * BENCH_FRAMES * 1e3 / ms, identical ? "yes" : "NO");
+    }
+
+    free(a);
+    free(b);
+    free(ref);
+    free(args);
+    free(threads);
+    return all_identical ? 0 : 1;
+}
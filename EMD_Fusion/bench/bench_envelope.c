@@ -0,0 +1,251 @@
+/*
+ * bench_envelope.c
+ *
+ * @brief Host comparison of the linear and cubic-spline 1-D envelopes.
+ *
+ * Part 1 decomposes synthetic 1-D signals (two tones plus a chirp) with
+ * emd_decompose_imfs() using each interpolator, and reports the sifting
+ * iterations per IMF, the throughput, and the RMS error of the first IMF
+ * against the fastest tone (away from the signal ends).
+ * Part 2 runs the 1-D fusion pipeline on a synthetic multi-focus pair and a
+ * noise pair with each interpolator, and reports how far the first IMFs
+ * differ, how many pixels change which image has the higher local variance,
+ * and how far the fused images differ.
+ * Part 3 decomposes tones around a flat plateau of up to 140000 samples, so
+ * the envelopes span a gap longer than 2^17 samples, with
+ * emd_decompose_imfs_scratch(), and fails when an IMF leaves the signal's
+ * range by more than a factor of four.
+ *
+ * Build and run on the host (from this directory):
+ *   gcc -O2 -I../src bench_envelope.c ../src/emd.c ../src/decision_mask.c ../src/fusion.c \
+ *       ../src/pixel_kernels.c ../src/image_io.c ../src/led.c -lm -o bench_envelope
+ *   ./bench_envelope
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include "emd.h"
+#include "decision_mask.h"
+#include "fusion.h"
+
+#define SIGNAL_LEN 4096
+#define BENCH_REPEATS 20
+#define IMAGE_SIZE 200
+#define EDGE_SKIP 200
+#define PLATEAU_TONE_LEN 4096
+#define PLATEAU_MAX_LEN 140000
+
+static const char* envelope_names[] = { "linear", "spline" };
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static double fast_tone(int i, double tone_period) {
+    return 50.0 * sin(2.0 * M_PI * i / tone_period);
+}
+
+/** Two tones plus a slower chirp, scaled to about +/-100 in Q16.16. */
+static void make_signal(int32_t* signal, int length, double tone_period) {
+    for (int i = 0; i < length; i++) {
+        double x = (double)i;
+        double v = fast_tone(i, tone_period) +
+                   30.0 * sin(2.0 * M_PI * x / (tone_period * 7.3)) +
+                   20.0 * sin(2.0 * M_PI * x * x / (8.0 * length * tone_period));
+        signal[i] = (int32_t)lrint(v * 65536.0);
+    }
+}
+
+/** The two-tone signal of tone period 16 in [0, tone_len), a flat plateau of plateau_len samples, the tones again. */
+static int make_plateau_signal(int32_t* signal, int tone_len, int plateau_len) {
+    int length = 2 * tone_len + plateau_len;
+    make_signal(signal, tone_len, 16.0);
+    for (int i = 0; i < plateau_len; i++) {
+        signal[tone_len + i] = signal[tone_len - 1];
+    }
+    memcpy(signal + tone_len + plateau_len, signal, (size_t)tone_len * sizeof(int32_t));
+    return length;
+}
+
+/**
+ * Scene 0: smooth shading plus texture, sharp in the left half of A and the
+ * right half of B, box-blurred elsewhere. Scene 1: independent noise, which
+ * puts many pixels near the decision threshold.
+ */
+static void make_pair(unsigned char* a, unsigned char* b, int width, int height, int scene) {
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            if (scene == 0) {
+                int base = 64 + (x + y) / 4;
+                int sharp = base + (((x * 7) ^ (y * 13)) & 0x3F);
+                int blur = base + ((((x & ~3) * 7) ^ ((y & ~3) * 13)) & 0x3F);
+                a[y * width + x] = (unsigned char)((x < width / 2) ? sharp : blur);
+                b[y * width + x] = (unsigned char)((x < width / 2) ? blur : sharp);
+            } else {
+                a[y * width + x] = (unsigned char)(rand() & 0xFF);
+                b[y * width + x] = (unsigned char)(rand() & 0xFF);
+            }
+        }
+    }
+}
+
+/** 1-D pipeline from EMD to the stretched fused image; leaves the IMF of A in imf_a. */
+static void fuse_pair(const unsigned char* a, const unsigned char* b, int width, int height,
+                      emd_scratch* scratch, int32_t* imf_a, int32_t* imf_b,
+                      int32_t* var_a, int32_t* var_b, unsigned char* fused) {
+    int num_pixels = width * height;
+    unsigned char min_val, max_val;
+
+    convert_to_q16_16(a, imf_a, num_pixels);
+    convert_to_q16_16(b, imf_b, num_pixels);
+    emd_decompose_image_scratch(imf_a, width, height, EMD_MODE_1D, scratch);
+    emd_decompose_image_scratch(imf_b, width, height, EMD_MODE_1D, scratch);
+    int64_t sum_var = calculate_local_variance(imf_a, width, height, WINDOW_SIZE, var_a);
+    sum_var += calculate_local_variance(imf_b, width, height, WINDOW_SIZE, var_b);
+    fuse_images_var(a, b, var_a, var_b, num_pixels, decision_mask_epsilon(sum_var, 2 * (int64_t)num_pixels),
+                    fused, &min_val, &max_val);
+    histogram_stretch_lut(fused, num_pixels, min_val, max_val);
+}
+
+int main(void) {
+    static int32_t signal[SIGNAL_LEN];
+    static int32_t imfs[EMD_DEFAULT_MAX_IMFS * SIGNAL_LEN];
+    static int32_t residue[SIGNAL_LEN];
+    static const double tone_periods[] = { 8.0, 24.0, 64.0 };
+
+    // Part 1: iterations to convergence and throughput.
+    printf("envelope,tone_period,imfs,iterations_per_imf,total_iterations,imf1_rms_error,ms_per_decomposition,msamples_per_s\n");
+    for (size_t p = 0; p < sizeof(tone_periods) / sizeof(tone_periods[0]); p++) {
+        make_signal(signal, SIGNAL_LEN, tone_periods[p]);
+        for (int envelope = EMD_ENVELOPE_LINEAR; envelope <= EMD_ENVELOPE_SPLINE; envelope++) {
+            emd_imf_stats stats[EMD_DEFAULT_MAX_IMFS];
+            char per_imf[64] = "";
+            int num_imfs = 0, total = 0;
+            double best = 1e30, err_sq = 0.0;
+
+            emd_set_envelope(envelope);
+            for (int r = 0; r < BENCH_REPEATS; r++) {
+                double t0 = now_ms();
+                num_imfs = emd_decompose_imfs(signal, SIGNAL_LEN, NULL, imfs, residue, stats);
+                double t1 = now_ms();
+                if (t1 - t0 < best) best = t1 - t0;
+            }
+            if (num_imfs < 0) {
+                return 1;
+            }
+            for (int k = 0; k < num_imfs; k++) {
+                size_t used = strlen(per_imf);
+                snprintf(per_imf + used, sizeof(per_imf) - used, "%s%d", k ? " " : "", stats[k].iterations);
+                total += stats[k].iterations;
+            }
+            for (int i = EDGE_SKIP; i < SIGNAL_LEN - EDGE_SKIP; i++) {
+                double d = imfs[i] / 65536.0 - fast_tone(i, tone_periods[p]);
+                err_sq += d * d;
+            }
+            printf("%s,%.0f,%d,%s,%d,%.4f,%.3f,%.2f\n", envelope_names[envelope], tone_periods[p], num_imfs,
+                   per_imf, total, sqrt(err_sq / (SIGNAL_LEN - 2 * EDGE_SKIP)), best, SIGNAL_LEN / best / 1e3);
+        }
+    }
+    emd_set_envelope(EMD_ENVELOPE_LINEAR);
+
+    // Part 2: effect on the first IMF and on the fused image.
+    const int num_pixels = IMAGE_SIZE * IMAGE_SIZE;
+    unsigned char* a = malloc(num_pixels);
+    unsigned char* b = malloc(num_pixels);
+    unsigned char* fused[2] = { malloc(num_pixels), malloc(num_pixels) };
+    int32_t* imf_a[2] = { malloc(num_pixels * sizeof(int32_t)), malloc(num_pixels * sizeof(int32_t)) };
+    int32_t* imf_b = malloc(num_pixels * sizeof(int32_t));
+    int32_t* var_a[2] = { malloc(num_pixels * sizeof(int32_t)), malloc(num_pixels * sizeof(int32_t)) };
+    int32_t* var_b[2] = { malloc(num_pixels * sizeof(int32_t)), malloc(num_pixels * sizeof(int32_t)) };
+    emd_scratch scratch;
+    if (!a || !b || !fused[0] || !fused[1] || !imf_a[0] || !imf_a[1] || !imf_b || !var_a[0] || !var_a[1] ||
+        !var_b[0] || !var_b[1] ||
+        emd_scratch_init(&scratch, num_pixels) != 0) {
+        printf("Error: Out of memory.\n");
+        return 1;
+    }
+
+    printf("\nscene,linear_ms,spline_ms,imf_rms_diff,variance_order_flips,fused_differing_pixels,fused_max_diff,fused_psnr_db\n");
+    for (int scene = 0; scene < 2; scene++) {
+        double fuse_ms[2];
+        make_pair(a, b, IMAGE_SIZE, IMAGE_SIZE, scene);
+        for (int envelope = EMD_ENVELOPE_LINEAR; envelope <= EMD_ENVELOPE_SPLINE; envelope++) {
+            scratch.envelope = envelope;
+            double t0 = now_ms();
+            fuse_pair(a, b, IMAGE_SIZE, IMAGE_SIZE, &scratch, imf_a[envelope], imf_b,
+                      var_a[envelope], var_b[envelope], fused[envelope]);
+            fuse_ms[envelope] = now_ms() - t0;
+        }
+
+        double imf_sq = 0.0, fused_sq = 0.0;
+        int differing = 0, max_diff = 0, order_flips = 0;
+        for (int i = 0; i < num_pixels; i++) {
+            double d = (imf_a[1][i] - imf_a[0][i]) / 65536.0;
+            int f = abs(fused[1][i] - fused[0][i]);
+            imf_sq += d * d;
+            fused_sq += (double)f * f;
+            differing += (f != 0);
+            order_flips += ((var_a[0][i] > var_b[0][i]) != (var_a[1][i] > var_b[1][i]));
+            if (f > max_diff) max_diff = f;
+        }
+        double psnr = (fused_sq > 0.0) ? 10.0 * log10(255.0 * 255.0 / (fused_sq / num_pixels)) : INFINITY;
+        printf("%s,%.3f,%.3f,%.4f,%d,%d,%d,%.2f\n", scene == 0 ? "multifocus" : "noise", fuse_ms[0],
+               fuse_ms[1], sqrt(imf_sq / num_pixels), order_flips, differing, max_diff, psnr);
+    }
+
+    emd_scratch_free(&scratch);
+
+    // Part 3: envelopes across a long plateau.
+    static const int plateau_lens[] = { 2048, 40000, PLATEAU_MAX_LEN };
+    const int plateau_capacity = 2 * PLATEAU_TONE_LEN + PLATEAU_MAX_LEN;
+    int32_t* plateau = malloc(plateau_capacity * sizeof(int32_t));
+    int32_t* plateau_imfs = malloc((size_t)EMD_DEFAULT_MAX_IMFS * plateau_capacity * sizeof(int32_t));
+    if (!plateau || !plateau_imfs || emd_scratch_init(&scratch, plateau_capacity) != 0) {
+        printf("Error: Out of memory.\n");
+        return 1;
+    }
+
+    int failed = 0;
+    printf("\nenvelope,plateau_len,imfs,max_abs_signal,max_abs_imf,ok\n");
+    for (size_t p = 0; p < sizeof(plateau_lens) / sizeof(plateau_lens[0]); p++) {
+        int length = make_plateau_signal(plateau, PLATEAU_TONE_LEN, plateau_lens[p]);
+        int64_t max_signal = 0;
+        for (int i = 0; i < length; i++) {
+            if (llabs(plateau[i]) > max_signal) max_signal = llabs(plateau[i]);
+        }
+        for (int envelope = EMD_ENVELOPE_LINEAR; envelope <= EMD_ENVELOPE_SPLINE; envelope++) {
+            scratch.envelope = envelope;
+            int num_imfs = emd_decompose_imfs_scratch(plateau, length, NULL, plateau_imfs, NULL, NULL, &scratch);
+            int64_t max_imf = 0;
+            for (size_t i = 0; i < (size_t)(num_imfs > 0 ? num_imfs : 0) * length; i++) {
+                if (llabs(plateau_imfs[i]) > max_imf) max_imf = llabs(plateau_imfs[i]);
+            }
+            int ok = (num_imfs > 0 && max_imf <= 4 * max_signal);
+            failed |= !ok;
+            printf("%s,%d,%d,%.2f,%.2f,%s\n", envelope_names[envelope], plateau_lens[p], num_imfs,
+                   max_signal / 65536.0, max_imf / 65536.0, ok ? "yes" : "no");
+        }
+    }
+
+    emd_scratch_free(&scratch);
+    free(plateau);
+    free(plateau_imfs);
+    free(a);
+    free(b);
+    free(fused[0]);
+    free(fused[1]);
+    free(imf_a[0]);
+    free(imf_a[1]);
+    free(imf_b);
+    free(var_a[0]);
+    free(var_a[1]);
+    free(var_b[0]);
+    free(var_b[1]);
+    return failed;
+}
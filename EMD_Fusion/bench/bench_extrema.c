@@ -0,0 +1,196 @@
+/*
+ * bench_extrema.c
+ *
+ * @brief Host benchmark of the extrema search of the 1-D EMD.
+ *
+ * Compares the branchy scalar scan that emd.c used before the extrema kernel
+ * with the find_extrema() kernel of every variant in pixel_kernels.h: the
+ * branchless scalar compaction and the SSE4.1 and AVX2 left-pack kernels.
+ * Inputs are a noisy signal (uniform Q16.16 noise, an extremum every ~1.5
+ * samples, where the branches of the scan mispredict), a smooth one (a slow
+ * sine, an extremum every ~32 samples, where they predict well) and any images
+ * given on the command line, flattened row by row as emd_decompose_image() does.
+ *
+ * For each input and implementation it prints one CSV line with the time per
+ * sample (best of BENCH_REPEATS), the speedup over the branchy scan, the
+ * extrema counts and whether the lists equal the scan's. Exits non-zero on a
+ * mismatch.
+ *
+ * Build and run on the host (from this directory):
+ *   gcc -O2 -I../src bench_extrema.c ../src/pixel_kernels.c ../src/image_io.c -lm -o bench_extrema
+ *   ./bench_extrema [image]...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include "emd.h"
+#include "pixel_kernels.h"
+#include "image_io.h"
+
+#define BENCH_REPEATS 20
+#define BENCH_LENGTH  (1024 * 1024)
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/** Extrema lists of one run. */
+typedef struct {
+    int32_t* list[4];  /**< max_pos, max_val, min_pos, min_val */
+    int num_max;
+    int num_min;
+} extrema_lists;
+
+/** The branchy scan of emd.c before the extrema kernel, the baseline. */
+static void branchy_find_extrema(const int32_t* signal, int length, int32_t* max_pos, int32_t* max_val,
+                                 int32_t* min_pos, int32_t* min_val, int* out_num_max, int* out_num_min) {
+    int num_max = 0, num_min = 0;
+
+    if (length > 1) {
+        if (signal[0] > signal[1]) {
+            max_pos[num_max] = 0;
+            max_val[num_max++] = signal[0];
+        } else if (signal[0] < signal[1]) {
+            min_pos[num_min] = 0;
+            min_val[num_min++] = signal[0];
+        }
+    }
+    for (int i = 1; i < length - 1; i++) {
+        if (signal[i] > signal[i - 1] && signal[i] > signal[i + 1]) {
+            max_pos[num_max] = i;
+            max_val[num_max++] = signal[i];
+        } else if (signal[i] < signal[i - 1] && signal[i] < signal[i + 1]) {
+            min_pos[num_min] = i;
+            min_val[num_min++] = signal[i];
+        }
+    }
+    if (length > 1) {
+        if (signal[length - 1] > signal[length - 2]) {
+            max_pos[num_max] = length - 1;
+            max_val[num_max++] = signal[length - 1];
+        } else if (signal[length - 1] < signal[length - 2]) {
+            min_pos[num_min] = length - 1;
+            min_val[num_min++] = signal[length - 1];
+        }
+    }
+    *out_num_max = num_max;
+    *out_num_min = num_min;
+}
+
+typedef void (*find_extrema_fn)(const int32_t* signal, int length, int32_t* max_pos, int32_t* max_val,
+                                int32_t* min_pos, int32_t* min_val, int* num_max, int* num_min);
+
+/** Best time of BENCH_REPEATS runs in milliseconds. */
+static double time_run(find_extrema_fn fn, const int32_t* signal, int length, extrema_lists* out) {
+    double best = 1e30;
+    for (int rep = 0; rep < BENCH_REPEATS; rep++) {
+        double t0 = now_ms();
+        fn(signal, length, out->list[0], out->list[1], out->list[2], out->list[3], &out->num_max, &out->num_min);
+        double t = now_ms() - t0;
+        if (t < best) best = t;
+    }
+    return best;
+}
+
+static int same_lists(const extrema_lists* a, const extrema_lists* b) {
+    return a->num_max == b->num_max && a->num_min == b->num_min &&
+           memcmp(a->list[0], b->list[0], a->num_max * sizeof(int32_t)) == 0 &&
+           memcmp(a->list[1], b->list[1], a->num_max * sizeof(int32_t)) == 0 &&
+           memcmp(a->list[2], b->list[2], a->num_min * sizeof(int32_t)) == 0 &&
+           memcmp(a->list[3], b->list[3], a->num_min * sizeof(int32_t)) == 0;
+}
+
+static int alloc_lists(extrema_lists* lists, int length) {
+    for (int i = 0; i < 4; i++) {
+        lists->list[i] = malloc((size_t)EMD_MAX_EXTREMA(length) * sizeof(int32_t));
+        if (lists->list[i] == NULL) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void free_lists(extrema_lists* lists) {
+    for (int i = 0; i < 4; i++) {
+        free(lists->list[i]);
+    }
+}
+
+/** Time the scan and every kernel variant on one signal; returns the number of mismatches. */
+static int bench_signal(const char* name, const int32_t* signal, int length) {
+    extrema_lists ref, out;
+    int mismatches = 0;
+
+    if (alloc_lists(&ref, length) != 0 || alloc_lists(&out, length) != 0) {
+        printf("Error: Out of memory.\n");
+        exit(1);
+    }
+    double ref_ms = time_run(branchy_find_extrema, signal, length, &ref);
+    printf("%s,%d,branchy,%.3f,1.00,%d,%d,yes\n", name, length, ref_ms * 1e6 / length, ref.num_max, ref.num_min);
+
+    for (int variant = 0; variant < PIXEL_KERNELS_COUNT; variant++) {
+        const pixel_kernels* k = pixel_kernels_variant(variant);
+        if (k == NULL) {
+            continue;
+        }
+        double ms = time_run(k->find_extrema, signal, length, &out);
+        int same = same_lists(&ref, &out);
+        mismatches += !same;
+        printf("%s,%d,%s,%.3f,%.2f,%d,%d,%s\n", name, length, k->name, ms * 1e6 / length, ref_ms / ms,
+               out.num_max, out.num_min, same ? "yes" : "no");
+    }
+    free_lists(&ref);
+    free_lists(&out);
+    return mismatches;
+}
+
+int main(int argc, char** argv) {
+    int32_t* signal = malloc(BENCH_LENGTH * sizeof(int32_t));
+    int mismatches = 0;
+
+    if (signal == NULL) {
+        printf("Error: Out of memory.\n");
+        return 1;
+    }
+    printf("input,length,implementation,ns_per_sample,speedup,maxima,minima,matches_branchy\n");
+
+    srand(7);
+    for (int i = 0; i < BENCH_LENGTH; i++) {
+        signal[i] = (int32_t)(rand() % (256 << 16));
+    }
+    mismatches += bench_signal("noisy", signal, BENCH_LENGTH);
+
+    for (int i = 0; i < BENCH_LENGTH; i++) {
+        signal[i] = (int32_t)((128.0 + 100.0 * sin(i * (M_PI / 32.0))) * 65536.0);
+    }
+    mismatches += bench_signal("smooth", signal, BENCH_LENGTH);
+
+    for (int i = 1; i < argc; i++) {
+        image_view view;
+        if (image_open(argv[i], &view) != 0) {
+            free(signal);
+            return 1;
+        }
+        int length = (int)(view.width * view.height);
+        int32_t* pixels = malloc((size_t)length * sizeof(int32_t));
+        if (pixels == NULL) {
+            printf("Error: Out of memory.\n");
+            image_close(&view);
+            free(signal);
+            return 1;
+        }
+        pixel_kernels_get()->to_q16_16(view.pixels, pixels, length);
+        mismatches += bench_signal(argv[i], pixels, length);
+        free(pixels);
+        image_close(&view);
+    }
+
+    free(signal);
+    return (mismatches == 0) ? 0 : 1;
+}
@@ -0,0 +1,265 @@
+/*
+ * bench_focus_stack.c
+ *
+ * @brief Host check and benchmark of N-plane focus-stack fusion.
+ *
+ * The stacks are synthetic: one textured scene, with plane k sharp in the k-th
+ * vertical band and box-blurred elsewhere, more strongly the farther the band
+ * is from plane k. For each size and EMD mode the program checks:
+ *   pair      a two-plane stack against the two-image path (EMD, variance,
+ *             decision_mask_epsilon() and fuse_images_var(), before the
+ *             stretch). Pixels may differ only where the Q16.16 variance
+ *             difference lies exactly halfway between two integers, which
+ *             the two paths round towards opposite signs.
+ *   shuffled  the stack fused in a shuffled and in the reversed plane order
+ *             against the stack in order. The fused images must be identical.
+ *             Plane indices are compared through the permutation; they may
+ *             differ only where two planes have the same variance.
+ *   wide      the pair check in the 1-D mode on planes wider than
+ *             VARIANCE_MAX_WIDTH, which the stack takes with its own column sums.
+ * and reports the best time of BENCH_REPEATS runs of focus_stack_fuse_planes().
+ * It exits with 1 if a check fails.
+ *
+ * Build and run on the host (from this directory):
+ *   gcc -O2 -I../src bench_focus_stack.c ../src/focus_stack.c ../src/emd.c ../src/decision_mask.c \
+ *       ../src/fusion.c ../src/pixel_kernels.c ../src/image_io.c ../src/trace.c ../src/led.c -o bench_focus_stack
+ *   ./bench_focus_stack [planes]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "focus_stack.h"
+#include "emd.h"
+#include "decision_mask.h"
+#include "fusion.h"
+
+#define BENCH_REPEATS 3
+#define WIDE_WIDTH (VARIANCE_MAX_WIDTH + 52)
+#define WIDE_HEIGHT 24
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static uint32_t xorshift32(uint32_t* state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+/** Stack of num_planes planes: plane k is sharp in band k of num_planes vertical bands. */
+static void make_stack(unsigned char** planes, int num_planes, int width, int height) {
+    unsigned char* sharp = malloc((size_t)width * height);
+    uint32_t seed = 2026u;
+
+    for (int i = 0; i < width * height; i++) {
+        sharp[i] = (unsigned char)(64 + (xorshift32(&seed) & 127));
+    }
+    for (int k = 0; k < num_planes; k++) {
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                int band = x * num_planes / width;
+                int r = (band > k) ? band - k : k - band;
+                if (r > 3) r = 3;
+                int sum = 0, count = 0;
+                for (int j = y - r; j <= y + r; j++) {
+                    for (int i = x - r; i <= x + r; i++) {
+                        if (j >= 0 && j < height && i >= 0 && i < width) {
+                            sum += sharp[j * width + i];
+                            count++;
+                        }
+                    }
+                }
+                planes[k][y * width + x] = (unsigned char)(sum / count);
+            }
+        }
+    }
+    free(sharp);
+}
+
+/**
+ * Two-image path on planes a and b into fused (unstretched). Sets halfway[i] where the
+ * Q16.16 variance difference has a fraction of exactly one half.
+ */
+static int fuse_pair(const unsigned char* a, const unsigned char* b, int width, int height, int emd_mode,
+                     unsigned char* fused, unsigned char* halfway) {
+    int num_pixels = width * height;
+    int32_t* signal = malloc((size_t)num_pixels * sizeof(int32_t));
+    int32_t* var[2] = { malloc((size_t)num_pixels * sizeof(int32_t)),
+                        malloc((size_t)num_pixels * sizeof(int32_t)) };
+    int64_t* sums = malloc((size_t)2 * width * sizeof(int64_t));
+    const unsigned char* img[2] = { a, b };
+    emd_scratch scratch;
+    int64_t sum_var = 0;
+    int status = emd_scratch_init(&scratch, num_pixels);
+
+    for (int i = 0; i < 2 && status == 0; i++) {
+        convert_to_q16_16(img[i], signal, num_pixels);
+        status = emd_decompose_image_scratch(signal, width, height, emd_mode, &scratch);
+        sum_var += calculate_local_variance_rows(signal, width, height, WINDOW_SIZE, 0, height, var[i],
+                                                 sums, sums + width);
+    }
+    if (status == 0) {
+        unsigned char lo, hi;
+        fuse_images_var(a, b, var[0], var[1], num_pixels, decision_mask_epsilon(sum_var, 2 * (int64_t)num_pixels),
+                        fused, &lo, &hi);
+        for (int i = 0; i < num_pixels; i++) {
+            halfway[i] = ((uint32_t)(var[0][i] - var[1][i]) & 0xFFFF) == 0x8000;
+        }
+    }
+    emd_scratch_free(&scratch);
+    free(signal);
+    free(var[0]);
+    free(var[1]);
+    free(sums);
+    return status;
+}
+
+int main(int argc, char** argv) {
+    static const int sizes[] = { 128, 256, 512 };
+    int num_planes = (argc > 1) ? atoi(argv[1]) : 6;
+    int failures = 0;
+
+    if (num_planes < 2 || num_planes > FOCUS_STACK_MAX_PLANES) {
+        printf("Error: planes must be 2..%d.\n", FOCUS_STACK_MAX_PLANES);
+        return 1;
+    }
+
+    printf("check,mode,size,planes,ms,pixels_differing,allowed,index_differing,pass\n");
+    for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++) {
+        int size = sizes[s];
+        size_t num_pixels = (size_t)size * size;
+        unsigned char** planes = malloc((size_t)num_planes * sizeof(unsigned char*));
+        const unsigned char** order = malloc((size_t)num_planes * sizeof(unsigned char*));
+        int* perm = malloc((size_t)num_planes * sizeof(int));
+        unsigned char* ref = malloc(num_pixels);
+        unsigned char* out = malloc(num_pixels);
+        uint8_t* ref_index = malloc(num_pixels);
+        uint8_t* out_index = malloc(num_pixels);
+        unsigned char* halfway = malloc(num_pixels);
+
+        for (int k = 0; k < num_planes; k++) {
+            planes[k] = malloc(num_pixels);
+        }
+        make_stack(planes, num_planes, size, size);
+
+        for (int mode = EMD_MODE_1D; mode <= EMD_MODE_2D; mode++) {
+            const char* mode_name = (mode == EMD_MODE_1D) ? "1d" : "2d";
+
+            // A two-plane stack against the two-image decision: first and last plane.
+            const unsigned char* pair[2] = { planes[0], planes[num_planes - 1] };
+            int allowed = 0, differing = 0, pass = 1;
+            if (focus_stack_fuse_planes(pair, 2, size, size, mode, out, NULL) != 0 ||
+                fuse_pair(pair[0], pair[1], size, size, mode, ref, halfway) != 0) {
+                return 1;
+            }
+            for (size_t i = 0; i < num_pixels; i++) {
+                allowed += halfway[i];
+                differing += out[i] != ref[i];
+                pass &= out[i] == ref[i] || halfway[i];
+            }
+            failures += !pass;
+            printf("pair,%s,%d,2,,%d,%d,,%s\n", mode_name, size, differing, allowed, pass ? "yes" : "NO");
+
+            // The whole stack in order, timed.
+            const unsigned char* const* in_order = (const unsigned char* const*)planes;
+            double best = 1e30;
+            for (int r = 0; r < BENCH_REPEATS; r++) {
+                double t0 = now_ms();
+                if (focus_stack_fuse_planes(in_order, num_planes, size, size, mode, ref, ref_index) != 0) {
+                    return 1;
+                }
+                double t = now_ms() - t0;
+                if (t < best) best = t;
+            }
+            printf("ordered,%s,%d,%d,%.3f,,,,yes\n", mode_name, size, num_planes, best);
+
+            // Shuffled and reversed orders must give the same image.
+            for (int variant = 0; variant < 2; variant++) {
+                uint32_t seed = 99u + (uint32_t)size;
+                for (int k = 0; k < num_planes; k++) {
+                    perm[k] = (variant == 0) ? k : num_planes - 1 - k;
+                }
+                if (variant == 0) {
+                    for (int k = num_planes - 1; k > 0; k--) {
+                        int j = (int)(xorshift32(&seed) % (uint32_t)(k + 1));
+                        int t = perm[k];
+                        perm[k] = perm[j];
+                        perm[j] = t;
+                    }
+                }
+                for (int k = 0; k < num_planes; k++) {
+                    order[k] = planes[perm[k]];
+                }
+                if (focus_stack_fuse_planes(order, num_planes, size, size, mode, out, out_index) != 0) {
+                    return 1;
+                }
+                differing = 0;
+                int index_differing = 0;
+                for (size_t i = 0; i < num_pixels; i++) {
+                    differing += out[i] != ref[i];
+                    index_differing += perm[out_index[i]] != ref_index[i];
+                }
+                pass = differing == 0;
+                failures += !pass;
+                printf("%s,%s,%d,%d,,%d,0,%d,%s\n", (variant == 0) ? "shuffled" : "reversed", mode_name, size,
+                       num_planes, differing, index_differing, pass ? "yes" : "NO");
+            }
+        }
+
+        for (int k = 0; k < num_planes; k++) {
+            free(planes[k]);
+        }
+        free(planes);
+        free(order);
+        free(perm);
+        free(ref);
+        free(out);
+        free(ref_index);
+        free(out_index);
+        free(halfway);
+    }
+
+    // Two planes wider than the static variance buffers, against the two-image path.
+    {
+        size_t num_pixels = (size_t)WIDE_WIDTH * WIDE_HEIGHT;
+        unsigned char* wide[2] = { malloc(num_pixels), malloc(num_pixels) };
+        unsigned char* ref = malloc(num_pixels);
+        unsigned char* out = malloc(num_pixels);
+        unsigned char* halfway = malloc(num_pixels);
+        int allowed = 0, differing = 0, pass = 1;
+
+        make_stack(wide, 2, WIDE_WIDTH, WIDE_HEIGHT);
+        const unsigned char* pair[2] = { wide[0], wide[1] };
+        if (focus_stack_fuse_planes(pair, 2, WIDE_WIDTH, WIDE_HEIGHT, EMD_MODE_1D, out, NULL) != 0 ||
+            fuse_pair(pair[0], pair[1], WIDE_WIDTH, WIDE_HEIGHT, EMD_MODE_1D, ref, halfway) != 0) {
+            return 1;
+        }
+        for (size_t i = 0; i < num_pixels; i++) {
+            allowed += halfway[i];
+            differing += out[i] != ref[i];
+            pass &= out[i] == ref[i] || halfway[i];
+        }
+        failures += !pass;
+        printf("wide,1d,%dx%d,2,,%d,%d,,%s\n", WIDE_WIDTH, WIDE_HEIGHT, differing, allowed, pass ? "yes" : "NO");
+        free(wide[0]);
+        free(wide[1]);
+        free(ref);
+        free(out);
+        free(halfway);
+    }
+
+    if (failures > 0) {
+        printf("Error: %d focus-stack checks failed.\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,123 @@
+/*
+ * bench_fused.c
+ *
+ * @brief Host benchmark of the fused decide/fuse/stretch pass against the
+ *        separate mask, fusion and stretch passes.
+ *
+ * Both variants start from the same two variance maps and must produce
+ * identical images. The separate chain is
+ *   generate_decision_mask() -> fuse_images() -> histogram_stretch()
+ * which sums the maps, writes the mask, fuses, and scans the result twice.
+ * The fused chain takes the variance sum returned by calculate_local_variance(),
+ * then runs fuse_images_var() and histogram_stretch_lut().
+ *
+ * Bytes moved are counted per pixel from the arrays each pass reads and writes
+ * (variance maps 4 + 4, images 1 + 1, mask 1, fused image 1):
+ *   separate: sum 8, mask 8 + 1, fuse 3 + 1, min/max 1, stretch 1 + 1 = 24
+ *   fused:    fuse 10 + 1, stretch 1 + 1                              = 13
+ *
+ * Build and run on the host (from this directory):
+ *   gcc -O2 -I../src bench_fused.c ../src/decision_mask.c ../src/fusion.c \
+ *       ../src/pixel_kernels.c ../src/image_io.c ../src/led.c -o bench_fused
+ *   ./bench_fused
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "decision_mask.h"
+#include "fusion.h"
+#include "pixel_kernels.h"
+
+#define BENCH_REPEATS 10
+
+#define SEPARATE_BYTES_PER_PIXEL 24
+#define FUSED_BYTES_PER_PIXEL    13
+
+static const int bench_sizes[][2] = { { 200, 200 }, { 640, 480 }, { 1024, 1024 }, { 2048, 2048 } };
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/**
+ * Synthetic multi-focus pair: a textured scene, sharp in the left half of A
+ * and the right half of B, box-blurred elsewhere.
+ */
+static void make_pair(unsigned char* a, unsigned char* b, int width, int height) {
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int sharp = ((x * 7) ^ (y * 13)) & 0xFF;
+            int blur = (((x & ~3) * 7) ^ ((y & ~3) * 13)) & 0xFF;
+            a[y * width + x] = (unsigned char)((x < width / 2) ? sharp : blur);
+            b[y * width + x] = (unsigned char)((x < width / 2) ? blur : sharp);
+        }
+    }
+}
+
+int main(void) {
+    printf("width,height,separate_ms,fused_ms,speedup,separate_mb,fused_mb,identical\n");
+
+    for (size_t s = 0; s < sizeof(bench_sizes) / sizeof(bench_sizes[0]); s++) {
+        int width = bench_sizes[s][0];
+        int height = bench_sizes[s][1];
+        int num_pixels = width * height;
+
+        unsigned char* a = malloc(num_pixels);
+        unsigned char* b = malloc(num_pixels);
+        unsigned char* out_separate = malloc(num_pixels);
+        unsigned char* out_fused = malloc(num_pixels);
+        char* mask = malloc(num_pixels);
+        int32_t* signal = malloc((size_t)num_pixels * sizeof(int32_t));
+        int32_t* var1 = malloc((size_t)num_pixels * sizeof(int32_t));
+        int32_t* var2 = malloc((size_t)num_pixels * sizeof(int32_t));
+        if (!a || !b || !out_separate || !out_fused || !mask || !signal || !var1 || !var2) {
+            printf("Error: Out of memory.\n");
+            return 1;
+        }
+
+        make_pair(a, b, width, height);
+        pixel_kernels_get()->to_q16_16(a, signal, num_pixels);
+        int64_t sum_var = calculate_local_variance(signal, width, height, WINDOW_SIZE, var1);
+        pixel_kernels_get()->to_q16_16(b, signal, num_pixels);
+        sum_var += calculate_local_variance(signal, width, height, WINDOW_SIZE, var2);
+
+        double best_separate = 1e30, best_fused = 1e30;
+        for (int r = 0; r < BENCH_REPEATS; r++) {
+            double t0 = now_ms();
+            generate_decision_mask(var1, var2, width, height, mask);
+            fuse_images(a, b, mask, width, height, out_separate);
+            histogram_stretch(out_separate, width, height);
+            double t1 = now_ms();
+
+            unsigned char min_val, max_val;
+            int32_t adaptive_epsilon = decision_mask_epsilon(sum_var, 2 * (int64_t)num_pixels);
+            fuse_images_var(a, b, var1, var2, num_pixels, adaptive_epsilon, out_fused, &min_val, &max_val);
+            histogram_stretch_lut(out_fused, num_pixels, min_val, max_val);
+            double t2 = now_ms();
+
+            if (t1 - t0 < best_separate) best_separate = t1 - t0;
+            if (t2 - t1 < best_fused) best_fused = t2 - t1;
+        }
+
+        printf("%d,%d,%.3f,%.3f,%.2f,%.2f,%.2f,%s\n", width, height, best_separate, best_fused,
+               best_separate / best_fused,
+               (double)SEPARATE_BYTES_PER_PIXEL * num_pixels / 1e6,
+               (double)FUSED_BYTES_PER_PIXEL * num_pixels / 1e6,
+               memcmp(out_separate, out_fused, num_pixels) == 0 ? "yes" : "NO");
+
+        free(a);
+        free(b);
+        free(out_separate);
+        free(out_fused);
+        free(mask);
+        free(signal);
+        free(var1);
+        free(var2);
+    }
+    return 0;
+}
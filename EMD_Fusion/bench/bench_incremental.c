@@ -0,0 +1,252 @@
+/*
+ * bench_incremental.c
+ *
+ * @brief Host benchmark of the change-detection (incremental) scoring mode.
+ *
+ * Fuses sequences of BENCH_FRAMES pairs with a full-recompute context and an
+ * incremental one and reports the share of tiles skipped (unchanged since the
+ * last frame, or image B equal to image A), the share of IMF samples sifted
+ * again, the mean time per frame of both contexts after the first frame and
+ * the latency saved. Every fused frame of the incremental context must equal
+ * the full recompute; the program exits with 1 otherwise.
+ *
+ * The sequences are built on a synthetic multi-focus pair (textured noise,
+ * sharp in the left half of A and the right half of B, 5x5 box blur
+ * elsewhere):
+ *   static  the same pair every frame,
+ *   moving  a 32x32 textured object in focus in both images moves over the pair,
+ *   equal   B equals A except in a centred disc, and the scene shifts by a pixel
+ *           every frame, so only the comparison of B with A can skip tiles,
+ *   noise   new noise every frame, nothing can be skipped (overhead of the checks).
+ * Image pairs given on the command line are used as the background of the
+ * moving sequence.
+ *
+ * Build and run on the host (from this directory):
+ *   gcc -O2 -pthread -I../src bench_incremental.c ../src/emd_fusion.c ../src/incremental_fusion.c \
+ *       ../src/pyramid_fusion.c ../src/precision_kernels.c ../src/parallel_fusion.c ../src/thread_pool.c \
+ *       ../src/emd.c ../src/decision_mask.c ../src/fusion.c ../src/pixel_kernels.c ../src/image_io.c \
+ *       ../src/trace.c ../src/led.c -o bench_incremental
+ *   ./bench_incremental [imageA imageB]...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "emd_fusion.h"
+#include "image_io.h"
+
+#define BENCH_FRAMES 12
+
+/** Side of the moving object in pixels. */
+#define BENCH_OBJECT 32
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static uint32_t xorshift32(uint32_t* state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+/** Textured noise in 64..191 of a scene twice as wide as the frame, so it can be shifted. */
+static void make_texture(unsigned char* texture, int width, int height, uint32_t seed) {
+    for (int i = 0; i < 2 * width * height; i++) {
+        texture[i] = (unsigned char)(64 + (xorshift32(&seed) & 127));
+    }
+}
+
+/** 5x5 box blur of a width x height window of a scene of stride columns. */
+static unsigned char blur_at(const unsigned char* scene, int stride, int width, int height, int x, int y) {
+    int sum = 0, count = 0;
+    for (int j = y - 2; j <= y + 2; j++) {
+        for (int k = x - 2; k <= x + 2; k++) {
+            if (j >= 0 && j < height && k >= 0 && k < width) {
+                sum += scene[j * stride + k];
+                count++;
+            }
+        }
+    }
+    return (unsigned char)(sum / count);
+}
+
+/**
+ * Multi-focus pair of the scene window starting at column shift: A sharp in the left
+ * half, B in the right half; with equal_outside_disc, B is A except inside a centred disc.
+ */
+static void make_pair(const unsigned char* scene, int width, int height, int shift, int equal_outside_disc,
+                      unsigned char* a, unsigned char* b) {
+    const unsigned char* view = scene + shift;
+    const int stride = 2 * width;
+    int radius = ((width < height) ? width : height) / 4;
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int i = y * width + x;
+            unsigned char sharp = view[y * stride + x];
+            unsigned char blurred = blur_at(view, stride, width, height, x, y);
+            a[i] = (x < width / 2) ? sharp : blurred;
+            if (equal_outside_disc) {
+                int dx = x - width / 2, dy = y - height / 2;
+                b[i] = (dx * dx + dy * dy < radius * radius) ? blurred : a[i];
+            } else {
+                b[i] = (x < width / 2) ? blurred : sharp;
+            }
+        }
+    }
+}
+
+/** Draw the sharp object of frame f into both images, moving diagonally. */
+static void draw_object(unsigned char* a, unsigned char* b, int width, int height, int f) {
+    uint32_t seed = 0x9e3779b9u;
+    int x0 = (16 + f * 7) % (width - BENCH_OBJECT);
+    int y0 = (height / 3 + f * 3) % (height - BENCH_OBJECT);
+
+    for (int y = 0; y < BENCH_OBJECT; y++) {
+        for (int x = 0; x < BENCH_OBJECT; x++) {
+            unsigned char v = (unsigned char)(xorshift32(&seed) & 255);
+            a[(y0 + y) * width + x0 + x] = v;
+            b[(y0 + y) * width + x0 + x] = v;
+        }
+    }
+}
+
+/** Aggregates of one sequence. */
+typedef struct {
+    double full_ms;
+    double incremental_ms;
+    int64_t tiles_skipped;
+    int64_t tiles;
+    int64_t samples_sifted;
+    int64_t samples;
+    int frames_differing;
+} sequence_result;
+
+/** Fuse one frame with both contexts, timing and checking it (the first frame is not counted). */
+static void run_frame(emd_fusion_ctx* full, emd_fusion_ctx* inc, const unsigned char* a, const unsigned char* b,
+                      int f, unsigned char* ref, unsigned char* out, sequence_result* res) {
+    size_t n = (size_t)full->width * full->height;
+
+    double t0 = now_ms();
+    emd_fusion_run(full, a, b, ref);
+    double t1 = now_ms();
+    emd_fusion_run(inc, a, b, out);
+    double t2 = now_ms();
+
+    res->frames_differing += memcmp(ref, out, n) != 0;
+    if (f == 0) {
+        return;
+    }
+    res->full_ms += t1 - t0;
+    res->incremental_ms += t2 - t1;
+    res->tiles_skipped += inc->incremental.tiles_static + inc->incremental.tiles_equal;
+    res->tiles += 2 * inc->incremental.tiles;
+    res->samples_sifted += inc->incremental.samples_sifted;
+    res->samples += 2 * (int64_t)n;
+}
+
+/** Run one sequence over a background pair; returns the number of frames differing. */
+static int bench_sequence(const char* name, const char* sequence, const unsigned char* bg_a,
+                          const unsigned char* bg_b, int width, int height) {
+    size_t n = (size_t)width * height;
+    unsigned char* scene = malloc(2 * n);
+    unsigned char* a = malloc(n);
+    unsigned char* b = malloc(n);
+    unsigned char* ref = malloc(n);
+    unsigned char* out = malloc(n);
+    emd_fusion_config config;
+    emd_fusion_ctx full, inc;
+    sequence_result res;
+
+    memset(&res, 0, sizeof(res));
+    emd_fusion_config_default(&config);
+    if (emd_fusion_init(&full, width, height, &config, NULL, 0) != 0) {
+        exit(1);
+    }
+    config.incremental = 1;
+    if (emd_fusion_init(&inc, width, height, &config, NULL, 0) != 0) {
+        exit(1);
+    }
+
+    make_texture(scene, width, height, 12345);
+    for (int f = 0; f < BENCH_FRAMES; f++) {
+        if (strcmp(sequence, "static") == 0) {
+            make_pair(scene, width, height, 0, 0, a, b);
+        } else if (strcmp(sequence, "moving") == 0) {
+            if (bg_a != NULL) {
+                memcpy(a, bg_a, n);
+                memcpy(b, bg_b, n);
+            } else {
+                make_pair(scene, width, height, 0, 0, a, b);
+            }
+            draw_object(a, b, width, height, f);
+        } else if (strcmp(sequence, "equal") == 0) {
+            make_pair(scene, width, height, f, 1, a, b);
+        } else {
+            make_texture(scene, width, height, 777u + (uint32_t)f);
+            make_pair(scene, width, height, 0, 0, a, b);
+        }
+        run_frame(&full, &inc, a, b, f, ref, out, &res);
+    }
+
+    double frames = BENCH_FRAMES - 1;
+    printf("%s,%s,%dx%d,%.1f,%.1f,%.3f,%.3f,%.3f,%.2f,%d\n", name, sequence, width, height,
+           100.0 * res.tiles_skipped / res.tiles, 100.0 * res.samples_sifted / res.samples,
+           res.full_ms / frames, res.incremental_ms / frames, (res.full_ms - res.incremental_ms) / frames,
+           res.full_ms / res.incremental_ms, res.frames_differing);
+
+    emd_fusion_free(&full);
+    emd_fusion_free(&inc);
+    free(scene);
+    free(a);
+    free(b);
+    free(ref);
+    free(out);
+    return res.frames_differing;
+}
+
+int main(int argc, char** argv) {
+    static const int sizes[] = { 256, 512, 1024 };
+    static const char* const sequences[] = { "static", "moving", "equal", "noise" };
+    int differing = 0;
+
+    printf("pair,sequence,size,tiles_skipped_pct,samples_sifted_pct,full_ms,incremental_ms,saved_ms,speedup,"
+           "frames_differing\n");
+    for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++) {
+        for (int q = 0; q < (int)(sizeof(sequences) / sizeof(sequences[0])); q++) {
+            differing += bench_sequence("synthetic", sequences[q], NULL, NULL, sizes[s], sizes[s]);
+        }
+    }
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        image_view va, vb;
+        if (image_open(argv[i], &va) != 0) {
+            return 1;
+        }
+        if (image_open(argv[i + 1], &vb) != 0) {
+            image_close(&va);
+            return 1;
+        }
+        if (va.width == vb.width && va.height == vb.height && va.width > BENCH_OBJECT &&
+            va.height > BENCH_OBJECT) {
+            differing += bench_sequence(argv[i], "moving", va.pixels, vb.pixels, (int)va.width, (int)va.height);
+        } else {
+            printf("Error: %s and %s differ in size or are too small.\n", argv[i], argv[i + 1]);
+        }
+        image_close(&va);
+        image_close(&vb);
+    }
+    if (differing > 0) {
+        printf("Error: %d incremental frames differ from the full recompute.\n", differing);
+        return 1;
+    }
+    return 0;
+}
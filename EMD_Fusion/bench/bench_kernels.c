@@ -0,0 +1,97 @@
+/*
+ * bench_kernels.c
+ *
+ * @brief Host check and benchmark of the per-pixel kernel variants.
+ *
+ * First runs pixel_kernels_verify(), which compares every SIMD variant the CPU
+ * supports against the scalar kernels (non-zero exit on any mismatch), then
+ * times each kernel of each variant on a 4-megapixel frame.
+ *
+ * Build and run on the host (from this directory):
+ *   gcc -O2 -I../src bench_kernels.c ../src/pixel_kernels.c -o bench_kernels
+ *   ./bench_kernels
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include "pixel_kernels.h"
+
+#define BENCH_PIXELS (2048 * 2048)
+#define BENCH_REPEATS 10
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+int main(void) {
+    int failures = pixel_kernels_verify();
+    printf("verify: %s (%d mismatches), selected variant: %s\n",
+           failures == 0 ? "ok" : "FAILED", failures, pixel_kernels_get()->name);
+
+    unsigned char* a = malloc(BENCH_PIXELS);
+    unsigned char* b = malloc(BENCH_PIXELS);
+    unsigned char* out = malloc(BENCH_PIXELS);
+    char* mask = malloc(BENCH_PIXELS);
+    int32_t* q16 = malloc(BENCH_PIXELS * sizeof(int32_t));
+    int32_t* upper = malloc(BENCH_PIXELS * sizeof(int32_t));
+    int32_t* lower = malloc(BENCH_PIXELS * sizeof(int32_t));
+    if (!a || !b || !out || !mask || !q16 || !upper || !lower) {
+        printf("Error: Out of memory.\n");
+        return 1;
+    }
+    for (int i = 0; i < BENCH_PIXELS; i++) {
+        a[i] = (unsigned char)(rand() & 0xFF);
+        b[i] = (unsigned char)(rand() & 0xFF);
+        mask[i] = (char)(rand() % 3);
+        upper[i] = (rand() & 0xFF) << 16;
+        lower[i] = -((rand() & 0xFF) << 16);
+    }
+
+    printf("variant,to_q16_16_ms,from_q16_16_ms,subtract_mean_envelope_ms,mask_select_ms,min_max_ms,stretch_ms,"
+           "fuse_min_max_ms\n");
+    for (int variant = 0; variant < PIXEL_KERNELS_COUNT; variant++) {
+        const pixel_kernels* k = pixel_kernels_variant(variant);
+        if (k == NULL) {
+            continue;
+        }
+        double best[7] = { 1e30, 1e30, 1e30, 1e30, 1e30, 1e30, 1e30 };
+        for (int r = 0; r < BENCH_REPEATS; r++) {
+            int64_t s0, s1;
+            unsigned char lo, hi;
+            double t[8];
+            t[0] = now_ms();
+            k->to_q16_16(a, q16, BENCH_PIXELS);
+            t[1] = now_ms();
+            k->from_q16_16(q16, out, BENCH_PIXELS);
+            t[2] = now_ms();
+            k->subtract_mean_envelope(q16, upper, lower, BENCH_PIXELS, &s0, &s1);
+            t[3] = now_ms();
+            k->mask_select(a, b, mask, out, BENCH_PIXELS);
+            t[4] = now_ms();
+            k->min_max(out, BENCH_PIXELS, &lo, &hi);
+            t[5] = now_ms();
+            k->stretch(out, BENCH_PIXELS, 10, 200);
+            t[6] = now_ms();
+            k->fuse_min_max(a, b, upper, lower, 3, out, BENCH_PIXELS, &lo, &hi);
+            t[7] = now_ms();
+            for (int s = 0; s < 7; s++) {
+                if (t[s + 1] - t[s] < best[s]) best[s] = t[s + 1] - t[s];
+            }
+        }
+        printf("%s,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n", k->name,
+               best[0], best[1], best[2], best[3], best[4], best[5], best[6]);
+    }
+
+    free(a);
+    free(b);
+    free(out);
+    free(mask);
+    free(q16);
+    free(upper);
+    free(lower);
+    return failures == 0 ? 0 : 1;
+}
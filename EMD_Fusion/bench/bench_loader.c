@@ -0,0 +1,218 @@
+/*
+ * bench_loader.c
+ *
+ * @brief Host benchmark of the run-time image loader against the compiled-in header path.
+ *
+ * Each path is timed from nothing to a Q16.16 signal ready for EMD, i.e.
+ * load plus convert_to_q16_16(), then release:
+ *   header     the p27a array generated by generate_header.py (no load step),
+ *   pgm, raw   image_open() maps the file and hands out a zero-copy view,
+ *   bmp        bottom-up rows, so image_open() unpacks them into a buffer,
+ *   bmp_td     top-down rows, viewed in place,
+ *   fread      malloc() and fread() of the raw file, for reference.
+ * "first" is the first run, with the file evicted from the page cache
+ * (posix_fadvise) or, for the header, the first touch of the array in the
+ * process. "warm" is the best of BENCH_REPEATS later runs. The header path
+ * exists only at the compiled-in size. Larger frames would need a new header,
+ * about 6 bytes of C text per pixel, and a rebuild, and add width * height
+ * bytes to the binary.
+ *
+ * Build and run on the host (from this directory, after generate_header.py):
+ *   gcc -O2 -I../src bench_loader.c ../src/image_io.c ../src/emd.c ../src/pixel_kernels.c \
+ *       ../src/decision_mask.c ../src/led.c -lm -o bench_loader
+ *   ./bench_loader
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "emd.h"
+#include "image_io.h"
+#include "p27a.h"
+
+#define BENCH_REPEATS 20
+
+static const int bench_sizes[][2] = { { 0, 0 }, { 1024, 1024 }, { 4096, 4096 } };
+
+static const char* const bench_files[] = { "bench_loader.pgm", "bench_loader.bin",
+                                           "bench_loader.bmp", "bench_loader_td.bmp" };
+static const char* const path_names[] = { "pgm", "raw", "bmp", "bmp_td", "fread", "header" };
+
+/** Load paths; the first four index bench_files. */
+enum { PATH_PGM, PATH_RAW, PATH_BMP, PATH_BMP_TD, PATH_FREAD, PATH_HEADER, NUM_PATHS };
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void put_le32(unsigned char* p, uint32_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+/** Write an 8-bit BMP with a grey palette, bottom-up or top-down. */
+static int write_bmp(FILE* fp, const unsigned char* img, int width, int height, int top_down) {
+    unsigned char header[54 + 1024];
+    int stride = (width + 3) & ~3;
+    static const unsigned char pad[3];
+
+    memset(header, 0, sizeof(header));
+    header[0] = 'B';
+    header[1] = 'M';
+    put_le32(header + 2, (uint32_t)(sizeof(header) + (size_t)stride * height));
+    put_le32(header + 10, sizeof(header));
+    put_le32(header + 14, 40);
+    put_le32(header + 18, (uint32_t)width);
+    put_le32(header + 22, (uint32_t)(top_down ? -height : height));
+    header[26] = 1;
+    header[28] = 8;
+    put_le32(header + 34, (uint32_t)stride * height);
+    for (int i = 0; i < 256; i++) {
+        header[54 + 4 * i] = header[55 + 4 * i] = header[56 + 4 * i] = (unsigned char)i;
+    }
+    if (fwrite(header, 1, sizeof(header), fp) != sizeof(header)) return -1;
+    for (int y = 0; y < height; y++) {
+        const unsigned char* row = img + (size_t)(top_down ? y : height - 1 - y) * width;
+        if (fwrite(row, 1, width, fp) != (size_t)width ||
+            fwrite(pad, 1, stride - width, fp) != (size_t)(stride - width)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/** Write the image in every file format and flush it to disk so it can be evicted. */
+static int write_files(const unsigned char* img, int width, int height) {
+    for (int f = PATH_PGM; f <= PATH_BMP_TD; f++) {
+        FILE* fp = fopen(bench_files[f], "wb");
+        unsigned char dims[IMAGE_RAW_HEADER];
+        int rc = (fp == NULL);
+        if (!rc && f == PATH_PGM) {
+            rc = fprintf(fp, "P5\n%d %d\n255\n", width, height) < 0 ||
+                 fwrite(img, 1, (size_t)width * height, fp) != (size_t)width * height;
+        } else if (!rc && f == PATH_RAW) {
+            put_le32(dims, (uint32_t)width);
+            put_le32(dims + 4, (uint32_t)height);
+            rc = fwrite(dims, 1, sizeof(dims), fp) != sizeof(dims) ||
+                 fwrite(img, 1, (size_t)width * height, fp) != (size_t)width * height;
+        } else if (!rc) {
+            rc = write_bmp(fp, img, width, height, f == PATH_BMP_TD);
+        }
+        if (fp != NULL) {
+            fflush(fp);
+            fsync(fileno(fp));
+            fclose(fp);
+        }
+        if (rc) {
+            printf("Error: Cannot write %s.\n", bench_files[f]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void evict(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+}
+
+/** Load with one path and convert to Q16.16. Returns the elapsed time, or -1 on error. */
+static double load_and_convert(int path, int32_t* signal, int* copied) {
+    double t0 = now_ms();
+    if (path == PATH_HEADER) {
+        convert_to_q16_16(p27a, signal, (int)(p27a_width * p27a_height));
+        *copied = 0;
+    } else if (path == PATH_FREAD) {
+        FILE* fp = fopen(bench_files[PATH_RAW], "rb");
+        unsigned char dims[IMAGE_RAW_HEADER];
+        if (fp == NULL || fread(dims, 1, sizeof(dims), fp) != sizeof(dims)) {
+            if (fp != NULL) fclose(fp);
+            return -1.0;
+        }
+        uint32_t width, height;
+        memcpy(&width, dims, sizeof(width)); // Little-endian host.
+        memcpy(&height, dims + 4, sizeof(height));
+        size_t num_pixels = (size_t)width * height;
+        unsigned char* img = malloc(num_pixels);
+        if (img == NULL || fread(img, 1, num_pixels, fp) != num_pixels) {
+            free(img);
+            fclose(fp);
+            return -1.0;
+        }
+        fclose(fp);
+        convert_to_q16_16(img, signal, (int)num_pixels);
+        free(img);
+        *copied = 1;
+    } else {
+        image_view view;
+        if (image_open(bench_files[path], &view) != 0) return -1.0;
+        convert_to_q16_16(view.pixels, signal, (int)(view.width * view.height));
+        *copied = (view.copy != NULL);
+        image_close(&view);
+    }
+    return now_ms() - t0;
+}
+
+int main(void) {
+    printf("width,height,path,first_ms,warm_ms,pixels_copied\n");
+
+    for (size_t s = 0; s < sizeof(bench_sizes) / sizeof(bench_sizes[0]); s++) {
+        int compiled_in = (bench_sizes[s][0] == 0);
+        int width = compiled_in ? (int)p27a_width : bench_sizes[s][0];
+        int height = compiled_in ? (int)p27a_height : bench_sizes[s][1];
+        size_t num_pixels = (size_t)width * height;
+        unsigned char* img = malloc(num_pixels);
+        int32_t* signal = malloc(num_pixels * sizeof(int32_t));
+        if (img == NULL || signal == NULL) {
+            printf("Error: Out of memory.\n");
+            return 1;
+        }
+        for (size_t i = 0; i < num_pixels; i++) {
+            img[i] = compiled_in ? p27a[i] : (unsigned char)((i * 2654435761u) >> 24);
+        }
+        if (write_files(img, width, height) != 0) {
+            return 1;
+        }
+
+        // The header path runs first so its first touch of p27a is the first in the process.
+        static const int path_order[NUM_PATHS] = { PATH_HEADER, PATH_PGM, PATH_RAW, PATH_BMP,
+                                                   PATH_BMP_TD, PATH_FREAD };
+        for (int k = compiled_in ? 0 : 1; k < NUM_PATHS; k++) {
+            int path = path_order[k];
+            int copied = 0;
+            if (path != PATH_HEADER) evict(bench_files[(path == PATH_FREAD) ? PATH_RAW : path]);
+            double first = load_and_convert(path, signal, &copied);
+            double warm = 1e30;
+            for (int r = 0; r < BENCH_REPEATS && first >= 0.0; r++) {
+                double t = load_and_convert(path, signal, &copied);
+                if (t < warm) warm = t;
+            }
+            if (first < 0.0) {
+                printf("Error: Path %s failed.\n", path_names[path]);
+                return 1;
+            }
+            printf("%d,%d,%s,%.3f,%.3f,%s\n", width, height, path_names[path], first, warm,
+                   copied ? "yes" : "no");
+        }
+
+        free(img);
+        free(signal);
+    }
+
+    for (int f = PATH_PGM; f <= PATH_BMP_TD; f++) {
+        remove(bench_files[f]);
+    }
+    return 0;
+}
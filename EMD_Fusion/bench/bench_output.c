@@ -0,0 +1,130 @@
+/*
+ * bench_output.c
+ *
+ * @brief Host benchmark of the single-write output path against the grouped fwrite() loop.
+ *
+ * For each frame size the program times:
+ *   grouped   the previous save_fused_image() body: one fwrite() per 4 pixels,
+ *   raw, pgm  image_save() with one writev() of header and pixels,
+ *   bmp       image_save() gathering the reversed rows with writev(),
+ *   memory    image_encode() of a BMP into a caller buffer (no file).
+ * Every file is read back with image_open() and compared with the source image.
+ *
+ * Build and run on the host (from this directory):
+ *   gcc -O2 -I../src bench_output.c ../src/image_io.c -o bench_output
+ *   ./bench_output
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "image_io.h"
+
+#define BENCH_REPEATS 10
+
+static const int bench_sizes[][2] = { { 200, 200 }, { 640, 480 }, { 1024, 1024 }, { 4096, 4096 } };
+
+static const char* const bench_file = "bench_output.tmp";
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/** The previous save_fused_image() loop, without the LED updates. */
+static int save_grouped(const char* filename, unsigned int width, unsigned int height, const unsigned char* img) {
+    FILE* fp = fopen(filename, "wb");
+    if (fp == NULL) return -1;
+    if (fwrite(&width, sizeof(width), 1, fp) != 1 || fwrite(&height, sizeof(height), 1, fp) != 1) {
+        fclose(fp);
+        return -1;
+    }
+    size_t num_pixels = (size_t)width * height;
+    const unsigned char* p = img;
+    for (size_t i = 0; i < num_pixels / 4; i++, p += 4) {
+        uint32_t group = (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+                         ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+        if (fwrite(&group, sizeof(group), 1, fp) != 1) {
+            fclose(fp);
+            return -1;
+        }
+    }
+    for (size_t i = 0; i < num_pixels % 4; i++) {
+        if (fputc(p[i], fp) == EOF) {
+            fclose(fp);
+            return -1;
+        }
+    }
+    return fclose(fp);
+}
+
+/** Read the file back and compare it with the source image. */
+static int read_back_ok(const unsigned char* img, unsigned int width, unsigned int height) {
+    image_view view;
+    if (image_open(bench_file, &view) != 0) return 0;
+    int ok = view.width == width && view.height == height &&
+             memcmp(view.pixels, img, (size_t)width * height) == 0;
+    image_close(&view);
+    return ok;
+}
+
+int main(void) {
+    static const char* const path_names[] = { "grouped", "raw", "pgm", "bmp", "memory" };
+    static const int path_formats[] = { IMAGE_FORMAT_RAW, IMAGE_FORMAT_RAW, IMAGE_FORMAT_PGM,
+                                        IMAGE_FORMAT_BMP, IMAGE_FORMAT_BMP };
+
+    printf("width,height,path,calls,ms,mb_per_s,round_trip\n");
+    for (size_t s = 0; s < sizeof(bench_sizes) / sizeof(bench_sizes[0]); s++) {
+        unsigned int width = (unsigned int)bench_sizes[s][0];
+        unsigned int height = (unsigned int)bench_sizes[s][1];
+        size_t num_pixels = (size_t)width * height;
+        size_t capacity = image_encoded_size(IMAGE_FORMAT_BMP, width, height);
+        unsigned char* img = malloc(num_pixels);
+        unsigned char* encoded = malloc(capacity);
+        if (img == NULL || encoded == NULL) {
+            printf("Error: Out of memory.\n");
+            return 1;
+        }
+        for (size_t i = 0; i < num_pixels; i++) {
+            img[i] = (unsigned char)((i * 2654435761u) >> 24);
+        }
+
+        for (int path = 0; path < 5; path++) {
+            double best = 1e30;
+            int ok = 1;
+            for (int r = 0; r < BENCH_REPEATS && ok; r++) {
+                double t0 = now_ms();
+                if (path == 0) {
+                    ok = (save_grouped(bench_file, width, height, img) == 0);
+                } else if (path < 4) {
+                    ok = (image_save(bench_file, path_formats[path], width, height, img) == 0);
+                } else {
+                    ok = (image_encode(path_formats[path], width, height, img, encoded, capacity) == capacity);
+                }
+                double t = now_ms() - t0;
+                if (t < best) best = t;
+            }
+            if (ok && path < 4) {
+                ok = read_back_ok(img, width, height);
+            } else if (ok) {
+                image_view view;
+                ok = image_parse(encoded, capacity, &view) == 0 &&
+                     memcmp(view.pixels, img, num_pixels) == 0;
+                image_close(&view);
+            }
+            // fwrite() calls for the grouped loop; writev() calls (or none) for the others.
+            size_t calls = (path == 0) ? 2 + num_pixels / 4 + num_pixels % 4 :
+                           (path == 3) ? (height + 499) / 500 : (path == 4) ? 0 : 1;
+            printf("%u,%u,%s,%zu,%.3f,%.1f,%s\n", width, height, path_names[path], calls, best,
+                   image_encoded_size(path_formats[path], width, height) / best / 1e3, ok ? "yes" : "NO");
+        }
+
+        free(img);
+        free(encoded);
+    }
+    remove(bench_file);
+    return 0;
+}
@@ -0,0 +1,262 @@
+/*
+ * bench_precision.c
+ *
+ * @brief Host benchmark of the numeric-type variants of precision_kernels.h.
+ *
+ * For each pair, every variant runs the 1-D EMD, the local variance and the
+ * fused decision. The program reports per stage throughput (megapixels per
+ * second, best of BENCH_REPEATS) and accuracy against the double variant:
+ * largest and RMS error of the IMF in pixel units, largest variance error
+ * relative to the mean variance, the share of mask decisions that agree and
+ * the number of fused pixels that differ.
+ *
+ * It also checks that the generated Q16.16 variant is bit-identical to the
+ * tuned pipeline (emd_decompose_image_scratch(), calculate_local_variance_rows()
+ * and emd_fusion_run()), and exits non-zero otherwise.
+ *
+ * Build and run on the host (from this directory):
+ *   gcc -O2 -pthread -I../src bench_precision.c ../src/precision_kernels.c ../src/emd_fusion.c \
+ *       ../src/incremental_fusion.c ../src/pyramid_fusion.c ../src/parallel_fusion.c ../src/thread_pool.c \
+ *       ../src/emd.c ../src/decision_mask.c ../src/fusion.c ../src/pixel_kernels.c ../src/image_io.c \
+ *       ../src/trace.c ../src/led.c -lm -o bench_precision
+ *   ./bench_precision [imageA imageB]...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include "emd_fusion.h"
+#include "fusion.h"
+#include "image_io.h"
+
+#define BENCH_REPEATS 3
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/** Synthetic multi-focus pair: textured noise, sharp in the left half of A and the right half of B. */
+static void make_pair(unsigned char* a, unsigned char* b, int width, int height) {
+    unsigned char* sharp = malloc((size_t)width * height);
+    srand(7);
+    for (int i = 0; i < width * height; i++) {
+        sharp[i] = (unsigned char)(64 + (rand() % 128));
+    }
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int sum = 0, count = 0;
+            for (int j = y - 2; j <= y + 2; j++) {
+                for (int k = x - 2; k <= x + 2; k++) {
+                    if (j >= 0 && j < height && k >= 0 && k < width) {
+                        sum += sharp[j * width + k];
+                        count++;
+                    }
+                }
+            }
+            unsigned char blurred = (unsigned char)(sum / count);
+            int i = y * width + x;
+            a[i] = (x < width / 2) ? sharp[i] : blurred;
+            b[i] = (x < width / 2) ? blurred : sharp[i];
+        }
+    }
+    free(sharp);
+}
+
+/** Buffers and results of one variant on one pair. */
+typedef struct {
+    const precision_kernels* k;
+    void* signal[2];
+    void* var_map[2];
+    char* mask;
+    unsigned char* fused;
+    void* sums;
+    void* work;
+    double emd_ms, variance_ms, fuse_ms;
+} variant_run;
+
+static int run_variant(variant_run* r, const unsigned char* img[2], int width, int height) {
+    size_t n = (size_t)width * height;
+    double sum_var = 0;
+    unsigned char min_val, max_val;
+
+    for (int i = 0; i < 2; i++) {
+        r->signal[i] = malloc(n * r->k->sample_bytes);
+        r->var_map[i] = malloc(n * r->k->variance_bytes);
+    }
+    r->mask = malloc(n);
+    r->fused = malloc(n);
+    r->sums = malloc(16 * (size_t)width);
+    r->work = malloc(precision_work_bytes(r->k, (int)n));
+    if (!r->signal[0] || !r->signal[1] || !r->var_map[0] || !r->var_map[1] || !r->mask || !r->fused ||
+        !r->sums || !r->work) {
+        return -1;
+    }
+
+    r->emd_ms = r->variance_ms = r->fuse_ms = 1e30;
+    for (int rep = 0; rep < BENCH_REPEATS; rep++) {
+        double t0 = now_ms();
+        for (int i = 0; i < 2; i++) {
+            r->k->to_samples(img[i], r->signal[i], (int)n);
+            r->k->sift(r->signal[i], (int)n, r->work);
+        }
+        double t1 = now_ms();
+        sum_var = 0;
+        for (int i = 0; i < 2; i++) {
+            sum_var += r->k->variance_rows(r->signal[i], width, height, WINDOW_SIZE, 0, height,
+                                           r->var_map[i], r->sums);
+        }
+        double t2 = now_ms();
+        r->k->fuse(img[0], img[1], r->var_map[0], r->var_map[1], (int)n, sum_var, 2 * (int64_t)n,
+                   r->fused, &min_val, &max_val);
+        double t3 = now_ms();
+        if (t1 - t0 < r->emd_ms) r->emd_ms = t1 - t0;
+        if (t2 - t1 < r->variance_ms) r->variance_ms = t2 - t1;
+        if (t3 - t2 < r->fuse_ms) r->fuse_ms = t3 - t2;
+    }
+    histogram_stretch_lut(r->fused, (int)n, min_val, max_val);
+    r->k->decide(r->var_map[0], r->var_map[1], (int)n, sum_var, 2 * (int64_t)n, r->mask);
+    return 0;
+}
+
+static void free_variant(variant_run* r) {
+    for (int i = 0; i < 2; i++) {
+        free(r->signal[i]);
+        free(r->var_map[i]);
+    }
+    free(r->mask);
+    free(r->fused);
+    free(r->sums);
+    free(r->work);
+}
+
+/** Check the generated Q16.16 variant against the tuned pipeline; returns the number of mismatches. */
+static int check_q16(const variant_run* q16, const unsigned char* img[2], int width, int height) {
+    size_t n = (size_t)width * height;
+    int32_t* signal = malloc(n * sizeof(int32_t));
+    int32_t* var_map = malloc(n * sizeof(int32_t));
+    int64_t* sums = malloc(2 * (size_t)width * sizeof(int64_t));
+    unsigned char* fused = malloc(n);
+    emd_scratch scratch;
+    emd_fusion_ctx ctx;
+    int mismatches = 0;
+
+    emd_scratch_init(&scratch, (int)n);
+    for (int i = 0; i < 2; i++) {
+        convert_to_q16_16(img[i], signal, (int)n);
+        emd_decompose_image_scratch(signal, width, height, EMD_MODE_1D, &scratch);
+        mismatches += memcmp(signal, q16->signal[i], n * sizeof(int32_t)) != 0;
+        calculate_local_variance_rows(signal, width, height, WINDOW_SIZE, 0, height, var_map, sums, sums + width);
+        mismatches += memcmp(var_map, q16->var_map[i], n * sizeof(int32_t)) != 0;
+    }
+    if (emd_fusion_init(&ctx, width, height, NULL, NULL, 0) == 0) {
+        emd_fusion_run(&ctx, img[0], img[1], fused);
+        mismatches += memcmp(fused, q16->fused, n) != 0;
+        emd_fusion_free(&ctx);
+    } else {
+        mismatches++;
+    }
+
+    emd_scratch_free(&scratch);
+    free(signal);
+    free(var_map);
+    free(sums);
+    free(fused);
+    return mismatches;
+}
+
+/** Run every variant on one pair and print one CSV line per variant; returns the Q16.16 mismatches. */
+static int bench_pair(const char* name, const unsigned char* a, const unsigned char* b, int width, int height) {
+    const unsigned char* img[2] = { a, b };
+    variant_run runs[EMD_PRECISION_COUNT];
+    size_t n = (size_t)width * height;
+    double mp = n / 1e6;
+    int mismatches = 0;
+
+    memset(runs, 0, sizeof(runs));
+    for (int p = 0; p < EMD_PRECISION_COUNT; p++) {
+        runs[p].k = precision_kernels_get(p);
+        if (run_variant(&runs[p], img, width, height) != 0) {
+            printf("Error: Out of memory.\n");
+            exit(1);
+        }
+    }
+
+    const variant_run* ref = &runs[EMD_PRECISION_F64];
+    for (int p = 0; p < EMD_PRECISION_COUNT; p++) {
+        const variant_run* r = &runs[p];
+        double imf_max = 0, imf_sq = 0, var_max = 0, var_mean = 0;
+        int64_t agree = 0, fused_diff = 0;
+
+        for (int i = 0; i < 2; i++) {
+            for (size_t j = 0; j < n; j++) {
+                double e = fabs(r->k->sample_value(r->signal[i], (int)j) - ref->k->sample_value(ref->signal[i], (int)j));
+                double v = ref->k->variance_value(ref->var_map[i], (int)j);
+                double ev = fabs(r->k->variance_value(r->var_map[i], (int)j) - v);
+                if (e > imf_max) imf_max = e;
+                imf_sq += e * e;
+                if (ev > var_max) var_max = ev;
+                var_mean += v;
+            }
+        }
+        var_mean /= 2.0 * n;
+        for (size_t j = 0; j < n; j++) {
+            agree += r->mask[j] == ref->mask[j];
+            fused_diff += r->fused[j] != ref->fused[j];
+        }
+        // Throughput counts both images for the EMD and variance, output pixels for the fusion.
+        printf("%s,%dx%d,%s,%.1f,%.1f,%.1f,%.1f,%.4f,%.5f,%.4f,%.3f,%lld\n", name, width, height, r->k->name,
+               2 * mp * 1e3 / r->emd_ms, 2 * mp * 1e3 / r->variance_ms, mp * 1e3 / r->fuse_ms,
+               mp * 1e3 / (r->emd_ms + r->variance_ms + r->fuse_ms), imf_max, sqrt(imf_sq / (2.0 * n)),
+               100.0 * var_max / var_mean, 100.0 * agree / n, (long long)fused_diff);
+    }
+
+    mismatches = check_q16(&runs[EMD_PRECISION_Q16], img, width, height);
+    if (mismatches != 0) {
+        printf("Error: %s: generated q16.16 differs from the tuned pipeline (%d buffers).\n", name, mismatches);
+    }
+    for (int p = 0; p < EMD_PRECISION_COUNT; p++) {
+        free_variant(&runs[p]);
+    }
+    return mismatches;
+}
+
+int main(int argc, char** argv) {
+    static const int sizes[] = { 256, 512, 1024 };
+    int mismatches = 0;
+
+    printf("pair,size,type,emd_mp_s,variance_mp_s,fuse_mp_s,total_mp_s,"
+           "imf_max_err,imf_rms_err,var_max_err_pct,mask_agree_pct,fused_pixels_differing\n");
+    for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++) {
+        int size = sizes[s];
+        unsigned char* a = malloc((size_t)size * size);
+        unsigned char* b = malloc((size_t)size * size);
+        make_pair(a, b, size, size);
+        mismatches += bench_pair("synthetic", a, b, size, size);
+        free(a);
+        free(b);
+    }
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        image_view va, vb;
+        if (image_open(argv[i], &va) != 0) {
+            return 1;
+        }
+        if (image_open(argv[i + 1], &vb) != 0) {
+            image_close(&va);
+            return 1;
+        }
+        if (va.width == vb.width && va.height == vb.height) {
+            mismatches += bench_pair(argv[i], va.pixels, vb.pixels, (int)va.width, (int)va.height);
+        } else {
+            printf("Error: %s and %s differ in size.\n", argv[i], argv[i + 1]);
+        }
+        image_close(&va);
+        image_close(&vb);
+    }
+    return (mismatches == 0) ? 0 : 1;
+}
@@ -0,0 +1,161 @@
+/*
+ * bench_pyramid.c
+ *
+ * @brief Host benchmark of the coarse-to-fine (pyramid) decision mode.
+ *
+ * Fuses each pair with the full-frame path and with 1 and 2 pyramid levels,
+ * in both EMD modes, and reports the fraction of pixels refined at full
+ * resolution, the best time of BENCH_REPEATS runs, the speedup over the
+ * full-frame path and how many output pixels differ from it (and by how much).
+ *
+ * The pairs are synthetic multi-focus scenes (textured noise, sharp in one
+ * region of A and the complementary region of B, 5x5 box blur elsewhere)
+ * with a straight focus boundary ("halves") and a round one ("disc"), plus
+ * any image pairs given on the command line.
+ *
+ * Build and run on the host (from this directory):
+ *   gcc -O2 -pthread -I../src bench_pyramid.c ../src/emd_fusion.c \
+ *       ../src/incremental_fusion.c ../src/pyramid_fusion.c \
+ *       ../src/precision_kernels.c ../src/parallel_fusion.c ../src/thread_pool.c ../src/emd.c \
+ *       ../src/decision_mask.c ../src/fusion.c ../src/pixel_kernels.c ../src/image_io.c \
+ *       ../src/trace.c ../src/led.c -o bench_pyramid
+ *   ./bench_pyramid [imageA imageB]...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "emd_fusion.h"
+#include "image_io.h"
+
+#define BENCH_REPEATS 3
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/** Synthetic pair: A is sharp in the left half (or inside a centred disc), B everywhere else. */
+static void make_pair(unsigned char* a, unsigned char* b, int width, int height, int disc) {
+    unsigned char* sharp = malloc((size_t)width * height);
+    int radius = ((width < height) ? width : height) / 3;
+
+    srand(7);
+    for (int i = 0; i < width * height; i++) {
+        sharp[i] = (unsigned char)(64 + (rand() % 128));
+    }
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int sum = 0, count = 0;
+            for (int j = y - 2; j <= y + 2; j++) {
+                for (int k = x - 2; k <= x + 2; k++) {
+                    if (j >= 0 && j < height && k >= 0 && k < width) {
+                        sum += sharp[j * width + k];
+                        count++;
+                    }
+                }
+            }
+            int dx = x - width / 2, dy = y - height / 2;
+            int in_a = disc ? (dx * dx + dy * dy < radius * radius) : (x < width / 2);
+            unsigned char blurred = (unsigned char)(sum / count);
+            int i = y * width + x;
+            a[i] = in_a ? sharp[i] : blurred;
+            b[i] = in_a ? blurred : sharp[i];
+        }
+    }
+    free(sharp);
+}
+
+/** Best time of BENCH_REPEATS runs of one configuration; -1 if the context cannot be created. */
+static double time_fusion(const unsigned char* a, const unsigned char* b, int width, int height,
+                          int emd_mode, int levels, unsigned char* out, int* refined) {
+    emd_fusion_config config;
+    emd_fusion_ctx ctx;
+    double best = 1e30;
+
+    emd_fusion_config_default(&config);
+    config.emd_mode = emd_mode;
+    config.pyramid = levels;
+    if (emd_fusion_init(&ctx, width, height, &config, NULL, 0) != 0) {
+        return -1.0;
+    }
+    for (int r = 0; r < BENCH_REPEATS; r++) {
+        double t0 = now_ms();
+        emd_fusion_run(&ctx, a, b, out);
+        double t = now_ms() - t0;
+        if (t < best) best = t;
+    }
+    *refined = (levels > 0) ? ctx.pyramid.refined_pixels : width * height;
+    emd_fusion_free(&ctx);
+    return best;
+}
+
+/** Compare one pair across the full-frame path and every pyramid level, in both EMD modes. */
+static void bench_pair(const char* name, const unsigned char* a, const unsigned char* b, int width, int height) {
+    size_t n = (size_t)width * height;
+    unsigned char* ref = malloc(n);
+    unsigned char* out = malloc(n);
+
+    for (int mode = EMD_MODE_1D; mode <= EMD_MODE_2D; mode++) {
+        int refined;
+        double full_ms = time_fusion(a, b, width, height, mode, 0, ref, &refined);
+        if (full_ms < 0) {
+            continue;
+        }
+        for (int levels = 0; levels <= PYRAMID_MAX_LEVELS; levels++) {
+            double ms = (levels == 0) ? full_ms : time_fusion(a, b, width, height, mode, levels, out, &refined);
+            int diff = 0, max_diff = 0;
+            if (levels == 0) {
+                memcpy(out, ref, n);
+            }
+            for (size_t i = 0; i < n; i++) {
+                int d = abs((int)out[i] - (int)ref[i]);
+                diff += d != 0;
+                if (d > max_diff) max_diff = d;
+            }
+            printf("%s,%dx%d,%s,%d,%.1f,%.3f,%.2f,%d,%d\n", name, width, height, mode == EMD_MODE_2D ? "2d" : "1d",
+                   levels, 100.0 * refined / n, ms, full_ms / ms, diff, max_diff);
+        }
+    }
+    free(ref);
+    free(out);
+}
+
+int main(int argc, char** argv) {
+    static const int sizes[] = { 256, 512, 1024 };
+
+    printf("pair,size,emd,levels,refined_pct,ms,speedup,pixels_differing,max_diff\n");
+    for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++) {
+        int size = sizes[s];
+        unsigned char* a = malloc((size_t)size * size);
+        unsigned char* b = malloc((size_t)size * size);
+        for (int disc = 0; disc <= 1; disc++) {
+            make_pair(a, b, size, size, disc);
+            bench_pair(disc ? "disc" : "halves", a, b, size, size);
+        }
+        free(a);
+        free(b);
+    }
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        image_view va, vb;
+        if (image_open(argv[i], &va) != 0) {
+            return 1;
+        }
+        if (image_open(argv[i + 1], &vb) != 0) {
+            image_close(&va);
+            return 1;
+        }
+        if (va.width == vb.width && va.height == vb.height) {
+            bench_pair(argv[i], va.pixels, vb.pixels, (int)va.width, (int)va.height);
+        } else {
+            printf("Error: %s and %s differ in size.\n", argv[i], argv[i + 1]);
+        }
+        image_close(&va);
+        image_close(&vb);
+    }
+    return 0;
+}
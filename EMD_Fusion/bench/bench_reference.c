@@ -0,0 +1,744 @@
+/*
+ * bench_reference.c
+ *
+ * @brief Host regression suite: per-stage accuracy against a double reference,
+ *        golden fused outputs and stage timings against a stored baseline.
+ *
+ * Accuracy. The double variant of precision_kernels.h is the reference of the
+ * conversion, EMD, local variance and decision; the fusion and the stretch are
+ * checked against their exact real-valued results. Each stage of the tuned
+ * Q16.16 pipeline is fed the reference output of the stage before it (rounded
+ * to Q16.16), so an error is charged to the stage that made it:
+ *   emd        emd_decompose_image_scratch() vs. the double sift, largest IMF
+ *              error in pixels
+ *   variance   calculate_local_variance_rows() on the reference IMF, largest
+ *              error relative to the mean variance, in percent
+ *   decision   generate_decision_mask() on the reference variance maps, share
+ *              of decisions that agree, in percent
+ *   chain      the mask of the whole tuned chain from the pixels, share that
+ *              agrees with the reference mask
+ *   fuse       fuse_images() with the reference mask, largest error in grey
+ *              levels against the exact mean
+ *   stretch    histogram_stretch() of the reference fused image, largest error
+ *              in grey levels against the exact linear map
+ * The kernel variants are also checked against scalar (pixel_kernels_verify()).
+ *
+ * Golden outputs. Every pair is fused by emd_fusion_run() (or
+ * emd_fusion_run_rgb()) in each configuration below and the FNV-1a hash of the
+ * output is compared with golden/bench_reference.csv. The synthetic pairs are
+ * generated here, so their hashes are fixed; pairs given on the command line
+ * are keyed by the path of their first image and reported as new until
+ * --update-golden records them. A change to the arithmetic of any stage shows
+ * up as a hash mismatch, and --update-golden rewrites the file once the new
+ * output has been checked.
+ *
+ * Timing. Each stage is timed on a 512x512 pair, median of TIMING_REPEATS runs,
+ * in milliseconds per megapixel. --save-baseline writes the timings to a file;
+ * --baseline compares with such a file and fails a stage slower than the
+ * baseline by more than --threshold percent (default 25). Baselines belong to
+ * one machine and build, so none is committed; record one before a change and
+ * compare after it.
+ *
+ * One CSV section per part; the exit status is non-zero if any check fails.
+ *
+ * Build and run on the host (from this directory):
+ *   gcc -O2 -pthread -I../src bench_reference.c ../src/precision_kernels.c ../src/emd_fusion.c \
+ *       ../src/incremental_fusion.c ../src/pyramid_fusion.c ../src/parallel_fusion.c ../src/thread_pool.c \
+ *       ../src/emd.c ../src/decision_mask.c ../src/fusion.c ../src/pixel_kernels.c ../src/image_io.c \
+ *       ../src/trace.c ../src/led.c -lm -o bench_reference
+ *   ./bench_reference [--golden file] [--update-golden] [--baseline file] [--save-baseline file]
+ *                     [--threshold percent] [imageA imageB]...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include "emd_fusion.h"
+#include "decision_mask.h"
+#include "fusion.h"
+#include "image_io.h"
+#include "pixel_kernels.h"
+
+/**
+ * Per-stage bounds, a few times the largest error seen on the synthetic and sample
+ * pairs. The tuned decision compares rounded integer variance differences with an
+ * integer threshold, so a few tenths of a percent of pixels near the threshold differ.
+ */
+#define BOUND_EMD_MAX_ERR      0.0001  /**< Pixels. */
+#define BOUND_VAR_MAX_ERR_PCT  0.005   /**< Percent of the mean variance. */
+#define BOUND_DECISION_AGREE   99.5    /**< Percent of pixels, at least. */
+#define BOUND_CHAIN_AGREE      99.5    /**< Percent of pixels, at least. */
+#define BOUND_FUSE_MAX_ERR     0.5     /**< Grey levels: the tuned mean rounds half up. */
+#define BOUND_STRETCH_MAX_ERR  1.0     /**< Grey levels, exclusive: the tuned map truncates. */
+
+#define TIMING_SIZE     512
+#define TIMING_REPEATS  9
+#define GOLDEN_MAX      256
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/** xorshift32, so the synthetic pairs do not depend on the C library's rand(). */
+static uint32_t next_random(uint32_t* state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+/** Box blur of radius r, clamped at the borders. */
+static void box_blur(const unsigned char* src, unsigned char* dst, int width, int height, int r) {
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int sum = 0, count = 0;
+            for (int dy = -r; dy <= r; dy++) {
+                for (int dx = -r; dx <= r; dx++) {
+                    int yy = y + dy, xx = x + dx;
+                    if (yy >= 0 && yy < height && xx >= 0 && xx < width) {
+                        sum += src[yy * width + xx];
+                        count++;
+                    }
+                }
+            }
+            dst[y * width + x] = (unsigned char)((sum + count / 2) / count);
+        }
+    }
+}
+
+/**
+ * Synthetic pairs: a sharp scene and its blurred copy, A in focus where in_a()
+ * holds and B elsewhere.
+ *   texture  random texture, focus split at the middle column
+ *   scene    smooth gratings and discs, A in focus inside a central disc
+ *   edges    8-pixel checkerboard with a diagonal focus boundary, odd size
+ */
+#define SYNTHETIC_COUNT 3
+static const char* const synthetic_names[SYNTHETIC_COUNT] = { "texture", "scene", "edges" };
+static const int synthetic_sizes[SYNTHETIC_COUNT][2] = { { 256, 256 }, { 256, 256 }, { 301, 187 } };
+
+static int in_a(int kind, int x, int y, int width, int height) {
+    int dx = x - width / 2, dy = y - height / 2;
+    switch (kind) {
+    case 0:  return x < width / 2;
+    case 1:  return dx * dx + dy * dy < (width * width) / 9;
+    default: return x * height < y * width;
+    }
+}
+
+static void make_pair(int kind, unsigned char* a, unsigned char* b, int width, int height) {
+    size_t n = (size_t)width * height;
+    unsigned char* sharp = malloc(n);
+    unsigned char* blurred = malloc(n);
+    uint32_t state = 0x2545F491u + (uint32_t)kind;
+
+    if (sharp == NULL || blurred == NULL) {
+        printf("Error: Out of memory.\n");
+        exit(1);
+    }
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int v;
+            if (kind == 0) {
+                v = 64 + (int)(next_random(&state) >> 25) + (x + y) / 8 % 64;
+            } else if (kind == 1) {
+                // Integer gratings only, so no libm rounding reaches the golden hashes.
+                int dx = x - width / 3, dy = y - height / 3;
+                v = 72 + abs(((x * 7) & 63) - 32) * abs(((y * 5) & 63) - 32) / 10 + ((x + 2 * y) % 12 < 6 ? 24 : 0);
+                v += (dx * dx + dy * dy < 400) ? 40 : 0;
+                v += (int)(next_random(&state) >> 29) - 4;
+            } else {
+                v = (((x / 8) ^ (y / 8)) & 1) ? 200 : 40;
+                v += (int)(next_random(&state) >> 28) - 8;
+            }
+            sharp[y * width + x] = (unsigned char)((v < 0) ? 0 : (v > 255) ? 255 : v);
+        }
+    }
+    box_blur(sharp, blurred, width, height, 2);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int i = y * width + x;
+            int focus_a = in_a(kind, x, y, width, height);
+            a[i] = focus_a ? sharp[i] : blurred[i];
+            b[i] = focus_a ? blurred[i] : sharp[i];
+        }
+    }
+    free(sharp);
+    free(blurred);
+}
+
+/** Interleaved RGB pair from a grey pair: the channels are scaled differently so they are not equal. */
+static void make_rgb(const unsigned char* grey, unsigned char* rgb, int num_pixels) {
+    for (int i = 0; i < num_pixels; i++) {
+        rgb[3 * i] = grey[i];
+        rgb[3 * i + 1] = (unsigned char)(grey[i] * 3 / 4 + 32);
+        rgb[3 * i + 2] = (unsigned char)(255 - grey[i] / 2);
+    }
+}
+
+static int32_t to_q16(double v) {
+    double q = floor(v * 65536.0 + 0.5);
+    return (int32_t)((q > INT32_MAX) ? INT32_MAX : (q < INT32_MIN) ? INT32_MIN : q);
+}
+
+/* ---- Accuracy ---- */
+
+static int report_check(const char* pair, int width, int height, const char* stage, const char* metric,
+                        double value, double bound, int pass) {
+    printf("check,%s,%dx%d,%s,%s,%.6f,%.6f,%s\n", pair, width, height, stage, metric, value, bound,
+           pass ? "yes" : "NO");
+    return !pass;
+}
+
+/** Check every stage of the tuned pipeline on one pair; returns the number of failed checks. */
+static int check_pair(const char* name, const unsigned char* a, const unsigned char* b, int width, int height) {
+    const precision_kernels* ref = precision_kernels_get(EMD_PRECISION_F64);
+    const unsigned char* img[2] = { a, b };
+    size_t n = (size_t)width * height;
+    double* imf[2];
+    double* var[2];
+    int32_t* signal = malloc(n * sizeof(int32_t));
+    int32_t* var_q16[2];
+    int64_t* sums = malloc(2 * (size_t)width * sizeof(int64_t));
+    void* ref_sums = malloc(16 * (size_t)width);
+    void* work = malloc(precision_work_bytes(ref, (int)n));
+    char* ref_mask = malloc(n);
+    char* mask = malloc(n);
+    unsigned char* fused = malloc(n);
+    unsigned char* unstretched = malloc(n);
+    emd_scratch scratch;
+    double emd_err = 0, var_err = 0, var_mean = 0, fuse_err = 0, stretch_err = 0, sum_var = 0;
+    int64_t agree = 0, chain_agree = 0;
+    int failures = 0;
+
+    for (int i = 0; i < 2; i++) {
+        imf[i] = malloc(n * sizeof(double));
+        var[i] = malloc(n * sizeof(double));
+        var_q16[i] = malloc(n * sizeof(int32_t));
+        if (imf[i] == NULL || var[i] == NULL || var_q16[i] == NULL) {
+            printf("Error: Out of memory.\n");
+            exit(1);
+        }
+    }
+    if (signal == NULL || sums == NULL || ref_sums == NULL || work == NULL || ref_mask == NULL ||
+        mask == NULL || fused == NULL || unstretched == NULL ||
+        emd_scratch_init(&scratch, (int)n) != 0) {
+        printf("Error: Out of memory.\n");
+        exit(1);
+    }
+
+    /* Reference: double conversion, sift, variance and decision. */
+    for (int i = 0; i < 2; i++) {
+        ref->to_samples(img[i], imf[i], (int)n);
+        ref->sift(imf[i], (int)n, work);
+        sum_var += ref->variance_rows(imf[i], width, height, WINDOW_SIZE, 0, height, var[i], ref_sums);
+    }
+    ref->decide(var[0], var[1], (int)n, sum_var, 2 * (int64_t)n, ref_mask);
+    var_mean = sum_var / (2.0 * n);
+
+    for (int i = 0; i < 2; i++) {
+        /* EMD from the pixels. */
+        convert_to_q16_16(img[i], signal, (int)n);
+        emd_decompose_image_scratch(signal, width, height, EMD_MODE_1D, &scratch);
+        for (size_t j = 0; j < n; j++) {
+            double e = fabs(signal[j] / 65536.0 - imf[i][j]);
+            if (e > emd_err) emd_err = e;
+        }
+        /* The rest of the tuned chain on its own IMF, for the chained mask. */
+        calculate_local_variance_rows(signal, width, height, WINDOW_SIZE, 0, height, var_q16[i], sums, sums + width);
+    }
+    generate_decision_mask(var_q16[0], var_q16[1], width, height, mask);
+    for (size_t j = 0; j < n; j++) {
+        chain_agree += mask[j] == ref_mask[j];
+    }
+
+    /* Variance of the reference IMF. */
+    for (int i = 0; i < 2; i++) {
+        for (size_t j = 0; j < n; j++) {
+            signal[j] = to_q16(imf[i][j]);
+        }
+        calculate_local_variance_rows(signal, width, height, WINDOW_SIZE, 0, height, var_q16[i], sums, sums + width);
+        for (size_t j = 0; j < n; j++) {
+            double e = fabs(var_q16[i][j] / 65536.0 - var[i][j]);
+            if (e > var_err) var_err = e;
+        }
+    }
+
+    /* Decision on the reference variance maps. */
+    for (int i = 0; i < 2; i++) {
+        for (size_t j = 0; j < n; j++) {
+            var_q16[i][j] = to_q16(var[i][j]);
+        }
+    }
+    generate_decision_mask(var_q16[0], var_q16[1], width, height, mask);
+    for (size_t j = 0; j < n; j++) {
+        agree += mask[j] == ref_mask[j];
+    }
+
+    /* Fusion with the reference mask, then the stretch of its output. */
+    fuse_images(a, b, ref_mask, width, height, fused);
+    unsigned char lo = 255, hi = 0;
+    for (size_t j = 0; j < n; j++) {
+        double exact = (ref_mask[j] == ALPHA_A) ? a[j] : (ref_mask[j] == ALPHA_B) ? b[j] : (a[j] + b[j]) / 2.0;
+        double e = fabs(fused[j] - exact);
+        if (e > fuse_err) fuse_err = e;
+        if (fused[j] < lo) lo = fused[j];
+        if (fused[j] > hi) hi = fused[j];
+    }
+    memcpy(unstretched, fused, n);
+    histogram_stretch(fused, width, height);
+    for (size_t j = 0; j < n; j++) {
+        unsigned char v = unstretched[j];
+        double exact = (hi > lo) ? (v - lo) * 255.0 / (hi - lo) : v;
+        double e = fabs(fused[j] - exact);
+        if (e > stretch_err) stretch_err = e;
+    }
+
+    failures += report_check(name, width, height, "emd", "max_err_px", emd_err, BOUND_EMD_MAX_ERR,
+                             emd_err <= BOUND_EMD_MAX_ERR);
+    failures += report_check(name, width, height, "variance", "max_err_pct_of_mean", 100.0 * var_err / var_mean,
+                             BOUND_VAR_MAX_ERR_PCT, 100.0 * var_err / var_mean <= BOUND_VAR_MAX_ERR_PCT);
+    failures += report_check(name, width, height, "decision", "agree_pct", 100.0 * agree / n,
+                             BOUND_DECISION_AGREE, 100.0 * agree / n >= BOUND_DECISION_AGREE);
+    failures += report_check(name, width, height, "chain", "agree_pct", 100.0 * chain_agree / n,
+                             BOUND_CHAIN_AGREE, 100.0 * chain_agree / n >= BOUND_CHAIN_AGREE);
+    failures += report_check(name, width, height, "fuse", "max_err_levels", fuse_err, BOUND_FUSE_MAX_ERR,
+                             fuse_err <= BOUND_FUSE_MAX_ERR);
+    failures += report_check(name, width, height, "stretch", "max_err_levels", stretch_err,
+                             BOUND_STRETCH_MAX_ERR, stretch_err < BOUND_STRETCH_MAX_ERR);
+
+    emd_scratch_free(&scratch);
+    for (int i = 0; i < 2; i++) {
+        free(imf[i]);
+        free(var[i]);
+        free(var_q16[i]);
+    }
+    free(signal);
+    free(sums);
+    free(ref_sums);
+    free(work);
+    free(ref_mask);
+    free(mask);
+    free(fused);
+    free(unstretched);
+    return failures;
+}
+
+/* ---- Golden outputs ---- */
+
+/** A fusion configuration with a golden output per pair. */
+typedef struct {
+    const char* name;
+    int emd_mode;
+    int envelope;
+    int compact;
+    int threads;
+    int pyramid;
+    int precision;
+    int stretch_clip;
+    int incremental;
+} golden_config;
+
+static const golden_config golden_configs[] = {
+    { "default",     EMD_MODE_1D, EMD_ENVELOPE_LINEAR, 0, 0, 0, EMD_PRECISION_Q16, 0, 0 },
+    { "compact",     EMD_MODE_1D, EMD_ENVELOPE_LINEAR, 1, 0, 0, EMD_PRECISION_Q16, 0, 0 },
+    { "threads2",    EMD_MODE_1D, EMD_ENVELOPE_LINEAR, 0, 2, 0, EMD_PRECISION_Q16, 0, 0 },
+    { "spline",      EMD_MODE_1D, EMD_ENVELOPE_SPLINE, 0, 0, 0, EMD_PRECISION_Q16, 0, 0 },
+    { "2d",          EMD_MODE_2D, EMD_ENVELOPE_LINEAR, 0, 0, 0, EMD_PRECISION_Q16, 0, 0 },
+    { "pyramid1",    EMD_MODE_1D, EMD_ENVELOPE_LINEAR, 0, 0, 1, EMD_PRECISION_Q16, 0, 0 },
+    { "clip5",       EMD_MODE_1D, EMD_ENVELOPE_LINEAR, 0, 0, 0, EMD_PRECISION_Q16, 5, 0 },
+    { "q8",          EMD_MODE_1D, EMD_ENVELOPE_LINEAR, 0, 0, 0, EMD_PRECISION_Q8, 0, 0 },
+    { "float",       EMD_MODE_1D, EMD_ENVELOPE_LINEAR, 0, 0, 0, EMD_PRECISION_F32, 0, 0 },
+    { "incremental", EMD_MODE_1D, EMD_ENVELOPE_LINEAR, 0, 0, 0, EMD_PRECISION_Q16, 0, 1 },
+};
+#define GOLDEN_CONFIGS ((int)(sizeof(golden_configs) / sizeof(golden_configs[0])))
+
+/** One line of the golden file: pair, config and size, and the hash of the fused output. */
+typedef struct {
+    char key[192];
+    uint64_t hash;
+} golden_entry;
+
+static golden_entry golden[GOLDEN_MAX];
+static int golden_count;
+static golden_entry results[GOLDEN_MAX];
+static int result_count;
+
+/** FNV-1a, 64-bit. */
+static uint64_t hash_bytes(const unsigned char* data, size_t size) {
+    uint64_t h = 0xCBF29CE484222325ull;
+    for (size_t i = 0; i < size; i++) {
+        h = (h ^ data[i]) * 0x100000001B3ull;
+    }
+    return h;
+}
+
+/** Read the golden file; a missing file leaves the table empty. */
+static void load_golden(const char* path) {
+    char line[256];
+    FILE* fp = fopen(path, "r");
+
+    golden_count = 0;
+    if (fp == NULL) {
+        return;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL && golden_count < GOLDEN_MAX) {
+        char* last = strrchr(line, ',');
+        if (last == NULL || strncmp(line, "pair,", 5) == 0 || (size_t)(last - line) >= sizeof(golden[0].key)) {
+            continue;
+        }
+        memcpy(golden[golden_count].key, line, last - line);
+        golden[golden_count].key[last - line] = '\0';
+        golden[golden_count].hash = strtoull(last + 1, NULL, 16);
+        golden_count++;
+    }
+    fclose(fp);
+}
+
+static int save_golden(const char* path) {
+    FILE* fp = fopen(path, "w");
+    if (fp == NULL) {
+        printf("Error: Cannot write %s.\n", path);
+        return -1;
+    }
+    fprintf(fp, "pair,config,size,hash\n");
+    for (int i = 0; i < result_count; i++) {
+        fprintf(fp, "%s,%016llx\n", results[i].key, (unsigned long long)results[i].hash);
+    }
+    return fclose(fp);
+}
+
+/** Record one fused output and compare it with the golden file; returns 1 on a mismatch. */
+static int check_golden(const char* pair, const char* config, int width, int height, const unsigned char* fused,
+                        size_t size) {
+    golden_entry* r = &results[result_count];
+    const char* status = "new";
+    int mismatch = 0;
+
+    if (result_count == GOLDEN_MAX) {
+        printf("Error: More than %d golden outputs.\n", GOLDEN_MAX);
+        return 1;
+    }
+    snprintf(r->key, sizeof(r->key), "%s,%s,%dx%d", pair, config, width, height);
+    r->hash = hash_bytes(fused, size);
+    result_count++;
+    for (int i = 0; i < golden_count; i++) {
+        if (strcmp(golden[i].key, r->key) == 0) {
+            mismatch = golden[i].hash != r->hash;
+            status = mismatch ? "NO" : "yes";
+            printf("golden,%s,%016llx,%016llx,%s\n", r->key, (unsigned long long)r->hash,
+                   (unsigned long long)golden[i].hash, status);
+            return mismatch;
+        }
+    }
+    printf("golden,%s,%016llx,,%s\n", r->key, (unsigned long long)r->hash, status);
+    return 0;
+}
+
+/** Fuse one pair in every configuration, and in colour for synthetic pairs; returns the mismatches. */
+static int golden_pair(const char* name, const unsigned char* a, const unsigned char* b, int width, int height,
+                       int synthetic) {
+    size_t n = (size_t)width * height;
+    unsigned char* fused = malloc(3 * n);
+    int mismatches = 0;
+
+    if (fused == NULL) {
+        printf("Error: Out of memory.\n");
+        exit(1);
+    }
+    for (int c = 0; c < GOLDEN_CONFIGS; c++) {
+        const golden_config* g = &golden_configs[c];
+        emd_fusion_config config;
+        emd_fusion_ctx ctx;
+
+        emd_fusion_config_default(&config);
+        config.emd_mode = g->emd_mode;
+        config.envelope = g->envelope;
+        config.compact = g->compact;
+        config.threads = g->threads;
+        config.pyramid = g->pyramid;
+        config.precision = g->precision;
+        config.stretch_clip = g->stretch_clip;
+        config.incremental = g->incremental;
+        if (emd_fusion_init(&ctx, width, height, &config, NULL, 0) != 0) {
+            printf("Error: %s: cannot create the %s context.\n", name, g->name);
+            mismatches++;
+            continue;
+        }
+        emd_fusion_run(&ctx, a, b, fused);
+        mismatches += check_golden(name, g->name, width, height, fused, n);
+        emd_fusion_free(&ctx);
+    }
+
+    if (synthetic) {
+        unsigned char* rgb_a = malloc(3 * n);
+        unsigned char* rgb_b = malloc(3 * n);
+        emd_fusion_config config;
+        emd_fusion_ctx ctx;
+
+        emd_fusion_config_default(&config);
+        config.color = 1;
+        if (rgb_a == NULL || rgb_b == NULL || emd_fusion_init(&ctx, width, height, &config, NULL, 0) != 0) {
+            printf("Error: %s: cannot create the color context.\n", name);
+            mismatches++;
+        } else {
+            make_rgb(a, rgb_a, (int)n);
+            make_rgb(b, rgb_b, (int)n);
+            emd_fusion_run_rgb(&ctx, rgb_a, rgb_b, fused);
+            mismatches += check_golden(name, "color", width, height, fused, 3 * n);
+            emd_fusion_free(&ctx);
+        }
+        free(rgb_a);
+        free(rgb_b);
+    }
+    free(fused);
+    return mismatches;
+}
+
+/* ---- Timing ---- */
+
+#define TIMING_STAGES 7
+static const char* const timing_names[TIMING_STAGES] = { "convert", "emd", "variance", "decision", "fuse",
+                                                         "stretch", "frame" };
+
+static int compare_ms(const void* x, const void* y) {
+    double a = *(const double*)x, b = *(const double*)y;
+    return (a > b) - (a < b);
+}
+
+/** Median milliseconds per megapixel of each stage on one pair of TIMING_SIZE squared pixels. */
+static void time_stages(double* ms_per_mp) {
+    const int size = TIMING_SIZE;
+    const int n = size * size;
+    unsigned char* img[2] = { malloc(n), malloc(n) };
+    unsigned char* fused = malloc(n);
+    char* mask = malloc(n);
+    int32_t* signal[2] = { malloc(n * sizeof(int32_t)), malloc(n * sizeof(int32_t)) };
+    int32_t* var_map[2] = { malloc(n * sizeof(int32_t)), malloc(n * sizeof(int32_t)) };
+    int64_t* sums = malloc(2 * (size_t)size * sizeof(int64_t));
+    double samples[TIMING_STAGES][TIMING_REPEATS];
+    emd_scratch scratch;
+    emd_fusion_ctx ctx;
+
+    if (img[0] == NULL || img[1] == NULL || fused == NULL || mask == NULL || signal[0] == NULL ||
+        signal[1] == NULL || var_map[0] == NULL || var_map[1] == NULL || sums == NULL ||
+        emd_scratch_init(&scratch, n) != 0 || emd_fusion_init(&ctx, size, size, NULL, NULL, 0) != 0) {
+        printf("Error: Out of memory.\n");
+        exit(1);
+    }
+    make_pair(0, img[0], img[1], size, size);
+
+    for (int rep = 0; rep < TIMING_REPEATS; rep++) {
+        double t[TIMING_STAGES + 1];
+        t[0] = now_ms();
+        for (int i = 0; i < 2; i++) {
+            convert_to_q16_16(img[i], signal[i], n);
+        }
+        t[1] = now_ms();
+        for (int i = 0; i < 2; i++) {
+            emd_decompose_image_scratch(signal[i], size, size, EMD_MODE_1D, &scratch);
+        }
+        t[2] = now_ms();
+        for (int i = 0; i < 2; i++) {
+            calculate_local_variance_rows(signal[i], size, size, WINDOW_SIZE, 0, size, var_map[i], sums, sums + size);
+        }
+        t[3] = now_ms();
+        generate_decision_mask(var_map[0], var_map[1], size, size, mask);
+        t[4] = now_ms();
+        fuse_images(img[0], img[1], mask, size, size, fused);
+        t[5] = now_ms();
+        histogram_stretch(fused, size, size);
+        t[6] = now_ms();
+        emd_fusion_run(&ctx, img[0], img[1], fused);
+        t[7] = now_ms();
+        for (int s = 0; s < TIMING_STAGES; s++) {
+            samples[s][rep] = t[s + 1] - t[s];
+        }
+    }
+    for (int s = 0; s < TIMING_STAGES; s++) {
+        qsort(samples[s], TIMING_REPEATS, sizeof(double), compare_ms);
+        ms_per_mp[s] = samples[s][TIMING_REPEATS / 2] / (n / 1e6);
+    }
+
+    emd_fusion_free(&ctx);
+    emd_scratch_free(&scratch);
+    for (int i = 0; i < 2; i++) {
+        free(img[i]);
+        free(signal[i]);
+        free(var_map[i]);
+    }
+    free(fused);
+    free(mask);
+    free(sums);
+}
+
+/** Read the baseline timing of each stage; a stage missing from the file stays negative. */
+static int load_baseline(const char* path, double* ms_per_mp) {
+    char line[128];
+    FILE* fp = fopen(path, "r");
+
+    if (fp == NULL) {
+        printf("Error: Cannot open %s.\n", path);
+        return -1;
+    }
+    for (int s = 0; s < TIMING_STAGES; s++) {
+        ms_per_mp[s] = -1;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        char stage[32];
+        int size;
+        double ms;
+        if (sscanf(line, "%31[^,],%d,%lf", stage, &size, &ms) != 3 || size != TIMING_SIZE) {
+            continue;
+        }
+        for (int s = 0; s < TIMING_STAGES; s++) {
+            if (strcmp(stage, timing_names[s]) == 0) {
+                ms_per_mp[s] = ms;
+            }
+        }
+    }
+    fclose(fp);
+    return 0;
+}
+
+static int save_baseline(const char* path, const double* ms_per_mp) {
+    FILE* fp = fopen(path, "w");
+    if (fp == NULL) {
+        printf("Error: Cannot write %s.\n", path);
+        return -1;
+    }
+    fprintf(fp, "stage,size,ms_per_mp\n");
+    for (int s = 0; s < TIMING_STAGES; s++) {
+        fprintf(fp, "%s,%d,%.4f\n", timing_names[s], TIMING_SIZE, ms_per_mp[s]);
+    }
+    return fclose(fp);
+}
+
+int main(int argc, char** argv) {
+    const char* golden_path = "golden/bench_reference.csv";
+    const char* baseline_path = NULL;
+    const char* save_path = NULL;
+    double threshold = 25.0;
+    int update = 0;
+    int failures = 0;
+    int first_pair = argc;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--golden") == 0 && i + 1 < argc) {
+            golden_path = argv[++i];
+        } else if (strcmp(argv[i], "--update-golden") == 0) {
+            update = 1;
+        } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baseline_path = argv[++i];
+        } else if (strcmp(argv[i], "--save-baseline") == 0 && i + 1 < argc) {
+            save_path = argv[++i];
+        } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+        } else {
+            first_pair = i;
+            break;
+        }
+    }
+    load_golden(golden_path);
+
+    int verify = pixel_kernels_verify();
+    printf("kernels,%s,%d mismatches against scalar,%s\n", pixel_kernels_get()->name, verify,
+           verify == 0 ? "yes" : "NO");
+    failures += verify != 0;
+
+    /* Accuracy and golden outputs: synthetic pairs, then the pairs on the command line. */
+    printf("check,pair,size,stage,metric,value,bound,pass\n");
+    for (int p = 0; p < SYNTHETIC_COUNT; p++) {
+        int width = synthetic_sizes[p][0], height = synthetic_sizes[p][1];
+        unsigned char* a = malloc((size_t)width * height);
+        unsigned char* b = malloc((size_t)width * height);
+        if (a == NULL || b == NULL) {
+            printf("Error: Out of memory.\n");
+            return 1;
+        }
+        make_pair(p, a, b, width, height);
+        failures += check_pair(synthetic_names[p], a, b, width, height);
+        free(a);
+        free(b);
+    }
+    for (int i = first_pair; i + 1 < argc; i += 2) {
+        image_view va, vb;
+        if (image_open(argv[i], &va) != 0) {
+            return 1;
+        }
+        if (image_open(argv[i + 1], &vb) != 0) {
+            image_close(&va);
+            return 1;
+        }
+        if (va.width != vb.width || va.height != vb.height || va.channels != 1 || vb.channels != 1) {
+            printf("Error: %s and %s differ in size or are not grayscale.\n", argv[i], argv[i + 1]);
+            failures++;
+        } else {
+            failures += check_pair(argv[i], va.pixels, vb.pixels, (int)va.width, (int)va.height);
+        }
+        image_close(&va);
+        image_close(&vb);
+    }
+
+    printf("golden,pair,config,size,hash,expected,pass\n");
+    for (int p = 0; p < SYNTHETIC_COUNT; p++) {
+        int width = synthetic_sizes[p][0], height = synthetic_sizes[p][1];
+        unsigned char* a = malloc((size_t)width * height);
+        unsigned char* b = malloc((size_t)width * height);
+        if (a == NULL || b == NULL) {
+            printf("Error: Out of memory.\n");
+            return 1;
+        }
+        make_pair(p, a, b, width, height);
+        failures += golden_pair(synthetic_names[p], a, b, width, height, 1);
+        free(a);
+        free(b);
+    }
+    for (int i = first_pair; i + 1 < argc; i += 2) {
+        image_view va, vb;
+        if (image_open(argv[i], &va) != 0) {
+            return 1;
+        }
+        if (image_open(argv[i + 1], &vb) != 0) {
+            image_close(&va);
+            return 1;
+        }
+        if (va.width == vb.width && va.height == vb.height && va.channels == 1 && vb.channels == 1) {
+            failures += golden_pair(argv[i], va.pixels, vb.pixels, (int)va.width, (int)va.height, 0);
+        }
+        image_close(&va);
+        image_close(&vb);
+    }
+    if (update && save_golden(golden_path) != 0) {
+        failures++;
+    }
+
+    /* Stage timings against the baseline. */
+    double ms_per_mp[TIMING_STAGES], baseline[TIMING_STAGES];
+    int compare = baseline_path != NULL && load_baseline(baseline_path, baseline) == 0;
+    failures += baseline_path != NULL && !compare;
+    time_stages(ms_per_mp);
+    printf("timing,stage,size,ms_per_mp,baseline,limit,pass\n");
+    for (int s = 0; s < TIMING_STAGES; s++) {
+        if (compare && baseline[s] >= 0) {
+            double limit = baseline[s] * (1.0 + threshold / 100.0);
+            int pass = ms_per_mp[s] <= limit;
+            failures += !pass;
+            printf("timing,%s,%d,%.4f,%.4f,%.4f,%s\n", timing_names[s], TIMING_SIZE, ms_per_mp[s], baseline[s],
+                   limit, pass ? "yes" : "NO");
+        } else {
+            printf("timing,%s,%d,%.4f,,,n/a\n", timing_names[s], TIMING_SIZE, ms_per_mp[s]);
+        }
+    }
+    if (save_path != NULL && save_baseline(save_path, ms_per_mp) != 0) {
+        failures++;
+    }
+    return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,362 @@
+/*
+ * bench_stages.c
+ *
+ * @brief Host per-stage benchmark of the fusion pipeline with size sweeps.
+ *
+ * Every repetition runs the whole chain once and times each stage on its own:
+ *   convert_to_q16_16, emd_decompose, calculate_local_variance,
+ *   generate_decision_mask, fuse_images, histogram_stretch, save_fused_image
+ * (the classic separate passes, both images per stage where there are two),
+ * and the single-pass variant used by main.c:
+ *   fuse_images_var, histogram_stretch_lut.
+ * "total" is the sum of the classic stages. The first --warmup repetitions are
+ * discarded. Of the others the median, p99, minimum and mean are reported, with
+ * the throughput at the median in megapixels per second.
+ *
+ * Inputs are synthetic multi-focus pairs over the size sweep (64x64 up to
+ * 2048x2048 by default), or a real pair of PGM/BMP/raw files (see image_io.h)
+ * at its own size. Results go to stdout as CSV (default) or JSON, one record
+ * per input and stage, so runs can be diffed between releases. Progress and
+ * errors go to stderr.
+ *
+ * Build and run on the host (from this directory):
+ *   gcc -O2 -I../src bench_stages.c ../src/emd.c ../src/decision_mask.c ../src/fusion.c \
+ *       ../src/pixel_kernels.c ../src/image_io.c ../src/led.c -lm -o bench_stages
+ *   ./bench_stages [--json] [--mode 1d|2d] [--warmup N] [--repeats N]
+ *                  [--sizes 64,256,1024] [imageA imageB] > stages.csv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "emd.h"
+#include "decision_mask.h"
+#include "fusion.h"
+#include "image_io.h"
+
+#define MAX_SIZES 16
+#define SAVE_FILE "bench_stages.bin"
+
+enum {
+    STAGE_CONVERT,
+    STAGE_EMD,
+    STAGE_VARIANCE,
+    STAGE_MASK,
+    STAGE_FUSE,
+    STAGE_STRETCH,
+    STAGE_SAVE,
+    STAGE_FUSE_VAR,
+    STAGE_STRETCH_LUT,
+    STAGE_TOTAL,
+    NUM_STAGES
+};
+
+static const char* const stage_names[NUM_STAGES] = {
+    "convert_to_q16_16", "emd_decompose", "calculate_local_variance", "generate_decision_mask",
+    "fuse_images", "histogram_stretch", "save_fused_image", "fuse_images_var",
+    "histogram_stretch_lut", "total"
+};
+
+typedef struct {
+    int json;
+    int emd_mode;
+    int warmup;
+    int repeats;
+    int num_sizes;
+    int sizes[MAX_SIZES];
+    const char* paths[2];
+} bench_options;
+
+/** Buffers of one benchmark input. */
+typedef struct {
+    const char* name;
+    const unsigned char* img[2];
+    int width;
+    int height;
+    int32_t* signal[2];
+    int32_t* var[2];
+    char* mask;
+    unsigned char* fused;
+    emd_scratch scratch;
+    double* samples[NUM_STAGES];
+} bench_input;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double* sorted, int count, double q) {
+    int index = (int)(q * count + 0.999999) - 1;
+    if (index < 0) index = 0;
+    if (index >= count) index = count - 1;
+    return sorted[index];
+}
+
+/**
+ * Synthetic multi-focus pair: a textured scene, sharp in the left half of A
+ * and the right half of B, box-blurred elsewhere.
+ */
+static void make_pair(unsigned char* a, unsigned char* b, int width, int height) {
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int sharp = ((x * 7) ^ (y * 13)) & 0xFF;
+            int blur = (((x & ~3) * 7) ^ ((y & ~3) * 13)) & 0xFF;
+            a[y * width + x] = (unsigned char)((x < width / 2) ? sharp : blur);
+            b[y * width + x] = (unsigned char)((x < width / 2) ? blur : sharp);
+        }
+    }
+}
+
+static int parse_options(int argc, char* argv[], bench_options* opt) {
+    static const int default_sizes[] = { 64, 128, 256, 512, 1024, 2048 };
+    int num_paths = 0;
+
+    memset(opt, 0, sizeof(*opt));
+    opt->emd_mode = EMD_MODE_1D;
+    opt->warmup = 2;
+    opt->repeats = 10;
+    opt->num_sizes = (int)(sizeof(default_sizes) / sizeof(default_sizes[0]));
+    memcpy(opt->sizes, default_sizes, sizeof(default_sizes));
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            opt->json = 1;
+        } else if (strcmp(argv[i], "--csv") == 0) {
+            opt->json = 0;
+        } else if (strcmp(argv[i], "--mode") == 0 && i + 1 < argc) {
+            opt->emd_mode = (strcmp(argv[++i], "2d") == 0) ? EMD_MODE_2D : EMD_MODE_1D;
+        } else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+            opt->warmup = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--repeats") == 0 && i + 1 < argc) {
+            opt->repeats = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--sizes") == 0 && i + 1 < argc) {
+            char* p = argv[++i];
+            opt->num_sizes = 0;
+            while (*p != '\0' && opt->num_sizes < MAX_SIZES) {
+                opt->sizes[opt->num_sizes++] = (int)strtol(p, &p, 10);
+                if (*p == ',') p++;
+            }
+        } else if (argv[i][0] != '-' && num_paths < 2) {
+            opt->paths[num_paths++] = argv[i];
+        } else {
+            return -1;
+        }
+    }
+    if (num_paths == 1 || opt->warmup < 0 || opt->repeats < 1) {
+        return -1;
+    }
+    for (int s = 0; s < opt->num_sizes; s++) {
+        if (opt->sizes[s] < 8) return -1;
+    }
+    return 0;
+}
+
+static int input_alloc(bench_input* in, int repeats) {
+    size_t num_pixels = (size_t)in->width * in->height;
+    for (int k = 0; k < 2; k++) {
+        in->signal[k] = malloc(num_pixels * sizeof(int32_t));
+        in->var[k] = malloc(num_pixels * sizeof(int32_t));
+    }
+    in->mask = malloc(num_pixels);
+    in->fused = malloc(num_pixels);
+    for (int s = 0; s < NUM_STAGES; s++) {
+        in->samples[s] = malloc((size_t)repeats * sizeof(double));
+        if (in->samples[s] == NULL) return -1;
+    }
+    if (!in->signal[0] || !in->signal[1] || !in->var[0] || !in->var[1] || !in->mask || !in->fused) {
+        return -1;
+    }
+    return emd_scratch_init(&in->scratch, (int)num_pixels);
+}
+
+static void input_free(bench_input* in) {
+    for (int k = 0; k < 2; k++) {
+        free(in->signal[k]);
+        free(in->var[k]);
+    }
+    free(in->mask);
+    free(in->fused);
+    for (int s = 0; s < NUM_STAGES; s++) {
+        free(in->samples[s]);
+    }
+    emd_scratch_free(&in->scratch);
+}
+
+/** Run the chain once, storing the time of each stage in t. */
+static void run_chain(bench_input* in, int emd_mode, double* t) {
+    int num_pixels = in->width * in->height;
+    unsigned char min_val, max_val;
+    double t0, t1;
+
+    t0 = now_ms();
+    convert_to_q16_16(in->img[0], in->signal[0], num_pixels);
+    convert_to_q16_16(in->img[1], in->signal[1], num_pixels);
+    t1 = now_ms();
+    t[STAGE_CONVERT] = t1 - t0;
+
+    emd_decompose_image_scratch(in->signal[0], in->width, in->height, emd_mode, &in->scratch);
+    emd_decompose_image_scratch(in->signal[1], in->width, in->height, emd_mode, &in->scratch);
+    t0 = now_ms();
+    t[STAGE_EMD] = t0 - t1;
+
+    int64_t sum_var = calculate_local_variance(in->signal[0], in->width, in->height, WINDOW_SIZE, in->var[0]);
+    sum_var += calculate_local_variance(in->signal[1], in->width, in->height, WINDOW_SIZE, in->var[1]);
+    t1 = now_ms();
+    t[STAGE_VARIANCE] = t1 - t0;
+
+    generate_decision_mask(in->var[0], in->var[1], in->width, in->height, in->mask);
+    t0 = now_ms();
+    t[STAGE_MASK] = t0 - t1;
+
+    fuse_images(in->img[0], in->img[1], in->mask, in->width, in->height, in->fused);
+    t1 = now_ms();
+    t[STAGE_FUSE] = t1 - t0;
+
+    histogram_stretch(in->fused, in->width, in->height);
+    t0 = now_ms();
+    t[STAGE_STRETCH] = t0 - t1;
+
+    save_fused_image(SAVE_FILE, (unsigned int)in->width, (unsigned int)in->height, in->fused);
+    t1 = now_ms();
+    t[STAGE_SAVE] = t1 - t0;
+
+    fuse_images_var(in->img[0], in->img[1], in->var[0], in->var[1], num_pixels,
+                    decision_mask_epsilon(sum_var, 2 * (int64_t)num_pixels), in->fused, &min_val, &max_val);
+    t0 = now_ms();
+    t[STAGE_FUSE_VAR] = t0 - t1;
+
+    histogram_stretch_lut(in->fused, num_pixels, min_val, max_val);
+    t1 = now_ms();
+    t[STAGE_STRETCH_LUT] = t1 - t0;
+
+    t[STAGE_TOTAL] = 0.0;
+    for (int s = STAGE_CONVERT; s <= STAGE_SAVE; s++) {
+        t[STAGE_TOTAL] += t[s];
+    }
+}
+
+static void report(const bench_options* opt, bench_input* in, int* first_record) {
+    double mpix = (double)in->width * in->height / 1e6;
+    for (int s = 0; s < NUM_STAGES; s++) {
+        double* v = in->samples[s];
+        double sum = 0.0;
+        qsort(v, (size_t)opt->repeats, sizeof(double), compare_double);
+        for (int r = 0; r < opt->repeats; r++) sum += v[r];
+        double median = percentile(v, opt->repeats, 0.50);
+        double p99 = percentile(v, opt->repeats, 0.99);
+        double mpix_per_s = (median > 0.0) ? mpix / (median / 1e3) : 0.0;
+
+        if (opt->json) {
+            printf("%s\n    {\"input\": \"%s\", \"width\": %d, \"height\": %d, \"stage\": \"%s\", "
+                   "\"median_ms\": %.4f, \"p99_ms\": %.4f, \"min_ms\": %.4f, \"mean_ms\": %.4f, "
+                   "\"mpix_per_s\": %.2f}",
+                   *first_record ? "" : ",", in->name, in->width, in->height, stage_names[s],
+                   median, p99, v[0], sum / opt->repeats, mpix_per_s);
+        } else {
+            printf("%s,%d,%d,%s,%.4f,%.4f,%.4f,%.4f,%.2f\n", in->name, in->width, in->height,
+                   stage_names[s], median, p99, v[0], sum / opt->repeats, mpix_per_s);
+        }
+        *first_record = 0;
+    }
+    fflush(stdout);
+}
+
+static int bench_one(const bench_options* opt, bench_input* in, int* first_record) {
+    double t[NUM_STAGES];
+
+    if (input_alloc(in, opt->repeats) != 0) {
+        fprintf(stderr, "Error: Out of memory for %dx%d.\n", in->width, in->height);
+        input_free(in);
+        return -1;
+    }
+    fprintf(stderr, "%s %dx%d ...\n", in->name, in->width, in->height);
+    for (int r = 0; r < opt->warmup + opt->repeats; r++) {
+        run_chain(in, opt->emd_mode, t);
+        if (r >= opt->warmup) {
+            for (int s = 0; s < NUM_STAGES; s++) {
+                in->samples[s][r - opt->warmup] = t[s];
+            }
+        }
+    }
+    report(opt, in, first_record);
+    input_free(in);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    bench_options opt;
+    int first_record = 1;
+    int rc = 0;
+
+    if (parse_options(argc, argv, &opt) != 0) {
+        fprintf(stderr, "Usage: %s [--json|--csv] [--mode 1d|2d] [--warmup N] [--repeats N] "
+                        "[--sizes N,N,...] [imageA imageB]\n", argv[0]);
+        return 2;
+    }
+
+    if (opt.json) {
+        printf("{\n  \"emd_mode\": \"%s\", \"warmup\": %d, \"repeats\": %d,\n  \"results\": [",
+               opt.emd_mode == EMD_MODE_2D ? "2d" : "1d", opt.warmup, opt.repeats);
+    } else {
+        printf("input,width,height,stage,median_ms,p99_ms,min_ms,mean_ms,mpix_per_s\n");
+    }
+
+    if (opt.paths[0] != NULL) {
+        image_view views[2];
+        bench_input in;
+        if (image_open(opt.paths[0], &views[0]) != 0) return 1;
+        if (image_open(opt.paths[1], &views[1]) != 0) return 1;
+        if (views[0].width != views[1].width || views[0].height != views[1].height) {
+            fprintf(stderr, "Error: Input images differ in size.\n");
+            return 1;
+        }
+        memset(&in, 0, sizeof(in));
+        in.name = opt.paths[0];
+        in.img[0] = views[0].pixels;
+        in.img[1] = views[1].pixels;
+        in.width = (int)views[0].width;
+        in.height = (int)views[0].height;
+        rc = bench_one(&opt, &in, &first_record);
+        image_close(&views[0]);
+        image_close(&views[1]);
+    } else {
+        for (int s = 0; s < opt.num_sizes && rc == 0; s++) {
+            int size = opt.sizes[s];
+            unsigned char* a = malloc((size_t)size * size);
+            unsigned char* b = malloc((size_t)size * size);
+            bench_input in;
+            if (a == NULL || b == NULL) {
+                fprintf(stderr, "Error: Out of memory for %dx%d.\n", size, size);
+                free(a);
+                free(b);
+                rc = -1;
+                break;
+            }
+            make_pair(a, b, size, size);
+            memset(&in, 0, sizeof(in));
+            in.name = "synthetic";
+            in.img[0] = a;
+            in.img[1] = b;
+            in.width = size;
+            in.height = size;
+            rc = bench_one(&opt, &in, &first_record);
+            free(a);
+            free(b);
+        }
+    }
+
+    if (opt.json) {
+        printf("\n  ]\n}\n");
+    }
+    remove(SAVE_FILE);
+    return (rc == 0) ? 0 : 1;
+}
@@ -0,0 +1,124 @@
+/*
+ * bench_stretch.c
+ *
+ * @brief Host benchmark of the histogram stretch: min/max scan plus per-pixel
+ *        arithmetic against the 256-entry lookup table.
+ *
+ * The variants, each on the same fused-like image (values in [40..210]):
+ *   scan+arith scalar  min_max and stretch kernels of the scalar table, the
+ *                      SHARC histogram_stretch()
+ *   scan+arith <simd>  the same with the selected kernel variant
+ *   scan+lut           min_max kernel, then histogram_stretch_lut()
+ *   lut                histogram_stretch_lut() with the range handed over by
+ *                      the producing stage (fuse_images_var() etc.), no scan
+ *   percentile lut     histogram_stretch_percentile(), 5 per mille clipped on
+ *                      each side: histogram count, range search and lut
+ * It prints milliseconds per megapixel (best of BENCH_REPEATS) and the speedup
+ * over scan+arith scalar, and checks that every min/max variant produces the
+ * same image as the scalar arithmetic (non-zero exit otherwise).
+ *
+ * Build and run on the host (from this directory):
+ *   gcc -O2 -I../src bench_stretch.c ../src/fusion.c ../src/pixel_kernels.c ../src/image_io.c \
+ *       ../src/decision_mask.c ../src/trace.c ../src/led.c -o bench_stretch
+ *   ./bench_stretch
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "fusion.h"
+#include "pixel_kernels.h"
+
+#define BENCH_REPEATS 10
+#define BENCH_CLIP_PERMILLE 5
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+enum { SCAN_ARITH_SCALAR, SCAN_ARITH_SIMD, SCAN_LUT, LUT, PERCENTILE_LUT, NUM_VARIANTS };
+
+/** Stretch img in place with one variant. min_val/max_val is the range known by the producer. */
+static void run_variant(int variant, unsigned char* img, int n, unsigned char min_val, unsigned char max_val) {
+    const pixel_kernels* k = pixel_kernels_get();
+    unsigned char lo, hi;
+
+    switch (variant) {
+        case SCAN_ARITH_SCALAR:
+            k = pixel_kernels_variant(PIXEL_KERNELS_SCALAR);
+            /* fall through */
+        case SCAN_ARITH_SIMD:
+            k->min_max(img, n, &lo, &hi);
+            if (hi > lo) {
+                k->stretch(img, n, lo, hi - lo);
+            }
+            break;
+        case SCAN_LUT:
+            k->min_max(img, n, &lo, &hi);
+            histogram_stretch_lut(img, n, lo, hi);
+            break;
+        case LUT:
+            histogram_stretch_lut(img, n, min_val, max_val);
+            break;
+        default:
+            histogram_stretch_percentile(img, n, BENCH_CLIP_PERMILLE);
+            break;
+    }
+}
+
+int main(void) {
+    static const int sizes[] = { 200, 1024, 2048 };
+    char names[NUM_VARIANTS][32] = { "scan+arith scalar", "", "scan+lut", "lut", "percentile lut" };
+    int mismatches = 0;
+
+    snprintf(names[SCAN_ARITH_SIMD], sizeof(names[0]), "scan+arith %s", pixel_kernels_get()->name);
+    printf("size,variant,ms_per_mp,speedup,matches_arith\n");
+
+    for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++) {
+        int n = sizes[s] * sizes[s];
+        unsigned char* src = malloc(n);
+        unsigned char* ref = malloc(n);
+        unsigned char* img = malloc(n);
+        double mp = n / 1e6;
+        double base_ms = 0;
+
+        if (src == NULL || ref == NULL || img == NULL) {
+            printf("Error: Out of memory.\n");
+            return 1;
+        }
+        srand(7);
+        for (int i = 0; i < n; i++) {
+            src[i] = (unsigned char)(40 + rand() % 171);
+        }
+
+        for (int v = 0; v < NUM_VARIANTS; v++) {
+            double best = 1e30;
+            for (int rep = 0; rep < BENCH_REPEATS; rep++) {
+                memcpy(img, src, n);
+                double t0 = now_ms();
+                run_variant(v, img, n, 40, 210);
+                double t = now_ms() - t0;
+                if (t < best) best = t;
+            }
+            if (v == SCAN_ARITH_SCALAR) {
+                memcpy(ref, img, n);
+                base_ms = best;
+            }
+            // The percentile variant clips, so it is not expected to match.
+            int same = memcmp(ref, img, n) == 0;
+            if (v != PERCENTILE_LUT) {
+                mismatches += !same;
+            }
+            printf("%dx%d,%s,%.3f,%.2f,%s\n", sizes[s], sizes[s], names[v], best / mp, base_ms / best,
+                   (v == PERCENTILE_LUT) ? "n/a" : (same ? "yes" : "no"));
+        }
+        free(src);
+        free(ref);
+        free(img);
+    }
+    return (mismatches == 0) ? 0 : 1;
+}
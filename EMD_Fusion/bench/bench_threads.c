@@ -0,0 +1,151 @@
+/*
+ * bench_threads.c
+ *
+ * @brief Host scaling benchmark of the multi-threaded fusion pipeline.
+ *
+ * Fuses a synthetic multi-focus pair with 1..N threads, reports the wall time
+ * and speedup per thread count, and checks that every run is byte-identical to
+ * the serial chain of library calls (non-zero exit otherwise).
+ *
+ * Build and run on the host (from this directory):
+ *   gcc -O2 -pthread -I../src bench_threads.c ../src/parallel_fusion.c ../src/thread_pool.c \
+ *       ../src/emd.c ../src/decision_mask.c ../src/fusion.c ../src/pixel_kernels.c ../src/image_io.c \
+ *       ../src/led.c -o bench_threads
+ *   ./bench_threads [max_threads] [width height] [emd_mode]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include "emd.h"
+#include "decision_mask.h"
+#include "fusion.h"
+#include "parallel_fusion.h"
+
+#define BENCH_REPEATS 3
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/**
+ * Synthetic multi-focus pair: a textured scene, sharp in the left half of A
+ * and in the right half of B, box-blurred elsewhere.
+ */
+static void make_pair(unsigned char* a, unsigned char* b, int width, int height) {
+    unsigned char* sharp = malloc((size_t)width * height);
+    srand(7);
+    for (int i = 0; i < width * height; i++) {
+        sharp[i] = (unsigned char)(64 + (rand() % 128));
+    }
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int sum = 0, count = 0;
+            for (int j = y - 2; j <= y + 2; j++) {
+                for (int k = x - 2; k <= x + 2; k++) {
+                    if (j >= 0 && j < height && k >= 0 && k < width) {
+                        sum += sharp[j * width + k];
+                        count++;
+                    }
+                }
+            }
+            unsigned char blurred = (unsigned char)(sum / count);
+            int i = y * width + x;
+            a[i] = (x < width / 2) ? sharp[i] : blurred;
+            b[i] = (x < width / 2) ? blurred : sharp[i];
+        }
+    }
+    free(sharp);
+}
+
+/**
+ * Serial reference: the same library calls main() makes, on heap buffers.
+ */
+static void fuse_serial(const unsigned char* a, const unsigned char* b, int width, int height,
+                        int emd_mode, unsigned char* fused) {
+    int n = width * height;
+    int32_t* s1 = malloc((size_t)n * sizeof(int32_t));
+    int32_t* s2 = malloc((size_t)n * sizeof(int32_t));
+    int32_t* v1 = malloc((size_t)n * sizeof(int32_t));
+    int32_t* v2 = malloc((size_t)n * sizeof(int32_t));
+    int64_t* sums = malloc((size_t)2 * width * sizeof(int64_t));
+    char* mask = malloc((size_t)n);
+    emd_scratch scratch;
+
+    emd_scratch_init(&scratch, n);
+    convert_to_q16_16(a, s1, n);
+    convert_to_q16_16(b, s2, n);
+    emd_decompose_image_scratch(s1, width, height, emd_mode, &scratch);
+    emd_decompose_image_scratch(s2, width, height, emd_mode, &scratch);
+    calculate_local_variance_rows(s1, width, height, WINDOW_SIZE, 0, height, v1, sums, sums + width);
+    calculate_local_variance_rows(s2, width, height, WINDOW_SIZE, 0, height, v2, sums, sums + width);
+    generate_decision_mask(v1, v2, width, height, mask);
+    fuse_images(a, b, mask, width, height, fused);
+    histogram_stretch(fused, width, height);
+
+    emd_scratch_free(&scratch);
+    free(s1);
+    free(s2);
+    free(v1);
+    free(v2);
+    free(sums);
+    free(mask);
+}
+
+int main(int argc, char** argv) {
+    int max_threads = (argc > 1) ? atoi(argv[1]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int width = (argc > 3) ? atoi(argv[2]) : 1024;
+    int height = (argc > 3) ? atoi(argv[3]) : 1024;
+    int emd_mode = (argc > 4) ? atoi(argv[4]) : EMD_MODE_1D;
+    int n = width * height;
+    int all_identical = 1;
+
+    unsigned char* a = malloc((size_t)n);
+    unsigned char* b = malloc((size_t)n);
+    unsigned char* ref = malloc((size_t)n);
+    unsigned char* out = malloc((size_t)n);
+    if (!a || !b || !ref || !out) {
+        printf("Error: Out of memory.\n");
+        return 1;
+    }
+    make_pair(a, b, width, height);
+
+    double t0 = now_ms();
+    fuse_serial(a, b, width, height, emd_mode, ref);
+    double serial_ms = now_ms() - t0;
+    printf("serial,%.3f\n", serial_ms);
+
+    printf("threads,ms,speedup,identical\n");
+    double one_thread_ms = 0.0;
+    for (int threads = 1; threads <= max_threads; threads++) {
+        parallel_fusion pf;
+        if (parallel_fusion_init(&pf, threads, width, height) != 0) {
+            printf("Error: Cannot start %d threads.\n", threads);
+            return 1;
+        }
+        double best = 1e30;
+        for (int r = 0; r < BENCH_REPEATS; r++) {
+            double t1 = now_ms();
+            parallel_fusion_run(&pf, a, b, emd_mode, out);
+            double t2 = now_ms();
+            if (t2 - t1 < best) best = t2 - t1;
+        }
+        parallel_fusion_free(&pf);
+
+        if (threads == 1) one_thread_ms = best;
+        int identical = memcmp(ref, out, (size_t)n) == 0;
+        all_identical &= identical;
+        printf("%d,%.3f,%.2f,%s\n", threads, best, one_thread_ms / best, identical ? "yes" : "NO");
+    }
+
+    free(a);
+    free(b);
+    free(ref);
+    free(out);
+    return all_identical ? 0 : 1;
+}
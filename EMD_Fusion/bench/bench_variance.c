@@ -0,0 +1,104 @@
+/*
+ * bench_variance.c
+ *
+ * @brief Host benchmark for calculate_local_variance() over window sizes 3..31.
+ *
+ * Compares the running-sum implementation against the direct per-window loop it
+ * replaced: the output must be bit-identical, and the timing shows the direct
+ * loop growing with window_size^2 while the running sums stay flat.
+ *
+ * Build and run on the host (from this directory):
+ *   gcc -O2 -I../src bench_variance.c ../src/decision_mask.c ../src/led.c -o bench_variance
+ *   ./bench_variance [width height]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "decision_mask.h"
+
+#define BENCH_REPEATS 5
+
+/**
+ * Direct O(window^2) local variance, as implemented before the running sums.
+ */
+static void variance_direct(const int32_t* imf, int width, int height, int window_size, int32_t* variance_map) {
+    const int half_window = window_size / 2;
+    for (int y = 0; y < height; y++) {
+        int y_start = (y - half_window < 0) ? 0 : (y - half_window);
+        int y_end   = (y + half_window >= height) ? (height - 1) : (y + half_window);
+
+        for (int x = 0; x < width; x++) {
+            int x_start = (x - half_window < 0) ? 0 : (x - half_window);
+            int x_end   = (x + half_window >= width) ? (width - 1) : (x + half_window);
+
+            int64_t sum = 0;
+            int64_t sum_sq = 0;
+            int count = 0;
+            for (int j = y_start; j <= y_end; j++) {
+                for (int k = x_start; k <= x_end; k++) {
+                    int32_t val = imf[j * width + k];
+                    sum += val;
+                    sum_sq += ((int64_t)val * val) >> 16;
+                    count++;
+                }
+            }
+
+            int32_t mean = (int32_t)(sum / count);
+            int32_t var = (int32_t)((sum_sq / count) - (((int64_t)mean * mean) >> 16));
+            variance_map[y * width + x] = var;
+        }
+    }
+}
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+int main(int argc, char** argv) {
+    int width = (argc > 2) ? atoi(argv[1]) : 512;
+    int height = (argc > 2) ? atoi(argv[2]) : 512;
+    int num_pixels = width * height;
+
+    int32_t* imf = malloc((size_t)num_pixels * sizeof(int32_t));
+    int32_t* var_fast = malloc((size_t)num_pixels * sizeof(int32_t));
+    int32_t* var_ref = malloc((size_t)num_pixels * sizeof(int32_t));
+    if (imf == NULL || var_fast == NULL || var_ref == NULL) {
+        printf("Error: Out of memory.\n");
+        return 1;
+    }
+
+    // Zero-mean IMF-like input in Q16.16.
+    srand(1);
+    for (int i = 0; i < num_pixels; i++) {
+        imf[i] = ((rand() % 256) - 128) << 16;
+    }
+
+    printf("window,direct_ms,running_ms,speedup,identical\n");
+    int all_identical = 1;
+    for (int window = 3; window <= 31; window += 2) {
+        double direct_ms = 1e30, running_ms = 1e30;
+        for (int r = 0; r < BENCH_REPEATS; r++) {
+            double t0 = now_ms();
+            variance_direct(imf, width, height, window, var_ref);
+            double t1 = now_ms();
+            calculate_local_variance(imf, width, height, window, var_fast);
+            double t2 = now_ms();
+            if (t1 - t0 < direct_ms) direct_ms = t1 - t0;
+            if (t2 - t1 < running_ms) running_ms = t2 - t1;
+        }
+        int identical = memcmp(var_ref, var_fast, (size_t)num_pixels * sizeof(int32_t)) == 0;
+        all_identical &= identical;
+        printf("%d,%.3f,%.3f,%.2f,%s\n", window, direct_ms, running_ms,
+               direct_ms / running_ms, identical ? "yes" : "NO");
+    }
+
+    free(imf);
+    free(var_fast);
+    free(var_ref);
+    return all_identical ? 0 : 1;
+}
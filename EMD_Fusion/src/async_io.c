@@ -0,0 +1,439 @@
+/*
+ * async_io.c
+ *
+ */
+
+#include "async_io.h"
+
+#if !defined(__ADSP21000__)
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+/* io_uring is driven through its system calls, so no library is needed; the
+   kernel header only has to be present at build time. */
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#include <linux/io_uring.h>
+#define ASYNC_IO_HAVE_URING 1
+#endif
+#endif
+#ifndef ASYNC_IO_HAVE_URING
+#define ASYNC_IO_HAVE_URING 0
+#endif
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+const char* async_io_backend_name(int backend) {
+    switch (backend) {
+        case ASYNC_IO_NONE:   return "none";
+        case ASYNC_IO_THREAD: return "thread";
+        case ASYNC_IO_URING:  return "io_uring";
+        case ASYNC_IO_AUTO:   return "auto";
+        default:              return "?";
+    }
+}
+
+static void fill_request(async_io_request* req, int op, int fd, unsigned char* data, size_t size,
+                         long long offset) {
+    req->op = op;
+    req->fd = fd;
+    req->data = data;
+    req->size = size;
+    req->offset = offset;
+    req->transferred = 0;
+    req->state = ASYNC_IO_PENDING;
+    req->submit_ms = now_ms();
+    req->done_ms = req->submit_ms;
+    req->next = NULL;
+}
+
+/* ---- Thread backend ---------------------------------------------------- */
+
+/** Transfer the whole request with pread()/pwrite(), continuing after short transfers. */
+static int transfer(async_io_request* req) {
+    while (req->transferred < req->size) {
+        unsigned char* p = req->data + req->transferred;
+        size_t left = req->size - req->transferred;
+        off_t at = (off_t)(req->offset + (long long)req->transferred);
+        ssize_t n = (req->op == ASYNC_IO_READ) ? pread(req->fd, p, left, at) : pwrite(req->fd, p, left, at);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            // An error, or end of file before the whole buffer was read.
+            return ASYNC_IO_FAILED;
+        }
+        req->transferred += (size_t)n;
+    }
+    return ASYNC_IO_DONE;
+}
+
+static void* io_thread_main(void* arg) {
+    async_io* io = (async_io*)arg;
+
+    pthread_mutex_lock(&io->lock);
+    for (;;) {
+        while (io->head == NULL && !io->stop) {
+            pthread_cond_wait(&io->work, &io->lock);
+        }
+        async_io_request* req = io->head;
+        if (req == NULL) {
+            break;
+        }
+        io->head = req->next;
+        if (io->head == NULL) {
+            io->tail = NULL;
+        }
+        pthread_mutex_unlock(&io->lock);
+
+        int state = transfer(req);
+
+        pthread_mutex_lock(&io->lock);
+        req->done_ms = now_ms();
+        req->state = state;
+        io->in_flight--;
+        pthread_cond_broadcast(&io->done);
+    }
+    pthread_mutex_unlock(&io->lock);
+    return NULL;
+}
+
+static int thread_init(async_io* io) {
+    io->head = io->tail = NULL;
+    io->stop = 0;
+    if (pthread_mutex_init(&io->lock, NULL) != 0) {
+        return -1;
+    }
+    if (pthread_cond_init(&io->work, NULL) != 0) {
+        pthread_mutex_destroy(&io->lock);
+        return -1;
+    }
+    if (pthread_cond_init(&io->done, NULL) != 0) {
+        pthread_cond_destroy(&io->work);
+        pthread_mutex_destroy(&io->lock);
+        return -1;
+    }
+    if (pthread_create(&io->thread, NULL, io_thread_main, io) != 0) {
+        pthread_cond_destroy(&io->done);
+        pthread_cond_destroy(&io->work);
+        pthread_mutex_destroy(&io->lock);
+        return -1;
+    }
+    io->backend = ASYNC_IO_THREAD;
+    return 0;
+}
+
+static void thread_free(async_io* io) {
+    pthread_mutex_lock(&io->lock);
+    io->stop = 1;
+    pthread_cond_signal(&io->work);
+    pthread_mutex_unlock(&io->lock);
+    pthread_join(io->thread, NULL);
+    pthread_cond_destroy(&io->done);
+    pthread_cond_destroy(&io->work);
+    pthread_mutex_destroy(&io->lock);
+}
+
+/* ---- io_uring backend -------------------------------------------------- */
+
+#if ASYNC_IO_HAVE_URING
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int uring_init(async_io* io) {
+    struct io_uring_params params;
+
+    memset(&params, 0, sizeof(params));
+    int fd = (int)syscall(__NR_io_uring_setup, ASYNC_IO_DEPTH, &params);
+    if (fd < 0) {
+        return -1;
+    }
+
+    io->ring_fd = fd;
+    io->sq_ring_bytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    io->cq_ring_bytes = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    // Kernels with IORING_FEAT_SINGLE_MMAP (5.4 and later) share one mapping for both rings.
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (io->cq_ring_bytes > io->sq_ring_bytes) {
+            io->sq_ring_bytes = io->cq_ring_bytes;
+        }
+        io->cq_ring_bytes = 0;
+    }
+    io->sq_ring = mmap(NULL, io->sq_ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                       IORING_OFF_SQ_RING);
+    io->cq_ring = io->sq_ring;
+    if (io->sq_ring != MAP_FAILED && io->cq_ring_bytes > 0) {
+        io->cq_ring = mmap(NULL, io->cq_ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                           IORING_OFF_CQ_RING);
+    }
+    io->sqes_bytes = params.sq_entries * sizeof(struct io_uring_sqe);
+    io->sqes = MAP_FAILED;
+    if (io->sq_ring != MAP_FAILED && io->cq_ring != MAP_FAILED) {
+        io->sqes = mmap(NULL, io->sqes_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                        IORING_OFF_SQES);
+    }
+    if (io->sqes == MAP_FAILED) {
+        if (io->cq_ring != MAP_FAILED && io->cq_ring_bytes > 0) munmap(io->cq_ring, io->cq_ring_bytes);
+        if (io->sq_ring != MAP_FAILED) munmap(io->sq_ring, io->sq_ring_bytes);
+        close(fd);
+        return -1;
+    }
+
+    unsigned char* sq = (unsigned char*)io->sq_ring;
+    unsigned char* cq = (unsigned char*)io->cq_ring;
+    io->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    io->sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+    io->sq_array = (unsigned*)(sq + params.sq_off.array);
+    io->cq_head = (unsigned*)(cq + params.cq_off.head);
+    io->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    io->cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+    io->cqes = cq + params.cq_off.cqes;
+#ifdef IOSQE_ASYNC
+    // Without it a read from the page cache is copied inside the submitting call.
+    io->sqe_flags = IOSQE_ASYNC;
+#endif
+    io->backend = ASYNC_IO_URING;
+    return 0;
+}
+
+static void uring_free(async_io* io) {
+    munmap(io->sqes, io->sqes_bytes);
+    if (io->cq_ring_bytes > 0) {
+        munmap(io->cq_ring, io->cq_ring_bytes);
+    }
+    munmap(io->sq_ring, io->sq_ring_bytes);
+    close(io->ring_fd);
+}
+
+/**
+ * Queue the untransferred part of a request and hand it to the kernel. The owner
+ * keeps at most ASYNC_IO_DEPTH requests in flight, so a slot is always free.
+ */
+static int uring_push(async_io* io, async_io_request* req) {
+    unsigned tail = *io->sq_tail;
+    unsigned index = tail & *io->sq_mask;
+    struct io_uring_sqe* sqe = (struct io_uring_sqe*)io->sqes + index;
+
+    req->iov.iov_base = req->data + req->transferred;
+    req->iov.iov_len = req->size - req->transferred;
+    memset(sqe, 0, sizeof(*sqe));
+    // The vectored operations are the ones every io_uring kernel (5.1 and later) has.
+    sqe->opcode = (req->op == ASYNC_IO_READ) ? IORING_OP_READV : IORING_OP_WRITEV;
+    sqe->flags = (unsigned char)io->sqe_flags;
+    sqe->fd = req->fd;
+    sqe->addr = (uint64_t)(uintptr_t)&req->iov;
+    sqe->len = 1;
+    sqe->off = (uint64_t)(req->offset + (long long)req->transferred);
+    sqe->user_data = (uint64_t)(uintptr_t)req;
+    io->sq_array[index] = index;
+    __atomic_store_n(io->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    for (;;) {
+        int rc = uring_enter(io->ring_fd, 1, 0, 0);
+        if (rc >= 0) {
+            return 0;
+        }
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            return -1;
+        }
+    }
+}
+
+/** Take the completions off the ring, continuing short and interrupted transfers. */
+static void uring_reap(async_io* io) {
+    unsigned head = *io->cq_head;
+    unsigned tail = __atomic_load_n(io->cq_tail, __ATOMIC_ACQUIRE);
+    async_io_request* resubmit = NULL;
+
+    if (head == tail) {
+        return;
+    }
+    double t = now_ms();
+    while (head != tail) {
+        struct io_uring_cqe* cqe = (struct io_uring_cqe*)io->cqes + (head & *io->cq_mask);
+        async_io_request* req = (async_io_request*)(uintptr_t)cqe->user_data;
+        int res = cqe->res;
+        head++;
+
+        if (res == -EINVAL && io->sqe_flags != 0) {
+            // Kernels before 5.6 reject IOSQE_ASYNC: submit without it from now on.
+            io->sqe_flags = 0;
+            res = -EAGAIN;
+        }
+        if (res == -EINTR || res == -EAGAIN || (res > 0 && req->transferred + (size_t)res < req->size)) {
+            req->transferred += (res > 0) ? (size_t)res : 0;
+            req->next = resubmit;
+            resubmit = req;
+            continue;
+        }
+        if (res > 0) {
+            req->transferred += (size_t)res;
+        }
+        req->done_ms = t;
+        req->state = (res > 0) ? ASYNC_IO_DONE : ASYNC_IO_FAILED;
+        io->in_flight--;
+    }
+    __atomic_store_n(io->cq_head, head, __ATOMIC_RELEASE);
+
+    // The rest of a short transfer goes back on the ring; its completion slot was just freed.
+    while (resubmit != NULL) {
+        async_io_request* req = resubmit;
+        resubmit = req->next;
+        if (uring_push(io, req) != 0) {
+            req->done_ms = now_ms();
+            req->state = ASYNC_IO_FAILED;
+            io->in_flight--;
+        }
+    }
+}
+
+/** Block until at least one completion has arrived. */
+static void uring_wait_one(async_io* io) {
+    if (uring_enter(io->ring_fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+        // The ring cannot wait; poll it instead so that no completion is missed.
+        sched_yield();
+    }
+}
+#endif /* ASYNC_IO_HAVE_URING */
+
+/* ---- Public interface -------------------------------------------------- */
+
+int async_io_init(async_io* io, int backend) {
+    memset(io, 0, sizeof(*io));
+    io->ring_fd = -1;
+#if ASYNC_IO_HAVE_URING
+    if (backend == ASYNC_IO_URING || backend == ASYNC_IO_AUTO) {
+        if (uring_init(io) == 0) {
+            return 0;
+        }
+        if (backend == ASYNC_IO_URING) {
+            printf("Error: io_uring is not available (%s).\n", strerror(errno));
+            return -1;
+        }
+    }
+#else
+    if (backend == ASYNC_IO_URING) {
+        printf("Error: io_uring is not available in this build.\n");
+        return -1;
+    }
+#endif
+    if (backend != ASYNC_IO_THREAD && backend != ASYNC_IO_URING && backend != ASYNC_IO_AUTO) {
+        printf("Error: Unknown I/O backend %d.\n", backend);
+        return -1;
+    }
+    if (thread_init(io) != 0) {
+        printf("Error: Cannot start the I/O thread.\n");
+        return -1;
+    }
+    return 0;
+}
+
+double async_io_submit(async_io* io, async_io_request* req, int op, int fd, unsigned char* data, size_t size,
+                       long long offset) {
+    fill_request(req, op, fd, data, size, offset);
+    if (size == 0) {
+        req->state = ASYNC_IO_DONE;
+        return 0.0;
+    }
+#if ASYNC_IO_HAVE_URING
+    if (io->backend == ASYNC_IO_URING) {
+        while (io->in_flight >= ASYNC_IO_DEPTH) {
+            uring_wait_one(io);
+            uring_reap(io);
+        }
+        io->in_flight++;
+        if (uring_push(io, req) != 0) {
+            req->state = ASYNC_IO_FAILED;
+            io->in_flight--;
+        }
+        // Requests the kernel completed during submission are stamped now.
+        uring_reap(io);
+        return now_ms() - req->submit_ms;
+    }
+#endif
+    pthread_mutex_lock(&io->lock);
+    if (io->tail != NULL) {
+        io->tail->next = req;
+    } else {
+        io->head = req;
+    }
+    io->tail = req;
+    io->in_flight++;
+    pthread_cond_signal(&io->work);
+    pthread_mutex_unlock(&io->lock);
+    return now_ms() - req->submit_ms;
+}
+
+void async_io_poll(async_io* io) {
+#if ASYNC_IO_HAVE_URING
+    if (io->backend == ASYNC_IO_URING) {
+        uring_reap(io);
+    }
+#else
+    (void)io;
+#endif
+}
+
+double async_io_wait(async_io* io, async_io_request* req) {
+    double t0;
+
+#if ASYNC_IO_HAVE_URING
+    if (io->backend == ASYNC_IO_URING) {
+        uring_reap(io);
+        if (req->state != ASYNC_IO_PENDING) {
+            return 0.0;
+        }
+        t0 = now_ms();
+        while (req->state == ASYNC_IO_PENDING) {
+            uring_wait_one(io);
+            uring_reap(io);
+        }
+        return now_ms() - t0;
+    }
+#endif
+    pthread_mutex_lock(&io->lock);
+    if (req->state != ASYNC_IO_PENDING) {
+        pthread_mutex_unlock(&io->lock);
+        return 0.0;
+    }
+    t0 = now_ms();
+    while (req->state == ASYNC_IO_PENDING) {
+        pthread_cond_wait(&io->done, &io->lock);
+    }
+    pthread_mutex_unlock(&io->lock);
+    // The owner sees the completion only once it runs again, which on a busy core can be later.
+    double t1 = now_ms();
+    if (req->done_ms < t1) {
+        req->done_ms = t1;
+    }
+    return t1 - t0;
+}
+
+void async_io_free(async_io* io) {
+#if ASYNC_IO_HAVE_URING
+    if (io->backend == ASYNC_IO_URING) {
+        uring_free(io);
+        io->backend = ASYNC_IO_NONE;
+        return;
+    }
+#endif
+    if (io->backend == ASYNC_IO_THREAD) {
+        thread_free(io);
+    }
+    io->backend = ASYNC_IO_NONE;
+}
+
+#endif /* !__ADSP21000__ */
@@ -0,0 +1,170 @@
+/*
+ * async_io.h
+ *
+ * @brief Header file for the asynchronous file I/O engine (hosted builds only).
+ *
+ * An engine runs whole-buffer reads and writes (pread()/pwrite() semantics at
+ * an offset) while its owner computes, so that the input of the next frame
+ * is read ahead and the output of the last one is written behind. Requests
+ * are submitted without blocking and waited for when their buffer is needed.
+ *
+ * Two backends do the work:
+ *   - io_uring (Linux 5.1 and later): the requests go to the kernel ring and
+ *     no thread is started. Completions are seen by async_io_poll() and
+ *     async_io_wait().
+ *   - a dedicated I/O thread that runs the requests in order with pread()
+ *     and pwrite(), for kernels or sandboxes without io_uring.
+ * ASYNC_IO_AUTO takes io_uring when the kernel allows it and the thread
+ * otherwise. Short transfers are continued until the whole buffer is done.
+ *
+ * Each request records when it was submitted and when it completed, and
+ * async_io_wait() returns how long the caller was blocked, so an owner can
+ * split the I/O time of a frame into the part hidden behind its compute and
+ * the part exposed on its critical path. A completion the owner waited for
+ * is stamped when the owner wakes up. The I/O thread stamps the others when
+ * they happen. io_uring has no such thread: its completions are stamped when
+ * async_io_poll() or async_io_wait() next looks at the ring, which may be a
+ * whole compute stage later. Its done_ms - submit_ms is then only an upper
+ * bound, and the hidden share must be measured against synchronous I/O.
+ *
+ * An engine, and every request it runs, belongs to one thread; independent
+ * engines may run concurrently.
+ */
+
+#ifndef ASYNC_IO_H_
+#define ASYNC_IO_H_
+
+#if !defined(__ADSP21000__)
+
+#include <stddef.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+/** @brief Backends. */
+#define ASYNC_IO_NONE   0  /**< No engine: the caller reads and writes synchronously. */
+#define ASYNC_IO_THREAD 1  /**< pread()/pwrite() on a dedicated thread. */
+#define ASYNC_IO_URING  2  /**< io_uring, without a thread. */
+#define ASYNC_IO_AUTO   3  /**< io_uring if available, the thread otherwise. */
+
+/** @brief Operations. */
+#define ASYNC_IO_READ  0
+#define ASYNC_IO_WRITE 1
+
+/** @brief Request states. */
+#define ASYNC_IO_PENDING 0  /**< Submitted, not complete. */
+#define ASYNC_IO_DONE    1  /**< The whole buffer was transferred. */
+#define ASYNC_IO_FAILED  2  /**< An error, or end of file before the whole buffer was read. */
+
+/** @brief io_uring queue depth; submitting more requests than this waits for one to complete. */
+#define ASYNC_IO_DEPTH 16
+
+/**
+ * @brief One read or write of a whole buffer.
+ */
+typedef struct async_io_request {
+    int op;                         /**< ASYNC_IO_READ or ASYNC_IO_WRITE. */
+    int fd;                         /**< Open file descriptor. */
+    unsigned char* data;            /**< Buffer of size bytes. */
+    size_t size;                    /**< Bytes to transfer. */
+    long long offset;               /**< File offset of data[0]. */
+    size_t transferred;             /**< Bytes transferred so far. */
+    volatile int state;             /**< ASYNC_IO_PENDING, _DONE or _FAILED. */
+    double submit_ms;               /**< Time of async_io_submit(). */
+    double done_ms;                 /**< Time the completion was seen (see above for io_uring). */
+    struct iovec iov;               /**< Remaining part of the buffer (io_uring). */
+    struct async_io_request* next;  /**< Queue link (thread backend). */
+} async_io_request;
+
+/**
+ * @brief State of one engine.
+ */
+typedef struct {
+    int backend;                /**< ASYNC_IO_THREAD or ASYNC_IO_URING once initialized. */
+    int in_flight;              /**< Requests submitted and not seen complete. */
+    /* Thread backend. */
+    pthread_t thread;           /**< I/O thread. */
+    pthread_mutex_t lock;       /**< Guards the queue, the states and stop. */
+    pthread_cond_t work;        /**< Signalled on a new request or stop. */
+    pthread_cond_t done;        /**< Signalled when a request completes. */
+    async_io_request* head;     /**< First queued request. */
+    async_io_request* tail;     /**< Last queued request. */
+    int stop;                   /**< Set to end the I/O thread. */
+    /* io_uring backend. */
+    int ring_fd;                /**< Ring file descriptor. */
+    void* sq_ring;              /**< Submission ring mapping. */
+    size_t sq_ring_bytes;       /**< Length of the submission ring mapping. */
+    void* cq_ring;              /**< Completion ring mapping (sq_ring if shared). */
+    size_t cq_ring_bytes;       /**< Length of the completion ring mapping. */
+    void* sqes;                 /**< Submission entries. */
+    size_t sqes_bytes;          /**< Length of the submission entries mapping. */
+    unsigned* sq_tail;          /**< Submission ring tail, advanced by the owner. */
+    unsigned* sq_mask;          /**< Submission ring index mask. */
+    unsigned* sq_array;         /**< Submission ring, indices into sqes. */
+    unsigned* cq_head;          /**< Completion ring head, advanced by the owner. */
+    unsigned* cq_tail;          /**< Completion ring tail, advanced by the kernel. */
+    unsigned* cq_mask;          /**< Completion ring index mask. */
+    void* cqes;                 /**< Completion entries. */
+    unsigned sqe_flags;         /**< IOSQE_ASYNC while the kernel accepts it, else 0. */
+} async_io;
+
+/**
+ * @brief Start an engine.
+ *
+ * @param io      Engine to initialize.
+ * @param backend ASYNC_IO_THREAD, ASYNC_IO_URING or ASYNC_IO_AUTO.
+ * @return 0 on success (io->backend tells which backend runs), -1 if the backend cannot start.
+ */
+int async_io_init(async_io* io, int backend);
+
+/**
+ * @brief Submit a read or write of a whole buffer.
+ *
+ * The buffer and the descriptor must stay valid until the request is complete.
+ * With io_uring the request is handed to the kernel's workers rather than run
+ * inline, where the kernel allows it, so submitting does not block on the copy.
+ *
+ * @param io     Engine.
+ * @param req    Request to fill and submit, not in flight.
+ * @param op     ASYNC_IO_READ or ASYNC_IO_WRITE.
+ * @param fd     Open file descriptor.
+ * @param data   Buffer.
+ * @param size   Bytes to transfer.
+ * @param offset File offset.
+ * @return Milliseconds the call took, which are exposed I/O time.
+ */
+double async_io_submit(async_io* io, async_io_request* req, int op, int fd, unsigned char* data, size_t size,
+                     long long offset);
+
+/**
+ * @brief Note the completions that have arrived, without blocking.
+ *
+ * Only the io_uring backend needs it; the I/O thread stamps its completions itself.
+ *
+ * @param io Engine.
+ */
+void async_io_poll(async_io* io);
+
+/**
+ * @brief Wait for a request to complete.
+ *
+ * @param io  Engine.
+ * @param req Submitted request.
+ * @return Milliseconds the caller was blocked, 0 if the request was already complete.
+ */
+double async_io_wait(async_io* io, async_io_request* req);
+
+/**
+ * @brief Stop an engine. Every submitted request must have been waited for.
+ *
+ * @param io Engine to release.
+ */
+void async_io_free(async_io* io);
+
+/**
+ * @brief Name of a backend, e.g. "io_uring" or "thread".
+ */
+const char* async_io_backend_name(int backend);
+
+#endif /* !__ADSP21000__ */
+
+#endif /* ASYNC_IO_H_ */
@@ -0,0 +1,671 @@
+/*
+ * batch_fusion.c
+ *
+ */
+
+#include "batch_fusion.h"
+
+#if !defined(__ADSP21000__)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "image_io.h"
+
+/** @brief Longest manifest line. */
+#define BATCH_LINE_MAX 4096
+
+/** Pair indices of one worker; the owner takes from head, thieves from tail. */
+typedef struct {
+    pthread_mutex_t lock;
+    int* jobs;
+    int head;
+    int tail;
+} batch_deque;
+
+/** State shared by the workers of one run. */
+typedef struct {
+    const batch_list* list;
+    const emd_fusion_config* config;
+    int format;
+    int io_backend;
+    int num_workers;
+    batch_deque* deques;
+    batch_result* results;
+} batch_run;
+
+typedef struct {
+    batch_run* run;
+    int id;
+    int io_backend;  /**< Backend the worker ran. */
+} batch_worker;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static const char* format_extension(int format) {
+    return (format == IMAGE_FORMAT_PGM) ? ".pgm" :
+           (format == IMAGE_FORMAT_PPM) ? ".ppm" :
+           (format == IMAGE_FORMAT_BMP || format == IMAGE_FORMAT_BMP24) ? ".bmp" : ".bin";
+}
+
+static char* join_path(const char* dir, const char* name, const char* ext) {
+    size_t length = strlen(dir) + 1 + strlen(name) + strlen(ext) + 1;
+    char* path = malloc(length);
+    if (path != NULL) {
+        snprintf(path, length, "%s/%s%s", dir, name, ext);
+    }
+    return path;
+}
+
+static long long file_bytes(const char* path) {
+    struct stat st;
+    return (stat(path, &st) == 0) ? (long long)st.st_size : 0;
+}
+
+static int add_pair(batch_list* list, const char* image_a, const char* image_b, const char* out_dir,
+                    const char* name, const char* ext) {
+    if (list->count == list->capacity) {
+        int capacity = list->capacity ? 2 * list->capacity : 64;
+        batch_pair* grown = realloc(list->pairs, (size_t)capacity * sizeof(batch_pair));
+        if (grown == NULL) {
+            printf("Error: Out of memory.\n");
+            return -1;
+        }
+        list->pairs = grown;
+        list->capacity = capacity;
+    }
+
+    batch_pair* pair = &list->pairs[list->count];
+    pair->image_a = strdup(image_a);
+    pair->image_b = strdup(image_b);
+    pair->output = join_path(out_dir, name, ext);
+    pair->bytes = file_bytes(image_a) + file_bytes(image_b);
+    if (pair->image_a == NULL || pair->image_b == NULL || pair->output == NULL) {
+        free(pair->image_a);
+        free(pair->image_b);
+        free(pair->output);
+        printf("Error: Out of memory.\n");
+        return -1;
+    }
+    list->count++;
+    return 0;
+}
+
+/** Output name of an input path: the file name without directory and extension. */
+static void stem_of(const char* path, char* stem, size_t size) {
+    const char* name = strrchr(path, '/');
+    name = (name != NULL) ? name + 1 : path;
+    snprintf(stem, size, "%s", name);
+    char* dot = strrchr(stem, '.');
+    if (dot != NULL && dot != stem) {
+        *dot = '\0';
+    }
+}
+
+static int load_manifest(FILE* fp, const char* out_dir, const char* ext, batch_list* list) {
+    char line[BATCH_LINE_MAX];
+    char image_a[BATCH_LINE_MAX], image_b[BATCH_LINE_MAX], output[BATCH_LINE_MAX];
+    int line_number = 0;
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        line_number++;
+        int fields = sscanf(line, "%4095s %4095s %4095s", image_a, image_b, output);
+        if (fields <= 0 || image_a[0] == '#') {
+            continue;
+        }
+        if (fields == 1) {
+            printf("Error: Manifest line %d has no image B; skipped.\n", line_number);
+            continue;
+        }
+        if (fields == 2) {
+            char stem[BATCH_LINE_MAX];
+            stem_of(image_a, stem, sizeof(stem));
+            if (add_pair(list, image_a, image_b, out_dir, stem, ext) != 0) return -1;
+        } else if (add_pair(list, image_a, image_b, out_dir, output, "") != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int load_directory(const char* dir, const char* out_dir, const char* ext, batch_list* list) {
+    struct dirent** entries;
+    int num_entries = scandir(dir, &entries, NULL, alphasort);
+    int rc = 0;
+    if (num_entries < 0) {
+        printf("Error: Cannot read directory %s.\n", dir);
+        return -1;
+    }
+
+    for (int i = 0; i < num_entries && rc == 0; i++) {
+        // <stem>a.<ext> pairs with <stem>b.<ext>.
+        const char* name = entries[i]->d_name;
+        const char* dot = strrchr(name, '.');
+        size_t stem_length = (dot != NULL) ? (size_t)(dot - name) : strlen(name);
+        if (stem_length < 2 || name[stem_length - 1] != 'a') {
+            continue;
+        }
+        char partner[BATCH_LINE_MAX];
+        snprintf(partner, sizeof(partner), "%s", name);
+        partner[stem_length - 1] = 'b';
+
+        char* path_a = join_path(dir, name, "");
+        char* path_b = join_path(dir, partner, "");
+        if (path_a == NULL || path_b == NULL) {
+            printf("Error: Out of memory.\n");
+            rc = -1;
+        } else if (file_bytes(path_b) > 0) {
+            char stem[BATCH_LINE_MAX];
+            snprintf(stem, sizeof(stem), "%.*s", (int)(stem_length - 1), name);
+            rc = add_pair(list, path_a, path_b, out_dir, stem, ext);
+        }
+        free(path_a);
+        free(path_b);
+    }
+
+    for (int i = 0; i < num_entries; i++) {
+        free(entries[i]);
+    }
+    free(entries);
+    return rc;
+}
+
+int batch_list_load(const char* source, const char* out_dir, int format, batch_list* list) {
+    struct stat st;
+    int rc;
+
+    memset(list, 0, sizeof(*list));
+    if (stat(source, &st) != 0) {
+        printf("Error: Cannot open %s.\n", source);
+        return -1;
+    }
+    if (mkdir(out_dir, 0777) != 0 && errno != EEXIST) {
+        printf("Error: Cannot create directory %s.\n", out_dir);
+        return -1;
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+        rc = load_directory(source, out_dir, format_extension(format), list);
+    } else {
+        FILE* fp = fopen(source, "r");
+        if (fp == NULL) {
+            printf("Error: Cannot open %s.\n", source);
+            return -1;
+        }
+        rc = load_manifest(fp, out_dir, format_extension(format), list);
+        fclose(fp);
+    }
+    if (rc != 0) {
+        batch_list_free(list);
+    }
+    return rc;
+}
+
+void batch_list_free(batch_list* list) {
+    for (int i = 0; i < list->count; i++) {
+        free(list->pairs[i].image_a);
+        free(list->pairs[i].image_b);
+        free(list->pairs[i].output);
+    }
+    free(list->pairs);
+    memset(list, 0, sizeof(*list));
+}
+
+const char* batch_status_name(int status) {
+    switch (status) {
+        case BATCH_OK:          return "ok";
+        case BATCH_ERROR_READ:  return "read";
+        case BATCH_ERROR_SIZE:  return "size";
+        case BATCH_ERROR_WRITE: return "write";
+        default:                return "?";
+    }
+}
+
+/** Next pair for a worker: its own largest, else the smallest left in another deque; -1 when all are empty. */
+static int next_job(batch_run* run, int id) {
+    int job = -1;
+    batch_deque* own = &run->deques[id];
+
+    pthread_mutex_lock(&own->lock);
+    if (own->head < own->tail) {
+        job = own->jobs[own->head++];
+    }
+    pthread_mutex_unlock(&own->lock);
+
+    for (int k = 1; k < run->num_workers && job < 0; k++) {
+        batch_deque* victim = &run->deques[(id + k) % run->num_workers];
+        pthread_mutex_lock(&victim->lock);
+        if (victim->head < victim->tail) {
+            job = victim->jobs[--victim->tail];
+        }
+        pthread_mutex_unlock(&victim->lock);
+    }
+    return job;
+}
+
+/** Check a pair, grow the worker's context and output buffer to it, and fuse it into *fused. */
+static int fuse_views(const batch_run* run, const batch_pair* pair, const image_view* a, const image_view* b,
+                      emd_fusion_ctx* ctx, unsigned char** fused, size_t* fused_capacity,
+                      batch_result* result) {
+    int status = BATCH_OK;
+
+    // A colour context fuses interleaved RGB and writes three bytes per pixel.
+    unsigned int channels = run->config->color ? 3 : 1;
+    size_t num_bytes = (size_t)a->width * a->height * channels;
+    result->width = (int)a->width;
+    result->height = (int)a->height;
+    if (a->width != b->width || a->height != b->height) {
+        printf("Error: %s and %s differ in size.\n", pair->image_a, pair->image_b);
+        status = BATCH_ERROR_SIZE;
+    } else if (a->channels != channels || b->channels != channels) {
+        printf("Error: %s and %s are not both %s.\n", pair->image_a, pair->image_b,
+               (channels == 3) ? "colour" : "grayscale");
+        status = BATCH_ERROR_SIZE;
+    } else if (num_bytes > *fused_capacity) {
+        free(*fused);
+        *fused = malloc(num_bytes);
+        *fused_capacity = (*fused != NULL) ? num_bytes : 0;
+        if (*fused == NULL) {
+            printf("Error: Out of memory.\n");
+            status = BATCH_ERROR_SIZE;
+        }
+    }
+    // A failed resize leaves the context unusable, so it is created again.
+    if (status == BATCH_OK && emd_fusion_resize(ctx, (int)a->width, (int)a->height) != 0) {
+        emd_fusion_free(ctx);
+        emd_fusion_init(ctx, 1, 1, run->config, NULL, 0);
+        status = BATCH_ERROR_SIZE;
+    }
+
+    if (status == BATCH_OK) {
+        double t0 = now_ms();
+        int rc = (channels == 3) ? emd_fusion_run_rgb(ctx, a->pixels, b->pixels, *fused)
+                                 : emd_fusion_run(ctx, a->pixels, b->pixels, *fused);
+        result->fuse_ms = now_ms() - t0;
+        if (rc != 0) {
+            status = BATCH_ERROR_SIZE;
+        }
+    }
+    return status;
+}
+
+/** Fuse one pair with the worker's context and output buffer, mapping the inputs and writing synchronously. */
+static int fuse_pair(const batch_run* run, const batch_pair* pair, emd_fusion_ctx* ctx,
+                     unsigned char** fused, size_t* fused_capacity, batch_result* result) {
+    image_view a, b;
+
+    if (image_open(pair->image_a, &a) != 0) {
+        return BATCH_ERROR_READ;
+    }
+    if (image_open(pair->image_b, &b) != 0) {
+        image_close(&a);
+        return BATCH_ERROR_READ;
+    }
+
+    int status = fuse_views(run, pair, &a, &b, ctx, fused, fused_capacity, result);
+    if (status == BATCH_OK && image_save(pair->output, run->format, a.width, a.height, *fused) != 0) {
+        status = BATCH_ERROR_WRITE;
+    }
+
+    image_close(&a);
+    image_close(&b);
+    return status;
+}
+
+/** Inputs of one pair being read ahead: both files, each in a recycled buffer. */
+typedef struct {
+    int job;                     /**< Pair index, -1 when unused. */
+    int status;                  /**< BATCH_ERROR_READ if a file could not be opened. */
+    int fd[2];
+    unsigned char* data[2];
+    size_t capacity[2];
+    async_io_request read[2];
+} batch_input;
+
+/** One write-behind output: a recycled buffer and the write in flight from it. */
+typedef struct {
+    int job;                     /**< Pair being written, -1 when the buffer is free. */
+    int fd;
+    unsigned char* data;
+    size_t capacity;
+    async_io_request write;
+} batch_output;
+
+/**
+ * Open both inputs of a pair and submit their reads into the slot's buffers. The
+ * time the submissions took is exposed I/O of that pair; it is returned.
+ */
+static double read_ahead(const batch_run* run, async_io* io, batch_input* in, int job) {
+    const batch_pair* pair = &run->list->pairs[job];
+    const char* paths[2] = { pair->image_a, pair->image_b };
+    double blocked = 0.0;
+
+    in->job = job;
+    in->status = BATCH_OK;
+    for (int i = 0; i < 2; i++) {
+        struct stat st;
+        in->fd[i] = -1;
+        in->read[i].state = ASYNC_IO_FAILED;
+        if (in->status != BATCH_OK) {
+            continue;
+        }
+        int fd = open(paths[i], O_RDONLY);
+        if (fd < 0) {
+            printf("Error: Cannot open image %s.\n", paths[i]);
+            in->status = BATCH_ERROR_READ;
+            continue;
+        }
+        size_t size = (fstat(fd, &st) == 0 && st.st_size > 0) ? (size_t)st.st_size : 0;
+        if (size > in->capacity[i]) {
+            free(in->data[i]);
+            in->data[i] = malloc(size);
+            in->capacity[i] = (in->data[i] != NULL) ? size : 0;
+        }
+        if (size == 0 || in->data[i] == NULL) {
+            printf("Error: Cannot read image %s.\n", paths[i]);
+            close(fd);
+            in->status = BATCH_ERROR_READ;
+            continue;
+        }
+        in->fd[i] = fd;
+        blocked += async_io_submit(io, &in->read[i], ASYNC_IO_READ, fd, in->data[i], size, 0);
+    }
+    run->results[job].io_exposed_ms += blocked;
+    run->results[job].total_ms += blocked;
+    return blocked;
+}
+
+/** Wait for the reads of a slot and close its files; returns BATCH_OK if both inputs arrived. */
+static int finish_reads(const batch_run* run, async_io* io, batch_input* in, batch_result* result) {
+    const batch_pair* pair = &run->list->pairs[in->job];
+    int status = in->status;
+
+    for (int i = 0; i < 2; i++) {
+        if (in->fd[i] < 0) {
+            continue;
+        }
+        double exposed = async_io_wait(io, &in->read[i]);
+        result->io_exposed_ms += exposed;
+        result->io_ms += in->read[i].done_ms - in->read[i].submit_ms;
+        close(in->fd[i]);
+        in->fd[i] = -1;
+        if (in->read[i].state != ASYNC_IO_DONE && status == BATCH_OK) {
+            printf("Error: Cannot read image %s.\n", (i == 0) ? pair->image_a : pair->image_b);
+            status = BATCH_ERROR_READ;
+        }
+    }
+    return status;
+}
+
+/** Wait for the write in flight from an output buffer, if any, and record it on its pair; returns the wait. */
+static double retire_write(const batch_run* run, async_io* io, batch_output* out) {
+    if (out->job < 0) {
+        return 0.0;
+    }
+    batch_result* result = &run->results[out->job];
+    double exposed = async_io_wait(io, &out->write);
+    result->io_exposed_ms += exposed;
+    result->io_ms += out->write.done_ms - out->write.submit_ms;
+    result->total_ms += exposed;
+    if (close(out->fd) != 0 || out->write.state != ASYNC_IO_DONE) {
+        printf("Error: Failed to write image %s.\n", run->list->pairs[out->job].output);
+        result->status = BATCH_ERROR_WRITE;
+    }
+    out->job = -1;
+    return exposed;
+}
+
+/** Encode a fused pair into a free output buffer and write it behind. */
+static int write_behind(const batch_run* run, async_io* io, batch_output* out, int job, unsigned int width,
+                        unsigned int height, const unsigned char* fused) {
+    const char* path = run->list->pairs[job].output;
+    size_t size = image_encoded_size(run->format, width, height);
+
+    if (size > out->capacity) {
+        free(out->data);
+        out->data = malloc(size);
+        out->capacity = (out->data != NULL) ? size : 0;
+    }
+    if (out->data == NULL || image_encode(run->format, width, height, fused, out->data, size) != size) {
+        printf("Error: Failed to write image %s.\n", path);
+        return BATCH_ERROR_WRITE;
+    }
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        printf("Error: Cannot open file %s for writing.\n", path);
+        return BATCH_ERROR_WRITE;
+    }
+    out->job = job;
+    out->fd = fd;
+    run->results[job].io_exposed_ms += async_io_submit(io, &out->write, ASYNC_IO_WRITE, fd, out->data, size, 0);
+    return BATCH_OK;
+}
+
+/**
+ * Worker loop with an I/O engine: the next pair is claimed and read ahead while
+ * the current one is fused, and outputs are written behind from BATCH_WRITE_BEHIND
+ * recycled buffers.
+ */
+static void run_async(batch_run* run, int id, async_io* io, emd_fusion_ctx* ctx, unsigned char** fused,
+                      size_t* fused_capacity) {
+    batch_input inputs[2];
+    batch_output outputs[BATCH_WRITE_BEHIND];
+    int slot = 0;
+
+    memset(inputs, 0, sizeof(inputs));
+    memset(outputs, 0, sizeof(outputs));
+    for (int k = 0; k < BATCH_WRITE_BEHIND; k++) {
+        outputs[k].job = -1;
+    }
+
+    int job = next_job(run, id);
+    if (job >= 0) {
+        read_ahead(run, io, &inputs[0], job);
+    }
+    for (int cur = 0; job >= 0; cur ^= 1) {
+        batch_input* in = &inputs[cur];
+        batch_result* result = &run->results[job];
+        double t0 = now_ms();
+
+        // The next pair's files are read while this one is fused.
+        int next = next_job(run, id);
+        if (next >= 0) {
+            t0 += read_ahead(run, io, &inputs[cur ^ 1], next);
+        }
+
+        result->worker = id;
+        int status = finish_reads(run, io, in, result);
+        image_view a, b;
+        memset(&a, 0, sizeof(a));
+        memset(&b, 0, sizeof(b));
+        if (status == BATCH_OK && (image_parse(in->data[0], in->read[0].size, &a) != 0 ||
+                                   image_parse(in->data[1], in->read[1].size, &b) != 0)) {
+            printf("Error: Cannot load image %s.\n", (a.pixels == NULL) ? run->list->pairs[job].image_a :
+                                                                          run->list->pairs[job].image_b);
+            status = BATCH_ERROR_READ;
+        }
+        if (status == BATCH_OK) {
+            status = fuse_views(run, &run->list->pairs[job], &a, &b, ctx, fused, fused_capacity, result);
+        }
+        image_close(&a);
+        image_close(&b);
+        // Completions that arrived during fusion are stamped before the wait below.
+        async_io_poll(io);
+        if (status == BATCH_OK) {
+            // The wait for the buffer's last write is charged to the pair that wrote it.
+            batch_output* out = &outputs[slot];
+            t0 += retire_write(run, io, out);
+            status = write_behind(run, io, out, job, (unsigned int)result->width, (unsigned int)result->height,
+                                  *fused);
+            slot = (slot + 1) % BATCH_WRITE_BEHIND;
+        }
+        result->status = status;
+        result->total_ms += now_ms() - t0;
+        job = next;
+    }
+
+    for (int k = 0; k < BATCH_WRITE_BEHIND; k++) {
+        retire_write(run, io, &outputs[k]);
+        free(outputs[k].data);
+    }
+    for (int i = 0; i < 2; i++) {
+        free(inputs[0].data[i]);
+        free(inputs[1].data[i]);
+    }
+}
+
+static void* worker_main(void* arg) {
+    batch_worker* worker = (batch_worker*)arg;
+    batch_run* run = worker->run;
+    emd_fusion_ctx ctx;
+    async_io io;
+    unsigned char* fused = NULL;
+    size_t fused_capacity = 0;
+    int job;
+
+    // The context starts at one pixel and grows to the largest pair this worker meets.
+    if (emd_fusion_init(&ctx, 1, 1, run->config, NULL, 0) != 0) {
+        return NULL;
+    }
+
+    if (run->io_backend != ASYNC_IO_NONE && async_io_init(&io, run->io_backend) == 0) {
+        worker->io_backend = io.backend;
+        run_async(run, worker->id, &io, &ctx, &fused, &fused_capacity);
+        async_io_free(&io);
+    } else {
+        worker->io_backend = ASYNC_IO_NONE;
+        while ((job = next_job(run, worker->id)) >= 0) {
+            batch_result* result = &run->results[job];
+            double t0 = now_ms();
+
+            result->worker = worker->id;
+            result->status = fuse_pair(run, &run->list->pairs[job], &ctx, &fused, &fused_capacity, result);
+            result->total_ms = now_ms() - t0;
+            // Every byte was read and written on the worker's critical path.
+            result->io_ms = result->io_exposed_ms = result->total_ms - result->fuse_ms;
+        }
+    }
+
+    emd_fusion_free(&ctx);
+    free(fused);
+    return NULL;
+}
+
+/** A pair index with its size, for sorting. */
+typedef struct {
+    long long bytes;
+    int index;
+} batch_order;
+
+static int compare_bytes_desc(const void* x, const void* y) {
+    long long a = ((const batch_order*)x)->bytes;
+    long long b = ((const batch_order*)y)->bytes;
+    return (a < b) - (a > b);
+}
+
+int batch_fusion_run(const batch_list* list, int threads, const emd_fusion_config* config, int format,
+                     int io_backend, batch_result* results, batch_stats* stats) {
+    batch_run run;
+    int num_workers = (threads < 1) ? 1 : (threads > list->count && list->count > 0) ? list->count : threads;
+    batch_order* order = malloc((size_t)(list->count + 1) * sizeof(batch_order));
+    int* dealt = malloc((size_t)(list->count + 1) * sizeof(int));
+    batch_deque* deques = calloc((size_t)num_workers, sizeof(batch_deque));
+    batch_worker* workers = calloc((size_t)num_workers, sizeof(batch_worker));
+    pthread_t* tids = calloc((size_t)num_workers, sizeof(pthread_t));
+    int started = 0;
+
+    memset(stats, 0, sizeof(*stats));
+    if (order == NULL || dealt == NULL || deques == NULL || workers == NULL || tids == NULL ||
+        config->threads != 0) {
+        printf("Error: Cannot start the batch workers.\n");
+        free(order);
+        free(dealt);
+        free(deques);
+        free(workers);
+        free(tids);
+        return -1;
+    }
+
+    for (int i = 0; i < list->count; i++) {
+        order[i].bytes = list->pairs[i].bytes;
+        order[i].index = i;
+        results[i].status = BATCH_ERROR_READ;
+        results[i].width = results[i].height = 0;
+        results[i].worker = -1;
+        results[i].fuse_ms = results[i].total_ms = 0.0;
+        results[i].io_ms = results[i].io_exposed_ms = 0.0;
+    }
+    qsort(order, (size_t)list->count, sizeof(batch_order), compare_bytes_desc);
+
+    // Largest pairs first, dealt round-robin so every deque holds a similar share of the work.
+    int start = 0;
+    for (int w = 0; w < num_workers; w++) {
+        deques[w].jobs = dealt + start;
+        for (int i = w; i < list->count; i += num_workers) {
+            deques[w].jobs[deques[w].tail++] = order[i].index;
+        }
+        start += deques[w].tail;
+        pthread_mutex_init(&deques[w].lock, NULL);
+    }
+
+    run.list = list;
+    run.config = config;
+    run.format = format;
+    run.io_backend = io_backend;
+    run.num_workers = num_workers;
+    run.deques = deques;
+    run.results = results;
+
+    double t0 = now_ms();
+    for (int w = 0; w < num_workers; w++) {
+        workers[w].run = &run;
+        workers[w].id = w;
+        if (pthread_create(&tids[w], NULL, worker_main, &workers[w]) != 0) {
+            break;
+        }
+        started++;
+    }
+    // Pairs in the deques of workers that did not start are stolen by the others.
+    for (int w = 0; w < started; w++) {
+        pthread_join(tids[w], NULL);
+    }
+
+    stats->pairs = list->count;
+    stats->seconds = (now_ms() - t0) / 1e3;
+    for (int i = 0; i < list->count; i++) {
+        stats->failed += (results[i].status != BATCH_OK);
+        stats->io_ms += results[i].io_ms;
+        stats->io_exposed_ms += results[i].io_exposed_ms;
+    }
+    stats->pairs_per_second = (stats->seconds > 0.0) ? (stats->pairs - stats->failed) / stats->seconds : 0.0;
+    stats->io_backend = (started > 0) ? workers[0].io_backend : ASYNC_IO_NONE;
+    if (stats->io_backend == ASYNC_IO_URING) {
+        stats->io_hidden_pct = -1.0;
+    } else {
+        stats->io_hidden_pct =
+            (stats->io_ms > 0.0) ? 100.0 * (stats->io_ms - stats->io_exposed_ms) / stats->io_ms : 0.0;
+    }
+
+    for (int w = 0; w < num_workers; w++) {
+        pthread_mutex_destroy(&deques[w].lock);
+    }
+    free(order);
+    free(dealt);
+    free(deques);
+    free(workers);
+    free(tids);
+    return (started > 0 && stats->failed == 0) ? 0 : -1;
+}
+
+#endif /* !__ADSP21000__ */
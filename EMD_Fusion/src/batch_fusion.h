@@ -0,0 +1,149 @@
+/*
+ * batch_fusion.h
+ *
+ * @brief Header file for batch fusion of many image pairs (hosted builds only).
+ *
+ * A batch is a list of pairs, read from a manifest or found in a directory:
+ *   - manifest: a text file with one pair per line, "imageA imageB [output]",
+ *     separated by blanks; empty lines and lines starting with '#' are skipped.
+ *     The output is a file name in the target directory, used as given. Without
+ *     it the output is named after image A, without directory and extension.
+ *   - directory: every file named <stem>a.<ext> with a partner <stem>b.<ext>
+ *     (e.g. p27a.pgm and p27b.pgm) is a pair; the output is named <stem>.
+ * Paths must not contain blanks. Generated output names get the extension of
+ * the chosen format (.pgm, .ppm, .bmp or .bin).
+ *
+ * Every worker thread owns one emd_fusion_ctx and one output buffer and
+ * resizes them as it goes, so buffers are only allocated when a worker meets
+ * a larger pair than any before. Pairs are sorted by file size, largest
+ * first, and dealt round-robin to per-worker deques. A worker takes the
+ * largest pair left in its own deque. When its deque is empty it steals the
+ * smallest pair left in another deque, so big pairs start early and small
+ * ones fill the gaps at the end.
+ *
+ * With an I/O backend (see async_io.h) each worker also owns an I/O engine
+ * and overlaps its file I/O with fusion. While a pair is fused, the worker
+ * has already claimed its next pair and that pair's inputs are being read
+ * into the second of two input buffer sets (read-ahead). The fused image is
+ * encoded into one of BATCH_WRITE_BEHIND recycled output buffers and written
+ * in the background (write-behind); the worker only waits for a write when
+ * it needs its buffer again, or at the end. The inputs are parsed in place in
+ * the buffers they were read into. Every pair records its I/O time, from
+ * submission to completion, and the part of it the worker spent blocked
+ * (exposed). The rest was hidden behind fusion. Without a backend
+ * (ASYNC_IO_NONE) the inputs are mapped and the output written synchronously,
+ * and all of the I/O time is exposed.
+ *
+ * A pair that cannot be read, has mismatched or invalid sizes, or cannot be
+ * written is recorded with its status, and the worker moves on to the next
+ * pair.
+ */
+
+#ifndef BATCH_FUSION_H_
+#define BATCH_FUSION_H_
+
+#if !defined(__ADSP21000__)
+
+#include "emd_fusion.h"
+#include "async_io.h"
+
+/** @brief Pair status. */
+#define BATCH_OK          0
+#define BATCH_ERROR_READ  1  /**< An input could not be opened or parsed. */
+#define BATCH_ERROR_SIZE  2  /**< The inputs differ in size or channels, or the size is not supported. */
+#define BATCH_ERROR_WRITE 3  /**< The output could not be written. */
+
+/** @brief Output buffers a worker writes behind with an I/O backend. */
+#define BATCH_WRITE_BEHIND 2
+
+/**
+ * @brief One pair of a batch.
+ */
+typedef struct {
+    char* image_a;     /**< Path of image A. */
+    char* image_b;     /**< Path of image B. */
+    char* output;      /**< Path of the fused output. */
+    long long bytes;   /**< Combined input file size, used for scheduling. */
+} batch_pair;
+
+/**
+ * @brief A list of pairs.
+ */
+typedef struct {
+    batch_pair* pairs; /**< Pairs, in manifest or name order. */
+    int count;         /**< Number of pairs. */
+    int capacity;      /**< Allocated entries. */
+} batch_list;
+
+/**
+ * @brief Outcome of one pair.
+ */
+typedef struct {
+    int status;           /**< BATCH_OK or a BATCH_ERROR_ code. */
+    int width;            /**< Frame width, 0 if unknown. */
+    int height;           /**< Frame height, 0 if unknown. */
+    int worker;           /**< Worker that handled the pair. */
+    double fuse_ms;       /**< Fusion time. */
+    double total_ms;      /**< Worker time on the pair: fusion, parsing, encoding and the exposed I/O. */
+    double io_ms;         /**< Reading and writing, from submission to completion (an upper bound with io_uring). */
+    double io_exposed_ms; /**< Part of io_ms the worker was blocked on. */
+} batch_result;
+
+/**
+ * @brief Totals of a batch run.
+ */
+typedef struct {
+    int pairs;                  /**< Pairs in the batch. */
+    int failed;                 /**< Pairs that did not produce an output. */
+    double seconds;             /**< Wall time of the run. */
+    double pairs_per_second;    /**< Pairs fused per second of wall time. */
+    int io_backend;             /**< Backend the workers ran, ASYNC_IO_NONE if synchronous. */
+    double io_ms;               /**< Sum of the pairs' io_ms. */
+    double io_exposed_ms;       /**< Sum of the pairs' io_exposed_ms. */
+    double io_hidden_pct;       /**< Share of io_ms hidden behind fusion, -1 with io_uring, whose io_ms is
+                                     only an upper bound (see async_io.h). */
+} batch_stats;
+
+/**
+ * @brief Build the pair list from a manifest file or a directory.
+ *
+ * @param source  Manifest file or directory of pairs.
+ * @param out_dir Target directory, created if it does not exist.
+ * @param format  Output format, IMAGE_FORMAT_PGM, _BMP or _RAW (IMAGE_FORMAT_PPM or _BMP24 for colour).
+ * @param list    Output list; release it with batch_list_free().
+ * @return 0 on success, -1 on error.
+ */
+int batch_list_load(const char* source, const char* out_dir, int format, batch_list* list);
+
+/**
+ * @brief Release a pair list.
+ *
+ * @param list List to release.
+ */
+void batch_list_free(batch_list* list);
+
+/**
+ * @brief Fuse every pair of a list on a pool of workers.
+ *
+ * @param list       Pairs to fuse.
+ * @param threads    Number of workers.
+ * @param config     Fusion options for every worker context; threads must be 0. With config->color the
+ *                   inputs must be PPM or 24-bit BMP and are fused by emd_fusion_run_rgb().
+ * @param format     Output format.
+ * @param io_backend ASYNC_IO_NONE for synchronous I/O, or the backend of the workers' I/O engines
+ *                   (ASYNC_IO_THREAD, _URING or _AUTO). A worker whose engine cannot start runs synchronously.
+ * @param results    Output, one entry per pair in list order.
+ * @param stats      Output totals.
+ * @return 0 if every pair was fused, -1 if any failed or the workers could not start.
+ */
+int batch_fusion_run(const batch_list* list, int threads, const emd_fusion_config* config, int format,
+                     int io_backend, batch_result* results, batch_stats* stats);
+
+/**
+ * @brief Short name of a pair status, e.g. "ok" or "read".
+ */
+const char* batch_status_name(int status);
+
+#endif /* !__ADSP21000__ */
+
+#endif /* BATCH_FUSION_H_ */
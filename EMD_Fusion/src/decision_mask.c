@@ -6,63 +6,255 @@
  */
 
 #include "decision_mask.h"
-#include "led.h"
+#include <stdio.h>
+#include <string.h>
+#include "trace.h"
 
-/** Named constants for alpha mask decisions. */
-#define ALPHA_A    0
-#define ALPHA_B    1
-#define ALPHA_AVG  2
+// Running column sums of values and squares (Q16.16) for the variance window.
+#pragma section("seg_sdram1")
+static int64_t col_sum[VARIANCE_MAX_WIDTH];
+
+#pragma section("seg_sdram1")
+static int64_t col_sum_sq[VARIANCE_MAX_WIDTH];
+
+/**
+ * Add (sign = 1) or remove (sign = -1) one image row from the column sums.
+ */
+static void update_column_sums(const int32_t* row, int width, int sign, int64_t* sums, int64_t* sums_sq) {
+    #pragma SIMD_for
+    for (int x = 0; x < width; x++) {
+        int32_t val = row[x];
+        sums[x]    += sign * (int64_t)val;
+        sums_sq[x] += sign * (((int64_t)val * val) >> 16); // Adjust for Q16.16 format
+    }
+}
+
+/**
+ * Narrow a Q16.16 variance to its integer part, saturated to 16 bits. The
+ * variance is never below -1 (see window_variance()), so a stored value q
+ * brackets the variance in [q * 2^16 - 1, q * 2^16 + 0xFFFF] below saturation.
+ */
+static inline uint16_t variance_to_u16(int32_t var) {
+    int32_t val = var >> 16;
+    return (uint16_t)((val < 0) ? 0 : (val > VARIANCE_U16_MAX ? VARIANCE_U16_MAX : val));
+}
+
+/**
+ * Q16.16 variance of the window around (x, y), summed directly. The sums are
+ * exact integers, so the result equals the sliding-window value of
+ * variance_rows(). Each squared term is truncated by less than one unit, so
+ * the variance is at least -1.
+ */
+static int32_t window_variance(const int32_t* imf, int width, int height, int window_size, int x, int y) {
+    const int half_window = window_size / 2;
+    int y_start = (y - half_window < 0) ? 0 : (y - half_window);
+    int y_last  = (y + half_window >= height) ? (height - 1) : (y + half_window);
+    int x_start = (x - half_window < 0) ? 0 : (x - half_window);
+    int x_end   = (x + half_window >= width) ? (width - 1) : (x + half_window);
+    int count   = (y_last - y_start + 1) * (x_end - x_start + 1);
+    int64_t sum = 0;
+    int64_t sum_sq = 0;
+
+    for (int j = y_start; j <= y_last; j++) {
+        for (int i = x_start; i <= x_end; i++) {
+            int32_t val = imf[j * width + i];
+            sum    += val;
+            sum_sq += ((int64_t)val * val) >> 16;
+        }
+    }
+    int32_t mean = (int32_t)(sum / count);
+    return (int32_t)((sum_sq / count) - (((int64_t)mean * mean) >> 16));
+}
+
+/**
+ * Variance of rows [y_begin, y_end) into either a Q16.16 map (var32) or a
+ * 16-bit map (var16); returns the sum of the Q16.16 values.
+ */
+static int64_t variance_rows(const int32_t* imf, int width, int height, int window_size,
+                             int y_begin, int y_end, int32_t* var32, uint16_t* var16,
+                             int64_t* sums, int64_t* sums_sq) {
+    const int half_window = window_size / 2;
+    const int prime_start = (y_begin - half_window < 0) ? 0 : (y_begin - half_window);
+    int64_t var_sum = 0;
+
+    TRACE_BEGIN(TRACE_STAGE_VARIANCE);
+    memset(sums, 0, (size_t)width * sizeof(int64_t));
+    memset(sums_sq, 0, (size_t)width * sizeof(int64_t));
+
+    // Prime the column sums with the rows of the first window.
+    for (int j = prime_start; j < y_begin + half_window && j < height; j++) {
+        update_column_sums(imf + j * width, width, 1, sums, sums_sq);
+    }
+
+    for (int y = y_begin; y < y_end; y++) {
+        // Slide the vertical window: add the entering row, drop the leaving one.
+        if (y + half_window < height) {
+            update_column_sums(imf + (y + half_window) * width, width, 1, sums, sums_sq);
+        }
+        if (y - half_window - 1 >= prime_start) {
+            update_column_sums(imf + (y - half_window - 1) * width, width, -1, sums, sums_sq);
+        }
 
-void calculate_local_variance(const int32_t* imf, int width, int height, int32_t* variance_map) {
-	const int half_window = WINDOW_SIZE / 2;
-    #pragma vector_for
-    for (int y = 0; y < height; y++) {
         // Precompute vertical window boundaries.
         int y_start = (y - half_window < 0) ? 0 : (y - half_window);
-        int y_end   = (y + half_window >= height) ? (height - 1) : (y + half_window);
+        int y_last  = (y + half_window >= height) ? (height - 1) : (y + half_window);
+        int rows    = y_last - y_start + 1;
+
+        // Prime the horizontal running sums with the columns of the first window.
+        int64_t sum = 0;
+        int64_t sum_sq = 0;
+        for (int k = 0; k < half_window && k < width; k++) {
+            sum += sums[k];
+            sum_sq += sums_sq[k];
+        }
 
         for (int x = 0; x < width; x++) {
+            if (x + half_window < width) {
+                sum += sums[x + half_window];
+                sum_sq += sums_sq[x + half_window];
+            }
+            if (x - half_window - 1 >= 0) {
+                sum -= sums[x - half_window - 1];
+                sum_sq -= sums_sq[x - half_window - 1];
+            }
+
             // Precompute horizontal window boundaries.
             int x_start = (x - half_window < 0) ? 0 : (x - half_window);
             int x_end   = (x + half_window >= width) ? (width - 1) : (x + half_window);
-
-            int64_t sum = 0;
-            int64_t sum_sq = 0;
-            int count = 0;
-			#pragma SIMD_for
-            for (int j = y_start; j <= y_end; j++) {
-                for (int k = x_start; k <= x_end; k++) {
-                    int32_t val = imf[j * width + k];
-                    sum += val;
-                    sum_sq += ((int64_t)val * val) >> 16; // Adjust for Q16.16 format
-                    count++;
-                }
-            }
+            int count   = rows * (x_end - x_start + 1);
 
             int32_t mean = (int32_t)(sum / count);
             int32_t var = (int32_t)((sum_sq / count) - (((int64_t)mean * mean) >> 16));
-            variance_map[y * width + x] = var;
+            if (var16 != NULL) {
+                var16[y * width + x] = variance_to_u16(var);
+            } else {
+                var32[y * width + x] = var;
+            }
+            var_sum += var;
         }
     }
+    TRACE_END(TRACE_STAGE_VARIANCE);
+    return var_sum;
 }
 
-void generate_decision_mask(const int32_t* var_map1, const int32_t* var_map2,
-                            int width, int height, char* alpha_mask) {
-    int64_t sum_var = 0;
-    int total_pixels = width * height;
-    for (int i = 0; i < total_pixels; i++) {
-        sum_var += var_map1[i] + var_map2[i];
+int64_t calculate_local_variance_rows(const int32_t* imf, int width, int height, int window_size,
+                                      int y_begin, int y_end, int32_t* variance_map,
+                                      int64_t* sums, int64_t* sums_sq) {
+    return variance_rows(imf, width, height, window_size, y_begin, y_end, variance_map, NULL, sums, sums_sq);
+}
+
+int64_t calculate_local_variance_rows_u16(const int32_t* imf, int width, int height, int window_size,
+                                          int y_begin, int y_end, uint16_t* variance_map,
+                                          int64_t* sums, int64_t* sums_sq) {
+    return variance_rows(imf, width, height, window_size, y_begin, y_end, NULL, variance_map, sums, sums_sq);
+}
+
+int64_t calculate_local_variance(const int32_t* imf, int width, int height, int window_size,
+                                 int32_t* variance_map) {
+    if (width > VARIANCE_MAX_WIDTH) {
+        printf("Error: Image width %d exceeds VARIANCE_MAX_WIDTH.\n", width);
+        return 0;
     }
-    int32_t avg_var = (int32_t)(sum_var / (2 * total_pixels));
-    // Set threshold at 20% of average variance.
-    int32_t adaptive_epsilon = (avg_var * 20) / 100;
 
+    return variance_rows(imf, width, height, window_size, 0, height, variance_map, NULL,
+                         col_sum, col_sum_sq);
+}
+
+int64_t calculate_local_variance_u16(const int32_t* imf, int width, int height, int window_size,
+                                     uint16_t* variance_map) {
+    if (width > VARIANCE_MAX_WIDTH) {
+        printf("Error: Image width %d exceeds VARIANCE_MAX_WIDTH.\n", width);
+        return 0;
+    }
+
+    return variance_rows(imf, width, height, window_size, 0, height, NULL, variance_map,
+                         col_sum, col_sum_sq);
+}
+
+#if EMD_TRACE
+/** Report the number of pixels in each mask class. */
+static void trace_mask_classes(const int64_t* counts) {
+    TRACE_COUNT(TRACE_COUNTER_MASK_A, counts[ALPHA_A]);
+    TRACE_COUNT(TRACE_COUNTER_MASK_B, counts[ALPHA_B]);
+    TRACE_COUNT(TRACE_COUNTER_MASK_AVG, counts[ALPHA_AVG]);
+}
+#endif
+
+int32_t decision_mask_epsilon(int64_t sum_var, int64_t count) {
+    int64_t avg_var = sum_var / count;
+    // Set threshold at 20% of average variance, rounded from Q16.16 to the integer
+    // units of the variance difference it is compared against.
+    return (int32_t)(((avg_var * 20) / 100 + 0x8000) >> 16);
+}
+
+void generate_decision_mask_eps(const int32_t* var_map1, const int32_t* var_map2, int num_pixels,
+                                int32_t adaptive_epsilon, char* alpha_mask) {
+    TRACE_BEGIN(TRACE_STAGE_DECISION);
     #pragma vector_for
-    for (int i = 0; i < total_pixels; i++) {
+    for (int i = 0; i < num_pixels; i++) {
         // Convert the Q16.16 difference to an integer.
         const int32_t diff = (var_map1[i] - var_map2[i] + 0x8000) >> 16;
         // Choose ALPHA_A if image A has higher variance, ALPHA_B if lower, otherwise ALPHA_AVG.
         alpha_mask[i] = (diff > adaptive_epsilon)  ? ALPHA_A :
                         (diff < -adaptive_epsilon) ? ALPHA_B : ALPHA_AVG;
     }
+#if EMD_TRACE
+    int64_t counts[3] = {0, 0, 0};
+    for (int i = 0; i < num_pixels; i++) {
+        counts[(int)alpha_mask[i]]++;
+    }
+    trace_mask_classes(counts);
+#endif
+    TRACE_END(TRACE_STAGE_DECISION);
+}
+
+void generate_decision_mask(const int32_t* var_map1, const int32_t* var_map2,
+                            int width, int height, char* alpha_mask) {
+    int64_t sum_var = 0;
+    int total_pixels = width * height;
+    for (int i = 0; i < total_pixels; i++) {
+        sum_var += var_map1[i] + var_map2[i];
+    }
+    int32_t adaptive_epsilon = decision_mask_epsilon(sum_var, 2 * (int64_t)total_pixels);
+
+    generate_decision_mask_eps(var_map1, var_map2, total_pixels, adaptive_epsilon, alpha_mask);
+}
+
+void generate_decision_mask_packed(const uint16_t* var_map1, const uint16_t* var_map2,
+                                   const int32_t* imf1, const int32_t* imf2, int width, int height,
+                                   int window_size, int32_t adaptive_epsilon, uint32_t* packed_mask) {
+    const int num_pixels = width * height;
+#if EMD_TRACE
+    int64_t counts[3] = {0, 0, 0};
+#endif
+    TRACE_BEGIN(TRACE_STAGE_DECISION);
+    for (int w = 0; w < PACKED_MASK_WORDS(num_pixels); w++) {
+        int base = w * MASK_CODES_PER_WORD;
+        int count = (num_pixels - base < MASK_CODES_PER_WORD) ? (num_pixels - base) : MASK_CODES_PER_WORD;
+        uint32_t word = 0;
+        for (int k = 0; k < count; k++) {
+            const int i = base + k;
+            // The Q16.16 difference lies within one unit of the difference of the stored integer parts.
+            int32_t diff = (int32_t)var_map1[i] - (int32_t)var_map2[i];
+            // Near +epsilon means diff in {eps, eps + 1}, near -epsilon diff in {-eps - 1, -eps}.
+            if ((uint32_t)(diff - adaptive_epsilon) <= 1 || (uint32_t)(diff + adaptive_epsilon + 1) <= 1 ||
+                var_map1[i] == VARIANCE_U16_MAX || var_map2[i] == VARIANCE_U16_MAX) {
+                // Too close to the threshold (or saturated): decide on the full-precision variances.
+                int x = i % width, y = i / width;
+                diff = (window_variance(imf1, width, height, window_size, x, y) -
+                        window_variance(imf2, width, height, window_size, x, y) + 0x8000) >> 16;
+            }
+            uint32_t code = (diff > adaptive_epsilon)  ? ALPHA_A :
+                            (diff < -adaptive_epsilon) ? ALPHA_B : ALPHA_AVG;
+            word |= code << (2 * k);
+#if EMD_TRACE
+            counts[code]++;
+#endif
+        }
+        packed_mask[w] = word;
+    }
+#if EMD_TRACE
+    trace_mask_classes(counts);
+#endif
+    TRACE_END(TRACE_STAGE_DECISION);
 }
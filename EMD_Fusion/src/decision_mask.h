@@ -12,22 +12,105 @@
 
 #include <stdint.h>
 
-/** @brief Window size for variance calculation. */
+/** @brief Default window size for variance calculation. */
 #define WINDOW_SIZE 3
 
+/** @brief Maximum image width supported by the running-sum variance. */
+#define VARIANCE_MAX_WIDTH 2048
+
+/** Named constants for alpha mask decisions. */
+#define ALPHA_A    0
+#define ALPHA_B    1
+#define ALPHA_AVG  2
+
+/** @brief Largest value of a 16-bit variance map; larger variances saturate. */
+#define VARIANCE_U16_MAX 65535
+
+/** @brief Decision codes (2 bits each) per 32-bit word of a packed mask. */
+#define MASK_CODES_PER_WORD 16
+
+/** @brief Number of 32-bit words of a packed mask for n pixels. */
+#define PACKED_MASK_WORDS(n) (((n) + MASK_CODES_PER_WORD - 1) / MASK_CODES_PER_WORD)
+
 /**
  * @brief Calculate the local variance of an image using a sliding window.
  *
  * This function computes the local variance for each pixel of the input image (in Q16.16 format)
- * using a square window (e.g., 3x3).
+ * using a square window_size x window_size window, clipped at the image borders. Sums of values
+ * and squares are kept as running column sums plus a horizontal running sum, so the cost per
+ * pixel is O(1) regardless of the window size.
  *
- * @param imf         Pointer to the input image.
- * @param width       Image width.
- * @param height      Image height.
+ * @param imf          Pointer to the input image.
+ * @param width        Image width (at most VARIANCE_MAX_WIDTH).
+ * @param height       Image height.
+ * @param window_size  Side of the square window (odd, e.g. WINDOW_SIZE).
  * @param variance_map Output array to store the computed variance.
+ * @return Sum of the computed variance values, for decision_mask_epsilon().
+ */
+int64_t calculate_local_variance(const int32_t* imf, int width, int height, int window_size,
+                                 int32_t* variance_map);
+
+
+/**
+ * @brief Calculate the local variance for a band of rows with caller-owned scratch.
+ *
+ * Produces the same values as calculate_local_variance() for rows [y_begin, y_end),
+ * reading the window rows above and below the band from imf. Calls with different
+ * scratch buffers may run concurrently.
+ *
+ * @param imf          Pointer to the input image.
+ * @param width        Image width.
+ * @param height       Image height.
+ * @param window_size  Side of the square window.
+ * @param y_begin      First row to compute.
+ * @param y_end        One past the last row to compute.
+ * @param variance_map Output variance map of the whole image (only the band is written).
+ * @param sums         Column sum scratch, width entries.
+ * @param sums_sq      Column sum-of-squares scratch, width entries.
+ * @return Sum of the variance values of the band.
  */
-void calculate_local_variance(const int32_t* imf, int width, int height, int32_t* variance_map);
+int64_t calculate_local_variance_rows(const int32_t* imf, int width, int height, int window_size,
+                                      int y_begin, int y_end, int32_t* variance_map,
+                                      int64_t* sums, int64_t* sums_sq);
 
+/**
+ * @brief Calculate the local variance into a compact 16-bit map.
+ *
+ * Same window as calculate_local_variance(), but each value is stored as its
+ * integer part, saturated to [0, VARIANCE_U16_MAX], which halves the map.
+ * The returned sum is taken over the full Q16.16 values, so the threshold from
+ * decision_mask_epsilon() is unchanged.
+ *
+ * @param imf          Pointer to the input image.
+ * @param width        Image width (at most VARIANCE_MAX_WIDTH).
+ * @param height       Image height.
+ * @param window_size  Side of the square window.
+ * @param variance_map Output 16-bit variance map.
+ * @return Sum of the Q16.16 variance values.
+ */
+int64_t calculate_local_variance_u16(const int32_t* imf, int width, int height, int window_size,
+                                     uint16_t* variance_map);
+
+/**
+ * @brief Calculate the 16-bit local variance for a band of rows with caller-owned scratch.
+ *
+ * The compact counterpart of calculate_local_variance_rows(); see
+ * calculate_local_variance_u16() for the stored values.
+ *
+ * @param imf          Pointer to the input image.
+ * @param width        Image width.
+ * @param height       Image height.
+ * @param window_size  Side of the square window.
+ * @param y_begin      First row to compute.
+ * @param y_end        One past the last row to compute.
+ * @param variance_map Output 16-bit variance map of the whole image (only the band is written).
+ * @param sums         Column sum scratch, width entries.
+ * @param sums_sq      Column sum-of-squares scratch, width entries.
+ * @return Sum of the Q16.16 variance values of the band.
+ */
+int64_t calculate_local_variance_rows_u16(const int32_t* imf, int width, int height, int window_size,
+                                          int y_begin, int y_end, uint16_t* variance_map,
+                                          int64_t* sums, int64_t* sums_sq);
 
 /**
  * @brief Generate a decision mask based on the variance maps of two images.
@@ -42,4 +125,55 @@ void calculate_local_variance(const int32_t* imf, int width, int height, int32_t
  */
 void generate_decision_mask(const int32_t* var_map1, const int32_t* var_map2, int width, int height, char* alpha_mask);
 
+/**
+ * @brief Compute the adaptive decision threshold from accumulated variance.
+ *
+ * The threshold is 20% of the average variance, as used by generate_decision_mask(),
+ * rounded to an integer like the variance differences it is compared with.
+ *
+ * @param sum_var Sum of the variance values (Q16.16) of both images.
+ * @param count   Number of summed variance values.
+ * @return Adaptive epsilon compared against the integer variance difference.
+ */
+int32_t decision_mask_epsilon(int64_t sum_var, int64_t count);
+
+/**
+ * @brief Generate a decision mask with an explicit threshold.
+ *
+ * Same per-pixel decision as generate_decision_mask(), but the threshold is
+ * supplied by the caller, e.g. a running estimate over previously seen strips.
+ *
+ * @param var_map1         Variance map for the first image.
+ * @param var_map2         Variance map for the second image.
+ * @param num_pixels       Number of pixels to classify.
+ * @param adaptive_epsilon Threshold from decision_mask_epsilon().
+ * @param alpha_mask       Output array for the decision mask.
+ */
+void generate_decision_mask_eps(const int32_t* var_map1, const int32_t* var_map2, int num_pixels,
+                                int32_t adaptive_epsilon, char* alpha_mask);
+
+/**
+ * @brief Generate a packed 2-bit decision mask from 16-bit variance maps.
+ *
+ * Pixel i is stored in bits 2*(i % 16) of word i / 16. The mask is identical to
+ * the one generate_decision_mask_eps() makes from the Q16.16 maps. The Q16.16
+ * difference lies within one unit of the difference of the 16-bit values, so
+ * the 16-bit values decide every pixel except those whose difference is within
+ * one unit of +/-adaptive_epsilon or whose variance saturated; for these the
+ * two Q16.16 variances are recomputed from the IMFs.
+ *
+ * @param var_map1         16-bit variance map for the first image.
+ * @param var_map2         16-bit variance map for the second image.
+ * @param imf1             IMF the first map was computed from.
+ * @param imf2             IMF the second map was computed from.
+ * @param width            Image width.
+ * @param height           Image height.
+ * @param window_size      Side of the variance window used for the maps.
+ * @param adaptive_epsilon Threshold from decision_mask_epsilon().
+ * @param packed_mask      Output mask, PACKED_MASK_WORDS(width * height) words.
+ */
+void generate_decision_mask_packed(const uint16_t* var_map1, const uint16_t* var_map2,
+                                   const int32_t* imf1, const int32_t* imf2, int width, int height,
+                                   int window_size, int32_t adaptive_epsilon, uint32_t* packed_mask);
+
 #endif /* DECISION_MASK_H_ */
@@ -7,32 +7,42 @@
  */
 
 #include "emd.h"
+#include "pixel_kernels.h"
+#include "trace.h"
 
-// SDRAM buffers
-#pragma section("seg_sdram1")
-static int32_t upper_env_buffer[MAX_EXTREMA*8];
-
-#pragma section("seg_sdram1")
-static int32_t lower_env_buffer[MAX_EXTREMA*8];
-
-#pragma section("seg_sdram1")
-static int32_t mean_env[MAX_EXTREMA*8];
-
-#pragma section("seg_sdram1")
+#if !defined(__ADSP21000__)
+// Buffers of the functions without a scratch argument. The target pipeline binds
+// every scratch set to its own memory, so they are only kept on hosted builds.
+static int32_t upper_env_buffer[MAX_SIGNAL_LEN];
+static int32_t lower_env_buffer[MAX_SIGNAL_LEN];
 static int32_t max_pos[MAX_EXTREMA];
-
-#pragma section("seg_sdram1")
 static int32_t max_val[MAX_EXTREMA];
-
-#pragma section("seg_sdram1")
 static int32_t min_pos[MAX_EXTREMA];
-
-#pragma section("seg_sdram1")
 static int32_t min_val[MAX_EXTREMA];
-
-#pragma section("seg_sdram1")
 static int32_t imf[MAX_SIGNAL_LEN];
 
+// Line scratch for the separable BEMD filters (padded line of up to 3 * BEMD_MAX_LINE).
+static int32_t line_g[3 * BEMD_MAX_LINE];
+static int32_t line_h[3 * BEMD_MAX_LINE];
+
+// Tridiagonal solver scratch for the spline envelope.
+static int32_t spline_c[MAX_EXTREMA];
+static int64_t spline_m[MAX_EXTREMA];
+
+// Scratch set over these buffers, used by the functions without a scratch argument.
+static emd_scratch default_scratch = {
+    MAX_SIGNAL_LEN, MAX_EXTREMA,
+    upper_env_buffer, lower_env_buffer, imf,
+    max_pos, max_val, min_pos, min_val,
+    line_g, line_h,
+    spline_c, spline_m,
+    EMD_ENVELOPE_LINEAR, NULL
+};
+#endif
+
+// Envelope given to scratch sets created by emd_scratch_init().
+static int default_envelope = EMD_ENVELOPE_LINEAR;
+
 static void linear_interp_simd(const int32_t* extrema_pos, const int32_t* extrema_val,
                                int num_extrema, int32_t* envelope, int signal_length)
 {
@@ -56,9 +66,11 @@ static void linear_interp_simd(const int32_t* extrema_pos, const int32_t* extrem
         if (seg_length <= 0)
             continue;
 
-        // Calculate the delta and slope in Q31 format.
+        // Slope in Q16.16 samples per sample with 16 more fractional bits. It needs
+        // 64 bits: a Q31 slope in 32 bits overflows once the segment rises by
+        // more than one Q16.16 unit per sample.
         int32_t delta_val = val2 - val1;
-        int32_t slope = (int32_t)(((int64_t)delta_val << 31) / seg_length);
+        int64_t slope = ((int64_t)delta_val << 16) / seg_length;
 
         // Process the segment in pairs for SIMD efficiency.
         int offset = pos1;
@@ -67,14 +79,14 @@ static void linear_interp_simd(const int32_t* extrema_pos, const int32_t* extrem
 
         // Process in pairs.
         for (; j <= samples - 2; j += 2) {
-            int32_t prod0 = (int32_t)(((int64_t)slope * j) >> 31);
-            int32_t prod1 = (int32_t)(((int64_t)slope * (j + 1)) >> 31);
+            int32_t prod0 = (int32_t)((slope * j) >> 16);
+            int32_t prod1 = (int32_t)((slope * (j + 1)) >> 16);
             envelope[offset + j]     = val1 + prod0;
             envelope[offset + j + 1] = val1 + prod1;
         }
         // Process the remaining sample, if any.
         if (j < samples) {
-            int32_t prod = (int32_t)(((int64_t)slope * j) >> 31);
+            int32_t prod = (int32_t)((slope * j) >> 16);
             envelope[offset + j] = val1 + prod;
         }
     }
@@ -87,72 +99,555 @@ static void linear_interp_simd(const int32_t* extrema_pos, const int32_t* extrem
     }
 }
 
+/**
+ * Natural cubic spline through the extrema, evaluated at every sample.
+ *
+ * The second derivatives M come from the tridiagonal system
+ *   h[i-1] M[i-1] + 2 (h[i-1] + h[i]) M[i] + h[i] M[i+1] = 6 (slope[i] - slope[i-1])
+ * with M[0] = M[n-1] = 0, solved by the Thomas algorithm. The forward sweep keeps
+ * c'[i] in ws->spline_c and d'[i] in ws->spline_m, which the back substitution
+ * overwrites with M. Each segment is then evaluated with s = t / h as
+ *   y0 + s (y1 - y0) + h^2 / 6 (((1-s)^3 - (1-s)) M0 + (s^3 - s) M1).
+ *
+ * Samples and the envelope are Q16.16. The h^2 / 6 factor magnifies any error
+ * in M by up to spacing^2 / 6, so slopes and M carry 16 more fractional bits
+ * (Q32 in 64-bit storage) and c', which lies in [0, 0.5], is kept in Q30. The
+ * 64-bit intermediates hold for sample magnitudes of 8-bit image scale.
+ *
+ * Across a gap of more than EMD_SPLINE_MAX_SPACING samples (a long plateau, for
+ * example) a natural spline bulges by up to about spacing * slope / 2 and its
+ * terms leave 64 bits. M is pinned to 0 at both knots of such a gap, so the
+ * gap is spanned by a straight line and the knots on either side are the
+ * natural ends of separate splines.
+ */
+static void spline_interp(const emd_scratch* ws, const int32_t* extrema_pos, const int32_t* extrema_val,
+                          int num_extrema, int32_t* envelope, int signal_length)
+{
+    int32_t* cp = ws->spline_c;
+    int64_t* m = ws->spline_m;
+    const int n = num_extrema;
+    int i;
+
+    if (n < 3) {
+        // Fewer than three knots: the natural spline is the straight line.
+        linear_interp_simd(extrema_pos, extrema_val, num_extrema, envelope, signal_length);
+        return;
+    }
+
+    // Forward sweep. A knot with c' = d' = 0 gets M = 0 and starts a new spline.
+    cp[0] = 0;
+    m[0] = 0;
+    int64_t h_prev = extrema_pos[1] - extrema_pos[0];
+    int64_t slope_prev = (((int64_t)extrema_val[1] - extrema_val[0]) << 16) / h_prev;
+    for (i = 1; i < n - 1; i++) {
+        int64_t h = extrema_pos[i + 1] - extrema_pos[i];
+        int64_t slope = (((int64_t)extrema_val[i + 1] - extrema_val[i]) << 16) / h;
+        if (h_prev > EMD_SPLINE_MAX_SPACING || h > EMD_SPLINE_MAX_SPACING) {
+            cp[i] = 0;
+            m[i] = 0;
+        } else {
+            int64_t d = 6 * (slope - slope_prev);
+            // Pivot b - a * c'[i-1] in Q16.16; it is at least 1.5 * (h_prev + h).
+            int64_t pivot = ((2 * (h_prev + h)) << 16) - ((h_prev * cp[i - 1]) >> 14);
+            cp[i] = (int32_t)((h << 46) / pivot);
+            m[i] = ((d - h_prev * m[i - 1]) << 16) / pivot;
+        }
+        h_prev = h;
+        slope_prev = slope;
+    }
+
+    // Back substitution, M[i] = d'[i] - c'[i] * M[i+1], with the product split to stay in 64 bits.
+    m[n - 1] = 0;
+    for (i = n - 2; i > 0; i--) {
+        int64_t next = m[i + 1];
+        m[i] -= ((cp[i] * (next >> 16)) >> 14) + ((cp[i] * (next & 0xFFFF)) >> 30);
+    }
+
+    // Hold the end values outside the extrema, as the linear envelope does.
+    int first_pos = extrema_pos[0];
+    #pragma SIMD_for
+    for (i = 0; i < first_pos && i < signal_length; i++) {
+        envelope[i] = extrema_val[0];
+    }
+
+    for (int seg = 0; seg < n - 1; seg++) {
+        int pos1 = extrema_pos[seg];
+        int64_t h = extrema_pos[seg + 1] - pos1;
+        int32_t y0 = extrema_val[seg];
+        int64_t dy = (int64_t)extrema_val[seg + 1] - y0;
+        int64_t g0 = h * ((h * m[seg]) >> 16) / 6;       // h^2 M0 / 6 in Q16.16
+        int64_t g1 = h * ((h * m[seg + 1]) >> 16) / 6;   // h^2 M1 / 6 in Q16.16
+        int64_t inv_h = ((int64_t)1 << 46) / h;          // 1 / h in Q46
+
+        // The cubic weights are formed in Q30, since g0 and g1 can far exceed the sample range.
+        for (int t = 0; t < h; t++) {
+            int64_t s1 = ((int64_t)t * inv_h) >> 16;    // t / h in Q30
+            int64_t s0 = ((int64_t)1 << 30) - s1;
+            int64_t w0 = ((((s0 * s0) >> 30) * s0) >> 30) - s0;
+            int64_t w1 = ((((s1 * s1) >> 30) * s1) >> 30) - s1;
+            envelope[pos1 + t] = (int32_t)(y0 + ((dy * s1) >> 30) + ((g0 * w0 + g1 * w1) >> 30));
+        }
+    }
+
+    int last_pos = extrema_pos[n - 1];
+    #pragma vector_for
+    for (i = last_pos; i < signal_length; i++) {
+        envelope[i] = extrema_val[n - 1];
+    }
+}
+
+/**
+ * Find the local extrema of a signal and store them in the scratch
+ * max_pos/max_val and min_pos/min_val lists, which hold EMD_MAX_EXTREMA(length)
+ * entries, with the branchless extrema kernel.
+ */
+static void find_extrema(const emd_scratch* ws, const int32_t* signal, int length, int* out_num_max, int* out_num_min) {
+    pixel_kernels_get()->find_extrema(signal, length, ws->max_pos, ws->max_val, ws->min_pos, ws->min_val,
+                                      out_num_max, out_num_min);
+}
+
+/**
+ * Run one sifting iteration in place: h -= (upper_env + lower_env) / 2.
+ * Returns 0 without touching h when the signal is monotonic (no envelopes
+ * can be built), 1 otherwise. The SD of the iteration is stored in *sd.
+ */
+static int sift_iteration(const emd_scratch* ws, int32_t* h, int length, int* num_max, int* num_min, int32_t* sd) {
+    find_extrema(ws, h, length, num_max, num_min);
+    TRACE_COUNT(TRACE_COUNTER_MAXIMA, *num_max);
+    TRACE_COUNT(TRACE_COUNTER_MINIMA, *num_min);
+    if (*num_max == 0 || *num_min == 0 || *num_max + *num_min < 3) {
+        *sd = 0;
+        return 0;
+    }
+
+    int32_t* upper_env = ws->upper_env;
+    int32_t* lower_env = ws->lower_env;
+
+    if (ws->envelope == EMD_ENVELOPE_SPLINE) {
+        spline_interp(ws, ws->max_pos, ws->max_val, *num_max, upper_env, length);
+        spline_interp(ws, ws->min_pos, ws->min_val, *num_min, lower_env, length);
+    } else {
+        // Perform linear interpolation for speed.
+        linear_interp_simd(ws->max_pos, ws->max_val, *num_max, upper_env, length);
+        linear_interp_simd(ws->min_pos, ws->min_val, *num_min, lower_env, length);
+    }
+
+    // Subtract the average of the upper and lower envelopes from the signal.
+    // SD = sum(mean^2) / sum(h_prev^2), since h_prev - h is the envelope mean.
+    int64_t sum_mean_sq = 0;
+    int64_t sum_h_sq = 0;
+    pixel_kernels_get()->subtract_mean_envelope(h, upper_env, lower_env, length, &sum_mean_sq, &sum_h_sq);
+
+    int64_t denom = sum_h_sq >> 16;
+    int64_t ratio = sum_mean_sq / (denom > 0 ? denom : 1);
+    *sd = (ratio > INT32_MAX) ? INT32_MAX : (int32_t)ratio;
+    return 1;
+}
+
+#if !defined(__ADSP21000__)
 void emd_decompose(int32_t* signal, int length) {
+    int num_max, num_min;
+    int32_t sd;
+
+    sift_iteration(&default_scratch, signal, length, &num_max, &num_min, &sd);
+}
+#endif
+
+/**
+ * Count strict 2-D local maxima and minima over the in-bounds 3x3 neighbourhood.
+ */
+static void count_extrema_2d(const int32_t* image, int width, int height, int* out_num_max, int* out_num_min) {
     int num_max = 0, num_min = 0;
 
-    // Process the first element separately.
-    if (length > 1) {
-        if (signal[0] > signal[1]) {
-            max_pos[num_max] = 0;
-            max_val[num_max++] = signal[0];
-        } else if (signal[0] < signal[1]) {
-            min_pos[num_min] = 0;
-            min_val[num_min++] = signal[0];
+    for (int y = 0; y < height; y++) {
+        int y_start = (y > 0) ? y - 1 : 0;
+        int y_end   = (y < height - 1) ? y + 1 : height - 1;
+
+        for (int x = 0; x < width; x++) {
+            int x_start = (x > 0) ? x - 1 : 0;
+            int x_end   = (x < width - 1) ? x + 1 : width - 1;
+            int32_t center = image[y * width + x];
+            int is_max = 1, is_min = 1;
+
+            for (int j = y_start; j <= y_end; j++) {
+                for (int k = x_start; k <= x_end; k++) {
+                    if (j == y && k == x)
+                        continue;
+                    int32_t val = image[j * width + k];
+                    is_max &= (center > val);
+                    is_min &= (center < val);
+                }
+            }
+            num_max += is_max;
+            num_min += is_min;
         }
     }
 
-    // Process inner elements.
-    #pragma vector_for
-    for (int i = 1; i < length - 1; i++) {
-        if (signal[i] > signal[i - 1] && signal[i] > signal[i + 1]) {
-            max_pos[num_max] = i;
-            max_val[num_max++] = signal[i];
-        } else if (signal[i] < signal[i - 1] && signal[i] < signal[i + 1]) {
-            min_pos[num_min] = i;
-            min_val[num_min++] = signal[i];
+    *out_num_max = num_max;
+    *out_num_min = num_min;
+}
+
+/**
+ * Sliding max/min of radius r along a strided line (van Herk/Gil-Werman),
+ * three comparisons per sample regardless of r. Out-of-range samples are
+ * ignored, matching a window clipped at the image border.
+ */
+static void minmax_filter_line(const emd_scratch* ws, const int32_t* in, int in_stride, int32_t* out, int out_stride,
+                               int n, int r, int is_max) {
+    const int w = 2 * r + 1;
+    const int padded = n + 2 * r;
+    const int32_t pad = is_max ? INT32_MIN : INT32_MAX;
+
+    // Forward pass: running extremum from the start of each block of w samples.
+    for (int j = 0, block = 0; j < padded; j++, block++) {
+        int32_t v = (j >= r && j < r + n) ? in[(j - r) * in_stride] : pad;
+        if (block == w)
+            block = 0;
+        ws->line_h[j] = v;
+        if (block == 0)
+            ws->line_g[j] = v;
+        else
+            ws->line_g[j] = is_max ? (v > ws->line_g[j - 1] ? v : ws->line_g[j - 1])
+                               : (v < ws->line_g[j - 1] ? v : ws->line_g[j - 1]);
+    }
+
+    // Backward pass: running extremum to the end of each block.
+    for (int j = padded - 2; j >= 0; j--) {
+        if ((j + 1) % w == 0)
+            continue;
+        int32_t v = ws->line_h[j];
+        int32_t next = ws->line_h[j + 1];
+        ws->line_h[j] = is_max ? (v > next ? v : next) : (v < next ? v : next);
+    }
+
+    for (int i = 0; i < n; i++) {
+        int32_t a = ws->line_h[i];
+        int32_t b = ws->line_g[i + w - 1];
+        out[i * out_stride] = is_max ? (a > b ? a : b) : (a < b ? a : b);
+    }
+}
+
+/**
+ * Sliding mean of radius r along a strided line using a running sum. The
+ * window is clipped at the line ends.
+ */
+static void box_filter_line(const int32_t* in, int in_stride, int32_t* out, int out_stride, int n, int r) {
+    int64_t sum = 0;
+    int hi = (r < n - 1) ? r : n - 1;
+
+    for (int i = 0; i <= hi; i++) {
+        sum += in[i * in_stride];
+    }
+
+    for (int i = 0; i < n; i++) {
+        int lo = (i - r < 0) ? 0 : i - r;
+        int end = (i + r >= n) ? n - 1 : i + r;
+        out[i * out_stride] = (int32_t)(sum / (end - lo + 1));
+
+        if (i + r + 1 < n)
+            sum += in[(i + r + 1) * in_stride];
+        if (i - r >= 0)
+            sum -= in[(i - r) * in_stride];
+    }
+}
+
+/**
+ * Build one BEMD envelope into env: separable max (or min) filter followed by
+ * separable box smoothing, both of radius r. Uses the work buffer as the intermediate image.
+ */
+static void bemd_envelope(const emd_scratch* ws, const int32_t* image, int width, int height, int r, int is_max, int32_t* env) {
+    int32_t* tmp = ws->work;
+
+    for (int y = 0; y < height; y++) {
+        minmax_filter_line(ws, image + y * width, 1, tmp + y * width, 1, width, r, is_max);
+    }
+    for (int x = 0; x < width; x++) {
+        minmax_filter_line(ws, tmp + x, width, env + x, width, height, r, is_max);
+    }
+    for (int y = 0; y < height; y++) {
+        box_filter_line(env + y * width, 1, tmp + y * width, 1, width, r);
+    }
+    for (int x = 0; x < width; x++) {
+        box_filter_line(tmp + x, width, env + x, width, height, r);
+    }
+}
+
+static int bemd_decompose_scratch(const emd_scratch* ws, int32_t* image, int width, int height) {
+    int num_pixels = width * height;
+    int num_max, num_min;
+
+    if (width > BEMD_MAX_LINE || height > BEMD_MAX_LINE || num_pixels > ws->capacity)
+        return 0;
+
+    count_extrema_2d(image, width, height, &num_max, &num_min);
+    TRACE_COUNT(TRACE_COUNTER_MAXIMA, num_max);
+    TRACE_COUNT(TRACE_COUNTER_MINIMA, num_min);
+    if (num_max == 0 || num_min == 0)
+        return 0;
+
+    // Window from the mean spacing of the sparser extrema set: sqrt(area / count).
+    int sparse = (num_max < num_min) ? num_max : num_min;
+    int area = num_pixels / sparse;
+    int spacing = 1;
+    while ((spacing + 1) * (spacing + 1) <= area)
+        spacing++;
+    int window = spacing | 1;
+    if (window < 3)
+        window = 3;
+    int r = window / 2;
+    int longest = (width > height) ? width : height;
+    if (r > longest)
+        r = longest;
+
+    int32_t* upper_env = ws->upper_env;
+    int32_t* lower_env = ws->lower_env;
+
+    bemd_envelope(ws, image, width, height, r, 1, upper_env);
+    bemd_envelope(ws, image, width, height, r, 0, lower_env);
+
+    // Subtract the average of the upper and lower envelopes from the image.
+    pixel_kernels_get()->subtract_mean_envelope(image, upper_env, lower_env, num_pixels, NULL, NULL);
+
+    return 2 * r + 1;
+}
+
+#if !defined(__ADSP21000__)
+int bemd_decompose(int32_t* image, int width, int height) {
+    return bemd_decompose_scratch(&default_scratch, image, width, height);
+}
+#endif
+
+int emd_decompose_image_scratch(int32_t* image, int width, int height, int mode, const emd_scratch* scratch) {
+    if ((int64_t)width * height > scratch->capacity ||
+        (mode == EMD_MODE_2D && (width > BEMD_MAX_LINE || height > BEMD_MAX_LINE))) {
+        printf("Error: %dx%d image exceeds the EMD scratch of %d samples.\n", width, height, scratch->capacity);
+        return -1;
+    }
+
+    TRACE_BEGIN(TRACE_STAGE_EMD);
+    if (mode == EMD_MODE_2D) {
+        bemd_decompose_scratch(scratch, image, width, height);
+    } else {
+        int num_max, num_min;
+        int32_t sd;
+        sift_iteration(scratch, image, width * height, &num_max, &num_min, &sd);
+    }
+    TRACE_END(TRACE_STAGE_EMD);
+    return 0;
+}
+
+#if !defined(__ADSP21000__)
+int emd_decompose_image(int32_t* image, int width, int height, int mode) {
+    return emd_decompose_image_scratch(image, width, height, mode, &default_scratch);
+}
+#endif
+
+/**
+ * Extremum class of sample k of an 8-bit signal of at least two samples: 1 for a
+ * maximum, -1 for a minimum, 0 otherwise. Same rule as the extrema kernels: strict
+ * against both neighbours, and an endpoint against its only neighbour.
+ */
+static int pixel_extremum(const unsigned char* pixels, int length, int k) {
+    int prev = (k > 0) ? pixels[k - 1] : pixels[k + 1];
+    int next = (k < length - 1) ? pixels[k + 1] : pixels[k - 1];
+    int cur = pixels[k];
+    return (cur > prev && cur > next) - (cur < prev && cur < next);
+}
+
+/** Last sample at or before k of the given class, -1 if there is none. */
+static int extremum_before(const unsigned char* pixels, int length, int k, int type) {
+    for (; k >= 0; k--) {
+        if (pixel_extremum(pixels, length, k) == type) {
+            return k;
         }
     }
+    return -1;
+}
+
+/** First sample at or after k of the given class, -1 if there is none. */
+static int extremum_after(const unsigned char* pixels, int length, int k, int type) {
+    for (; k < length; k++) {
+        if (pixel_extremum(pixels, length, k) == type) {
+            return k;
+        }
+    }
+    return -1;
+}
 
-    // Process the last element separately.
-    if (length > 1) {
-        if (signal[length - 1] > signal[length - 2]) {
-            max_pos[num_max] = length - 1;
-            max_val[num_max++] = signal[length - 1];
-        } else if (signal[length - 1] < signal[length - 2]) {
-            min_pos[num_min] = length - 1;
-            min_val[num_min++] = signal[length - 1];
+void emd_count_extrema(const unsigned char* pixels, int length, int begin, int end, int* num_max, int* num_min) {
+    int n_max = 0, n_min = 0;
+
+    if (length >= 2) {
+        for (int k = begin; k < end; k++) {
+            int type = pixel_extremum(pixels, length, k);
+            n_max += type > 0;
+            n_min += type < 0;
         }
     }
+    *num_max = n_max;
+    *num_min = n_min;
+}
 
-    int32_t* upper_env = upper_env_buffer;
-    int32_t* lower_env = lower_env_buffer;
+void emd_affected_range(const unsigned char* pixels, int length, int begin, int end, int* first, int* last) {
+    // Samples begin - 1 .. end can change class; the envelopes change between the
+    // unchanged extrema of each class on either side of them.
+    int max_before = extremum_before(pixels, length, begin - 2, 1);
+    int min_before = extremum_before(pixels, length, begin - 2, -1);
+    int max_after = extremum_after(pixels, length, end + 1, 1);
+    int min_after = extremum_after(pixels, length, end + 1, -1);
 
-    // Perform linear interpolation for speed.
-    linear_interp_simd(max_pos, max_val, num_max, upper_env, length);
-    linear_interp_simd(min_pos, min_val, num_min, lower_env, length);
+    *first = (max_before < 0 || min_before < 0) ? 0 : (max_before < min_before ? max_before : min_before);
+    *last = (max_after < 0 || min_after < 0) ? length : (max_after > min_after ? max_after : min_after);
+}
 
-    // Subtract the average of the upper and lower envelopes from the signal.
-    #pragma vector_for
-    for (int i = 0; i < length; i++) {
-        signal[i] -= (upper_env[i] + lower_env[i]) >> 1;
+void emd_sift_range(const unsigned char* pixels, int length, int begin, int end, int32_t* imf,
+                    const emd_scratch* scratch) {
+    // Anchor both envelopes at the nearest extrema of each class outside the range. The
+    // sub-signal then starts and ends on a true extremum, which the endpoint rule of the
+    // kernels classifies the same way, so every envelope segment over the range is the
+    // one of the whole signal.
+    int max_before = extremum_before(pixels, length, begin, 1);
+    int min_before = extremum_before(pixels, length, begin, -1);
+    int max_after = extremum_after(pixels, length, end - 1, 1);
+    int min_after = extremum_after(pixels, length, end - 1, -1);
+    int lo = (max_before < 0 || min_before < 0) ? 0 : (max_before < min_before ? max_before : min_before);
+    int hi = (max_after < 0 || min_after < 0) ? length - 1 : (max_after > min_after ? max_after : min_after);
+    int span = hi - lo + 1;
+    int num_max, num_min;
+
+    pixel_kernels_get()->to_q16_16(pixels + lo, scratch->work, span);
+    find_extrema(scratch, scratch->work, span, &num_max, &num_min);
+    if (num_max == 0 || num_min == 0) {
+        return;
     }
+    linear_interp_simd(scratch->max_pos, scratch->max_val, num_max, scratch->upper_env, span);
+    linear_interp_simd(scratch->min_pos, scratch->min_val, num_min, scratch->lower_env, span);
+    pixel_kernels_get()->subtract_mean_envelope(scratch->work + (begin - lo), scratch->upper_env + (begin - lo),
+                                                scratch->lower_env + (begin - lo), end - begin, NULL, NULL);
+    memcpy(imf + begin, scratch->work + (begin - lo), (size_t)(end - begin) * sizeof(int32_t));
 }
 
-void convert_to_q16_16(const unsigned char* input, int32_t* output, int size) {
-    #pragma SIMD_for
-    for (int i = 0; i < size; i++) {
+void emd_set_envelope(int envelope) {
+    default_envelope = envelope;
+#if !defined(__ADSP21000__)
+    default_scratch.envelope = envelope;
+#endif
+}
+
+void emd_scratch_bind(emd_scratch* scratch, int capacity, void* memory) {
+    // The 64-bit spline buffer goes first so that it keeps the block's alignment.
+    int extrema = EMD_MAX_EXTREMA(capacity);
+    int64_t* wide = (int64_t*)memory;
+    int32_t* next = (int32_t*)(wide + extrema);
 
-        output[i] = ((int32_t)input[i]) << 16;
+    memset(scratch, 0, sizeof(*scratch));
+    scratch->capacity = capacity;
+    scratch->extrema_capacity = extrema;
+    scratch->spline_m  = wide;
+    scratch->upper_env = next; next += capacity;
+    scratch->lower_env = next; next += capacity;
+    scratch->work      = next; next += capacity;
+    scratch->max_pos   = next; next += extrema;
+    scratch->max_val   = next; next += extrema;
+    scratch->min_pos   = next; next += extrema;
+    scratch->min_val   = next; next += extrema;
+    scratch->spline_c  = next; next += extrema;
+    scratch->line_g    = next; next += 3 * BEMD_MAX_LINE;
+    scratch->line_h    = next;
+    scratch->envelope  = default_envelope;
+}
+
+int emd_scratch_init(emd_scratch* scratch, int capacity) {
+    void* memory = malloc(EMD_SCRATCH_BYTES(capacity));
+    if (memory == NULL) {
+        memset(scratch, 0, sizeof(*scratch));
+        return -1;
     }
+    emd_scratch_bind(scratch, capacity, memory);
+    scratch->memory = memory;
+    return 0;
+}
 
+void emd_scratch_free(emd_scratch* scratch) {
+    free(scratch->memory);
+    memset(scratch, 0, sizeof(*scratch));
 }
 
-void convert_from_q16_16(const int32_t* input, unsigned char* output, int size) {
-    #pragma SIMD_for
-    for (int i = 0; i < size; i++) {
-        int32_t val = (input[i] + (1 << 15)) >> 16; // Add rounding offset
-        output[i] = (val < 0) ? 0 : (val > 255 ? 255 : val);
+void emd_sift_config_default(emd_sift_config* config) {
+    config->max_imfs = EMD_DEFAULT_MAX_IMFS;
+    config->max_iterations = EMD_DEFAULT_MAX_ITERATIONS;
+    config->sd_threshold = EMD_DEFAULT_SD_THRESHOLD;
+}
+
+int emd_decompose_imfs_scratch(const int32_t* signal, int length, const emd_sift_config* config,
+                               int32_t* imfs, int32_t* residue, emd_imf_stats* stats, const emd_scratch* scratch) {
+    if (length > scratch->capacity) {
+        printf("Error: signal of %d samples exceeds the EMD scratch of %d samples.\n", length, scratch->capacity);
+        return -1;
+    }
+
+    emd_sift_config defaults;
+    if (config == NULL) {
+        emd_sift_config_default(&defaults);
+        config = &defaults;
     }
+
+    // The running residue lives in the caller's buffer or in the IMF scratch.
+    int32_t* res = (residue != NULL) ? residue : scratch->work;
+    memcpy(res, signal, (size_t)length * sizeof(int32_t));
+
+    int num_imfs = 0;
+    for (int k = 0; k < config->max_imfs; k++) {
+        int32_t* h = imfs + (size_t)k * length;
+        emd_imf_stats imf_stats = {0, 0, 0, 0, 0};
+
+        memcpy(h, res, (size_t)length * sizeof(int32_t));
+
+        // Sift until the SD test passes or the iteration cap is reached.
+        while (imf_stats.iterations < config->max_iterations) {
+            if (!sift_iteration(scratch, h, length, &imf_stats.num_max, &imf_stats.num_min, &imf_stats.sd)) {
+                break;
+            }
+            imf_stats.iterations++;
+            imf_stats.total_extrema += imf_stats.num_max + imf_stats.num_min;
+            if (config->sd_threshold > 0 && imf_stats.sd <= config->sd_threshold) {
+                break;
+            }
+        }
+        TRACE_COUNT(TRACE_COUNTER_SIFTS, imf_stats.iterations);
+
+        // A monotonic residue ends the decomposition.
+        if (imf_stats.iterations == 0) {
+            break;
+        }
+
+        #pragma vector_for
+        for (int i = 0; i < length; i++) {
+            res[i] -= h[i];
+        }
+
+        if (stats != NULL) {
+            stats[k] = imf_stats;
+        }
+        num_imfs++;
+    }
+
+    return num_imfs;
 }
 
+#if !defined(__ADSP21000__)
+int emd_decompose_imfs(const int32_t* signal, int length, const emd_sift_config* config,
+                       int32_t* imfs, int32_t* residue, emd_imf_stats* stats) {
+    return emd_decompose_imfs_scratch(signal, length, config, imfs, residue, stats, &default_scratch);
+}
+#endif
 
+void convert_to_q16_16(const unsigned char* input, int32_t* output, int size) {
+    TRACE_BEGIN(TRACE_STAGE_CONVERT);
+    pixel_kernels_get()->to_q16_16(input, output, size);
+    TRACE_END(TRACE_STAGE_CONVERT);
+}
+
+void convert_from_q16_16(const int32_t* input, unsigned char* output, int size) {
+    pixel_kernels_get()->from_q16_16(input, output, size);
+}
@@ -15,19 +15,115 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <limits.h>
-#include "led.h"
 
 /** @brief Maximum signal length (width * height). */
 #define MAX_SIGNAL_LEN (200 * 200)
 
-/** @brief Maximum number of extrema per signal. */
-#define MAX_EXTREMA 1024
+/** @brief Extra entries of each extrema list, written past the last extremum by the vector kernels. */
+#define EMD_EXTREMA_PAD 8
+
+/**
+ * @brief Entries of each extrema list for a signal of length samples. Strict
+ *        extrema of one kind are never adjacent, so there are at most
+ *        (length + 1) / 2 of them.
+ */
+#define EMD_MAX_EXTREMA(length) (((length) + 1) / 2 + EMD_EXTREMA_PAD)
+
+/** @brief Entries of each extrema list of the static scratch set. */
+#define MAX_EXTREMA EMD_MAX_EXTREMA(MAX_SIGNAL_LEN)
+
+/** @brief Maximum image width/height supported by the 2-D (BEMD) mode. */
+#define BEMD_MAX_LINE 2048
+
+/** @brief EMD mode: row-major 1-D sifting over the flattened image. */
+#define EMD_MODE_1D 0
+
+/** @brief EMD mode: bidimensional sifting with 3x3 extrema and separable envelopes. */
+#define EMD_MODE_2D 1
+
+/** @brief 1-D envelope: piecewise-linear interpolation between extrema. */
+#define EMD_ENVELOPE_LINEAR 0
+
+/** @brief 1-D envelope: natural cubic spline through the extrema. */
+#define EMD_ENVELOPE_SPLINE 1
+
+/** @brief Longest gap between extrema that the spline envelope bridges with a cubic; longer gaps are linear. */
+#define EMD_SPLINE_MAX_SPACING 1024
+
+/** @brief Bytes of a scratch set for signals of up to capacity samples (see emd_scratch_bind()). */
+#define EMD_SCRATCH_BYTES(capacity) \
+    ((size_t)(capacity) * 3 * sizeof(int32_t) + \
+     (size_t)EMD_MAX_EXTREMA(capacity) * (5 * sizeof(int32_t) + sizeof(int64_t)) + \
+     2 * 3 * BEMD_MAX_LINE * sizeof(int32_t))
+
+/** @brief Default number of IMFs extracted by the sifting engine. */
+#define EMD_DEFAULT_MAX_IMFS 4
+
+/** @brief Default cap on sifting iterations per IMF. */
+#define EMD_DEFAULT_MAX_ITERATIONS 10
+
+/** @brief Default SD stop threshold (0.2 in Q16.16). */
+#define EMD_DEFAULT_SD_THRESHOLD 13107
+
+
+/*==============================================================================
+ * Type Definitions
+ *============================================================================*/
+
+/**
+ * @brief Configuration of the multi-IMF sifting engine.
+ */
+typedef struct {
+    int max_imfs;          /**< Maximum number of IMFs to extract (K). */
+    int max_iterations;    /**< Sifting iteration cap per IMF. */
+    int32_t sd_threshold;  /**< SD (energy ratio) stop threshold in Q16.16, 0 disables the test. */
+} emd_sift_config;
+
+/**
+ * @brief Scratch buffers used by EMD.
+ *
+ * The functions without a scratch argument share one static set placed in SDRAM.
+ * Independent scratch sets (see emd_scratch_init()) allow several decompositions
+ * to run concurrently.
+ */
+typedef struct {
+    int capacity;          /**< Maximum signal length in samples. */
+    int extrema_capacity;  /**< Entries of each extrema list, EMD_MAX_EXTREMA(capacity). */
+    int32_t* upper_env;    /**< Upper envelope, capacity samples. */
+    int32_t* lower_env;    /**< Lower envelope, capacity samples. */
+    int32_t* work;         /**< Residue / intermediate image, capacity samples. */
+    int32_t* max_pos;      /**< Positions of maxima, extrema_capacity entries. */
+    int32_t* max_val;      /**< Values of maxima, extrema_capacity entries. */
+    int32_t* min_pos;      /**< Positions of minima, extrema_capacity entries. */
+    int32_t* min_val;      /**< Values of minima, extrema_capacity entries. */
+    int32_t* line_g;       /**< BEMD line scratch, 3 * BEMD_MAX_LINE samples. */
+    int32_t* line_h;       /**< BEMD line scratch, 3 * BEMD_MAX_LINE samples. */
+    int32_t* spline_c;     /**< Spline solver coefficients (Q30), extrema_capacity entries. */
+    int64_t* spline_m;     /**< Spline second derivatives (Q32), extrema_capacity entries. */
+    int envelope;          /**< 1-D envelope, EMD_ENVELOPE_LINEAR or EMD_ENVELOPE_SPLINE. */
+    void* memory;          /**< Block allocated by emd_scratch_init(), NULL for bound scratch. */
+} emd_scratch;
+
+/**
+ * @brief Per-IMF statistics reported by the sifting engine.
+ */
+typedef struct {
+    int iterations;        /**< Sifting iterations spent on this IMF. */
+    int num_max;           /**< Maxima found in the last sifting iteration. */
+    int num_min;           /**< Minima found in the last sifting iteration. */
+    int total_extrema;     /**< Extrema found over all sifting iterations of this IMF. */
+    int32_t sd;            /**< SD value of the last sifting iteration in Q16.16. */
+} emd_imf_stats;
 
 
 /*==============================================================================
  * Function Declarations
  *============================================================================*/
 
+// The functions without a scratch argument share one static scratch set of
+// MAX_SIGNAL_LEN samples. They are hosted-only: on the target every caller binds
+// its own scratch, and the static set would be a second copy in the same SRAM.
+#if !defined(__ADSP21000__)
 /**
  * @brief Perform Empirical Mode Decomposition (EMD) on a signal.
  *
@@ -38,6 +134,195 @@
  */
 void emd_decompose(int32_t* signal, int length);
 
+/**
+ * @brief Perform one bidimensional EMD (BEMD) sifting pass on an image.
+ *
+ * Local maxima and minima are detected over a 3x3 neighbourhood. Their density
+ * sets the envelope window, and the upper/lower envelopes are built with
+ * separable max/min (order-statistic) filters followed by separable box
+ * smoothing, so the cost is O(width * height) independent of the window size.
+ * The mean envelope is subtracted from the image in place.
+ *
+ * @param image  Pointer to the image data in Q16.16 fixed-point format.
+ * @param width  Image width (at most BEMD_MAX_LINE).
+ * @param height Image height (at most BEMD_MAX_LINE).
+ * @return Envelope window size used, or 0 if the image has no extrema to sift.
+ */
+int bemd_decompose(int32_t* image, int width, int height);
+
+/**
+ * @brief Perform EMD on an image using the selected mode.
+ *
+ * EMD_MODE_1D runs emd_decompose() over the row-major flattened image,
+ * EMD_MODE_2D runs bemd_decompose(). Both leave the result in place, in the
+ * layout expected by calculate_local_variance().
+ *
+ * @param image  Pointer to the image data in Q16.16 fixed-point format.
+ * @param width  Image width.
+ * @param height Image height.
+ * @param mode   EMD_MODE_1D or EMD_MODE_2D.
+ * @return 0 on success, -1 if the image does not fit the static scratch set.
+ */
+int emd_decompose_image(int32_t* image, int width, int height, int mode);
+#endif
+
+/**
+ * @brief Perform EMD on an image using caller-owned scratch buffers.
+ *
+ * Same as emd_decompose_image(), but reentrant: calls with different scratch
+ * sets may run concurrently.
+ *
+ * @param image   Pointer to the image data in Q16.16 fixed-point format.
+ * @param width   Image width.
+ * @param height  Image height (width * height at most scratch->capacity).
+ * @param mode    EMD_MODE_1D or EMD_MODE_2D.
+ * @param scratch Scratch buffers from emd_scratch_init().
+ * @return 0 on success, -1 if the image exceeds scratch->capacity (or BEMD_MAX_LINE in the
+ *         2-D mode); the image is then left unchanged.
+ */
+int emd_decompose_image_scratch(int32_t* image, int width, int height, int mode, const emd_scratch* scratch);
+
+/**
+ * @brief Count the local maxima and minima of an 8-bit signal among samples [begin, end).
+ *
+ * Uses the extrema rule of the sifting (strict interior extrema, endpoints
+ * against their only neighbour), so counting [0, length) gives the counts the
+ * 1-D sift of the converted signal finds.
+ *
+ * @param pixels  8-bit signal.
+ * @param length  Signal length.
+ * @param begin   First sample counted.
+ * @param end     One past the last sample counted.
+ * @param num_max Output number of maxima.
+ * @param num_min Output number of minima.
+ */
+void emd_count_extrema(const unsigned char* pixels, int length, int begin, int end, int* num_max, int* num_min);
+
+/**
+ * @brief Samples of the 1-D linear-envelope IMF that change when samples [begin, end) change.
+ *
+ * Changing those samples can only change the extremum class of samples
+ * begin - 1 .. end, so the envelopes, and with them the IMF, stay the same up
+ * to the last unchanged maximum and minimum before them and from the first
+ * unchanged maximum and minimum after them. Either search runs on the new
+ * signal and is valid as long as it meets no other changed samples.
+ *
+ * @param pixels 8-bit signal after the change.
+ * @param length Signal length.
+ * @param begin  First changed sample.
+ * @param end    One past the last changed sample.
+ * @param first  Output first sample whose IMF may change.
+ * @param last   Output one past the last sample whose IMF may change.
+ */
+void emd_affected_range(const unsigned char* pixels, int length, int begin, int end, int* first, int* last);
+
+/**
+ * @brief Recompute samples [begin, end) of the 1-D linear-envelope IMF of an 8-bit signal.
+ *
+ * Writes the same values as converting the whole signal to Q16.16 and running
+ * the 1-D linear-envelope sift over it, but converts and sifts only the span
+ * between the nearest extrema of each class around the range. The rest of imf
+ * is not touched. Valid only when the whole signal is sifted, i.e. it has a
+ * maximum, a minimum and at least three extrema.
+ *
+ * @param pixels  8-bit signal.
+ * @param length  Signal length (at most scratch->capacity).
+ * @param begin   First sample to recompute.
+ * @param end     One past the last sample to recompute.
+ * @param imf     IMF of the whole signal in Q16.16, updated in [begin, end).
+ * @param scratch Scratch buffers; the work buffer holds the sifted span.
+ */
+void emd_sift_range(const unsigned char* pixels, int length, int begin, int end, int32_t* imf,
+                    const emd_scratch* scratch);
+
+/**
+ * @brief Select the 1-D envelope interpolator.
+ *
+ * Applies to the shared scratch set (hosted builds) and to scratch sets bound afterwards
+ * with emd_scratch_bind() or emd_scratch_init(); their envelope field may also be set directly. The
+ * spline builds a natural cubic spline through the extrema with a tridiagonal
+ * (Thomas) solve in Q16.16 with 64-bit intermediates, in O(extrema + length).
+ * Beyond the first and last extremum both interpolators hold the end value.
+ * The 2-D mode is not affected.
+ *
+ * @param envelope EMD_ENVELOPE_LINEAR (default) or EMD_ENVELOPE_SPLINE.
+ */
+void emd_set_envelope(int envelope);
+
+/**
+ * @brief Allocate a scratch set for signals of up to capacity samples.
+ *
+ * @param scratch  Scratch set to initialize.
+ * @param capacity Maximum signal length in samples.
+ * @return 0 on success, -1 if an allocation failed.
+ */
+int emd_scratch_init(emd_scratch* scratch, int capacity);
+
+/**
+ * @brief Lay a scratch set out over caller memory, without allocating.
+ * Lets the caller place the scratch in a chosen memory section (SDRAM on the
+ * board) or inside a larger block. The memory must stay valid while the scratch
+ * is used and is not released by emd_scratch_free().
+ * @param scratch  Scratch set to initialize.
+ * @param capacity Maximum signal length in samples.
+ * @param memory   EMD_SCRATCH_BYTES(capacity) bytes, 8-byte aligned.
+ */
+void emd_scratch_bind(emd_scratch* scratch, int capacity, void* memory);
+
+/**
+ * @brief Release a scratch set allocated with emd_scratch_init().
+ *
+ * @param scratch Scratch set to release.
+ */
+void emd_scratch_free(emd_scratch* scratch);
+
+/**
+ * @brief Fill a sifting configuration with the default values.
+ *
+ * @param config Configuration to initialize.
+ */
+void emd_sift_config_default(emd_sift_config* config);
+
+#if !defined(__ADSP21000__)
+/**
+ * @brief Decompose a signal into up to K IMFs plus a residue.
+ *
+ * Every IMF is sifted until the SD between two successive iterations drops
+ * below config->sd_threshold or config->max_iterations is reached. Extraction
+ * stops early when the residue becomes monotonic. The extrema and envelope
+ * scratch buffers are shared by all iterations. Hosted builds only, as
+ * emd_decompose().
+ *
+ * @param signal  Input signal in Q16.16 format (not modified).
+ * @param length  Length of the signal (at most MAX_SIGNAL_LEN).
+ * @param config  Sifting configuration, NULL selects the defaults.
+ * @param imfs    Output IMFs, stored contiguously (max_imfs * length samples).
+ * @param residue Output residue (length samples), may be NULL.
+ * @param stats   Output statistics per IMF (max_imfs entries), may be NULL.
+ * @return Number of IMFs actually extracted, -1 if the signal exceeds the static scratch set.
+ */
+int emd_decompose_imfs(const int32_t* signal, int length, const emd_sift_config* config,
+                       int32_t* imfs, int32_t* residue, emd_imf_stats* stats);
+#endif
+
+/**
+ * @brief Decompose a signal into up to K IMFs using caller-owned scratch buffers.
+ *
+ * Same as emd_decompose_imfs(), but reentrant. Without a residue buffer the
+ * running residue is kept in scratch->work.
+ *
+ * @param signal  Input signal in Q16.16 format (not modified).
+ * @param length  Length of the signal (at most scratch->capacity).
+ * @param config  Sifting configuration, NULL selects the defaults.
+ * @param imfs    Output IMFs, stored contiguously (max_imfs * length samples).
+ * @param residue Output residue (length samples), may be NULL.
+ * @param stats   Output statistics per IMF (max_imfs entries), may be NULL.
+ * @param scratch Scratch buffers from emd_scratch_init().
+ * @return Number of IMFs actually extracted, -1 if the signal exceeds scratch->capacity.
+ */
+int emd_decompose_imfs_scratch(const int32_t* signal, int length, const emd_sift_config* config,
+                               int32_t* imfs, int32_t* residue, emd_imf_stats* stats, const emd_scratch* scratch);
+
 
 /**
  * @brief Convert an 8-bit image to Q16.16 fixed-point format.
@@ -0,0 +1,384 @@
+/*
+ * emd_fusion.c
+ *
+ */
+
+#include "emd_fusion.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fusion.h"
+
+/** Reserve bytes at *offset, keeping every buffer 8-byte aligned; NULL when only measuring. */
+static void* carve(unsigned char* base, size_t* offset, size_t bytes) {
+    void* p = (base != NULL) ? base + *offset : NULL;
+    *offset += (bytes + 7) & ~(size_t)7;
+    return p;
+}
+
+/**
+ * Lay the single-threaded buffers out from base and return their total size.
+ * With base == NULL the layout is only measured.
+ */
+static size_t layout(emd_fusion_ctx* ctx, unsigned char* base) {
+    size_t num_pixels = (size_t)ctx->width * ctx->height;
+    size_t offset = 0;
+
+    const precision_kernels* kernels = precision_kernels_get(ctx->config.precision);
+    if (ctx->config.precision != EMD_PRECISION_Q16 && kernels != NULL) {
+        // Generated kernels: buffers of the type's size and its own sifting work instead of the EMD scratch.
+        for (int i = 0; i < 2; i++) {
+            ctx->signal[i] = carve(base, &offset, num_pixels * kernels->sample_bytes);
+        }
+        for (int i = 0; i < 2; i++) {
+            ctx->var_map[i] = carve(base, &offset, num_pixels * kernels->variance_bytes);
+        }
+        ctx->column_sums = carve(base, &offset, 2 * (size_t)ctx->width * sizeof(int64_t));
+        ctx->precision_work = carve(base, &offset, precision_work_bytes(kernels, (int)num_pixels));
+        return offset;
+    }
+
+    for (int i = 0; i < 2; i++) {
+        ctx->signal[i] = carve(base, &offset, num_pixels * sizeof(int32_t));
+    }
+    for (int i = 0; i < 2; i++) {
+        if (ctx->config.compact) {
+            ctx->var_map16[i] = carve(base, &offset, num_pixels * sizeof(uint16_t));
+        } else {
+            ctx->var_map[i] = carve(base, &offset, num_pixels * sizeof(int32_t));
+        }
+    }
+    if (ctx->config.compact) {
+        ctx->packed_mask = carve(base, &offset, PACKED_MASK_WORDS(num_pixels) * sizeof(uint32_t));
+    }
+    ctx->column_sums = carve(base, &offset, 2 * (size_t)ctx->width * sizeof(int64_t));
+    if (ctx->config.color) {
+        ctx->luma[0] = carve(base, &offset, num_pixels);
+        ctx->luma[1] = carve(base, &offset, num_pixels);
+        ctx->alpha_mask = carve(base, &offset, num_pixels);
+    }
+
+    void* scratch = carve(base, &offset, EMD_SCRATCH_BYTES(num_pixels));
+    if (base != NULL) {
+        emd_scratch_bind(&ctx->scratch, (int)num_pixels, scratch);
+        ctx->scratch.envelope = ctx->config.envelope;
+    }
+
+    if (ctx->config.pyramid > 0) {
+        size_t bytes = pyramid_fusion_memory_size(ctx->width, ctx->height, ctx->config.pyramid);
+        void* pyramid = carve(base, &offset, bytes);
+        if (base != NULL) {
+            pyramid_fusion* pf = &ctx->pyramid;
+            pyramid_fusion_bind(pf, ctx->width, ctx->height, ctx->config.pyramid, pyramid);
+            pf->emd_mode = ctx->config.emd_mode;
+            pf->signal[0] = ctx->signal[0];
+            pf->signal[1] = ctx->signal[1];
+            pf->var_map[0] = ctx->var_map[0];
+            pf->var_map[1] = ctx->var_map[1];
+            pf->column_sums = ctx->column_sums;
+            pf->scratch = &ctx->scratch;
+        }
+    }
+
+    if (ctx->config.incremental) {
+        void* incremental = carve(base, &offset, incremental_fusion_memory_size(ctx->width, ctx->height));
+        if (base != NULL) {
+            incremental_fusion* inc = &ctx->incremental;
+            incremental_fusion_bind(inc, ctx->width, ctx->height, incremental);
+            inc->signal[0] = ctx->signal[0];
+            inc->signal[1] = ctx->signal[1];
+            inc->var_map[0] = ctx->var_map[0];
+            inc->var_map[1] = ctx->var_map[1];
+            inc->column_sums = ctx->column_sums;
+            inc->scratch = &ctx->scratch;
+        }
+    }
+    return offset;
+}
+
+void emd_fusion_config_default(emd_fusion_config* config) {
+    config->emd_mode = EMD_MODE_1D;
+    config->envelope = EMD_ENVELOPE_LINEAR;
+    config->compact = 0;
+    config->threads = 0;
+    config->pyramid = 0;
+    config->precision = EMD_PRECISION_Q16;
+    config->stretch_clip = 0;
+    config->color = 0;
+    config->incremental = 0;
+}
+
+size_t emd_fusion_memory_size(int width, int height, const emd_fusion_config* config) {
+    emd_fusion_ctx ctx;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.width = width;
+    ctx.height = height;
+    if (config != NULL) {
+        ctx.config = *config;
+    } else {
+        emd_fusion_config_default(&ctx.config);
+    }
+    return layout(&ctx, NULL);
+}
+
+int emd_fusion_init(emd_fusion_ctx* ctx, int width, int height, const emd_fusion_config* config,
+                    void* memory, size_t memory_size) {
+    memset(ctx, 0, sizeof(*ctx));
+    if (config != NULL) {
+        ctx->config = *config;
+    } else {
+        emd_fusion_config_default(&ctx->config);
+    }
+    ctx->base = memory;
+    ctx->memory_size = (memory != NULL) ? memory_size : 0;
+
+    if (ctx->config.pyramid < 0 || ctx->config.pyramid > PYRAMID_MAX_LEVELS ||
+        (ctx->config.pyramid > 0 && (ctx->config.compact || ctx->config.threads > 0))) {
+        printf("Error: The pyramid mode takes 1..%d levels and neither the compact mode nor threads.\n",
+               PYRAMID_MAX_LEVELS);
+        return -1;
+    }
+
+    if (ctx->config.precision != EMD_PRECISION_Q16 &&
+        (precision_kernels_get(ctx->config.precision) == NULL || ctx->config.emd_mode != EMD_MODE_1D ||
+         ctx->config.envelope != EMD_ENVELOPE_LINEAR || ctx->config.compact || ctx->config.threads > 0 ||
+         ctx->config.pyramid > 0)) {
+        printf("Error: Precision %d needs a known type, the 1-D EMD with the linear envelope, "
+               "and neither the compact, threaded nor pyramid mode.\n", ctx->config.precision);
+        return -1;
+    }
+
+    if (ctx->config.stretch_clip < 0 || ctx->config.stretch_clip >= 500 ||
+        (ctx->config.stretch_clip > 0 && (ctx->config.threads > 0 || ctx->config.pyramid > 0 ||
+                                          ctx->config.precision != EMD_PRECISION_Q16))) {
+        printf("Error: The stretch clips 0..499 per mille, and only in the serial Q16.16 pipeline "
+               "without the pyramid.\n");
+        return -1;
+    }
+
+    if (ctx->config.color && (ctx->config.compact || ctx->config.threads > 0 || ctx->config.pyramid > 0 ||
+                              ctx->config.precision != EMD_PRECISION_Q16)) {
+        printf("Error: The colour mode runs only in the serial Q16.16 pipeline with full-width maps "
+               "and without the pyramid.\n");
+        return -1;
+    }
+
+    if (ctx->config.incremental &&
+        (ctx->config.emd_mode != EMD_MODE_1D || ctx->config.envelope != EMD_ENVELOPE_LINEAR ||
+         ctx->config.compact || ctx->config.threads > 0 || ctx->config.pyramid > 0 ||
+         ctx->config.precision != EMD_PRECISION_Q16)) {
+        printf("Error: The incremental mode needs the 1-D EMD with the linear envelope in the serial "
+               "Q16.16 pipeline with full-width maps and without the pyramid.\n");
+        return -1;
+    }
+
+    if (ctx->config.threads > 0) {
+#if !defined(__ADSP21000__)
+        if (ctx->config.compact || memory != NULL) {
+            printf("Error: The threaded pipeline supports neither the compact mode nor caller memory.\n");
+            return -1;
+        }
+#else
+        printf("Error: Threads are not available on this target.\n");
+        return -1;
+#endif
+    }
+    return emd_fusion_resize(ctx, width, height);
+}
+
+int emd_fusion_resize(emd_fusion_ctx* ctx, int width, int height) {
+    if (width <= 0 || height <= 0) {
+        printf("Error: Invalid frame size %dx%d.\n", width, height);
+        return -1;
+    }
+    if (ctx->config.emd_mode == EMD_MODE_2D && (width > BEMD_MAX_LINE || height > BEMD_MAX_LINE)) {
+        printf("Error: %dx%d exceeds BEMD_MAX_LINE for the 2-D mode.\n", width, height);
+        return -1;
+    }
+
+#if !defined(__ADSP21000__)
+    if (ctx->config.threads > 0) {
+        if (ctx->parallel.pool != NULL && width == ctx->width && height == ctx->height) {
+            return 0;
+        }
+        parallel_fusion_free(&ctx->parallel);
+        ctx->width = width;
+        ctx->height = height;
+        if (parallel_fusion_init(&ctx->parallel, ctx->config.threads, width, height) != 0) {
+            printf("Error: Cannot start the parallel pipeline.\n");
+            return -1;
+        }
+        ctx->parallel.scratch[0].envelope = ctx->config.envelope;
+        ctx->parallel.scratch[1].envelope = ctx->config.envelope;
+        return 0;
+    }
+#endif
+
+    ctx->width = width;
+    ctx->height = height;
+    size_t size = layout(ctx, NULL);
+    if (size > ctx->memory_size) {
+        if (ctx->base != NULL && ctx->memory == NULL) {
+            printf("Error: The fusion context needs %lu bytes, %lu given.\n", (unsigned long)size,
+                   (unsigned long)ctx->memory_size);
+            return -1;
+        }
+        free(ctx->memory);
+        ctx->memory = malloc(size);
+        ctx->base = ctx->memory;
+        ctx->memory_size = (ctx->memory != NULL) ? size : 0;
+        if (ctx->memory == NULL) {
+            printf("Error: Cannot allocate %lu bytes for the fusion context.\n", (unsigned long)size);
+            return -1;
+        }
+    }
+    layout(ctx, (unsigned char*)ctx->base);
+    return 0;
+}
+
+/** Conversion and EMD of each image into ctx->signal; the scratch is reused for the second one. */
+static int decompose_pair(emd_fusion_ctx* ctx, const unsigned char* imgA, const unsigned char* imgB) {
+    const unsigned char* img[2] = { imgA, imgB };
+    int num_pixels = ctx->width * ctx->height;
+
+    for (int i = 0; i < 2; i++) {
+        convert_to_q16_16(img[i], ctx->signal[i], num_pixels);
+        if (emd_decompose_image_scratch(ctx->signal[i], ctx->width, ctx->height, ctx->config.emd_mode,
+                                        &ctx->scratch) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Conversion, EMD and full-width local variance of both images, the work shared by
+ * the grayscale and colour runs. Leaves the adaptive decision threshold in *epsilon.
+ */
+static int decompose_and_score(emd_fusion_ctx* ctx, const unsigned char* imgA, const unsigned char* imgB,
+                               int32_t* epsilon) {
+    int width = ctx->width;
+    int height = ctx->height;
+    int64_t* sums = ctx->column_sums;
+    int64_t sum_var = 0;
+
+    if (ctx->config.incremental) {
+        // Only the parts of the maps that the changed tiles reach are recomputed.
+        if (incremental_fusion_score(&ctx->incremental, imgA, imgB, &sum_var) != 0) {
+            return -1;
+        }
+        *epsilon = decision_mask_epsilon(sum_var, 2 * (int64_t)width * height);
+        return 0;
+    }
+
+    if (decompose_pair(ctx, imgA, imgB) != 0) {
+        return -1;
+    }
+    for (int i = 0; i < 2; i++) {
+        sum_var += calculate_local_variance_rows(ctx->signal[i], width, height, WINDOW_SIZE, 0, height,
+                                                 ctx->var_map[i], sums, sums + width);
+    }
+    *epsilon = decision_mask_epsilon(sum_var, 2 * (int64_t)width * height);
+    return 0;
+}
+
+/** Stretch num_values fused values, by the clipped histogram or by the range found during fusion. */
+static void stretch_fused(const emd_fusion_ctx* ctx, unsigned char* fused, int num_values, unsigned char min_val,
+                          unsigned char max_val) {
+    if (ctx->config.stretch_clip > 0) {
+        // The clipped range needs the histogram of the fused pixels, not just their range.
+        histogram_stretch_percentile(fused, num_values, ctx->config.stretch_clip);
+    } else {
+        histogram_stretch_lut(fused, num_values, min_val, max_val);
+    }
+}
+
+int emd_fusion_run(emd_fusion_ctx* ctx, const unsigned char* imgA, const unsigned char* imgB,
+                   unsigned char* fused_img) {
+    int width = ctx->width;
+    int height = ctx->height;
+    int num_pixels = width * height;
+    int64_t* sums = ctx->column_sums;
+    int64_t sum_var = 0;
+    unsigned char min_val, max_val;
+
+#if !defined(__ADSP21000__)
+    if (ctx->config.threads > 0) {
+        return parallel_fusion_run(&ctx->parallel, imgA, imgB, ctx->config.emd_mode, fused_img);
+    }
+#endif
+
+    if (ctx->config.pyramid > 0) {
+        return pyramid_fusion_run(&ctx->pyramid, imgA, imgB, fused_img);
+    }
+
+    if (ctx->config.precision != EMD_PRECISION_Q16) {
+        void* const signal[2] = { ctx->signal[0], ctx->signal[1] };
+        void* const var_map[2] = { ctx->var_map[0], ctx->var_map[1] };
+        precision_fusion_run(precision_kernels_get(ctx->config.precision), imgA, imgB, width, height,
+                             signal, var_map, ctx->column_sums, ctx->precision_work, fused_img);
+        return 0;
+    }
+
+    if (ctx->config.compact) {
+        if (decompose_pair(ctx, imgA, imgB) != 0) {
+            return -1;
+        }
+        // 16-bit variance maps and a 2-bit mask, deciding as the Q16.16 maps would (see decision_mask.h).
+        for (int i = 0; i < 2; i++) {
+            sum_var += calculate_local_variance_rows_u16(ctx->signal[i], width, height, WINDOW_SIZE, 0, height,
+                                                         ctx->var_map16[i], sums, sums + width);
+        }
+        int32_t adaptive_epsilon = decision_mask_epsilon(sum_var, 2 * (int64_t)num_pixels);
+
+        generate_decision_mask_packed(ctx->var_map16[0], ctx->var_map16[1], ctx->signal[0], ctx->signal[1],
+                                      width, height, WINDOW_SIZE, adaptive_epsilon, ctx->packed_mask);
+        fuse_images_packed(imgA, imgB, ctx->packed_mask, num_pixels, fused_img, &min_val, &max_val);
+    } else {
+        int32_t adaptive_epsilon;
+        if (decompose_and_score(ctx, imgA, imgB, &adaptive_epsilon) != 0) {
+            return -1;
+        }
+
+        // Decide and fuse in one pass over the variance maps, without a mask buffer.
+        fuse_images_var(imgA, imgB, ctx->var_map[0], ctx->var_map[1], num_pixels, adaptive_epsilon,
+                        fused_img, &min_val, &max_val);
+    }
+
+    stretch_fused(ctx, fused_img, num_pixels, min_val, max_val);
+    return 0;
+}
+
+int emd_fusion_run_rgb(emd_fusion_ctx* ctx, const unsigned char* rgbA, const unsigned char* rgbB,
+                       unsigned char* fused_rgb) {
+    int num_pixels = ctx->width * ctx->height;
+    unsigned char min_val, max_val;
+
+    if (!ctx->config.color) {
+        printf("Error: The context was not created for colour frames.\n");
+        return -1;
+    }
+    rgb_to_luma(rgbA, num_pixels, ctx->luma[0]);
+    rgb_to_luma(rgbB, num_pixels, ctx->luma[1]);
+    int32_t adaptive_epsilon;
+    if (decompose_and_score(ctx, ctx->luma[0], ctx->luma[1], &adaptive_epsilon) != 0) {
+        return -1;
+    }
+
+    // One mask from the luma decision, applied to all three channels.
+    generate_decision_mask_eps(ctx->var_map[0], ctx->var_map[1], num_pixels, adaptive_epsilon, ctx->alpha_mask);
+    fuse_images_rgb(rgbA, rgbB, ctx->alpha_mask, num_pixels, fused_rgb, &min_val, &max_val);
+    stretch_fused(ctx, fused_rgb, 3 * num_pixels, min_val, max_val);
+    return 0;
+}
+
+void emd_fusion_free(emd_fusion_ctx* ctx) {
+#if !defined(__ADSP21000__)
+    if (ctx->config.threads > 0) {
+        parallel_fusion_free(&ctx->parallel);
+    }
+#endif
+    free(ctx->memory);
+    memset(ctx, 0, sizeof(*ctx));
+}
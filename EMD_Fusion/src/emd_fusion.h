@@ -0,0 +1,206 @@
+/*
+ * emd_fusion.h
+ *
+ * @brief Header file for the reentrant image fusion API.
+ *
+ * An emd_fusion_ctx owns every buffer one fusion needs: the Q16.16 signals,
+ * the variance maps (or the 16-bit maps and packed mask of the compact mode),
+ * the variance column sums and the EMD scratch. It is sized from the frame
+ * dimensions when it is created and then fuses any number of frame pairs of
+ * that size without allocating. Nothing is shared between contexts, so
+ * independent fusions can run concurrently in one process, one context per
+ * thread. The only process-wide state is the pixel kernel selection, which is
+ * made once however many threads ask for it first, and the trace sinks.
+ *
+ * A context either allocates its buffers or is laid out over caller memory of
+ * emd_fusion_memory_size() bytes, e.g. a static block in SDRAM on the board.
+ * emd_fusion_resize() moves a context to another frame size, reusing its
+ * memory whenever the new layout fits, so a worker that fuses pairs of mixed
+ * sizes allocates only when it meets a larger frame than any before.
+ * With config.threads > 0 (hosted builds) the frame is fused by the
+ * multi-threaded pipeline of parallel_fusion.h instead, on the context's own
+ * worker pool. The output is the same in every configuration, except for the
+ * pyramid mode (config.pyramid > 0, see pyramid_fusion.h), which trades exactness near focus boundaries for
+ * skipping the full-resolution work elsewhere. With config.precision other
+ * than EMD_PRECISION_Q16 the frame is fused by the generated kernels of that
+ * numeric type (see precision_kernels.h) in the same buffers.
+ *
+ * A context made with config.color fuses interleaved RGB frames through
+ * emd_fusion_run_rgb(): the EMD, variance and decision run on the luma planes
+ * exactly as on a grayscale pair, and the one decision mask selects the whole
+ * RGB pixels, so the colour costs a luma conversion and a wider select and
+ * stretch, not a second decomposition.
+ *
+ * A context made with config.incremental keeps the IMFs and variance maps of
+ * the last pair and, for the next one, recomputes only the parts that the
+ * tiles changed since then (or differing between the two images) can reach,
+ * with the same output as a full recompute (see incremental_fusion.h). The
+ * decision, fusion and stretch still run over the whole frame.
+ */
+
+#ifndef EMD_FUSION_H_
+#define EMD_FUSION_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "emd.h"
+#include "decision_mask.h"
+#include "pyramid_fusion.h"
+#include "incremental_fusion.h"
+#include "precision_kernels.h"
+#if !defined(__ADSP21000__)
+#include "parallel_fusion.h"
+#endif
+
+/**
+ * @brief Upper bound of emd_fusion_memory_size() for frames of up to num_pixels
+ *        pixels and width columns, for sizing static memory. The pyramid mode
+ *        needs PYRAMID_FUSION_MEMORY_BYTES() on top, the colour mode EMD_FUSION_COLOR_BYTES()
+ *        and the incremental mode INCREMENTAL_FUSION_MEMORY_BYTES(); EMD_PRECISION_F64 is not
+ *        covered. Counted in sizeof units, so it is in words on the target.
+ *
+ * Two signals and two variance maps of int32_t (the compact maps and the types of
+ * precision_kernels.h are no larger), the packed mask, the column sums, the EMD
+ * scratch and the alignment of each buffer.
+ */
+#define EMD_FUSION_MEMORY_BYTES(width, num_pixels) \
+    (4 * (size_t)(num_pixels) * sizeof(int32_t) + (size_t)PACKED_MASK_WORDS(num_pixels) * sizeof(uint32_t) + \
+     2 * (size_t)(width) * sizeof(int64_t) + EMD_SCRATCH_BYTES(num_pixels) + 128)
+
+/** @brief Extra bytes of a colour context (config.color): two luma planes and the decision mask. */
+#define EMD_FUSION_COLOR_BYTES(num_pixels) ((size_t)(num_pixels) * 3 + 24)
+
+/**
+ * @brief Options of a fusion context.
+ */
+typedef struct {
+    int emd_mode;  /**< EMD_MODE_1D or EMD_MODE_2D. */
+    int envelope;  /**< 1-D envelope, EMD_ENVELOPE_LINEAR or EMD_ENVELOPE_SPLINE. */
+    int compact;   /**< 1 for 16-bit variance maps and a packed 2-bit mask (single-threaded only). */
+    int threads;   /**< Worker threads including the caller (hosted only), 0 fuses on the calling thread. */
+    int pyramid;   /**< Coarse-to-fine levels, 1..PYRAMID_MAX_LEVELS, 0 decides at full resolution only
+                        (single-threaded, full-width maps only). */
+    int precision; /**< Numeric type, EMD_PRECISION_Q16 or another type of precision_kernels.h
+                        (1-D linear EMD, single-threaded, full-width maps, no pyramid). */
+    int stretch_clip; /**< Pixels clipped on each side by the stretch in 1/1000, 0..499 (see
+                           histogram_stretch_percentile()); 0 stretches the fused range
+                           (single-threaded, Q16.16, no pyramid). */
+    int color;     /**< 1 to fuse interleaved RGB with emd_fusion_run_rgb() (single-threaded, full-width
+                        maps, Q16.16, no pyramid). */
+    int incremental; /**< 1 to recompute only what changed since the last pair (see incremental_fusion.h;
+                          1-D linear EMD, single-threaded, full-width maps, Q16.16, no pyramid). */
+} emd_fusion_config;
+
+/**
+ * @brief State of one fusion, reusable across frame pairs of one size.
+ */
+typedef struct {
+    int width;                  /**< Frame width. */
+    int height;                 /**< Frame height. */
+    emd_fusion_config config;   /**< Options given to emd_fusion_init(). */
+    int32_t* signal[2];         /**< Q16.16 signals of images A and B (samples of config.precision). */
+    int32_t* var_map[2];        /**< Variance maps of images A and B (compact == 0; of config.precision). */
+    uint16_t* var_map16[2];     /**< 16-bit variance maps of images A and B (compact == 1). */
+    uint32_t* packed_mask;      /**< Packed decision mask (compact == 1). */
+    int64_t* column_sums;       /**< Variance column sums, 2 * width. */
+    emd_scratch scratch;        /**< EMD scratch, shared by both images in turn. */
+    void* precision_work;       /**< Sifting work of the generated kernels (precision != Q16). */
+    unsigned char* luma[2];     /**< Luma planes of images A and B (color == 1). */
+    char* alpha_mask;           /**< Decision mask shared by the three channels (color == 1). */
+    pyramid_fusion pyramid;     /**< Coarse-to-fine state (config.pyramid > 0). */
+    incremental_fusion incremental; /**< Change-detection state (config.incremental == 1). */
+    void* memory;               /**< Block allocated by the context, NULL for caller memory. */
+    void* base;                 /**< Memory the buffers are laid out in (memory or the caller's). */
+    size_t memory_size;         /**< Bytes at base. */
+#if !defined(__ADSP21000__)
+    parallel_fusion parallel;   /**< Threaded pipeline (threads > 0). */
+#endif
+} emd_fusion_ctx;
+
+/**
+ * @brief Fill a configuration with the defaults: 1-D EMD, linear envelope, full-width maps, no threads,
+ *        no pyramid, Q16.16, unclipped stretch, grayscale, every pair computed in full.
+ *
+ * @param config Configuration to initialize.
+ */
+void emd_fusion_config_default(emd_fusion_config* config);
+
+/**
+ * @brief Bytes of caller memory needed by a single-threaded context.
+ *
+ * @param width  Frame width.
+ * @param height Frame height.
+ * @param config Options, NULL selects the defaults.
+ * @return Size in bytes, at most EMD_FUSION_MEMORY_BYTES(width, width * height), plus
+ *         PYRAMID_FUSION_MEMORY_BYTES(width, width * height) in the pyramid mode,
+ *         EMD_FUSION_COLOR_BYTES(width * height) in the colour mode and
+ *         INCREMENTAL_FUSION_MEMORY_BYTES(width * height, height) in the incremental mode.
+ */
+size_t emd_fusion_memory_size(int width, int height, const emd_fusion_config* config);
+
+/**
+ * @brief Create a fusion context for frames of one size.
+ *
+ * @param ctx         Context to initialize.
+ * @param width       Frame width.
+ * @param height      Frame height.
+ * @param config      Options, NULL selects the defaults.
+ * @param memory      Caller memory (8-byte aligned) to lay the buffers out in, or NULL to allocate them.
+ *                    Must be NULL when config->threads > 0.
+ * @param memory_size Bytes at memory.
+ * @return 0 on success, -1 on invalid options, too little memory or allocation failure.
+ */
+int emd_fusion_init(emd_fusion_ctx* ctx, int width, int height, const emd_fusion_config* config,
+                    void* memory, size_t memory_size);
+
+/**
+ * @brief Change the frame size of a context.
+ *
+ * The buffers are laid out again in the existing memory when they fit, otherwise
+ * an allocated context grows its block. A threaded context restarts its pipeline
+ * when the size changes.
+ *
+ * @param ctx    Context from emd_fusion_init().
+ * @param width  New frame width.
+ * @param height New frame height.
+ * @return 0 on success, -1 if the size is invalid, caller memory is too small
+ *         or an allocation failed (the context must then only be freed).
+ */
+int emd_fusion_resize(emd_fusion_ctx* ctx, int width, int height);
+
+/**
+ * @brief Fuse one frame pair: EMD, local variance, decision, fusion and histogram stretch.
+ *
+ * @param ctx       Context from emd_fusion_init().
+ * @param imgA      First 8-bit image, width * height pixels.
+ * @param imgB      Second 8-bit image, width * height pixels.
+ * @param fused_img Output stretched fused image, width * height pixels.
+ * @return 0 on success, -1 if the EMD could not decompose the frame.
+ */
+int emd_fusion_run(emd_fusion_ctx* ctx, const unsigned char* imgA, const unsigned char* imgB,
+                   unsigned char* fused_img);
+
+/**
+ * @brief Fuse one interleaved RGB frame pair on its luma.
+ *
+ * Converts both frames to luma (rgb_to_luma()), runs the EMD, local variance and
+ * decision of emd_fusion_run() on the luma planes, applies the mask to all three
+ * channels (fuse_images_rgb()) and stretches the channels with one table.
+ *
+ * @param ctx       Context from emd_fusion_init() with config.color = 1.
+ * @param rgbA      First image, width * height * 3 bytes (R, G, B).
+ * @param rgbB      Second image, width * height * 3 bytes.
+ * @param fused_rgb Output stretched fused image, width * height * 3 bytes.
+ * @return 0 on success, -1 if the context is not a colour context or the EMD could not decompose the luma.
+ */
+int emd_fusion_run_rgb(emd_fusion_ctx* ctx, const unsigned char* rgbA, const unsigned char* rgbB,
+                       unsigned char* fused_rgb);
+
+/**
+ * @brief Release the buffers and threads of a context.
+ *
+ * @param ctx Context to release.
+ */
+void emd_fusion_free(emd_fusion_ctx* ctx);
+
+#endif /* EMD_FUSION_H_ */
@@ -0,0 +1,164 @@
+/*
+ * focus_stack.c
+ *
+ */
+
+#include "focus_stack.h"
+#include <stdlib.h>
+#include <string.h>
+#include "emd.h"
+#include "decision_mask.h"
+
+int focus_stack_init(focus_stack* fs, int width, int height) {
+    size_t num_pixels = (size_t)width * height;
+
+    memset(fs, 0, sizeof(*fs));
+    fs->width = width;
+    fs->height = height;
+    fs->top_var = malloc(FOCUS_STACK_MAX_TIES * num_pixels * sizeof(int32_t));
+    fs->top_pixel = malloc(FOCUS_STACK_MAX_TIES * num_pixels);
+    fs->plane_index = malloc(num_pixels);
+
+    if (!fs->top_var || !fs->top_pixel || !fs->plane_index) {
+        focus_stack_free(fs);
+        return -1;
+    }
+    return 0;
+}
+
+void focus_stack_add_plane(focus_stack* fs, const unsigned char* plane, const int32_t* var_map) {
+    const int num_pixels = fs->width * fs->height;
+    const uint8_t k = (uint8_t)fs->num_planes;
+    // Slots beyond the planes added so far hold no variance yet.
+    const int filled = (fs->num_planes < FOCUS_STACK_MAX_TIES) ? fs->num_planes : FOCUS_STACK_MAX_TIES;
+
+    int64_t plane_sum = 0;
+    for (int i = 0; i < num_pixels; i++) {
+        plane_sum += var_map[i];
+    }
+    fs->sum_var += plane_sum;
+    fs->var_count += num_pixels;
+
+    if (fs->num_planes == 0) {
+        memcpy(fs->top_var, var_map, (size_t)num_pixels * sizeof(int32_t));
+        memcpy(fs->top_pixel, plane, (size_t)num_pixels);
+        memset(fs->plane_index, 0, (size_t)num_pixels);
+        fs->num_planes = 1;
+        return;
+    }
+
+    for (int i = 0; i < num_pixels; i++) {
+        int32_t var = var_map[i];
+        uint8_t pixel = plane[i];
+        int j;
+
+        if (var > fs->top_var[i]) {
+            fs->plane_index[i] = k;
+        }
+        // Insert into the descending slots; an equal variance goes after the planes added earlier.
+        for (j = 0; j < filled; j++) {
+            int32_t* slot_var = fs->top_var + (size_t)j * num_pixels + i;
+            uint8_t* slot_pixel = fs->top_pixel + (size_t)j * num_pixels + i;
+            if (var > *slot_var) {
+                int32_t t_var = *slot_var;
+                uint8_t t_pixel = *slot_pixel;
+                *slot_var = var;
+                *slot_pixel = pixel;
+                var = t_var;
+                pixel = t_pixel;
+            }
+        }
+        if (j < FOCUS_STACK_MAX_TIES) {
+            fs->top_var[(size_t)j * num_pixels + i] = var;
+            fs->top_pixel[(size_t)j * num_pixels + i] = pixel;
+        }
+    }
+    fs->num_planes++;
+}
+
+void focus_stack_fuse(const focus_stack* fs, unsigned char* fused_img) {
+    const int num_pixels = fs->width * fs->height;
+    const int filled = (fs->num_planes < FOCUS_STACK_MAX_TIES) ? fs->num_planes : FOCUS_STACK_MAX_TIES;
+
+    // Threshold over the whole stack, so that no plane sees a partial one.
+    const int32_t adaptive_epsilon = decision_mask_epsilon(fs->sum_var, fs->var_count);
+
+    for (int i = 0; i < num_pixels; i++) {
+        const int32_t best = fs->top_var[i];
+        int sum = fs->top_pixel[i];
+        int count = 1;
+        for (int j = 1; j < filled; j++) {
+            // Convert the Q16.16 difference to an integer, as in generate_decision_mask().
+            const int32_t diff = (fs->top_var[(size_t)j * num_pixels + i] - best + 0x8000) >> 16;
+            if (diff < -adaptive_epsilon) {
+                break;
+            }
+            sum += fs->top_pixel[(size_t)j * num_pixels + i];
+            count++;
+        }
+        fused_img[i] = (unsigned char)((sum + (count >> 1)) / count);
+    }
+}
+
+void focus_stack_free(focus_stack* fs) {
+    free(fs->top_var);
+    free(fs->top_pixel);
+    free(fs->plane_index);
+    memset(fs, 0, sizeof(*fs));
+}
+
+int focus_stack_fuse_planes(const unsigned char* const* planes, int num_planes, int width, int height,
+                            int emd_mode, unsigned char* fused_img, uint8_t* plane_index) {
+    int num_pixels = width * height;
+    focus_stack fs;
+    emd_scratch scratch;
+
+    if (num_planes < 1 || num_planes > FOCUS_STACK_MAX_PLANES) {
+        return -1;
+    }
+
+    int32_t* signal = malloc((size_t)num_pixels * sizeof(int32_t));
+    int32_t* var_map = malloc((size_t)num_pixels * sizeof(int32_t));
+    int64_t* sums = malloc((size_t)2 * width * sizeof(int64_t));
+    if (signal == NULL || var_map == NULL || sums == NULL ||
+        emd_scratch_init(&scratch, num_pixels) != 0) {
+        free(signal);
+        free(var_map);
+        free(sums);
+        return -1;
+    }
+    if (focus_stack_init(&fs, width, height) != 0) {
+        emd_scratch_free(&scratch);
+        free(signal);
+        free(var_map);
+        free(sums);
+        return -1;
+    }
+
+    // Each plane's variance is computed into the shared buffer and folded in before the next plane.
+    int status = 0;
+    for (int k = 0; k < num_planes; k++) {
+        convert_to_q16_16(planes[k], signal, num_pixels);
+        if (emd_decompose_image_scratch(signal, width, height, emd_mode, &scratch) != 0) {
+            status = -1;
+            break;
+        }
+        calculate_local_variance_rows(signal, width, height, WINDOW_SIZE, 0, height, var_map,
+                                      sums, sums + width);
+        focus_stack_add_plane(&fs, planes[k], var_map);
+    }
+
+    if (status == 0) {
+        focus_stack_fuse(&fs, fused_img);
+        if (plane_index != NULL) {
+            memcpy(plane_index, fs.plane_index, (size_t)num_pixels);
+        }
+    }
+
+    focus_stack_free(&fs);
+    emd_scratch_free(&scratch);
+    free(signal);
+    free(var_map);
+    free(sums);
+    return status;
+}
@@ -0,0 +1,104 @@
+/*
+ * focus_stack.h
+ *
+ * @brief Header file for N-plane focus-stack fusion.
+ *
+ * Every plane is presented once, with its variance map, in one streaming
+ * pass. For every pixel the stack keeps the FOCUS_STACK_MAX_TIES highest
+ * variances with the pixel values of their planes, and the index of the plane
+ * with the highest one. It also sums the variance of all planes. The variance
+ * map can be discarded after each call, so memory does not grow with the
+ * number of planes.
+ *
+ * The tie band uses the same adaptive epsilon as generate_decision_mask()
+ * (20% of the mean variance), computed over all planes once the pass is
+ * complete. A kept plane whose integer variance difference to the best is
+ * within [-epsilon, epsilon] joins the tie set, and tied planes are averaged
+ * with rounding. Where more than FOCUS_STACK_MAX_TIES planes are in the band,
+ * only the ones with the highest variances are averaged. The selection does
+ * not depend on the order of the planes, except between planes of exactly the
+ * same variance: the plane index goes to the one added first, and so does the
+ * last kept slot. For two planes this reproduces the two-image decision,
+ * except where the Q16.16 difference rounds exactly to the threshold.
+ */
+
+#ifndef FOCUS_STACK_H_
+#define FOCUS_STACK_H_
+
+#include <stdint.h>
+
+/** @brief Maximum number of planes in a stack (plane indices are 8-bit). */
+#define FOCUS_STACK_MAX_PLANES 255
+
+/** @brief Highest variances kept per pixel, and so the largest tie set that is averaged. */
+#define FOCUS_STACK_MAX_TIES 4
+
+/**
+ * @brief Running per-pixel state of a focus stack.
+ */
+typedef struct {
+    int width;               /**< Plane width. */
+    int height;              /**< Plane height. */
+    int num_planes;          /**< Planes added so far. */
+    int64_t sum_var;         /**< Sum of all variance values added so far. */
+    int64_t var_count;       /**< Number of variance values added so far. */
+    int32_t* top_var;        /**< FOCUS_STACK_MAX_TIES planes of the highest variances (Q16.16), descending. */
+    uint8_t* top_pixel;      /**< Pixel values of the planes of top_var, in the same layout. */
+    uint8_t* plane_index;    /**< Plane index with the highest variance per pixel. */
+} focus_stack;
+
+/**
+ * @brief Allocate the per-pixel state of a focus stack.
+ *
+ * @param fs     Stack to initialize.
+ * @param width  Plane width.
+ * @param height Plane height.
+ * @return 0 on success, -1 on allocation failure.
+ */
+int focus_stack_init(focus_stack* fs, int width, int height);
+
+/**
+ * @brief Fold one plane into the highest variances per pixel.
+ *
+ * The plane gets the next plane index, in the order of the calls.
+ *
+ * @param fs      Initialized stack with fewer than FOCUS_STACK_MAX_PLANES planes.
+ * @param plane   8-bit pixels of the plane.
+ * @param var_map Local variance of the plane's IMF (see calculate_local_variance()).
+ */
+void focus_stack_add_plane(focus_stack* fs, const unsigned char* plane, const int32_t* var_map);
+
+/**
+ * @brief Write the fused image: the best plane's pixel, or the rounded mean of tied planes.
+ *
+ * @param fs        Stack with at least one plane.
+ * @param fused_img Output 8-bit image (width * height).
+ */
+void focus_stack_fuse(const focus_stack* fs, unsigned char* fused_img);
+
+/**
+ * @brief Release the per-pixel state.
+ *
+ * @param fs Stack to release.
+ */
+void focus_stack_free(focus_stack* fs);
+
+/**
+ * @brief Fuse a whole stack: EMD, local variance and selection per plane.
+ *
+ * Only one Q16.16 signal and one variance map are allocated, and both are
+ * reused for every plane. The EMD and variance of each plane run once.
+ *
+ * @param planes      Array of num_planes pointers to 8-bit planes.
+ * @param num_planes  Number of planes (1..FOCUS_STACK_MAX_PLANES).
+ * @param width       Plane width.
+ * @param height      Plane height.
+ * @param emd_mode    EMD_MODE_1D or EMD_MODE_2D.
+ * @param fused_img   Output fused 8-bit image.
+ * @param plane_index Output plane index per pixel, may be NULL.
+ * @return 0 on success, -1 on invalid arguments, allocation failure or a plane the EMD cannot decompose.
+ */
+int focus_stack_fuse_planes(const unsigned char* const* planes, int num_planes, int width, int height,
+                            int emd_mode, unsigned char* fused_img, uint8_t* plane_index);
+
+#endif /* FOCUS_STACK_H_ */
@@ -0,0 +1,298 @@
+/*
+ * frame_stream.c
+ *
+ */
+
+#include "frame_stream.h"
+
+#if !defined(__ADSP21000__)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include "spsc_ring.h"
+#include "emd_fusion.h"
+#include "trace.h"
+
+/** One frame pair and its fused result, recycled through the rings. */
+typedef struct {
+    unsigned char* img[2];
+    unsigned char* fused;
+    double t_captured;
+    int failed;  /**< The pair could not be fused; the writer skips it. */
+} stream_frame;
+
+typedef struct {
+    FILE* in;
+    FILE* out;
+    unsigned int width;
+    unsigned int height;
+    spsc_ring free_ring;
+    spsc_ring ready_ring;
+    spsc_ring done_ring;
+    stream_frame frames[FRAME_STREAM_POOL];
+    int producer_done;
+    int fusion_done;
+    int stop;  /**< Set to end the producer before the end of the replay. */
+    int error;
+    double* latencies;
+    int num_latencies;
+    int latency_capacity;
+} frame_stream;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/**
+ * Pop from a ring, yielding while it is empty. Returns NULL once the ring is
+ * empty and *upstream_done is set.
+ */
+static void* wait_pop(spsc_ring* ring, const int* upstream_done) {
+    for (;;) {
+        void* item = spsc_ring_pop(ring);
+        if (item != NULL) {
+            return item;
+        }
+        if (__atomic_load_n(upstream_done, __ATOMIC_ACQUIRE)) {
+            // Re-check: the last push happens before the done flag is set.
+            return spsc_ring_pop(ring);
+        }
+        sched_yield();
+    }
+}
+
+/** Push to a ring that cannot overflow (it has room for the whole pool). */
+static void ring_push(spsc_ring* ring, void* item) {
+    while (spsc_ring_push(ring, item) != 0) {
+        sched_yield();
+    }
+}
+
+static void* producer_main(void* arg) {
+    frame_stream* fs = (frame_stream*)arg;
+    size_t num_pixels = (size_t)fs->width * fs->height;
+
+    for (;;) {
+        stream_frame* frame = wait_pop(&fs->free_ring, &fs->stop);
+        unsigned int dims[2];
+
+        if (frame == NULL || __atomic_load_n(&fs->stop, __ATOMIC_ACQUIRE)) {
+            break; // Stopped before the end of the replay.
+        }
+        if (fread(dims, sizeof(unsigned int), 2, fs->in) != 2) {
+            break; // End of the replay.
+        }
+        TRACE_BEGIN(TRACE_STAGE_READ);
+        int ok = dims[0] == fs->width && dims[1] == fs->height &&
+                 fread(frame->img[0], 1, num_pixels, fs->in) == num_pixels &&
+                 fread(frame->img[1], 1, num_pixels, fs->in) == num_pixels;
+        TRACE_END(TRACE_STAGE_READ);
+        if (!ok) {
+            printf("Error: Malformed frame pair in replay file.\n");
+            __atomic_store_n(&fs->error, 1, __ATOMIC_RELAXED);
+            break;
+        }
+        frame->t_captured = now_ms();
+        ring_push(&fs->ready_ring, frame);
+    }
+
+    __atomic_store_n(&fs->producer_done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static void* writer_main(void* arg) {
+    frame_stream* fs = (frame_stream*)arg;
+    size_t num_pixels = (size_t)fs->width * fs->height;
+    stream_frame* frame;
+
+    while ((frame = wait_pop(&fs->done_ring, &fs->fusion_done)) != NULL) {
+        TRACE_BEGIN(TRACE_STAGE_SAVE);
+        if (fs->out != NULL && !frame->failed &&
+            (fwrite(&fs->width, sizeof(fs->width), 1, fs->out) != 1 ||
+             fwrite(&fs->height, sizeof(fs->height), 1, fs->out) != 1 ||
+             fwrite(frame->fused, 1, num_pixels, fs->out) != num_pixels)) {
+            printf("Error: Failed to write fused frame.\n");
+            __atomic_store_n(&fs->error, 1, __ATOMIC_RELAXED);
+        }
+        TRACE_END(TRACE_STAGE_SAVE);
+
+        if (fs->num_latencies == fs->latency_capacity) {
+            int capacity = fs->latency_capacity ? 2 * fs->latency_capacity : 256;
+            double* grown = realloc(fs->latencies, (size_t)capacity * sizeof(double));
+            if (grown != NULL) {
+                fs->latencies = grown;
+                fs->latency_capacity = capacity;
+            }
+        }
+        if (fs->num_latencies < fs->latency_capacity) {
+            fs->latencies[fs->num_latencies++] = now_ms() - frame->t_captured;
+        }
+
+        ring_push(&fs->free_ring, frame);
+    }
+    return NULL;
+}
+
+static int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double* sorted, int count, double q) {
+    int index = (int)(q * count + 0.999999) - 1;
+    if (index < 0) index = 0;
+    if (index >= count) index = count - 1;
+    return sorted[index];
+}
+
+int frame_stream_write_replay(const char* path, const unsigned char* imgA, const unsigned char* imgB,
+                              unsigned int width, unsigned int height, int num_frames) {
+    size_t num_pixels = (size_t)width * height;
+    FILE* fp = fopen(path, "wb");
+    if (fp == NULL) {
+        printf("Error: Cannot open file %s for writing.\n", path);
+        return -1;
+    }
+    for (int k = 0; k < num_frames; k++) {
+        if (fwrite(&width, sizeof(width), 1, fp) != 1 || fwrite(&height, sizeof(height), 1, fp) != 1 ||
+            fwrite(imgA, 1, num_pixels, fp) != num_pixels || fwrite(imgB, 1, num_pixels, fp) != num_pixels) {
+            printf("Error: Failed to write replay file %s.\n", path);
+            fclose(fp);
+            return -1;
+        }
+    }
+    fclose(fp);
+    return 0;
+}
+
+int frame_stream_run(const char* replay_path, const char* output_path, int num_threads, int emd_mode,
+                     int incremental, frame_stream_stats* stats) {
+    frame_stream fs;
+    emd_fusion_config config;
+    emd_fusion_ctx ctx;
+    int64_t tiles_skipped = 0;
+    int64_t tiles = 0;
+    pthread_t producer, writer;
+    unsigned int dims[2];
+    int result = -1;
+
+    memset(&fs, 0, sizeof(fs));
+    memset(&ctx, 0, sizeof(ctx));
+    memset(stats, 0, sizeof(*stats));
+
+    // Successive frames of a stream are the case the incremental mode is made for; it runs serially.
+    emd_fusion_config_default(&config);
+    config.emd_mode = emd_mode;
+    if (incremental) {
+        config.incremental = 1;
+    } else {
+        config.threads = num_threads;
+    }
+
+    fs.in = fopen(replay_path, "rb");
+    if (fs.in == NULL) {
+        printf("Error: Cannot open replay file %s.\n", replay_path);
+        return -1;
+    }
+    if (fread(dims, sizeof(unsigned int), 2, fs.in) != 2 || dims[0] == 0 || dims[1] == 0) {
+        printf("Error: Replay file %s has no frames.\n", replay_path);
+        fclose(fs.in);
+        return -1;
+    }
+    rewind(fs.in);
+    fs.width = dims[0];
+    fs.height = dims[1];
+    size_t num_pixels = (size_t)fs.width * fs.height;
+
+    if (output_path != NULL && (fs.out = fopen(output_path, "wb")) == NULL) {
+        printf("Error: Cannot open file %s for writing.\n", output_path);
+        fclose(fs.in);
+        return -1;
+    }
+
+    // Every ring can hold the whole pool, so pushes never fail for long.
+    if (spsc_ring_init(&fs.free_ring, FRAME_STREAM_POOL) != 0 ||
+        spsc_ring_init(&fs.ready_ring, FRAME_STREAM_POOL) != 0 ||
+        spsc_ring_init(&fs.done_ring, FRAME_STREAM_POOL) != 0 ||
+        emd_fusion_init(&ctx, (int)fs.width, (int)fs.height, &config, NULL, 0) != 0) {
+        goto cleanup;
+    }
+    for (int k = 0; k < FRAME_STREAM_POOL; k++) {
+        stream_frame* frame = &fs.frames[k];
+        frame->img[0] = malloc(num_pixels);
+        frame->img[1] = malloc(num_pixels);
+        frame->fused = malloc(num_pixels);
+        if (!frame->img[0] || !frame->img[1] || !frame->fused) {
+            goto cleanup;
+        }
+        spsc_ring_push(&fs.free_ring, frame);
+    }
+
+    double t_start = now_ms();
+    if (pthread_create(&producer, NULL, producer_main, &fs) != 0) {
+        printf("Error: Cannot start the stream producer thread.\n");
+        goto cleanup;
+    }
+    if (pthread_create(&writer, NULL, writer_main, &fs) != 0) {
+        printf("Error: Cannot start the stream writer thread.\n");
+        __atomic_store_n(&fs.stop, 1, __ATOMIC_RELEASE);
+        pthread_join(producer, NULL);
+        goto cleanup;
+    }
+
+    // Fusion stage on the calling thread.
+    stream_frame* frame;
+    while ((frame = wait_pop(&fs.ready_ring, &fs.producer_done)) != NULL) {
+        frame->failed = emd_fusion_run(&ctx, frame->img[0], frame->img[1], frame->fused) != 0;
+        if (frame->failed) {
+            __atomic_store_n(&fs.error, 1, __ATOMIC_RELAXED);
+        }
+        if (incremental) {
+            tiles_skipped += ctx.incremental.tiles_static + ctx.incremental.tiles_equal;
+            tiles += 2 * ctx.incremental.tiles;
+        }
+        ring_push(&fs.done_ring, frame);
+    }
+    __atomic_store_n(&fs.fusion_done, 1, __ATOMIC_RELEASE);
+
+    pthread_join(producer, NULL);
+    pthread_join(writer, NULL);
+    double t_end = now_ms();
+
+    stats->frames = fs.num_latencies;
+    stats->seconds = (t_end - t_start) / 1e3;
+    stats->frames_per_second = (stats->seconds > 0.0) ? stats->frames / stats->seconds : 0.0;
+    if (fs.num_latencies > 0) {
+        qsort(fs.latencies, (size_t)fs.num_latencies, sizeof(double), compare_double);
+        stats->latency_p50_ms = percentile(fs.latencies, fs.num_latencies, 0.50);
+        stats->latency_p90_ms = percentile(fs.latencies, fs.num_latencies, 0.90);
+        stats->latency_p99_ms = percentile(fs.latencies, fs.num_latencies, 0.99);
+        stats->latency_max_ms = fs.latencies[fs.num_latencies - 1];
+    }
+    stats->tiles_skipped_pct = (tiles > 0) ? 100.0 * tiles_skipped / tiles : 0.0;
+    result = fs.error ? -1 : 0;
+
+cleanup:
+    emd_fusion_free(&ctx);
+    for (int k = 0; k < FRAME_STREAM_POOL; k++) {
+        free(fs.frames[k].img[0]);
+        free(fs.frames[k].img[1]);
+        free(fs.frames[k].fused);
+    }
+    free(fs.latencies);
+    spsc_ring_free(&fs.free_ring);
+    spsc_ring_free(&fs.ready_ring);
+    spsc_ring_free(&fs.done_ring);
+    if (fs.out != NULL) fclose(fs.out);
+    fclose(fs.in);
+    return result;
+}
+
+#endif /* !__ADSP21000__ */
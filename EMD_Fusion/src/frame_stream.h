@@ -0,0 +1,80 @@
+/*
+ * frame_stream.h
+ *
+ * @brief Header file for continuous frame-pair streaming (hosted builds only).
+ *
+ * Three stages run on their own threads and hand frames over through lock-free
+ * SPSC rings:
+ *
+ *   producer --ready--> fusion --done--> writer --free--> producer
+ *
+ * The producer replays frame pairs from a file, standing in for the camera.
+ * The fusion stage runs the parallel pipeline, or the serial incremental mode
+ * (see incremental_fusion.h), which recomputes only what changed since the
+ * previous frame. The writer appends the fused
+ * frames to the output file. A fixed pool of FRAME_STREAM_POOL frames circulates
+ * through the rings, so frame k + 1 is fused while frame k is written out, and
+ * no buffer is allocated after start-up.
+ *
+ * Replay and output files are sequences of records in the fused_image.bin
+ * layout: width and height as 32-bit unsigned integers, followed by the pixels.
+ * A replay record carries two images (A then B), an output record one.
+ */
+
+#ifndef FRAME_STREAM_H_
+#define FRAME_STREAM_H_
+
+#if !defined(__ADSP21000__)
+
+/** @brief Frames circulating between the stages. */
+#define FRAME_STREAM_POOL 4
+
+/**
+ * @brief Throughput and latency of a streaming run.
+ *
+ * Latency is measured per frame from the end of its read to the end of its write.
+ */
+typedef struct {
+    int frames;                 /**< Frames fused and written. */
+    double seconds;             /**< Wall time of the run. */
+    double frames_per_second;   /**< Sustained throughput. */
+    double latency_p50_ms;      /**< Median frame latency. */
+    double latency_p90_ms;      /**< 90th percentile frame latency. */
+    double latency_p99_ms;      /**< 99th percentile frame latency. */
+    double latency_max_ms;      /**< Worst frame latency. */
+    double tiles_skipped_pct;   /**< Tiles the incremental mode did not recompute, in percent (0 without it). */
+} frame_stream_stats;
+
+/**
+ * @brief Write a replay file repeating one frame pair.
+ *
+ * @param path       Replay file to create.
+ * @param imgA       First 8-bit image.
+ * @param imgB       Second 8-bit image.
+ * @param width      Image width.
+ * @param height     Image height.
+ * @param num_frames Number of records to write.
+ * @return 0 on success, -1 on I/O error.
+ */
+int frame_stream_write_replay(const char* path, const unsigned char* imgA, const unsigned char* imgB,
+                              unsigned int width, unsigned int height, int num_frames);
+
+/**
+ * @brief Stream every frame pair of a replay file through the fusion pipeline.
+ *
+ * All records must have the dimensions of the first one.
+ *
+ * @param replay_path Replay file to read.
+ * @param output_path Output file for the fused frames, or NULL to discard them.
+ * @param num_threads Threads of the fusion stage (see parallel_fusion_init()), unless incremental.
+ * @param emd_mode    EMD_MODE_1D or EMD_MODE_2D.
+ * @param incremental 1 to fuse serially in the incremental mode (EMD_MODE_1D only), 0 otherwise.
+ * @param stats       Output throughput and latency statistics.
+ * @return 0 on success, -1 on error.
+ */
+int frame_stream_run(const char* replay_path, const char* output_path, int num_threads, int emd_mode,
+                     int incremental, frame_stream_stats* stats);
+
+#endif /* !__ADSP21000__ */
+
+#endif /* FRAME_STREAM_H_ */
@@ -6,141 +6,203 @@
  */
 
 #include "fusion.h"
-#include "led.h"
-
-/** Named constants for alpha mask decisions. */
-#define ALPHA_A    0
-#define ALPHA_B    1
-#define ALPHA_AVG  2
+#include "decision_mask.h"
+#include "pixel_kernels.h"
+#include "image_io.h"
+#include "trace.h"
+#include <string.h>
 
 void fuse_images(const unsigned char* imgA, const unsigned char* imgB,
                  const char* alpha_mask, int width, int height, unsigned char* fused_img) {
-	#pragma vector_for
-    for (int i = 0; i < width * height; i++) {
-        switch (alpha_mask[i]) {
-            case ALPHA_A:
-                fused_img[i] = imgA[i];
-                break;
-            case ALPHA_B:
-                fused_img[i] = imgB[i];
-                break;
-            case ALPHA_AVG:
-                fused_img[i] = (imgA[i] + imgB[i] + 1) >> 1;
-                break;
-        }
+    TRACE_BEGIN(TRACE_STAGE_DECISION);
+    pixel_kernels_get()->mask_select(imgA, imgB, alpha_mask, fused_img, width * height);
+    TRACE_END(TRACE_STAGE_DECISION);
+}
+
+void fuse_images_var(const unsigned char* imgA, const unsigned char* imgB, const int32_t* var_map1,
+                     const int32_t* var_map2, int num_pixels, int32_t adaptive_epsilon,
+                     unsigned char* fused_img, unsigned char* min_val, unsigned char* max_val) {
+    TRACE_BEGIN(TRACE_STAGE_DECISION);
+    pixel_kernels_get()->fuse_min_max(imgA, imgB, var_map1, var_map2, adaptive_epsilon, fused_img,
+                                      num_pixels, min_val, max_val);
+#if EMD_TRACE
+    // The fused pass stores no mask, so classify the pixels again for the counters.
+    int64_t counts[3] = {0, 0, 0};
+    for (int i = 0; i < num_pixels; i++) {
+        const int32_t diff = (var_map1[i] - var_map2[i] + 0x8000) >> 16;
+        counts[(diff > adaptive_epsilon) ? ALPHA_A : (diff < -adaptive_epsilon) ? ALPHA_B : ALPHA_AVG]++;
     }
+    TRACE_COUNT(TRACE_COUNTER_MASK_A, counts[ALPHA_A]);
+    TRACE_COUNT(TRACE_COUNTER_MASK_B, counts[ALPHA_B]);
+    TRACE_COUNT(TRACE_COUNTER_MASK_AVG, counts[ALPHA_AVG]);
+#endif
+    TRACE_END(TRACE_STAGE_DECISION);
 }
 
-void histogram_stretch(unsigned char* img, int width, int height){
-    int num_pixels = width * height;
-    unsigned char minVal = 255;
-    unsigned char maxVal = 0;
+void fuse_images_rgb(const unsigned char* rgbA, const unsigned char* rgbB, const char* alpha_mask,
+                     int num_pixels, unsigned char* fused_rgb, unsigned char* min_val, unsigned char* max_val) {
+    TRACE_BEGIN(TRACE_STAGE_DECISION);
+    pixel_kernels_get()->mask_select_rgb(rgbA, rgbB, alpha_mask, fused_rgb, num_pixels, min_val, max_val);
+    TRACE_END(TRACE_STAGE_DECISION);
+}
 
-    /* Find the minimum and maximum pixel values. */
+void rgb_to_luma(const unsigned char* rgb, int num_pixels, unsigned char* luma) {
+    TRACE_BEGIN(TRACE_STAGE_CONVERT);
+    #pragma SIMD_for
     for (int i = 0; i < num_pixels; i++) {
-        unsigned char val = img[i];
-        if (val < minVal) {
-            minVal = val;
-        }
-        if (val > maxVal) {
-            maxVal = val;
+        const unsigned char* p = rgb + 3 * i;
+        luma[i] = (unsigned char)((77 * p[0] + 150 * p[1] + 29 * p[2] + 128) >> 8);
+    }
+    TRACE_END(TRACE_STAGE_CONVERT);
+}
+
+void fuse_images_packed(const unsigned char* imgA, const unsigned char* imgB, const uint32_t* packed_mask,
+                        int num_pixels, unsigned char* fused_img, unsigned char* min_val, unsigned char* max_val) {
+    unsigned char lo = 255;
+    unsigned char hi = 0;
+
+    TRACE_BEGIN(TRACE_STAGE_DECISION);
+    for (int base = 0; base < num_pixels; base += MASK_CODES_PER_WORD) {
+        int count = (num_pixels - base < MASK_CODES_PER_WORD) ? (num_pixels - base) : MASK_CODES_PER_WORD;
+        uint32_t word = packed_mask[base / MASK_CODES_PER_WORD];
+        for (int k = 0; k < count; k++, word >>= 2) {
+            int i = base + k;
+            uint32_t code = word & 3;
+            unsigned char val = (code == ALPHA_A) ? imgA[i] :
+                                (code == ALPHA_B) ? imgB[i] :
+                                (unsigned char)((imgA[i] + imgB[i] + 1) >> 1);
+            fused_img[i] = val;
+            if (val < lo) lo = val;
+            if (val > hi) hi = val;
         }
     }
+    *min_val = lo;
+    *max_val = hi;
+    TRACE_END(TRACE_STAGE_DECISION);
+}
+
+void histogram_stretch(unsigned char* img, int width, int height){
+    int num_pixels = width * height;
+    unsigned char minVal, maxVal;
 
-    /* If all pixels are identical, no stretching is needed. */
-    int range = maxVal - minVal;
-    if (range == 0) {
+    if (num_pixels <= 0) {
         return;
     }
 
-    /* Linearly stretch the pixel range to [0..255]. */
-    #pragma vector_for
-    for (int i = 0; i < num_pixels; i++) {
-        int val = (img[i] - minVal) * 255 / range;
+    /* Find the minimum and maximum pixel values. */
+    TRACE_BEGIN(TRACE_STAGE_STRETCH);
+    pixel_kernels_get()->min_max(img, num_pixels, &minVal, &maxVal);
+    TRACE_END(TRACE_STAGE_STRETCH);
+
+    /* Linearly stretch the pixel range to [0..255] through the lookup table. */
+    histogram_stretch_lut(img, num_pixels, minVal, maxVal);
+}
+
+void histogram_stretch_range(unsigned char* img, int num_pixels, unsigned char min_val, unsigned char max_val) {
+    histogram_stretch_lut(img, num_pixels, min_val, max_val);
+}
+
+int histogram_stretch_table(unsigned char* lut, unsigned char min_val, unsigned char max_val) {
+    int range = max_val - min_val;
+    if (range <= 0) {
+        return 0;
+    }
+
+    /* Same mapping as the stretch kernel, evaluated once per pixel value. */
+    for (int v = 0; v < HISTOGRAM_BINS; v++) {
+        int val = (v - min_val) * 255 / range;
         if (val < 0)   val = 0;
         if (val > 255) val = 255;
-        img[i] = (unsigned char)val;
+        lut[v] = (unsigned char)val;
     }
+    return 1;
 }
 
-void save_fused_image(const char *filename, unsigned int width, unsigned int height, const unsigned char *fused_img) {
-	FILE *fp = fopen(filename, "wb");
-    if (fp == NULL) {
-        printf("Error: Cannot open file %s for writing.\n", filename);
-        return;
+void histogram_apply_lut(unsigned char* img, int num_pixels, const unsigned char* lut) {
+    int i = 0;
+
+    TRACE_BEGIN(TRACE_STAGE_STRETCH);
+    /* Four independent lookups per step keep several loads in flight. */
+    for (; i + 4 <= num_pixels; i += 4) {
+        unsigned char p0 = lut[img[i]];
+        unsigned char p1 = lut[img[i + 1]];
+        unsigned char p2 = lut[img[i + 2]];
+        unsigned char p3 = lut[img[i + 3]];
+        img[i] = p0;
+        img[i + 1] = p1;
+        img[i + 2] = p2;
+        img[i + 3] = p3;
+    }
+    for (; i < num_pixels; i++) {
+        img[i] = lut[img[i]];
     }
+    TRACE_END(TRACE_STAGE_STRETCH);
+}
 
-    // Write image width and height (4 bytes each)
-    if (fwrite(&width, sizeof(width), 1, fp) != 1) {
-        printf("Error: Failed to write image width.\n");
-        fclose(fp);
-        return;
+void histogram_stretch_lut(unsigned char* img, int num_pixels, unsigned char min_val, unsigned char max_val) {
+    unsigned char lut[HISTOGRAM_BINS];
+
+    if (histogram_stretch_table(lut, min_val, max_val)) {
+        histogram_apply_lut(img, num_pixels, lut);
     }
-    if (fwrite(&height, sizeof(height), 1, fp) != 1) {
-        printf("Error: Failed to write image height.\n");
-        fclose(fp);
-        return;
+}
+
+void histogram_count(const unsigned char* img, int num_pixels, uint32_t* hist) {
+    // A second histogram for the odd pixels halves the increments that wait on the previous one.
+    uint32_t odd[HISTOGRAM_BINS];
+    int i = 0;
+
+    memset(odd, 0, sizeof(odd));
+    for (; i + 2 <= num_pixels; i += 2) {
+        hist[img[i]]++;
+        odd[img[i + 1]]++;
+    }
+    if (i < num_pixels) {
+        hist[img[i]]++;
+    }
+    for (int v = 0; v < HISTOGRAM_BINS; v++) {
+        hist[v] += odd[v];
     }
+}
 
-    size_t num_pixels = width * height;
-    size_t groups = num_pixels / 4;
-    size_t leftovers = num_pixels % 4;
-    const unsigned char *p = fused_img;
-    size_t segment_size = groups / 8; // Size of segment
-    // Process pixel data in groups of 4 bytes
-    for (size_t i = 0; i < groups; i++) {
-        uint32_t pixelGroup = ((uint32_t)p[0])        |
-                              (((uint32_t)p[1]) << 8)   |
-                              (((uint32_t)p[2]) << 16)  |
-                              (((uint32_t)p[3]) << 24);
-        if (fwrite(&pixelGroup, sizeof(pixelGroup), 1, fp) != 1) {
-            printf("Error: Failed to write grouped pixel data.\n");
-            fclose(fp);
-            return;
-        }
-        // Turning on LE diodes one by one as saving progresses
-        if (segment_size > 0 && (i % segment_size == 0) && (i / segment_size < 7)) {
-            switch(i / segment_size) {
-                case 0:
-                    led_on(7);  // LED8
-                    break;
-                case 1:
-                    led_on(6);  // LED7
-                    break;
-                case 2:
-                    led_on(5);  // LED6
-                    break;
-                case 3:
-                    led_on(4);  // LED5
-                    break;
-                case 4:
-                    led_on(3);  // LED4
-                    break;
-                case 5:
-                    led_on(2);  // LED3
-                    break;
-                case 6:
-                    led_on(1);  // LED2
-                    break;
-                case 7:
-                    led_on(0);  // LED1
-                    break;
-                default:
-                    break;
-            }
-        }
-        p += 4;
+void histogram_percentile_range(const uint32_t* hist, int clip_permille, unsigned char* min_val,
+                                unsigned char* max_val) {
+    int64_t total = 0;
+    for (int v = 0; v < HISTOGRAM_BINS; v++) {
+        total += hist[v];
     }
+    // Pixels that may be clipped on each side, rounded down so that 0 keeps the full range.
+    int64_t clip = total * clip_permille / 1000;
+    int64_t below = 0;
+    int lo = 0;
+    int hi = HISTOGRAM_BINS - 1;
 
-    // Process any remaining pixels individually
-    for (size_t i = 0; i < leftovers; i++) {
-        if (fputc(p[i], fp) == EOF) {
-            printf("Error: Failed to write remaining pixel data.\n");
-            fclose(fp);
-            return;
-        }
+    /* Lowest value with more than clip pixels at or below it, likewise from the top. */
+    while (lo < hi && below + hist[lo] <= clip) {
+        below += hist[lo++];
+    }
+    int64_t above = 0;
+    while (hi > lo && above + hist[hi] <= clip) {
+        above += hist[hi--];
     }
+    *min_val = (unsigned char)lo;
+    *max_val = (unsigned char)hi;
+}
+
+void histogram_stretch_percentile(unsigned char* img, int num_pixels, int clip_permille) {
+    uint32_t hist[HISTOGRAM_BINS];
+    unsigned char min_val, max_val;
+
+    memset(hist, 0, sizeof(hist));
+    histogram_count(img, num_pixels, hist);
+    histogram_percentile_range(hist, clip_permille, &min_val, &max_val);
+    histogram_stretch_lut(img, num_pixels, min_val, max_val);
+}
 
-    fclose(fp);
-    led_on(0);
+int save_fused_image(const char *filename, unsigned int width, unsigned int height, const unsigned char *fused_img) {
+    // Progress is reported through the SAVE stage (the LED sink lights LED1 when it ends).
+    TRACE_BEGIN(TRACE_STAGE_SAVE);
+    int status = image_save(filename, IMAGE_FORMAT_RAW, width, height, fused_img);
+    TRACE_END(TRACE_STAGE_SAVE);
+    return status;
 }
@@ -10,7 +10,10 @@
 #ifndef FUSION_H_
 #define FUSION_H_
 
+#include <stdint.h>
 
+/** @brief Entries of a pixel histogram or lookup table (8-bit pixels). */
+#define HISTOGRAM_BINS 256
 
 /**
  * @brief Fuse two images based on a decision mask.
@@ -26,13 +29,85 @@
  */
 void fuse_images(const unsigned char* imgA, const unsigned char* imgB, const char* alpha_mask, int width, int height, unsigned char* fused_img);
 
+/**
+ * @brief Fuse two images directly from their variance maps, without a mask buffer.
+ *
+ * Produces the same pixels as generate_decision_mask_eps() followed by fuse_images(),
+ * and also returns the pixel range needed by histogram_stretch_lut(), so the fused
+ * image is written once and never re-read before the stretch.
+ *
+ * @param imgA             Pointer to the first image data.
+ * @param imgB             Pointer to the second image data.
+ * @param var_map1         Variance map for the first image.
+ * @param var_map2         Variance map for the second image.
+ * @param num_pixels       Number of pixels (> 0).
+ * @param adaptive_epsilon Threshold from decision_mask_epsilon().
+ * @param fused_img        Output array to store the fused image.
+ * @param min_val          Output minimum fused pixel value.
+ * @param max_val          Output maximum fused pixel value.
+ */
+void fuse_images_var(const unsigned char* imgA, const unsigned char* imgB, const int32_t* var_map1,
+                     const int32_t* var_map2, int num_pixels, int32_t adaptive_epsilon,
+                     unsigned char* fused_img, unsigned char* min_val, unsigned char* max_val);
+
+/**
+ * @brief Fuse two interleaved RGB images with a decision mask made on their luma.
+ *
+ * The three channels of pixel i follow alpha_mask[i] exactly as fuse_images()
+ * selects a grayscale pixel, so one mask (and one EMD and variance pass, on the
+ * luma planes) serves the colour image. Also returns the range over all channels
+ * for histogram_stretch_lut().
+ *
+ * @param rgbA       First image, num_pixels * 3 bytes (R, G, B).
+ * @param rgbB       Second image, num_pixels * 3 bytes.
+ * @param alpha_mask Decision mask, one code per pixel.
+ * @param num_pixels Number of pixels (> 0).
+ * @param fused_rgb  Output image, num_pixels * 3 bytes.
+ * @param min_val    Output minimum fused channel value.
+ * @param max_val    Output maximum fused channel value.
+ */
+void fuse_images_rgb(const unsigned char* rgbA, const unsigned char* rgbB, const char* alpha_mask,
+                     int num_pixels, unsigned char* fused_rgb, unsigned char* min_val, unsigned char* max_val);
+
+/**
+ * @brief Convert interleaved RGB to 8-bit luma.
+ *
+ * Y = (77 R + 150 G + 29 B + 128) >> 8, the BT.601 weights in 8-bit fixed point
+ * (the Y of YCbCr). Chroma is never needed: the colour fusion selects whole RGB
+ * pixels.
+ *
+ * @param rgb        Input image, num_pixels * 3 bytes (R, G, B).
+ * @param num_pixels Number of pixels.
+ * @param luma       Output plane, num_pixels bytes.
+ */
+void rgb_to_luma(const unsigned char* rgb, int num_pixels, unsigned char* luma);
+
+/**
+ * @brief Fuse two images with a packed 2-bit decision mask.
+ *
+ * Same selection as fuse_images(), reading the codes written by
+ * generate_decision_mask_packed(), and also returns the pixel range for
+ * histogram_stretch_lut().
+ *
+ * @param imgA        Pointer to the first image data.
+ * @param imgB        Pointer to the second image data.
+ * @param packed_mask Packed decision mask.
+ * @param num_pixels  Number of pixels (> 0).
+ * @param fused_img   Output array to store the fused image.
+ * @param min_val     Output minimum fused pixel value.
+ * @param max_val     Output maximum fused pixel value.
+ */
+void fuse_images_packed(const unsigned char* imgA, const unsigned char* imgB, const uint32_t* packed_mask,
+                        int num_pixels, unsigned char* fused_img, unsigned char* min_val, unsigned char* max_val);
 
 /**
  * @brief Perform linear histogram stretching on an 8-bit grayscale image.
  *
  * This function scans the image to find the minimum and maximum pixel values,
- * and then linearly stretches all pixel values to cover the full range [0..255].
- * If all pixels have the same value, no stretching is applied.
+ * and then linearly stretches all pixel values to cover the full range [0..255]
+ * through histogram_stretch_lut(). If all pixels have the same value, no
+ * stretching is applied. Pipelines that know the range from the stage that
+ * wrote the pixels call histogram_stretch_lut() directly and skip the scan.
  *
  * @param img    Pointer to the input 8-bit grayscale image.
  * @param width  Image width.
@@ -40,17 +115,112 @@ void fuse_images(const unsigned char* imgA, const unsigned char* imgB, const cha
  */
 void histogram_stretch(unsigned char* img, int width, int height);
 
+/**
+ * @brief Linearly stretch pixels using a known [min_val..max_val] range.
+ *
+ * This is the second half of histogram_stretch(), for callers that gathered the
+ * range themselves (e.g. over several strips of the same image). It is the same
+ * as histogram_stretch_lut(); callers stretching many pieces of one image should
+ * build the table once with histogram_stretch_table() instead.
+ *
+ * @param img        Pointer to the 8-bit pixels to stretch in place.
+ * @param num_pixels Number of pixels.
+ * @param min_val    Minimum pixel value of the whole image.
+ * @param max_val    Maximum pixel value of the whole image.
+ */
+void histogram_stretch_range(unsigned char* img, int num_pixels, unsigned char min_val, unsigned char max_val);
+
+/**
+ * @brief Linearly stretch pixels using a known range through a 256-entry lookup table.
+ *
+ * Same result as histogram_stretch_range(), with the per-pixel multiply and divide
+ * replaced by one table lookup. The range normally comes from the stage that wrote
+ * the pixels (e.g. fuse_images_var()), so the image is read only once.
+ *
+ * @param img        Pointer to the 8-bit pixels to stretch in place.
+ * @param num_pixels Number of pixels.
+ * @param min_val    Minimum pixel value of the whole image.
+ * @param max_val    Maximum pixel value of the whole image.
+ */
+void histogram_stretch_lut(unsigned char* img, int num_pixels, unsigned char min_val, unsigned char max_val);
+
+/**
+ * @brief Build the lookup table of a linear stretch of [min_val..max_val] to [0..255].
+ *
+ * Values outside the range are clamped to 0 and 255. Callers that stretch an image
+ * in several pieces (bands, strips, file chunks) build the table once per frame and
+ * apply it to each piece with histogram_apply_lut().
+ *
+ * @param lut     Output table of HISTOGRAM_BINS entries.
+ * @param min_val Value mapped to 0.
+ * @param max_val Value mapped to 255.
+ * @return 1 if the table was built, 0 if min_val >= max_val (no stretch, lut untouched).
+ */
+int histogram_stretch_table(unsigned char* lut, unsigned char min_val, unsigned char max_val);
+
+/**
+ * @brief Map pixels in place through a lookup table.
+ *
+ * @param img        Pointer to the 8-bit pixels.
+ * @param num_pixels Number of pixels.
+ * @param lut        Table of HISTOGRAM_BINS entries.
+ */
+void histogram_apply_lut(unsigned char* img, int num_pixels, const unsigned char* lut);
+
+/**
+ * @brief Add the pixels of an image to a 256-bin histogram.
+ *
+ * The histogram is not cleared, so pieces of one image can be counted in turn.
+ *
+ * @param img        Pointer to the 8-bit pixels.
+ * @param num_pixels Number of pixels.
+ * @param hist       Histogram of HISTOGRAM_BINS counters.
+ */
+void histogram_count(const unsigned char* img, int num_pixels, uint32_t* hist);
+
+/**
+ * @brief Find the stretch range that clips a share of the pixels on each side.
+ *
+ * min_val is the lowest value with more than clip_permille / 1000 of the pixels at
+ * or below it, max_val likewise from the top. 0 gives the full pixel range, the
+ * same as a min/max scan.
+ *
+ * @param hist          Histogram of HISTOGRAM_BINS counters.
+ * @param clip_permille Pixels clipped on each side, in 1/1000 of the total (0..499).
+ * @param min_val       Output lower end of the range.
+ * @param max_val       Output upper end of the range.
+ */
+void histogram_percentile_range(const uint32_t* hist, int clip_permille, unsigned char* min_val,
+                                unsigned char* max_val);
+
+/**
+ * @brief Percentile-clipped histogram stretch through the lookup table.
+ *
+ * Counts the histogram of the image, takes the range of histogram_percentile_range()
+ * and stretches with histogram_stretch_lut(), so a few outlying pixels no longer
+ * limit the contrast gain. Unlike the min/max range, the histogram is not gathered
+ * by the fusion kernels, so this reads the image once more.
+ *
+ * @param img           Pointer to the 8-bit pixels to stretch in place.
+ * @param num_pixels    Number of pixels.
+ * @param clip_permille Pixels clipped on each side, in 1/1000 of the total (0..499).
+ */
+void histogram_stretch_percentile(unsigned char* img, int num_pixels, int clip_permille);
+
 /**
  * @brief Save the fused image to a binary file.
  *
  * This function writes the fused image to a file in binary format. The file will contain
  * the image width and height (each stored as a 32-bit unsigned integer) followed by the pixel data.
+ * Header and pixels go out in a single write (see image_save()); use image_save()
+ * directly for PGM or BMP output.
  *
  * @param filename  Name of the file to write.
  * @param width     Image width.
  * @param height    Image height.
  * @param fused_img Pointer to the fused image data (8-bit values).
+ * @return 0 on success, -1 if the file cannot be written.
  */
-void save_fused_image(const char *filename, unsigned int width, unsigned int height, const unsigned char *fused_img);
+int save_fused_image(const char *filename, unsigned int width, unsigned int height, const unsigned char *fused_img);
 
 #endif /* FUSION_H_ */
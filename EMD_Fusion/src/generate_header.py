@@ -1,19 +1,23 @@
 import os
+import sys
 from PIL import Image
 import numpy as np
 
-def process_images_in_directory(input_dir="Images"):
+def process_images_in_directory(input_dir="Images", rgb=False):
     """
-    @brief Finds all BMP and JPG images in the specified directory, converts them to grayscale,
-           and generates a corresponding C header file for each image.
+    @brief Finds all BMP and JPG images in the specified directory, converts them to grayscale
+           (or RGB), and generates a corresponding C header file for each image.
 
     @param input_dir Path to the directory containing BMP/JPG images.
                      Default value is 'Images'.
+    @param rgb       Keep the colour: the pixels are written as interleaved R, G, B bytes
+                     for a COLOR_FUSION build. Default value is False (grayscale).
 
     This function iterates over all files in the given directory. If a file has
-    the extension .bmp or .jpg, it is opened, converted to grayscale, and its pixel
-    data is written to a C header file (.h). The array name in the header file is
-    derived from the original image filename (without extension).
+    the extension .bmp or .jpg, it is opened, converted to grayscale or RGB, and its
+    pixel data is written to a C header file (.h) together with its width, height and
+    number of channels. The array name in the header file is derived from the original
+    image filename (without extension).
     """
 
     # Check if the input directory exists.
@@ -32,13 +36,14 @@ def process_images_in_directory(input_dir="Images"):
             array_name = os.path.splitext(filename)[0]
 
             try:
-                # Open and convert the image to 8-bit grayscale.
+                # Open and convert the image to 8-bit grayscale, or to 24-bit RGB.
                 img = Image.open(bmp_file_path)
-                img = img.convert("L")
+                img = img.convert("RGB" if rgb else "L")
                 width, height = img.size
-                
-                # Extract pixel data as a NumPy array of type uint8.
-                pixel_data = np.array(img, dtype=np.uint8)
+                channels = 3 if rgb else 1
+
+                # Extract pixel data as a NumPy array of type uint8, one row of width * channels bytes per line.
+                pixel_data = np.array(img, dtype=np.uint8).reshape(height, width * channels)
 
                 # Write the C header file with width, height, and pixel data.
                 with open(header_file_path, "w") as f:
@@ -47,7 +52,8 @@ def process_images_in_directory(input_dir="Images"):
                     f.write("#include <stdint.h>\n\n")
                     
                     f.write(f"const unsigned int {array_name}_width = {width};\n")
-                    f.write(f"const unsigned int {array_name}_height = {height};\n\n")
+                    f.write(f"const unsigned int {array_name}_height = {height};\n")
+                    f.write(f"const unsigned int {array_name}_channels = {channels};\n\n")
                     f.write(f"const unsigned char {array_name}[] __attribute__((section(\"seg_sdram1\"))) = {{\n")
                     
                     # Write pixel data in hexadecimal format.
@@ -65,4 +71,5 @@ def process_images_in_directory(input_dir="Images"):
                 print(f"Error processing {filename}: {e}")
 
 
-process_images_in_directory("Images")
\ No newline at end of file
+# "python3 generate_header.py --rgb" keeps the colour for a COLOR_FUSION build.
+process_images_in_directory("Images", rgb="--rgb" in sys.argv[1:])
\ No newline at end of file
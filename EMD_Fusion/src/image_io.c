@@ -0,0 +1,521 @@
+/*
+ * image_io.c
+ *
+ */
+
+#include "image_io.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#if !defined(__ADSP21000__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#endif
+
+/** @brief Largest accepted width or height, keeps width * height well inside size_t. */
+#define IMAGE_MAX_DIM 65535u
+
+static uint32_t read_le32(const unsigned char* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t read_le16(const unsigned char* p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static void write_le32(unsigned char* p, uint32_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+/** Bytes per BMP row, padded to a multiple of 4. */
+static size_t bmp_stride(unsigned int width) {
+    return ((size_t)width + 3) & ~(size_t)3;
+}
+
+/** Skip PGM whitespace and '#' comments. Returns the new position. */
+static size_t pgm_skip(const unsigned char* data, size_t size, size_t pos) {
+    while (pos < size) {
+        if (data[pos] == '#') {
+            while (pos < size && data[pos] != '\n') pos++;
+        } else if (data[pos] == ' ' || data[pos] == '\t' || data[pos] == '\r' || data[pos] == '\n') {
+            pos++;
+        } else {
+            break;
+        }
+    }
+    return pos;
+}
+
+/** Read a PGM header field. Returns 0 on success. */
+static int pgm_field(const unsigned char* data, size_t size, size_t* pos, unsigned int* value) {
+    size_t p = pgm_skip(data, size, *pos);
+    unsigned int v = 0;
+    int digits = 0;
+    while (p < size && data[p] >= '0' && data[p] <= '9' && digits < 6) {
+        v = v * 10 + (data[p] - '0');
+        p++;
+        digits++;
+    }
+    if (digits == 0 || digits == 6) return -1;
+    *value = v;
+    *pos = p;
+    return 0;
+}
+
+/** Parse a binary PGM (P5, channels 1) or PPM (P6, channels 3); the raster is used in place. */
+static int parse_pnm(const unsigned char* data, size_t size, unsigned int channels, image_view* view) {
+    size_t pos = 2;
+    unsigned int width, height, maxval;
+
+    if (pgm_field(data, size, &pos, &width) != 0 || pgm_field(data, size, &pos, &height) != 0 ||
+        pgm_field(data, size, &pos, &maxval) != 0) {
+        printf("Error: Malformed PGM/PPM header.\n");
+        return -1;
+    }
+    if (maxval == 0 || maxval > 255) {
+        printf("Error: PGM/PPM maxval %u is not supported (8-bit only).\n", maxval);
+        return -1;
+    }
+    // Exactly one whitespace character separates the header from the raster.
+    pos++;
+    if (width == 0 || height == 0 || width > IMAGE_MAX_DIM || height > IMAGE_MAX_DIM ||
+        pos > size || size - pos < (size_t)width * height * channels) {
+        printf("Error: PGM/PPM raster is truncated or has invalid dimensions.\n");
+        return -1;
+    }
+    view->pixels = data + pos;
+    view->width = width;
+    view->height = height;
+    view->channels = channels;
+    view->format = (channels == 3) ? IMAGE_FORMAT_PPM : IMAGE_FORMAT_PGM;
+    return 0;
+}
+
+/** Unpack a 24-bit BMP raster: flip, drop the row padding and reorder blue-green-red to RGB. */
+static int unpack_bmp24(const unsigned char* pixels, uint32_t width, uint32_t rows, int top_down,
+                        image_view* view) {
+    size_t stride = bmp_stride(3 * width);
+    unsigned char* copy = malloc((size_t)width * rows * 3);
+    if (copy == NULL) {
+        printf("Error: Out of memory unpacking BMP.\n");
+        return -1;
+    }
+    for (uint32_t y = 0; y < rows; y++) {
+        const unsigned char* src = pixels + stride * (top_down ? y : rows - 1 - y);
+        unsigned char* dst = copy + (size_t)y * width * 3;
+        for (uint32_t x = 0; x < 3 * width; x += 3) {
+            dst[x] = src[x + 2];
+            dst[x + 1] = src[x + 1];
+            dst[x + 2] = src[x];
+        }
+    }
+    view->width = width;
+    view->height = rows;
+    view->channels = 3;
+    view->format = IMAGE_FORMAT_BMP24;
+    view->copy = copy;
+    view->pixels = copy;
+    return 0;
+}
+
+static int parse_bmp(const unsigned char* data, size_t size, image_view* view) {
+    if (size < 54) {
+        printf("Error: BMP header is truncated.\n");
+        return -1;
+    }
+    uint32_t offset = read_le32(data + 10);
+    uint32_t info_size = read_le32(data + 14);
+    int32_t width = (int32_t)read_le32(data + 18);
+    int32_t height = (int32_t)read_le32(data + 22);
+    uint16_t bit_count = read_le16(data + 28);
+    uint32_t compression = read_le32(data + 30);
+    uint32_t colors = read_le32(data + 46);
+
+    if ((bit_count != 8 && bit_count != 24) || compression != 0) {
+        printf("Error: Only 8-bit and 24-bit uncompressed BMP files are supported.\n");
+        return -1;
+    }
+    int top_down = (height < 0);
+    uint32_t rows = top_down ? (uint32_t)(-(int64_t)height) : (uint32_t)height;
+    unsigned int row_bytes = (unsigned int)width * (bit_count / 8);
+    if (bit_count == 24) {
+        colors = 0; // No palette.
+    } else if (colors == 0) {
+        colors = 256;
+    }
+    if (width <= 0 || (uint32_t)width > IMAGE_MAX_DIM || rows == 0 || rows > IMAGE_MAX_DIM ||
+        info_size < 40 || colors > 256 || 14 + (size_t)info_size + 4 * (size_t)colors > size) {
+        printf("Error: BMP header has invalid dimensions or palette.\n");
+        return -1;
+    }
+    size_t stride = bmp_stride(row_bytes);
+    if (offset > size || size - offset < stride * (rows - 1) + (size_t)row_bytes) {
+        printf("Error: BMP pixel data is truncated.\n");
+        return -1;
+    }
+    if (bit_count == 24) {
+        return unpack_bmp24(data + offset, (uint32_t)width, rows, top_down, view);
+    }
+
+    // Palette entries are blue, green, red, reserved.
+    const unsigned char* palette = data + 14 + info_size;
+    unsigned char luma[256];
+    int identity = 1;
+    for (uint32_t i = 0; i < 256; i++) {
+        if (i < colors) {
+            const unsigned char* c = palette + 4 * i;
+            luma[i] = (unsigned char)((c[2] * 299 + c[1] * 587 + c[0] * 114 + 500) / 1000);
+        } else {
+            luma[i] = 0;
+        }
+        identity &= (luma[i] == i);
+    }
+
+    view->width = (unsigned int)width;
+    view->height = rows;
+    view->channels = 1;
+    view->format = IMAGE_FORMAT_BMP;
+    if (top_down && stride == (size_t)width && identity) {
+        view->pixels = data + offset;
+        return 0;
+    }
+
+    // Flip, drop the row padding and apply the palette.
+    unsigned char* copy = malloc((size_t)width * rows);
+    if (copy == NULL) {
+        printf("Error: Out of memory unpacking BMP.\n");
+        return -1;
+    }
+    for (uint32_t y = 0; y < rows; y++) {
+        const unsigned char* src = data + offset + stride * (top_down ? y : rows - 1 - y);
+        unsigned char* dst = copy + (size_t)y * width;
+        if (identity) {
+            memcpy(dst, src, (size_t)width);
+        } else {
+            for (int32_t x = 0; x < width; x++) {
+                dst[x] = luma[src[x]];
+            }
+        }
+    }
+    view->copy = copy;
+    view->pixels = copy;
+    return 0;
+}
+
+static int parse_raw(const unsigned char* data, size_t size, image_view* view) {
+    uint32_t width = read_le32(data);
+    uint32_t height = read_le32(data + 4);
+    if (width == 0 || height == 0 || width > IMAGE_MAX_DIM || height > IMAGE_MAX_DIM ||
+        size - IMAGE_RAW_HEADER != (size_t)width * height) {
+        printf("Error: Unknown image format (not PGM, PPM, BMP or raw).\n");
+        return -1;
+    }
+    view->pixels = data + IMAGE_RAW_HEADER;
+    view->width = width;
+    view->height = height;
+    view->channels = 1;
+    view->format = IMAGE_FORMAT_RAW;
+    return 0;
+}
+
+int image_parse(const unsigned char* data, size_t size, image_view* view) {
+    memset(view, 0, sizeof(*view));
+    if (size >= 2 && data[0] == 'P' && (data[1] == '5' || data[1] == '6')) {
+        return parse_pnm(data, size, (data[1] == '6') ? 3 : 1, view);
+    }
+    if (size >= 2 && data[0] == 'B' && data[1] == 'M') {
+        return parse_bmp(data, size, view);
+    }
+    if (size > IMAGE_RAW_HEADER) {
+        return parse_raw(data, size, view);
+    }
+    printf("Error: Image file is too short.\n");
+    return -1;
+}
+
+#if !defined(__ADSP21000__)
+int image_open(const char* path, image_view* view) {
+    struct stat st;
+    memset(view, 0, sizeof(*view));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        printf("Error: Cannot open image %s.\n", path);
+        return -1;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        printf("Error: Image %s is empty.\n", path);
+        close(fd);
+        return -1;
+    }
+    size_t size = (size_t)st.st_size;
+    void* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // The mapping keeps the file referenced.
+    if (map == MAP_FAILED) {
+        printf("Error: Cannot map image %s.\n", path);
+        return -1;
+    }
+    // The pipeline reads the pixels front to back, once.
+    madvise(map, size, MADV_SEQUENTIAL);
+
+    if (image_parse((const unsigned char*)map, size, view) != 0) {
+        printf("Error: Cannot load image %s.\n", path);
+        munmap(map, size);
+        return -1;
+    }
+    view->map = map;
+    view->map_size = size;
+    return 0;
+}
+#endif
+
+size_t image_header(int format, unsigned int width, unsigned int height, unsigned char* header) {
+    if (format == IMAGE_FORMAT_PGM) {
+        return (size_t)sprintf((char*)header, "P5\n%u %u\n255\n", width, height);
+    }
+    if (format == IMAGE_FORMAT_PPM) {
+        return (size_t)sprintf((char*)header, "P6\n%u %u\n255\n", width, height);
+    }
+    if (format == IMAGE_FORMAT_RAW) {
+        write_le32(header, width);
+        write_le32(header + 4, height);
+        return IMAGE_RAW_HEADER;
+    }
+    if (format == IMAGE_FORMAT_BMP) {
+        size_t data_size = bmp_stride(width) * height;
+        memset(header, 0, IMAGE_BMP_HEADER);
+        header[0] = 'B';
+        header[1] = 'M';
+        write_le32(header + 2, (uint32_t)(IMAGE_BMP_HEADER + data_size)); // bfSize
+        write_le32(header + 10, IMAGE_BMP_HEADER);                       // bfOffBits
+        write_le32(header + 14, 40);                                     // biSize
+        write_le32(header + 18, width);                                  // biWidth
+        write_le32(header + 22, height);                                 // biHeight, bottom-up
+        header[26] = 1;                                                  // biPlanes
+        header[28] = 8;                                                  // biBitCount
+        write_le32(header + 34, (uint32_t)data_size);                    // biSizeImage
+        write_le32(header + 38, 2835);                                   // 72 DPI
+        write_le32(header + 42, 2835);
+        write_le32(header + 46, 256);                                    // biClrUsed
+        for (int i = 0; i < 256; i++) {
+            unsigned char* entry = header + 54 + 4 * i;
+            entry[0] = entry[1] = entry[2] = (unsigned char)i;
+        }
+        return IMAGE_BMP_HEADER;
+    }
+    if (format == IMAGE_FORMAT_BMP24) {
+        size_t data_size = bmp_stride(3 * width) * height;
+        memset(header, 0, IMAGE_BMP24_HEADER);
+        header[0] = 'B';
+        header[1] = 'M';
+        write_le32(header + 2, (uint32_t)(IMAGE_BMP24_HEADER + data_size)); // bfSize
+        write_le32(header + 10, IMAGE_BMP24_HEADER);                       // bfOffBits
+        write_le32(header + 14, 40);                                       // biSize
+        write_le32(header + 18, width);                                    // biWidth
+        write_le32(header + 22, height);                                   // biHeight, bottom-up
+        header[26] = 1;                                                    // biPlanes
+        header[28] = 24;                                                   // biBitCount
+        write_le32(header + 34, (uint32_t)data_size);                      // biSizeImage
+        write_le32(header + 38, 2835);                                     // 72 DPI
+        write_le32(header + 42, 2835);
+        return IMAGE_BMP24_HEADER;
+    }
+    return 0;
+}
+
+size_t image_encoded_size(int format, unsigned int width, unsigned int height) {
+    unsigned char header[IMAGE_MAX_HEADER];
+    size_t header_size = image_header(format, width, height, header);
+    if (header_size == 0) {
+        return 0;
+    }
+    size_t row_bytes = (size_t)width * IMAGE_FORMAT_CHANNELS(format);
+    size_t stride = (format == IMAGE_FORMAT_BMP || format == IMAGE_FORMAT_BMP24) ? bmp_stride(row_bytes) : row_bytes;
+    return header_size + stride * height;
+}
+
+size_t image_encode(int format, unsigned int width, unsigned int height, const unsigned char* pixels,
+                    unsigned char* out, size_t capacity) {
+    unsigned char header[IMAGE_MAX_HEADER];
+    size_t header_size = image_header(format, width, height, header);
+    size_t size = image_encoded_size(format, width, height);
+    if (header_size == 0 || capacity < size) {
+        printf("Error: Unknown output format or buffer too small.\n");
+        return 0;
+    }
+    memcpy(out, header, header_size);
+    out += header_size;
+    size_t row_bytes = (size_t)width * IMAGE_FORMAT_CHANNELS(format);
+    if (format != IMAGE_FORMAT_BMP && format != IMAGE_FORMAT_BMP24) {
+        memcpy(out, pixels, row_bytes * height);
+        return size;
+    }
+    size_t stride = bmp_stride(row_bytes);
+    for (unsigned int y = 0; y < height; y++) {
+        unsigned char* row = out + stride * (height - 1 - y);
+        const unsigned char* src = pixels + (size_t)y * row_bytes;
+        if (format == IMAGE_FORMAT_BMP) {
+            memcpy(row, src, row_bytes);
+        } else {
+            for (size_t x = 0; x < row_bytes; x += 3) {
+                row[x] = src[x + 2];
+                row[x + 1] = src[x + 1];
+                row[x + 2] = src[x];
+            }
+        }
+        memset(row + row_bytes, 0, stride - row_bytes);
+    }
+    return size;
+}
+
+#if !defined(__ADSP21000__)
+/** @brief BMP rows gathered per writev(); with padding this stays within IOV_MAX (1024). */
+#define IMAGE_IOV_ROWS 500
+
+/** Write all iovecs, resuming after short writes. Returns 0 on success. */
+static int write_all(int fd, struct iovec* iov, int count) {
+    while (count > 0) {
+        ssize_t written = writev(fd, iov, count);
+        if (written < 0) {
+            return -1;
+        }
+        while (count > 0 && (size_t)written >= iov->iov_len) {
+            written -= (ssize_t)iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char*)iov->iov_base + written;
+            iov->iov_len -= (size_t)written;
+        }
+    }
+    return 0;
+}
+
+int image_save(const char* path, int format, unsigned int width, unsigned int height,
+               const unsigned char* pixels) {
+    unsigned char header[IMAGE_MAX_HEADER];
+    size_t header_size = image_header(format, width, height, header);
+    int rc = 0;
+
+    if (header_size == 0) {
+        printf("Error: Unknown output format %d.\n", format);
+        return -1;
+    }
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        printf("Error: Cannot open file %s for writing.\n", path);
+        return -1;
+    }
+
+    if (format == IMAGE_FORMAT_BMP24) {
+        // The rows are reordered to blue-green-red: encode them once and write them at once.
+        size_t size = image_encoded_size(format, width, height);
+        unsigned char* encoded = malloc(size);
+        struct iovec iov;
+        if (encoded == NULL || image_encode(format, width, height, pixels, encoded, size) != size) {
+            rc = -1;
+        } else {
+            iov.iov_base = encoded;
+            iov.iov_len = size;
+            rc = write_all(fd, &iov, 1);
+        }
+        free(encoded);
+    } else if (format == IMAGE_FORMAT_BMP) {
+        // Rows are stored bottom-up: gather them in reverse, IMAGE_IOV_ROWS per system call.
+        static const unsigned char padding[3];
+        size_t pad = bmp_stride(width) - width;
+        struct iovec iov[1 + 2 * IMAGE_IOV_ROWS];
+        int count = 0;
+        iov[count].iov_base = header;
+        iov[count++].iov_len = header_size;
+        for (unsigned int y = height; y-- > 0 && rc == 0;) {
+            iov[count].iov_base = (void*)(pixels + (size_t)y * width);
+            iov[count++].iov_len = width;
+            if (pad > 0) {
+                iov[count].iov_base = (void*)padding;
+                iov[count++].iov_len = pad;
+            }
+            if (count > 2 * IMAGE_IOV_ROWS - 1 || y == 0) {
+                rc = write_all(fd, iov, count);
+                count = 0;
+            }
+        }
+    } else {
+        // Header and pixels in one system call, straight from the caller's buffer.
+        struct iovec iov[2];
+        iov[0].iov_base = header;
+        iov[0].iov_len = header_size;
+        iov[1].iov_base = (void*)pixels;
+        iov[1].iov_len = (size_t)width * height * IMAGE_FORMAT_CHANNELS(format);
+        rc = write_all(fd, iov, 2);
+    }
+
+    if (close(fd) != 0 || rc != 0) {
+        printf("Error: Failed to write image %s.\n", path);
+        return -1;
+    }
+    return 0;
+}
+#else
+int image_save(const char* path, int format, unsigned int width, unsigned int height,
+               const unsigned char* pixels) {
+    unsigned char header[IMAGE_MAX_HEADER];
+    static const unsigned char padding[3];
+    size_t header_size = image_header(format, width, height, header);
+    int rc = 0;
+
+    if (header_size == 0) {
+        printf("Error: Unknown output format %d.\n", format);
+        return -1;
+    }
+    FILE* fp = fopen(path, "wb");
+    if (fp == NULL) {
+        printf("Error: Cannot open file %s for writing.\n", path);
+        return -1;
+    }
+    rc |= (fwrite(header, 1, header_size, fp) != header_size);
+    if (format == IMAGE_FORMAT_BMP24) {
+        size_t size = image_encoded_size(format, width, height);
+        unsigned char* encoded = malloc(size);
+        if (encoded == NULL || image_encode(format, width, height, pixels, encoded, size) != size) {
+            rc = 1;
+        } else {
+            rc |= (fwrite(encoded + header_size, 1, size - header_size, fp) != size - header_size);
+        }
+        free(encoded);
+    } else if (format == IMAGE_FORMAT_BMP) {
+        size_t pad = bmp_stride(width) - width;
+        for (unsigned int y = height; y-- > 0 && rc == 0;) {
+            rc |= (fwrite(pixels + (size_t)y * width, 1, width, fp) != width);
+            rc |= (fwrite(padding, 1, pad, fp) != pad);
+        }
+    } else {
+        size_t num_bytes = (size_t)width * height * IMAGE_FORMAT_CHANNELS(format);
+        rc |= (fwrite(pixels, 1, num_bytes, fp) != num_bytes);
+    }
+    if (fclose(fp) != 0 || rc != 0) {
+        printf("Error: Failed to write image %s.\n", path);
+        return -1;
+    }
+    return 0;
+}
+#endif
+
+void image_close(image_view* view) {
+#if !defined(__ADSP21000__)
+    if (view->map != NULL) {
+        munmap(view->map, view->map_size);
+    }
+#endif
+    free(view->copy);
+    memset(view, 0, sizeof(*view));
+}
@@ -0,0 +1,151 @@
+/*
+ * image_io.h
+ *
+ * @brief Header file for loading input images and writing output images at run time.
+ *
+ * Three 8-bit grayscale formats are recognised from their content:
+ *   - PGM (binary "P5", maxval up to 255; samples are used unscaled),
+ *   - BMP (8 bits per pixel, uncompressed, any palette),
+ *   - raw: the fused_image.bin layout, i.e. width and height as 32-bit
+ *     little-endian unsigned integers followed by exactly width * height pixels.
+ * and two 24-bit colour formats, read as interleaved RGB (3 channels):
+ *   - PPM (binary "P6", maxval up to 255),
+ *   - BMP (24 bits per pixel, uncompressed).
+ *
+ * image_parse() works on any buffer. On hosted builds image_open() maps the
+ * file read-only with mmap and parses it in place, so the returned view
+ * points into the page cache and the pixels are never copied. The exception
+ * is a BMP whose rows cannot be read in place: bottom-up rows, row padding, or
+ * a palette that is not the identity grey ramp. Such a file is unpacked once
+ * into an owned buffer, as is every 24-bit BMP (its channels are stored
+ * blue first).
+ *
+ * The writers produce the same five formats. The 8-bit BMP follows
+ * Debug/generate_bmp_image.py: a 54-byte header, a 256-entry grey palette
+ * (blue, green, red, 0) and bottom-up rows padded to 4 bytes. image_encode()
+ * fills a caller buffer. On hosted builds, image_save() writes PGM and raw
+ * files with a single writev() of the header and the caller's pixels, without
+ * copying them. BMP rows are gathered from the caller's buffer in reverse
+ * order, a few hundred rows per writev(). A 24-bit BMP is encoded into one
+ * buffer first, since its rows are converted to blue-green-red. SHARC builds
+ * fall back to stdio with one fwrite() per block (per row for 8-bit BMP).
+ */
+
+#ifndef IMAGE_IO_H_
+#define IMAGE_IO_H_
+
+#include <stddef.h>
+
+#define IMAGE_FORMAT_PGM 0
+#define IMAGE_FORMAT_BMP 1
+#define IMAGE_FORMAT_RAW 2
+#define IMAGE_FORMAT_PPM 3    /**< 24-bit colour, binary "P6". */
+#define IMAGE_FORMAT_BMP24 4  /**< 24-bit colour BMP. */
+
+/** @brief Channels of a format's pixels: 3 (interleaved RGB) for PPM and 24-bit BMP, 1 otherwise. */
+#define IMAGE_FORMAT_CHANNELS(format) \
+    (((format) == IMAGE_FORMAT_PPM || (format) == IMAGE_FORMAT_BMP24) ? 3 : 1)
+
+/** @brief Bytes of the raw (fused_image.bin) header: width and height. */
+#define IMAGE_RAW_HEADER 8
+
+/** @brief Bytes of the BMP headers and palette written by the encoder. */
+#define IMAGE_BMP_HEADER (54 + 256 * 4)
+
+/** @brief Bytes of the 24-bit BMP headers (no palette). */
+#define IMAGE_BMP24_HEADER 54
+
+/** @brief Largest header written by image_header(). */
+#define IMAGE_MAX_HEADER IMAGE_BMP_HEADER
+
+/**
+ * @brief Read-only view of an 8-bit grayscale or 24-bit RGB image.
+ */
+typedef struct {
+    const unsigned char* pixels; /**< width * height pixels of channels bytes, row-major, top row first. */
+    unsigned int width;          /**< Image width. */
+    unsigned int height;         /**< Image height. */
+    unsigned int channels;       /**< 1 for grayscale, 3 for interleaved RGB. */
+    int format;                  /**< IMAGE_FORMAT_PGM, _BMP, _RAW, _PPM or _BMP24. */
+    void* map;                   /**< File mapping owned by the view, or NULL. */
+    size_t map_size;             /**< Length of the mapping. */
+    unsigned char* copy;         /**< Unpacked BMP pixels owned by the view, or NULL. */
+} image_view;
+
+/**
+ * @brief Parse an image held in memory.
+ *
+ * The view points into data when the pixels can be read in place, so data
+ * must outlive it. Release the view with image_close().
+ *
+ * @param data Encoded image.
+ * @param size Length of data in bytes.
+ * @param view Output view.
+ * @return 0 on success, -1 if the format is unknown, malformed or unsupported.
+ */
+int image_parse(const unsigned char* data, size_t size, image_view* view);
+
+#if !defined(__ADSP21000__)
+/**
+ * @brief Map an image file and parse it (hosted builds only).
+ *
+ * @param path Image file.
+ * @param view Output view; release it with image_close().
+ * @return 0 on success, -1 on error.
+ */
+int image_open(const char* path, image_view* view);
+#endif
+
+/**
+ * @brief Build the header of an encoded image.
+ *
+ * @param format IMAGE_FORMAT_PGM, _BMP, _RAW, _PPM or _BMP24.
+ * @param width  Image width.
+ * @param height Image height.
+ * @param header Output, at least IMAGE_MAX_HEADER bytes.
+ * @return Header length in bytes, 0 for an unknown format.
+ */
+size_t image_header(int format, unsigned int width, unsigned int height, unsigned char* header);
+
+/**
+ * @brief Size of an encoded image, header included.
+ *
+ * @return Size in bytes, 0 for an unknown format.
+ */
+size_t image_encoded_size(int format, unsigned int width, unsigned int height);
+
+/**
+ * @brief Encode an image into a caller buffer.
+ *
+ * @param format   IMAGE_FORMAT_PGM, _BMP, _RAW, _PPM or _BMP24.
+ * @param width    Image width.
+ * @param height   Image height.
+ * @param pixels   width * height pixels of IMAGE_FORMAT_CHANNELS(format) bytes, top row first.
+ * @param out      Output buffer.
+ * @param capacity Size of out; image_encoded_size() bytes are needed.
+ * @return Bytes written, 0 if the format is unknown or out is too small.
+ */
+size_t image_encode(int format, unsigned int width, unsigned int height, const unsigned char* pixels,
+                    unsigned char* out, size_t capacity);
+
+/**
+ * @brief Write an image file.
+ *
+ * @param path   Output file, created or truncated.
+ * @param format IMAGE_FORMAT_PGM, _BMP, _RAW, _PPM or _BMP24.
+ * @param width  Image width.
+ * @param height Image height.
+ * @param pixels width * height pixels of IMAGE_FORMAT_CHANNELS(format) bytes, top row first.
+ * @return 0 on success, -1 on error.
+ */
+int image_save(const char* path, int format, unsigned int width, unsigned int height,
+               const unsigned char* pixels);
+
+/**
+ * @brief Release the mapping and buffer held by a view.
+ *
+ * @param view View returned by image_parse() or image_open().
+ */
+void image_close(image_view* view);
+
+#endif /* IMAGE_IO_H_ */
@@ -0,0 +1,340 @@
+/*
+ * incremental_fusion.c
+ *
+ */
+
+#include "incremental_fusion.h"
+#include <string.h>
+#include "trace.h"
+
+/** Reserve bytes at *offset, keeping every buffer 8-byte aligned; NULL when only measuring. */
+static void* carve(unsigned char* base, size_t* offset, size_t bytes) {
+    void* p = (base != NULL) ? base + *offset : NULL;
+    *offset += (bytes + 7) & ~(size_t)7;
+    return p;
+}
+
+static int tile_columns(int width) {
+    return (width + INCREMENTAL_TILE - 1) / INCREMENTAL_TILE;
+}
+
+/** Lay the buffers out from base and return their total size; with base == NULL only measure. */
+static size_t layout(incremental_fusion* inc, unsigned char* base) {
+    size_t num_pixels = (size_t)inc->width * inc->height;
+    size_t num_tiles = (size_t)tile_columns(inc->width) * ((inc->height + INCREMENTAL_TILE - 1) / INCREMENTAL_TILE);
+    size_t offset = 0;
+
+    for (int i = 0; i < 2; i++) {
+        inc->previous[i] = carve(base, &offset, num_pixels);
+    }
+    inc->tile_dirty = carve(base, &offset, 2 * num_tiles);
+    inc->row_dirty = carve(base, &offset, (size_t)inc->height);
+    inc->tiles = (int)num_tiles;
+    return offset;
+}
+
+size_t incremental_fusion_memory_size(int width, int height) {
+    incremental_fusion inc;
+
+    inc.width = width;
+    inc.height = height;
+    return layout(&inc, NULL);
+}
+
+void incremental_fusion_bind(incremental_fusion* inc, int width, int height, void* memory) {
+    inc->width = width;
+    inc->height = height;
+    inc->valid = 0;
+    inc->tiles_static = 0;
+    inc->tiles_equal = 0;
+    inc->tiles_dirty = 0;
+    inc->samples_sifted = 0;
+    inc->rows_variance = 0;
+    layout(inc, (unsigned char*)memory);
+}
+
+/** Flag the tiles of cur that differ from ref and return how many do. */
+static int compare_tiles(const incremental_fusion* inc, const unsigned char* cur, const unsigned char* ref,
+                         unsigned char* dirty) {
+    const int width = inc->width;
+    const int tiles_x = tile_columns(width);
+    int changed = 0;
+
+    memset(dirty, 0, (size_t)inc->tiles);
+    for (int y = 0; y < inc->height; y++) {
+        unsigned char* row = dirty + (y / INCREMENTAL_TILE) * tiles_x;
+        const size_t offset = (size_t)y * width;
+
+        for (int tx = 0; tx < tiles_x; tx++) {
+            int x0 = tx * INCREMENTAL_TILE;
+            int count = (width - x0 < INCREMENTAL_TILE) ? width - x0 : INCREMENTAL_TILE;
+            // A tile already found to differ needs no more rows compared.
+            if (!row[tx] && memcmp(cur + offset + x0, ref + offset + x0, (size_t)count) != 0) {
+                row[tx] = 1;
+                changed++;
+            }
+        }
+    }
+    return changed;
+}
+
+/** Position of next_change() in the tile flags. */
+typedef struct {
+    int y;  /**< Pixel row. */
+    int tx; /**< Tile column in that row. */
+} change_cursor;
+
+/**
+ * Next range [*begin, *end) of flat samples covered by changed tiles, in order.
+ * Runs that continue on the next row are joined. Returns 0 after the last one.
+ */
+static int next_change(const incremental_fusion* inc, const unsigned char* dirty, change_cursor* cursor,
+                       int* begin, int* end) {
+    const int width = inc->width;
+    const int tiles_x = tile_columns(width);
+    int found = 0;
+
+    while (cursor->y < inc->height) {
+        const unsigned char* row = dirty + (cursor->y / INCREMENTAL_TILE) * tiles_x;
+        int tx = cursor->tx;
+        while (tx < tiles_x && !row[tx]) {
+            tx++;
+        }
+        if (tx == tiles_x) {
+            cursor->y++;
+            cursor->tx = 0;
+            continue;
+        }
+        int tx_end = tx;
+        while (tx_end < tiles_x && row[tx_end]) {
+            tx_end++;
+        }
+        int run_begin = cursor->y * width + tx * INCREMENTAL_TILE;
+        int run_end = cursor->y * width + ((tx_end * INCREMENTAL_TILE < width) ? tx_end * INCREMENTAL_TILE : width);
+        if (found && run_begin != *end) {
+            return 1;
+        }
+        if (!found) {
+            *begin = run_begin;
+        }
+        *end = run_end;
+        found = 1;
+        cursor->tx = tx_end;
+        if (tx_end == tiles_x) {
+            cursor->y++;
+            cursor->tx = 0;
+        }
+    }
+    return found;
+}
+
+/** The 1-D sift runs only on a signal with a maximum, a minimum and three extrema (see emd.c). */
+static int sifts(int num_max, int num_min) {
+    return num_max > 0 && num_min > 0 && num_max + num_min >= 3;
+}
+
+/**
+ * Score image i from scratch: the same calls as the full-frame path. The extrema
+ * counts are left to the first update, so frames that always change cost no more.
+ * Returns -1 if the EMD fails.
+ */
+static int full_score(incremental_fusion* inc, int i, const unsigned char* img) {
+    const int width = inc->width;
+    const int height = inc->height;
+    const int num_pixels = width * height;
+
+    convert_to_q16_16(img, inc->signal[i], num_pixels);
+    if (emd_decompose_image_scratch(inc->signal[i], width, height, EMD_MODE_1D, inc->scratch) != 0) {
+        return -1;
+    }
+    inc->var_total[i] = calculate_local_variance_rows(inc->signal[i], width, height, WINDOW_SIZE, 0, height,
+                                                      inc->var_map[i], inc->column_sums,
+                                                      inc->column_sums + width);
+    inc->num_max[i] = -1;
+    inc->num_min[i] = -1;
+    inc->samples_sifted += num_pixels;
+    inc->rows_variance += height;
+    return 0;
+}
+
+/** Take over the IMF, variance and counts of image src as those of image dst. */
+static void copy_state(incremental_fusion* inc, int src, int dst) {
+    size_t bytes = (size_t)inc->width * inc->height * sizeof(int32_t);
+
+    memcpy(inc->signal[dst], inc->signal[src], bytes);
+    memcpy(inc->var_map[dst], inc->var_map[src], bytes);
+    inc->var_total[dst] = inc->var_total[src];
+    inc->num_max[dst] = inc->num_max[src];
+    inc->num_min[dst] = inc->num_min[src];
+}
+
+/** Whether a row within half rows of y had its IMF recomputed. */
+static int row_reached(const incremental_fusion* inc, int y, int half) {
+    int y0 = (y - half > 0) ? y - half : 0;
+    int y1 = (y + half < inc->height - 1) ? y + half : inc->height - 1;
+
+    for (int r = y0; r <= y1; r++) {
+        if (inc->row_dirty[r]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Update the state of image i, which holds the IMF and variance of the pixels ref,
+ * to the pixels img, which differ from ref only in the flagged tiles. Returns -1
+ * without changing the state when the old or the new signal is not sifted, so the
+ * IMF cannot be patched.
+ */
+static int update_score(incremental_fusion* inc, int i, const unsigned char* img, const unsigned char* ref,
+                        const unsigned char* dirty) {
+    const int width = inc->width;
+    const int height = inc->height;
+    const int length = width * height;
+    int next_begin, next_end;
+    change_cursor cursor = { 0, 0 };
+
+    if (inc->num_max[i] < 0) {
+        emd_count_extrema(ref, length, 0, length, &inc->num_max[i], &inc->num_min[i]);
+    }
+    int num_max = inc->num_max[i];
+    int num_min = inc->num_min[i];
+
+    /* Extrema counts of the new signal: only samples begin - 1 .. end of a change can change
+       class. Overlapping windows are merged so that no sample is counted twice. */
+    int has_next = next_change(inc, dirty, &cursor, &next_begin, &next_end);
+    while (has_next) {
+        int lo = (next_begin > 0) ? next_begin - 1 : 0;
+        int hi = (next_end < length) ? next_end + 1 : length;
+        while ((has_next = next_change(inc, dirty, &cursor, &next_begin, &next_end)) && next_begin - 1 <= hi) {
+            hi = (next_end < length) ? next_end + 1 : length;
+        }
+        int old_max, old_min, new_max, new_min;
+        emd_count_extrema(ref, length, lo, hi, &old_max, &old_min);
+        emd_count_extrema(img, length, lo, hi, &new_max, &new_min);
+        num_max += new_max - old_max;
+        num_min += new_min - old_min;
+    }
+    if (!sifts(inc->num_max[i], inc->num_min[i]) || !sifts(num_max, num_min)) {
+        return -1;
+    }
+    inc->num_max[i] = num_max;
+    inc->num_min[i] = num_min;
+
+    /* Sift again the samples whose envelopes the changes reach. The anchors of a range
+       must lie before the next change, otherwise the ranges are joined. */
+    TRACE_BEGIN(TRACE_STAGE_EMD);
+    memset(inc->row_dirty, 0, (size_t)height);
+    cursor.y = 0;
+    cursor.tx = 0;
+    int done = 0;
+    has_next = next_change(inc, dirty, &cursor, &next_begin, &next_end);
+    while (has_next) {
+        int begin = next_begin;
+        int end = next_end;
+        int first, last;
+
+        emd_affected_range(img, length, begin, end, &first, &last);
+        while ((has_next = next_change(inc, dirty, &cursor, &next_begin, &next_end)) && last >= next_begin - 1) {
+            end = next_end;
+            emd_affected_range(img, length, begin, end, &first, &last);
+        }
+        if (first < done) {
+            first = done;
+        }
+        if (first < last) {
+            emd_sift_range(img, length, first, last, inc->signal[i], inc->scratch);
+            memset(inc->row_dirty + first / width, 1, (size_t)((last - 1) / width - first / width + 1));
+            inc->samples_sifted += last - first;
+            done = last;
+        }
+    }
+    TRACE_END(TRACE_STAGE_EMD);
+
+    /* Recompute the variance of the rows whose window holds a changed IMF row, and
+       correct the total by the difference. */
+    const int half = WINDOW_SIZE / 2;
+    int64_t* sums = inc->column_sums;
+    for (int y = 0; y < height;) {
+        if (!row_reached(inc, y, half)) {
+            y++;
+            continue;
+        }
+        int y0 = y;
+        while (y < height && row_reached(inc, y, half)) {
+            y++;
+        }
+        const int32_t* band = inc->var_map[i] + (size_t)y0 * width;
+        int64_t old_sum = 0;
+        for (int k = 0; k < (y - y0) * width; k++) {
+            old_sum += band[k];
+        }
+        int64_t new_sum = calculate_local_variance_rows(inc->signal[i], width, height, WINDOW_SIZE, y0, y,
+                                                        inc->var_map[i], sums, sums + width);
+        inc->var_total[i] += new_sum - old_sum;
+        inc->rows_variance += y - y0;
+    }
+    return 0;
+}
+
+int incremental_fusion_score(incremental_fusion* inc, const unsigned char* imgA, const unsigned char* imgB,
+                             int64_t* sum_var) {
+    const unsigned char* img[2] = { imgA, imgB };
+    const size_t num_pixels = (size_t)inc->width * inc->height;
+
+    inc->tiles_static = 0;
+    inc->tiles_equal = 0;
+    inc->tiles_dirty = 0;
+    inc->samples_sifted = 0;
+    inc->rows_variance = 0;
+
+    for (int i = 0; i < 2; i++) {
+        const unsigned char* ref = inc->previous[i];
+        unsigned char* dirty = inc->tile_dirty;
+        int changed = inc->tiles;
+        int from_a = 0;
+
+        if (inc->valid) {
+            changed = compare_tiles(inc, img[i], ref, dirty);
+        }
+        if (i == 1) {
+            // Image A, scored just before, may be closer to image B than the last image B.
+            unsigned char* dirty_a = inc->tile_dirty + inc->tiles;
+            int changed_a = compare_tiles(inc, imgB, imgA, dirty_a);
+            if (changed_a < changed) {
+                ref = imgA;
+                dirty = dirty_a;
+                changed = changed_a;
+                from_a = 1;
+            }
+        }
+
+        int full = (changed == inc->tiles);
+        if (!full) {
+            if (from_a) {
+                copy_state(inc, 0, 1);
+            }
+            full = (changed > 0 && update_score(inc, i, img[i], ref, dirty) != 0);
+        }
+        if (full) {
+            if (full_score(inc, i, img[i]) != 0) {
+                // The maps of this pair are incomplete, so the next pair is scored in full.
+                inc->valid = 0;
+                return -1;
+            }
+            changed = inc->tiles;
+        } else if (from_a) {
+            inc->tiles_equal += inc->tiles - changed;
+        } else {
+            inc->tiles_static += inc->tiles - changed;
+        }
+        inc->tiles_dirty += changed;
+    }
+
+    memcpy(inc->previous[0], imgA, num_pixels);
+    memcpy(inc->previous[1], imgB, num_pixels);
+    inc->valid = 1;
+    *sum_var = inc->var_total[0] + inc->var_total[1];
+    return 0;
+}
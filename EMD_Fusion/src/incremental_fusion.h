@@ -0,0 +1,116 @@
+/*
+ * incremental_fusion.h
+ *
+ * @brief Header file for the change-detection (incremental) scoring mode.
+ *
+ * Successive pairs of a stream are often largely static, and the two images
+ * of a pair are often identical wherever neither is out of focus. This mode
+ * keeps the IMF, the variance map and the variance total of both images from
+ * the last frame and recomputes only what the changed pixels can reach.
+ *
+ * Each image is split into INCREMENTAL_TILE x INCREMENTAL_TILE tiles and
+ * every tile is compared bytewise with a reference: image A with the last
+ * image A, image B with the last image B or with the current image A,
+ * whichever leaves fewer changed tiles. With image A as the reference its IMF
+ * and variance are taken over first, so wherever the two images and their
+ * surroundings are identical the variance maps are equal, and the decision
+ * averages the pixels there exactly as the full-frame path does.
+ *
+ * The changed samples are then followed through the pipeline (the halo):
+ * the 1-D linear-envelope IMF changes only between the unchanged extrema of
+ * each class around the changed samples (see emd_affected_range()), which are
+ * sifted again with emd_sift_range(), and the local variance changes only in
+ * the rows within WINDOW_SIZE / 2 of a changed IMF row, which are recomputed
+ * while the variance total is corrected by their difference. The variance
+ * maps, and so the decision threshold, the mask and the fused image, are
+ * identical to a full recompute. A frame whose changed tiles cover the
+ * whole image, or whose extrema counts do not allow a sift, is recomputed in
+ * full.
+ */
+
+#ifndef INCREMENTAL_FUSION_H_
+#define INCREMENTAL_FUSION_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "emd.h"
+#include "decision_mask.h"
+
+/** @brief Side of a change-detection tile in pixels. */
+#define INCREMENTAL_TILE 32
+
+/**
+ * @brief Upper bound of incremental_fusion_memory_size() for frames of up to
+ *        num_pixels pixels and height rows.
+ */
+#define INCREMENTAL_FUSION_MEMORY_BYTES(num_pixels, height) \
+    ((size_t)(num_pixels) * 2 + (size_t)(num_pixels) / INCREMENTAL_TILE * 2 + (size_t)(height) * 3 + 64)
+
+/**
+ * @brief State of the incremental mode, reusable across frames of one size.
+ *
+ * The signals, variance maps, column sums and EMD scratch are borrowed from
+ * the owner (see emd_fusion.h), which sizes them for the full frame, and must
+ * not be written by anything else between frames.
+ */
+typedef struct {
+    int width;                  /**< Frame width. */
+    int height;                 /**< Frame height. */
+    int32_t* signal[2];         /**< Borrowed full-size signal buffers, holding the IMFs. */
+    int32_t* var_map[2];        /**< Borrowed full-size variance maps. */
+    int64_t* column_sums;       /**< Borrowed column sums, 2 * width. */
+    const emd_scratch* scratch; /**< Borrowed EMD scratch for width * height samples. */
+    unsigned char* previous[2]; /**< Pixels of images A and B of the last frame. */
+    unsigned char* tile_dirty;  /**< Per tile: differs from the reference (two sets of flags). */
+    unsigned char* row_dirty;   /**< Per row: IMF recomputed in this frame. */
+    int64_t var_total[2];       /**< Sum of each variance map. */
+    int num_max[2];             /**< Maxima of each image, -1 until counted. */
+    int num_min[2];             /**< Minima of each image, -1 until counted. */
+    int valid;                  /**< 1 once the kept state matches the previous pixels. */
+    int tiles;                  /**< Tiles per image. */
+    int tiles_static;           /**< Tiles equal to the last frame, over both images, in the last frame. */
+    int tiles_equal;            /**< Tiles of image B equal to image A in the last frame. */
+    int tiles_dirty;            /**< Tiles recomputed in the last frame, over both images. */
+    int samples_sifted;         /**< IMF samples sifted again in the last frame. */
+    int rows_variance;          /**< Variance rows computed in the last frame. */
+} incremental_fusion;
+
+/**
+ * @brief Bytes of memory needed by incremental_fusion_bind().
+ *
+ * @param width  Frame width.
+ * @param height Frame height.
+ * @return Size in bytes, at most INCREMENTAL_FUSION_MEMORY_BYTES(width * height, height).
+ */
+size_t incremental_fusion_memory_size(int width, int height);
+
+/**
+ * @brief Lay the incremental buffers out in memory of incremental_fusion_memory_size() bytes.
+ *
+ * The borrowed buffers (signal, var_map, column_sums, scratch) are set by the
+ * caller afterwards. The next frame is scored in full.
+ *
+ * @param inc    State to initialize.
+ * @param width  Frame width.
+ * @param height Frame height.
+ * @param memory 8-byte aligned memory.
+ */
+void incremental_fusion_bind(incremental_fusion* inc, int width, int height, void* memory);
+
+/**
+ * @brief Bring the IMFs and variance maps up to date with a frame pair.
+ *
+ * Leaves in var_map[0] and var_map[1] the maps of the 1-D linear-envelope
+ * pipeline for the pair, recomputing only the parts reached by the tiles
+ * that changed against their references.
+ *
+ * @param inc     Bound state.
+ * @param imgA    First 8-bit image, width * height pixels.
+ * @param imgB    Second 8-bit image, width * height pixels.
+ * @param sum_var Output sum of the variance values of both maps, for decision_mask_epsilon().
+ * @return 0 on success, -1 if the EMD could not decompose an image (the state is then reset).
+ */
+int incremental_fusion_score(incremental_fusion* inc, const unsigned char* imgA, const unsigned char* imgB,
+                             int64_t* sum_var);
+
+#endif /* INCREMENTAL_FUSION_H_ */
@@ -17,6 +17,8 @@ void Delay_Cycles(unsigned int delayCount)
     while(delayCount--);
 }
 
+#if defined(__ADSP21000__)
+
 void InitSRU(void)
 {
 	// Configuration for LED1, LED2, LED3 (DPI LEDs)
@@ -136,3 +138,16 @@ void led_off(int led_index)
     }
 }
 
+#else /* Hosted build: no LEDs, keep the API as no-ops. */
+
+void InitSRU(void) {}
+
+void led_init(void) {}
+
+void led_all_off(void) {}
+
+void led_on(int led_index) { (void)led_index; }
+
+void led_off(int led_index) { (void)led_index; }
+
+#endif /* __ADSP21000__ */
@@ -7,18 +7,21 @@
  * @brief Header file for LED control.
  *
  * This file contains the LED mapping definitions and function prototypes for
- * initializing, controlling, and managing the LED system.
+ * initializing, controlling, and managing the LED system. On hosted builds
+ * (no __ADSP21000__) the functions compile to no-ops.
  *****************************************************************************/
 
 #ifndef LED_CONTROL_H
 #define LED_CONTROL_H
 
+#include <stdio.h>
+#if defined(__ADSP21000__)
 #include <sys/platform.h>
 #include <def21489.h>
 #include <sru21489.h>
 #include <SYSREG.h>
-#include <stdio.h>
 #include "adi_initialize.h"
+#endif
 
 /**
  * @brief LED Mapping (From datasheet):
@@ -9,114 +9,749 @@
  * This file demonstrates an image fusion algorithm by performing the following steps:
  * 1. Retrieving image dimensions and input data.
  * 2. Converting 8-bit image data to Q16.16 fixed-point format.
- * 3. Applying EMD decomposition on each signal.
+ * 3. Applying EMD decomposition on each signal (1-D or 2-D mode).
  * 4. Calculating local variance using a 3x3 window.
- * 5. Generating a decision mask based on the variance.
- * 6. Fusing the images using the decision mask.
- * 7. Performing linear histogram stretching to pixel value
- * 8. Saving the fused image to a binary file.
+ * 5. Deciding per pixel from the variance and fusing the images in one pass.
+ * 6. Performing linear histogram stretching to pixel value (through a 256-entry
+ *    table, over the range found in step 5 or, with STRETCH_CLIP_PERMILLE > 0, a
+ *    percentile range from the histogram of the fused image)
+ * 7. Saving the fused image to a binary file (or a PGM/PPM/BMP, see OUTPUT_FORMAT).
+ *
+ * With STRIP_ROWS > 0, steps 2-5 run per strip of rows (see strip_fusion.h)
+ * and the stretch is applied to the output file afterwards.
+ *
+ * With EMD_PYRAMID = 1 or 2, the decision is first made on the pair downsampled
+ * by 2 or 4, and the full-resolution steps 2-5 only run in tiles near focus
+ * boundaries (see pyramid_fusion.h).
+ *
+ * EMD_PRECISION selects the numeric type of steps 2-5: Q16.16 (default),
+ * Q8.8 in 16 bits or float (see precision_kernels.h).
+ *
+ * With COLOR_FUSION = 1 the pair is interleaved RGB: steps 2-5 run on the luma
+ * of the pair, the decision mask selects whole RGB pixels and the output is a
+ * 24-bit PPM or BMP (see emd_fusion_run_rgb()).
+ *
+ * With INCREMENTAL_FUSION = 1, steps 2-4 are recomputed only where the pixels
+ * changed since the last pair or differ between the two images, with the same
+ * output (see incremental_fusion.h).
+ *
+ * With STREAM_FRAMES > 0 (hosted builds), the image pair is replayed as a stream
+ * of STREAM_FRAMES frame pairs through the pipelined streaming mode (see
+ * frame_stream.h), and throughput and latency are reported.
+ *
+ * On hosted builds the pair can be given on the command line as two PGM, BMP or
+ * raw files (PPM or 24-bit BMP with COLOR_FUSION) (see image_io.h), which are mapped rather than compiled in:
+ *   emd_fusion imageA.pgm imageB.pgm
+ * Without arguments the compiled-in pair is used. With COMPILED_IMAGES=0 the
+ * generated headers are left out of the build and the files are required.
+ *
+ * Hosted builds also fuse whole batches of pairs on a pool of workers (see
+ * batch_fusion.h), writing the outputs in OUTPUT_FORMAT:
+ *   emd_fusion --batch <manifest or directory> <output directory> [workers]
+ * Each worker reads the next pair ahead and writes its outputs behind on a
+ * BATCH_IO engine (see async_io.h), and the I/O time hidden behind fusion is
+ * reported where the backend measures it.
+ *
+ * With EMD_TRACE=1 the stages report progress through trace.h: the LED sink on
+ * the board; on hosted builds a stderr log if EMD_TRACE_STDERR is set and a
+ * Chrome trace file if EMD_TRACE_FILE names one.
  *
  * Created on: January 20, 2025.
  * Author: Radislav Kosijer
  */
 
 #include "main.h"
+#if defined(__ADSP21000__)
 #include <sys/platform.h>
 #include "adi_initialize.h"
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#if !defined(__ADSP21000__)
+#include <unistd.h>
+#endif
 #include "emd.h"            // Declarations for EMD functions and conversions.
 #include "decision_mask.h" // Declaration for local variance and decision mask
 #include "fusion.h"       // Declaration for image processing functions
 #include "led.h"         // Declaration for LED control functions
+#include "strip_fusion.h"  // Declaration for the banded (strip) pipeline
+#include "frame_stream.h"   // Declaration for the frame-pair streaming mode (hosted)
+#include "image_io.h"      // Declaration for the run-time image loader
+#include "trace.h"         // Declaration for the progress and instrumentation hooks
+#include "emd_fusion.h"    // Declaration for the reentrant fusion context
+#include "batch_fusion.h"  // Declaration for batch fusion of many pairs (hosted)
+
+/** @brief 1 links the image pair generated by generate_header.py into the binary. */
+#ifndef COMPILED_IMAGES
+#define COMPILED_IMAGES 1
+#endif
+
+#if !COMPILED_IMAGES && defined(__ADSP21000__)
+#error "COMPILED_IMAGES=0 requires a hosted build that can read image files"
+#endif
+
+#if COMPILED_IMAGES
 #include "p27a.h"
 #include "p27b.h"
+#endif
 
-// SDRAM buffers for intermediate processing
-#pragma section("seg_sdram1")
-static char alpha_mask_buffer[MAX_SIGNAL_LEN];
+/** @brief EMD mode used by the pipeline (EMD_MODE_1D or EMD_MODE_2D). */
+#ifndef EMD_MODE
+#define EMD_MODE EMD_MODE_1D
+#endif
 
-#pragma section("seg_sdram1")
-static int32_t buffer_signal1[MAX_SIGNAL_LEN];
+/** @brief 1-D envelope interpolator (EMD_ENVELOPE_LINEAR or EMD_ENVELOPE_SPLINE). */
+#ifndef EMD_ENVELOPE
+#define EMD_ENVELOPE EMD_ENVELOPE_LINEAR
+#endif
 
-#pragma section("seg_sdram1")
-static int32_t buffer_signal2[MAX_SIGNAL_LEN];
+/** @brief Rows per strip for the banded pipeline, 0 selects the full-frame path. */
+#ifndef STRIP_ROWS
+#define STRIP_ROWS 0
+#endif
 
+/**
+ * @brief Widest frame on the target, where the fusion context memory is static
+ *        and sized for it. The compiled pair of generate_header.py is 200 wide.
+ */
+#ifndef FRAME_MAX_WIDTH
+#define FRAME_MAX_WIDTH 200
+#endif
+
+#if FRAME_MAX_WIDTH > VARIANCE_MAX_WIDTH
+#error "FRAME_MAX_WIDTH must not exceed VARIANCE_MAX_WIDTH"
+#endif
+
+/** @brief Widest frame of the banded pipeline; its strip buffers are sized for it. */
+#ifndef STRIP_MAX_WIDTH
+#if defined(__ADSP21000__)
+#define STRIP_MAX_WIDTH FRAME_MAX_WIDTH
+#else
+#define STRIP_MAX_WIDTH VARIANCE_MAX_WIDTH
+#endif
+#endif
+
+#if STRIP_ROWS > 0 && STRIP_MAX_WIDTH > VARIANCE_MAX_WIDTH
+#error "STRIP_MAX_WIDTH must not exceed VARIANCE_MAX_WIDTH"
+#endif
+
+/** @brief Worker threads for the full-frame path on hosted builds, 0 runs serially. */
+#ifndef FUSION_THREADS
+#define FUSION_THREADS 0
+#endif
+
+#if FUSION_THREADS > 0 && defined(__ADSP21000__)
+#error "FUSION_THREADS requires a hosted (POSIX threads) build"
+#endif
+
+/** @brief Frame pairs replayed by the streaming mode on hosted builds, 0 runs once. */
+#ifndef STREAM_FRAMES
+#define STREAM_FRAMES 0
+#endif
+
+#if STREAM_FRAMES > 0 && defined(__ADSP21000__)
+#error "STREAM_FRAMES requires a hosted (POSIX threads) build"
+#endif
+#if STREAM_FRAMES > 0 && STRIP_ROWS > 0
+#error "STREAM_FRAMES and STRIP_ROWS are mutually exclusive"
+#endif
+
+/** @brief 1 keeps 16-bit variance maps and a packed 2-bit mask in the serial full-frame path. */
+#ifndef COMPACT_MASK
+#define COMPACT_MASK 0
+#endif
+
+/** @brief Numeric type of the serial full-frame path (see precision_kernels.h), Q16.16 by default. */
+#ifndef EMD_PRECISION
+#define EMD_PRECISION EMD_PRECISION_Q16
+#endif
+
+/** @brief Coarse-to-fine levels of the serial full-frame path (see pyramid_fusion.h), 0 is off. */
+#ifndef EMD_PYRAMID
+#define EMD_PYRAMID 0
+#endif
+
+/**
+ * @brief Pixels clipped on each side by the histogram stretch of the serial full-frame path,
+ *        in 1/1000 (see histogram_stretch_percentile()), 0 stretches the full fused range.
+ */
+#ifndef STRETCH_CLIP_PERMILLE
+#define STRETCH_CLIP_PERMILLE 0
+#endif
+#if STRETCH_CLIP_PERMILLE > 0 && (STRIP_ROWS > 0 || STREAM_FRAMES > 0)
+#error "STRETCH_CLIP_PERMILLE is only available in the full-frame path"
+#endif
+
+/** @brief 1 fuses an interleaved RGB pair on its luma in the serial full-frame path. */
+#ifndef COLOR_FUSION
+#define COLOR_FUSION 0
+#endif
+#if COLOR_FUSION && (STRIP_ROWS > 0 || STREAM_FRAMES > 0)
+#error "COLOR_FUSION is only available in the full-frame path"
+#endif
+
+/**
+ * @brief 1 recomputes only the tiles that changed since the last pair, or that differ
+ *        between the two images, in the serial full-frame and streaming paths.
+ */
+#ifndef INCREMENTAL_FUSION
+#define INCREMENTAL_FUSION 0
+#endif
+#if INCREMENTAL_FUSION && (STRIP_ROWS > 0 || COMPACT_MASK || FUSION_THREADS > 0 || EMD_PYRAMID > 0 || \
+                           EMD_PRECISION != EMD_PRECISION_Q16 || EMD_MODE != EMD_MODE_1D || \
+                           EMD_ENVELOPE != EMD_ENVELOPE_LINEAR)
+#error "INCREMENTAL_FUSION needs the serial 1-D linear-envelope Q16.16 pipeline with full-width maps"
+#endif
+
+/**
+ * @brief I/O of the batch mode (hosted): ASYNC_IO_AUTO (io_uring, else an I/O thread),
+ *        ASYNC_IO_THREAD, ASYNC_IO_URING, or ASYNC_IO_NONE for synchronous reads and writes.
+ */
+#ifndef BATCH_IO
+#define BATCH_IO ASYNC_IO_AUTO
+#endif
+
+/** @brief Bytes per input and output pixel. */
+#define PIXEL_CHANNELS (COLOR_FUSION ? 3 : 1)
+
+/**
+ * @brief The input image pair, compiled in or mapped from files.
+ */
+typedef struct {
+    const unsigned char* images[2];
+    unsigned int width;
+    unsigned int height;
+#if !defined(__ADSP21000__)
+    image_view views[2];
+#endif
+} input_pair;
+
+/**
+ * @brief Select the input pair: the files named on the command line, or the compiled-in images.
+ *
+ * @return 0 on success, -1 on error.
+ */
+static int open_inputs(int argc, char* argv[], input_pair* in) {
+    memset(in, 0, sizeof(*in));
+#if !defined(__ADSP21000__)
+    if (argc == 3) {
+        if (image_open(argv[1], &in->views[0]) != 0) {
+            return -1;
+        }
+        if (image_open(argv[2], &in->views[1]) != 0) {
+            image_close(&in->views[0]);
+            return -1;
+        }
+        if (in->views[0].width != in->views[1].width || in->views[0].height != in->views[1].height) {
+            printf("Error: Input images differ in size (%ux%u vs %ux%u).\n", in->views[0].width,
+                   in->views[0].height, in->views[1].width, in->views[1].height);
+            image_close(&in->views[0]);
+            image_close(&in->views[1]);
+            return -1;
+        }
+        if (in->views[0].channels != PIXEL_CHANNELS || in->views[1].channels != PIXEL_CHANNELS) {
+            printf("Error: This build fuses %s images (see COLOR_FUSION).\n",
+                   COLOR_FUSION ? "colour (PPM, 24-bit BMP)" : "grayscale");
+            image_close(&in->views[0]);
+            image_close(&in->views[1]);
+            return -1;
+        }
+        in->images[0] = in->views[0].pixels;
+        in->images[1] = in->views[1].pixels;
+        in->width = in->views[0].width;
+        in->height = in->views[0].height;
+        return 0;
+    }
+    if (argc != 1) {
+        printf("Usage: %s [imageA imageB]\n", argv[0]);
+        return -1;
+    }
+#else
+    (void)argc;
+    (void)argv;
+#endif
+#if COMPILED_IMAGES
+#if COLOR_FUSION
+    if (p27a_channels != 3 || p27b_channels != 3) {
+        printf("Error: Generate the compiled-in images with generate_header.py --rgb.\n");
+        return -1;
+    }
+#endif
+    // Assume both images have the same dimensions.
+    in->images[0] = p27a;
+    in->images[1] = p27b;
+    in->width = p27a_width;
+    in->height = p27a_height;
+    return 0;
+#else
+    printf("Error: No compiled-in images; pass two image files.\n");
+    return -1;
+#endif
+}
+
+static void close_inputs(input_pair* in) {
+#if !defined(__ADSP21000__)
+    image_close(&in->views[0]);
+    image_close(&in->views[1]);
+#else
+    (void)in;
+#endif
+}
+
+/**
+ * @brief Format of the full-frame output: IMAGE_FORMAT_RAW (fused_image.bin), _PGM or _BMP;
+ *        with COLOR_FUSION IMAGE_FORMAT_PPM (fused_image.ppm) or _BMP24.
+ */
+#ifndef OUTPUT_FORMAT
+#define OUTPUT_FORMAT (COLOR_FUSION ? IMAGE_FORMAT_PPM : IMAGE_FORMAT_RAW)
+#endif
+
+#if COLOR_FUSION != (OUTPUT_FORMAT == IMAGE_FORMAT_PPM || OUTPUT_FORMAT == IMAGE_FORMAT_BMP24)
+#error "COLOR_FUSION writes IMAGE_FORMAT_PPM or IMAGE_FORMAT_BMP24, and only it writes them"
+#endif
+
+#if OUTPUT_FORMAT == IMAGE_FORMAT_PGM
+#define OUTPUT_FILE "fused_image.pgm"
+#elif OUTPUT_FORMAT == IMAGE_FORMAT_PPM
+#define OUTPUT_FILE "fused_image.ppm"
+#elif OUTPUT_FORMAT == IMAGE_FORMAT_BMP || OUTPUT_FORMAT == IMAGE_FORMAT_BMP24
+#define OUTPUT_FILE "fused_image.bmp"
+#else
+#define OUTPUT_FILE "fused_image.bin"
+#endif
+
+#if STRIP_ROWS > 0
+
+/** @brief Chunk size used when stretching the output file in place. */
+#define STRETCH_CHUNK 4096
+
+static unsigned char stretch_chunk[STRETCH_CHUNK];
+
+// SDRAM block holding the strip buffers and their EMD scratch, for STRIP_ROWS rows of STRIP_MAX_WIDTH pixels.
 #pragma section("seg_sdram1")
-static int32_t var_map1_buffer[MAX_SIGNAL_LEN];
+static uint64_t strip_memory[(STRIP_FUSION_MEMORY_BYTES(STRIP_MAX_WIDTH, STRIP_ROWS) + sizeof(uint64_t) - 1) /
+                             sizeof(uint64_t)];
+
+/** @brief Context of the strip pipeline callbacks. */
+typedef struct {
+    const input_pair* in;
+    FILE* fp;
+} strip_io;
+
+/**
+ * @brief Row source for the strip pipeline reading from the input pair.
+ */
+static int read_input_rows(void* user, int image_index, int y, int rows, unsigned char* dst) {
+    const input_pair* in = ((strip_io*)user)->in;
+    memcpy(dst, in->images[image_index] + (size_t)y * in->width, (size_t)rows * in->width);
+    return 0;
+}
+
+/**
+ * @brief Row sink for the strip pipeline appending fused rows to the output file.
+ */
+static int write_output_rows(void* user, int y, int rows, const unsigned char* src) {
+    strip_io* io = (strip_io*)user;
+    size_t count = (size_t)rows * io->in->width;
+    (void)y;
+    return (fwrite(src, 1, count, io->fp) == count) ? 0 : -1;
+}
+
+/**
+ * @brief Fuse the images strip by strip into a binary file, then stretch it in place.
+ *
+ * The file has the same layout as save_fused_image(). Memory use is bounded by
+ * strip_memory and STRETCH_CHUNK, independent of the image height.
+ *
+ * @return 0 on success, -1 on error.
+ */
+static int fuse_strips_to_file(const char* filename, const input_pair* in) {
+    unsigned int width = in->width;
+    unsigned int height = in->height;
+    unsigned char min_val, max_val;
+    FILE* fp = fopen(filename, "w+b");
+    if (fp == NULL) {
+        printf("Error: Cannot open file %s for writing.\n", filename);
+        return -1;
+    }
+    strip_io io = { in, fp };
+
+    if (fwrite(&width, sizeof(width), 1, fp) != 1 || fwrite(&height, sizeof(height), 1, fp) != 1 ||
+        fuse_images_strips(width, height, STRIP_ROWS, EMD_MODE, strip_memory, sizeof(strip_memory),
+                           read_input_rows, write_output_rows, &io, &min_val, &max_val) != 0) {
+        fclose(fp);
+        return -1;
+    }
+
+    // Histogram stretching needs the global range, so it runs as a second pass over the file,
+    // through one table built for the whole image.
+    unsigned char lut[HISTOGRAM_BINS];
+    long offset = (long)(sizeof(width) + sizeof(height));
+    size_t remaining = histogram_stretch_table(lut, min_val, max_val) ? (size_t)width * height : 0;
+    while (remaining > 0) {
+        size_t count = (remaining < STRETCH_CHUNK) ? remaining : STRETCH_CHUNK;
+        if (fseek(fp, offset, SEEK_SET) != 0 || fread(stretch_chunk, 1, count, fp) != count) {
+            printf("Error: Failed to read back fused pixels.\n");
+            fclose(fp);
+            return -1;
+        }
+        histogram_apply_lut(stretch_chunk, (int)count, lut);
+        if (fseek(fp, offset, SEEK_SET) != 0 || fwrite(stretch_chunk, 1, count, fp) != count) {
+            printf("Error: Failed to write stretched pixels.\n");
+            fclose(fp);
+            return -1;
+        }
+        offset += (long)count;
+        remaining -= count;
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+#elif STREAM_FRAMES > 0
+
+/**
+ * @brief Replay the input pair as a stream and report throughput and latency.
+ *
+ * @return 0 on success, -1 on error.
+ */
+static int run_stream(const input_pair* in) {
+    frame_stream_stats stats;
+    int threads = (FUSION_THREADS > 0) ? FUSION_THREADS : 1;
+
+    if (frame_stream_write_replay("frame_pairs.bin", in->images[0], in->images[1], in->width, in->height,
+                                  STREAM_FRAMES) != 0 ||
+        frame_stream_run("frame_pairs.bin", "fused_stream.bin", threads, EMD_MODE, INCREMENTAL_FUSION,
+                         &stats) != 0) {
+        return -1;
+    }
+
+    printf("Streamed %d frames in %.3f s: %.2f frames/s\n", stats.frames, stats.seconds,
+           stats.frames_per_second);
+    printf("Frame latency (ms): p50 %.2f, p90 %.2f, p99 %.2f, max %.2f\n", stats.latency_p50_ms,
+           stats.latency_p90_ms, stats.latency_p99_ms, stats.latency_max_ms);
+#if INCREMENTAL_FUSION
+    printf("Skipped %.1f%% of the tiles.\n", stats.tiles_skipped_pct);
+#endif
+    return 0;
+}
+
+#else
+
+#if COMPACT_MASK && FUSION_THREADS > 0
+#error "COMPACT_MASK is only available in the single-threaded pipeline (FUSION_THREADS=0)"
+#endif
+#if EMD_PYRAMID > 0 && (COMPACT_MASK || FUSION_THREADS > 0)
+#error "EMD_PYRAMID is only available in the single-threaded pipeline with full-width maps"
+#endif
+#if EMD_PRECISION != EMD_PRECISION_Q16 && (COMPACT_MASK || FUSION_THREADS > 0 || EMD_PYRAMID > 0 || \
+                                           EMD_MODE != EMD_MODE_1D || EMD_ENVELOPE != EMD_ENVELOPE_LINEAR)
+#error "EMD_PRECISION other than Q16.16 needs the serial 1-D linear-envelope pipeline with full-width maps"
+#endif
+#if STRETCH_CLIP_PERMILLE > 0 && (FUSION_THREADS > 0 || EMD_PYRAMID > 0 || EMD_PRECISION != EMD_PRECISION_Q16)
+#error "STRETCH_CLIP_PERMILLE needs the serial Q16.16 pipeline without EMD_PYRAMID"
+#endif
+#if COLOR_FUSION && (COMPACT_MASK || FUSION_THREADS > 0 || EMD_PYRAMID > 0 || EMD_PRECISION != EMD_PRECISION_Q16)
+#error "COLOR_FUSION needs the serial Q16.16 pipeline with full-width maps and without EMD_PYRAMID"
+#endif
+
+#if defined(__ADSP21000__)
+/*
+ * SDRAM block holding the fusion context buffers, and the fused image. With
+ * decision_mask.c's column sums they are all of seg_sdram1, which app.ldf maps to
+ * mem_sram (0x80000 words). At MAX_SIGNAL_LEN and FRAME_MAX_WIDTH 200 the default
+ * build takes 483,964 words and EMD_PYRAMID=2 510,678; COLOR_FUSION and
+ * INCREMENTAL_FUSION need more than mem_sram holds and a smaller MAX_SIGNAL_LEN.
+ */
+#define FUSION_MEMORY_BYTES \
+    (EMD_FUSION_MEMORY_BYTES(FRAME_MAX_WIDTH, MAX_SIGNAL_LEN) + \
+     (EMD_PYRAMID > 0 ? PYRAMID_FUSION_MEMORY_BYTES(FRAME_MAX_WIDTH, MAX_SIGNAL_LEN) : 0) + \
+     (COLOR_FUSION ? EMD_FUSION_COLOR_BYTES(MAX_SIGNAL_LEN) : 0) + \
+     (INCREMENTAL_FUSION ? INCREMENTAL_FUSION_MEMORY_BYTES(MAX_SIGNAL_LEN, MAX_SIGNAL_LEN) : 0))
 
 #pragma section("seg_sdram1")
-static int32_t var_map2_buffer[MAX_SIGNAL_LEN];
+static uint64_t fusion_memory[(FUSION_MEMORY_BYTES + sizeof(uint64_t) - 1) / sizeof(uint64_t)];
 
 #pragma section("seg_sdram1")
-static unsigned char buffer_fused_image[MAX_SIGNAL_LEN];
+static unsigned char buffer_fused_image[MAX_SIGNAL_LEN * PIXEL_CHANNELS];
+#endif
+
+#if COMPACT_MASK
+/**
+ * @brief Print the bytes of the pipeline buffers each stage of the compact path reads or writes.
+ *
+ * EMD scratch is not included; it is the same with and without COMPACT_MASK.
+ */
+static void report_stage_bytes(int num_pixels) {
+    unsigned long images = 2UL * num_pixels;
+    unsigned long signals = 2UL * num_pixels * sizeof(int32_t);
+    unsigned long var_maps = 2UL * num_pixels * sizeof(uint16_t);
+    unsigned long mask = (unsigned long)PACKED_MASK_WORDS(num_pixels) * sizeof(uint32_t);
+    unsigned long fused = (unsigned long)num_pixels;
+
+    printf("Peak bytes per stage:\n");
+    printf("  decompose: %lu\n", images + signals);
+    printf("  variance:  %lu\n", signals + var_maps);
+    printf("  decision:  %lu\n", var_maps + mask);
+    printf("  fusion:    %lu\n", images + mask + fused);
+    printf("  stretch:   %lu\n", fused);
+}
+#endif
+
+/**
+ * @brief Fuse the input pair with a fusion context configured from the build options.
+ *
+ * @param in        Input pair.
+ * @param fused_img Output stretched fused image.
+ * @return 0 on success, -1 on error.
+ */
+static int fuse_frame(const input_pair* in, unsigned char* fused_img) {
+    emd_fusion_config config;
+    emd_fusion_ctx ctx;
+    void* memory = NULL;
+    size_t memory_size = 0;
+
+    emd_fusion_config_default(&config);
+    config.emd_mode = EMD_MODE;
+    config.envelope = EMD_ENVELOPE;
+    config.compact = COMPACT_MASK;
+    config.threads = FUSION_THREADS;
+    config.pyramid = EMD_PYRAMID;
+    config.precision = EMD_PRECISION;
+    config.stretch_clip = STRETCH_CLIP_PERMILLE;
+    config.color = COLOR_FUSION;
+    config.incremental = INCREMENTAL_FUSION;
+#if defined(__ADSP21000__)
+    memory = fusion_memory;
+    memory_size = sizeof(fusion_memory);
+#endif
+
+    if (emd_fusion_init(&ctx, (int)in->width, (int)in->height, &config, memory, memory_size) != 0) {
+        return -1;
+    }
+#if COLOR_FUSION
+    // EMD, variance and decision on the luma only; the mask then selects whole RGB pixels.
+    int status = emd_fusion_run_rgb(&ctx, in->images[0], in->images[1], fused_img);
+#else
+    int status = emd_fusion_run(&ctx, in->images[0], in->images[1], fused_img);
+#endif
+    if (status != 0) {
+        emd_fusion_free(&ctx);
+        return -1;
+    }
+#if EMD_PYRAMID > 0
+    printf("Refined %d of %u pixels (%.1f%%) in %d tiles.\n", ctx.pyramid.refined_pixels,
+           in->width * in->height, 100.0 * ctx.pyramid.refined_pixels / (in->width * in->height),
+           ctx.pyramid.refined_tiles);
+#endif
+#if INCREMENTAL_FUSION
+    printf("Skipped %d of %d tiles (%d of image B equal to image A).\n",
+           ctx.incremental.tiles_static + ctx.incremental.tiles_equal, 2 * ctx.incremental.tiles,
+           ctx.incremental.tiles_equal);
+#endif
+    emd_fusion_free(&ctx);
+
+#if COMPACT_MASK
+    report_stage_bytes((int)(in->width * in->height));
+#endif
+    return 0;
+}
+
+#endif /* STRIP_ROWS > 0, STREAM_FRAMES > 0 */
+
+#if EMD_TRACE
+/**
+ * @brief Register the trace sinks selected for this build and environment.
+ */
+static void register_trace_sinks(void) {
+#if defined(__ADSP21000__)
+    trace_sink led = trace_led_sink();
+    trace_register(&led);
+#else
+    trace_sink sink;
+    if (getenv("EMD_TRACE_STDERR") != NULL) {
+        sink = trace_stderr_sink();
+        trace_register(&sink);
+    }
+    const char* path = getenv("EMD_TRACE_FILE");
+    if (path != NULL && trace_chrome_open(path, &sink) == 0) {
+        trace_register(&sink);
+    }
+#endif
+}
+#endif
+
+#if !defined(__ADSP21000__)
+/**
+ * @brief Fuse a batch of pairs and report per-pair timings and throughput.
+ *
+ * @return Exit status: 0 if every pair was fused, 1 otherwise.
+ */
+static int run_batch(int argc, char* argv[]) {
+    batch_list list;
+    batch_stats stats;
+    emd_fusion_config config;
+
+    if (argc < 4) {
+        printf("Error: Usage: %s --batch <manifest or directory> <output directory> [workers]\n", argv[0]);
+        return 1;
+    }
+    int workers = (argc > 4) ? atoi(argv[4]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+    // Each worker fuses on its own context, so the pairs run concurrently rather than the bands.
+    emd_fusion_config_default(&config);
+    config.emd_mode = EMD_MODE;
+    config.envelope = EMD_ENVELOPE;
+    config.compact = COMPACT_MASK;
+    config.pyramid = EMD_PYRAMID;
+    config.precision = EMD_PRECISION;
+    config.stretch_clip = STRETCH_CLIP_PERMILLE;
+    config.color = COLOR_FUSION;
+    config.incremental = INCREMENTAL_FUSION;
+
+    if (batch_list_load(argv[2], argv[3], OUTPUT_FORMAT, &list) != 0) {
+        return 1;
+    }
+    batch_result* results = malloc((size_t)(list.count + 1) * sizeof(batch_result));
+    if (results == NULL) {
+        printf("Error: Out of memory.\n");
+        batch_list_free(&list);
+        return 1;
+    }
+
+    int rc = batch_fusion_run(&list, workers, &config, OUTPUT_FORMAT, BATCH_IO, results, &stats);
+
+    printf("pair,width,height,worker,fuse_ms,total_ms,io_ms,io_exposed_ms,status,output\n");
+    for (int i = 0; i < list.count; i++) {
+        printf("%s,%d,%d,%d,%.3f,%.3f,%.3f,%.3f,%s,%s\n", list.pairs[i].image_a, results[i].width,
+               results[i].height, results[i].worker, results[i].fuse_ms, results[i].total_ms, results[i].io_ms,
+               results[i].io_exposed_ms, batch_status_name(results[i].status), list.pairs[i].output);
+    }
+    printf("Fused %d of %d pairs in %.3f s: %.2f pairs/s\n", stats.pairs - stats.failed, stats.pairs,
+           stats.seconds, stats.pairs_per_second);
+    if (stats.io_hidden_pct < 0.0) {
+        // io_uring completions are only stamped when the ring is next polled (see async_io.h).
+        printf("I/O (%s): %.3f ms exposed; the hidden share is not measured with this backend, compare the "
+               "exposed time with a BATCH_IO=ASYNC_IO_NONE build\n",
+               async_io_backend_name(stats.io_backend), stats.io_exposed_ms);
+    } else {
+        printf("I/O (%s): %.3f ms, %.3f ms exposed, %.1f%% hidden behind fusion\n",
+               async_io_backend_name(stats.io_backend), stats.io_ms, stats.io_exposed_ms, stats.io_hidden_pct);
+    }
+
+    free(results);
+    batch_list_free(&list);
+    return (rc == 0) ? 0 : 1;
+}
+#endif
 
 /**
  * @brief Main entry point for the image fusion project.
  *
  * This function performs the following steps:
- *   - Assumes both input images have the same dimensions.
+ *   - Opens the input pair (image files on hosted builds, otherwise the compiled-in images).
+ *   - Creates a fusion context sized from the pair (emd_fusion.h), which:
  *   - Converts 8-bit image data to Q16.16 fixed-point format.
  *   - Applies EMD decomposition to each signal.
  *   - Calculates local variance for each signal using a 3x3 window.
- *   - Generates a decision mask based on the variance maps.
- *   - Fuses the two images using the decision mask.
+ *   - Decides per pixel from the variance maps and fuses the two images in one pass.
+ *   - Stretches the fused image with a lookup table.
  *   - Saves the fused image to a binary file.
  *
  * @return int Exit status.
  */
 
 
-int main(void) {
+int main(int argc, char* argv[]) {
 
     led_init();         // Initialize LE diodes.
     led_all_off();      // Turn off all LED at start.
+#if EMD_TRACE
+    register_trace_sinks(); // LEDs (board) or stderr / Chrome trace (hosted) report the stages.
+#endif
+    emd_set_envelope(EMD_ENVELOPE); // 1-D envelope of the strip and streaming modes.
 
-    // Assume both images have the same dimensions.
-    unsigned int width = p27a_width;
-    unsigned int height = p27a_height;
-    int num_pixels = width * height;
-
-    // Pointers to the input image data from header files.
-    const unsigned char* vector1 = p27a;
-    const unsigned char* vector2 = p27b;
-
-    // Use pre-allocated buffers for Q16.16 representation of signals.
-    int32_t* signal1 = buffer_signal1;
-    int32_t* signal2 = buffer_signal2;
-
-    // Convert 8-bit image data to Q16.16 fixed-point format.
-    convert_to_q16_16(vector1, signal1, num_pixels);
-    convert_to_q16_16(vector2, signal2, num_pixels);
-
-    // Apply EMD decomposition to each signal.
-    emd_decompose(signal1, num_pixels);
-    emd_decompose(signal2, num_pixels);
-
-    // Use pre-allocated buffers for local variance maps.
-    int32_t* var_map1 = var_map1_buffer;
-    int32_t* var_map2 = var_map2_buffer;
+#if !defined(__ADSP21000__)
+    if (argc > 1 && strcmp(argv[1], "--batch") == 0) {
+        int status = run_batch(argc, argv);
+#if EMD_TRACE
+        trace_chrome_close();
+#endif
+        return status;
+    }
+#endif
 
-    // Calculate local variance (using a 3x3 window) for both signals.
-    calculate_local_variance(signal1, width, height, var_map1);
-    calculate_local_variance(signal2, width, height, var_map2);
+    input_pair in;
+    if (open_inputs(argc, argv, &in) != 0) {
+        return 1;
+    }
 
-    // Generate a decision mask based on the local variance of both images.
-    char* alpha_mask = alpha_mask_buffer;
-    generate_decision_mask(var_map1, var_map2, width, height, alpha_mask);
+#if STRIP_ROWS > 0
+    // Banded pipeline: EMD, variance, mask and fusion per strip of STRIP_ROWS rows.
+    if (fuse_strips_to_file("fused_image.bin", &in) != 0) {
+        close_inputs(&in);
+        return 1;
+    }
+#elif STREAM_FRAMES > 0
+    // Streaming: read, fuse and write overlap across frames (see frame_stream.h).
+    if (run_stream(&in) != 0) {
+        close_inputs(&in);
+        return 1;
+    }
+#else
+    unsigned int width = in.width;
+    unsigned int height = in.height;
 
-    // Fuse the images using the decision mask.
+#if defined(__ADSP21000__)
     unsigned char* fused_img = buffer_fused_image;
-    fuse_images(vector1, vector2, alpha_mask, width, height, fused_img);
+    if ((size_t)width * height > MAX_SIGNAL_LEN || width > VARIANCE_MAX_WIDTH) {
+        printf("Error: %ux%u exceeds MAX_SIGNAL_LEN; use STRIP_ROWS.\n", width, height);
+        close_inputs(&in);
+        return 1;
+    }
+#else
+    // Hosted builds size the fusion context and the output from the input pair.
+    unsigned char* fused_img = malloc((size_t)width * height * PIXEL_CHANNELS);
+    if (fused_img == NULL) {
+        printf("Error: Out of memory.\n");
+        close_inputs(&in);
+        return 1;
+    }
+#endif
 
-    // Perform linear histogram stretching
-    histogram_stretch(fused_img, width, height);
+    // EMD, local variance, decision, fusion and stretch (see emd_fusion.h).
+    if (fuse_frame(&in, fused_img) != 0) {
+#if !defined(__ADSP21000__)
+        free(fused_img);
+#endif
+        close_inputs(&in);
+        return 1;
+    }
 
-    // Save the fused image to a binary file.
-    save_fused_image("fused_image.bin", width, height, fused_img);
+    // Save the fused image: fused_image.bin for the Debug scripts, or a viewable PGM/PPM/BMP.
+#if OUTPUT_FORMAT == IMAGE_FORMAT_RAW
+    int saved = save_fused_image(OUTPUT_FILE, width, height, fused_img);
+#else
+    TRACE_BEGIN(TRACE_STAGE_SAVE);
+    int saved = image_save(OUTPUT_FILE, OUTPUT_FORMAT, width, height, fused_img);
+    TRACE_END(TRACE_STAGE_SAVE);
+#endif
+#if !defined(__ADSP21000__)
+    free(fused_img);
+#endif
+    if (saved != 0) {
+        close_inputs(&in);
+        return 1;
+    }
+#endif
 
+    close_inputs(&in);
+#if EMD_TRACE && !defined(__ADSP21000__)
+    trace_chrome_close();
+#endif
     printf("Image fusion successfully completed!\n");
 
     return 0;
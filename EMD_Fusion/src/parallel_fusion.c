@@ -0,0 +1,176 @@
+/*
+ * parallel_fusion.c
+ *
+ */
+
+#include "parallel_fusion.h"
+
+#if !defined(__ADSP21000__)
+
+#include <stdlib.h>
+#include <string.h>
+#include "decision_mask.h"
+#include "fusion.h"
+
+/** @brief Row bands per thread, for load balancing. */
+#define BANDS_PER_THREAD 4
+
+/** Arguments of one frame, shared by all tasks of a stage. */
+typedef struct {
+    parallel_fusion* pf;
+    const unsigned char* img[2];
+    int emd_mode;
+    int emd_status[2];  /**< Result of the EMD of each image. */
+    unsigned char* fused_img;
+    int32_t adaptive_epsilon;
+    unsigned char lut[HISTOGRAM_BINS];  /**< Stretch table of the frame, built once for all bands. */
+} frame_job;
+
+static void band_rows(const parallel_fusion* pf, int band, int* y_begin, int* y_end) {
+    *y_begin = (int)((int64_t)band * pf->height / pf->num_bands);
+    *y_end = (int)((int64_t)(band + 1) * pf->height / pf->num_bands);
+}
+
+/** Stage 1, one task per image: conversion and EMD. */
+static void branch_task(void* ctx, int task) {
+    frame_job* job = (frame_job*)ctx;
+    parallel_fusion* pf = job->pf;
+    int num_pixels = pf->width * pf->height;
+
+    convert_to_q16_16(job->img[task], pf->signal[task], num_pixels);
+    job->emd_status[task] = emd_decompose_image_scratch(pf->signal[task], pf->width, pf->height, job->emd_mode,
+                                                        &pf->scratch[task]);
+}
+
+/** Stage 2, one task per image and band: local variance. */
+static void variance_task(void* ctx, int task) {
+    frame_job* job = (frame_job*)ctx;
+    parallel_fusion* pf = job->pf;
+    int image = task / pf->num_bands;
+    int band = task % pf->num_bands;
+    int y_begin, y_end;
+    int64_t* sums = pf->column_sums + (size_t)task * 2 * pf->width;
+
+    band_rows(pf, band, &y_begin, &y_end);
+    // The band sums feed the adaptive threshold, so no separate pass over the maps is needed.
+    pf->band_sum[task] = calculate_local_variance_rows(pf->signal[image], pf->width, pf->height, WINDOW_SIZE,
+                                                       y_begin, y_end, pf->var_map[image], sums, sums + pf->width);
+}
+
+/** Stage 3, one task per band: decision, fusion and min/max in one pass. */
+static void fuse_task(void* ctx, int band) {
+    frame_job* job = (frame_job*)ctx;
+    parallel_fusion* pf = job->pf;
+    int y_begin, y_end;
+
+    band_rows(pf, band, &y_begin, &y_end);
+    int offset = y_begin * pf->width;
+    int num_pixels = (y_end - y_begin) * pf->width;
+    if (num_pixels == 0) {
+        pf->band_min[band] = 255;
+        pf->band_max[band] = 0;
+        return;
+    }
+
+    fuse_images_var(job->img[0] + offset, job->img[1] + offset, pf->var_map[0] + offset,
+                    pf->var_map[1] + offset, num_pixels, job->adaptive_epsilon, job->fused_img + offset,
+                    &pf->band_min[band], &pf->band_max[band]);
+}
+
+/** Stage 4, one task per band: histogram stretch through the frame's table. */
+static void stretch_task(void* ctx, int band) {
+    frame_job* job = (frame_job*)ctx;
+    parallel_fusion* pf = job->pf;
+    int y_begin, y_end;
+
+    band_rows(pf, band, &y_begin, &y_end);
+    histogram_apply_lut(job->fused_img + y_begin * pf->width, (y_end - y_begin) * pf->width, job->lut);
+}
+
+int parallel_fusion_init(parallel_fusion* pf, int num_threads, int width, int height) {
+    int num_pixels = width * height;
+
+    memset(pf, 0, sizeof(*pf));
+    pf->width = width;
+    pf->height = height;
+    pf->pool = thread_pool_create(num_threads);
+    if (pf->pool == NULL) {
+        return -1;
+    }
+    pf->num_bands = thread_pool_size(pf->pool) * BANDS_PER_THREAD;
+    if (pf->num_bands > height) {
+        pf->num_bands = (height > 0) ? height : 1;
+    }
+
+    pf->signal[0] = malloc((size_t)num_pixels * sizeof(int32_t));
+    pf->signal[1] = malloc((size_t)num_pixels * sizeof(int32_t));
+    pf->var_map[0] = malloc((size_t)num_pixels * sizeof(int32_t));
+    pf->var_map[1] = malloc((size_t)num_pixels * sizeof(int32_t));
+    pf->column_sums = malloc((size_t)2 * 2 * pf->num_bands * width * sizeof(int64_t));
+    pf->band_sum = malloc((size_t)2 * pf->num_bands * sizeof(int64_t));
+    pf->band_min = malloc((size_t)pf->num_bands);
+    pf->band_max = malloc((size_t)pf->num_bands);
+
+    if (!pf->signal[0] || !pf->signal[1] || !pf->var_map[0] || !pf->var_map[1] ||
+        !pf->column_sums || !pf->band_sum || !pf->band_min || !pf->band_max ||
+        emd_scratch_init(&pf->scratch[0], num_pixels) != 0 ||
+        emd_scratch_init(&pf->scratch[1], num_pixels) != 0) {
+        parallel_fusion_free(pf);
+        return -1;
+    }
+    return 0;
+}
+
+int parallel_fusion_run(parallel_fusion* pf, const unsigned char* imgA, const unsigned char* imgB,
+                        int emd_mode, unsigned char* fused_img) {
+    frame_job job;
+    int64_t sum_var = 0;
+
+    job.pf = pf;
+    job.img[0] = imgA;
+    job.img[1] = imgB;
+    job.emd_mode = emd_mode;
+    job.fused_img = fused_img;
+
+    thread_pool_parallel_for(pf->pool, 2, branch_task, &job);
+    if (job.emd_status[0] != 0 || job.emd_status[1] != 0) {
+        return -1;
+    }
+    thread_pool_parallel_for(pf->pool, 2 * pf->num_bands, variance_task, &job);
+
+    for (int band = 0; band < 2 * pf->num_bands; band++) {
+        sum_var += pf->band_sum[band];
+    }
+    job.adaptive_epsilon = decision_mask_epsilon(sum_var, 2 * (int64_t)pf->width * pf->height);
+
+    thread_pool_parallel_for(pf->pool, pf->num_bands, fuse_task, &job);
+
+    unsigned char min_val = 255;
+    unsigned char max_val = 0;
+    for (int band = 0; band < pf->num_bands; band++) {
+        if (pf->band_min[band] < min_val) min_val = pf->band_min[band];
+        if (pf->band_max[band] > max_val) max_val = pf->band_max[band];
+    }
+
+    if (histogram_stretch_table(job.lut, min_val, max_val)) {
+        thread_pool_parallel_for(pf->pool, pf->num_bands, stretch_task, &job);
+    }
+    return 0;
+}
+
+void parallel_fusion_free(parallel_fusion* pf) {
+    thread_pool_destroy(pf->pool);
+    free(pf->signal[0]);
+    free(pf->signal[1]);
+    free(pf->var_map[0]);
+    free(pf->var_map[1]);
+    free(pf->column_sums);
+    free(pf->band_sum);
+    free(pf->band_min);
+    free(pf->band_max);
+    emd_scratch_free(&pf->scratch[0]);
+    emd_scratch_free(&pf->scratch[1]);
+    memset(pf, 0, sizeof(*pf));
+}
+
+#endif /* !__ADSP21000__ */
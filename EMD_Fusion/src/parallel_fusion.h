@@ -0,0 +1,71 @@
+/*
+ * parallel_fusion.h
+ *
+ * @brief Header file for the multi-threaded fusion pipeline (hosted builds only).
+ *
+ * The two image branches (conversion and EMD) run concurrently, each with its
+ * own EMD scratch. Local variance, the fused decision/selection pass and the
+ * histogram stretch are then split into row bands. Partial results (variance sums and
+ * min/max) are combined exactly, so the output is identical to the serial path.
+ */
+
+#ifndef PARALLEL_FUSION_H_
+#define PARALLEL_FUSION_H_
+
+#if !defined(__ADSP21000__)
+
+#include <stdint.h>
+#include "emd.h"
+#include "thread_pool.h"
+
+/**
+ * @brief State of the parallel pipeline, reusable across frames of one size.
+ */
+typedef struct {
+    thread_pool* pool;          /**< Worker pool. */
+    int width;                  /**< Frame width. */
+    int height;                 /**< Frame height. */
+    int num_bands;              /**< Row bands per stage. */
+    int32_t* signal[2];         /**< Q16.16 signals of images A and B. */
+    int32_t* var_map[2];        /**< Variance maps of images A and B. */
+    emd_scratch scratch[2];     /**< EMD scratch of each branch. */
+    int64_t* column_sums;       /**< Variance column sums, 2 * 2 * num_bands * width. */
+    int64_t* band_sum;          /**< Variance sum per image and band. */
+    unsigned char* band_min;    /**< Fused minimum per band. */
+    unsigned char* band_max;    /**< Fused maximum per band. */
+} parallel_fusion;
+
+/**
+ * @brief Allocate the pipeline state and start the worker threads.
+ *
+ * @param pf          State to initialize.
+ * @param num_threads Number of threads, including the calling thread.
+ * @param width       Frame width.
+ * @param height      Frame height.
+ * @return 0 on success, -1 on allocation failure.
+ */
+int parallel_fusion_init(parallel_fusion* pf, int num_threads, int width, int height);
+
+/**
+ * @brief Fuse one frame pair: EMD, local variance, decision mask, fusion and stretch.
+ *
+ * @param pf        Initialized pipeline state.
+ * @param imgA      First 8-bit image.
+ * @param imgB      Second 8-bit image.
+ * @param emd_mode  EMD_MODE_1D or EMD_MODE_2D.
+ * @param fused_img Output stretched fused image.
+ * @return 0 on success, -1 if the EMD could not decompose an image.
+ */
+int parallel_fusion_run(parallel_fusion* pf, const unsigned char* imgA, const unsigned char* imgB,
+                        int emd_mode, unsigned char* fused_img);
+
+/**
+ * @brief Stop the workers and release the pipeline state.
+ *
+ * @param pf State to release.
+ */
+void parallel_fusion_free(parallel_fusion* pf);
+
+#endif /* !__ADSP21000__ */
+
+#endif /* PARALLEL_FUSION_H_ */
@@ -0,0 +1,1055 @@
+/*
+ * pixel_kernels.c
+ *
+ */
+
+#include "pixel_kernels.h"
+#include "decision_mask.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if !defined(__ADSP21000__)
+#include <pthread.h>
+#endif
+
+#if PIXEL_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+/*==============================================================================
+ * Scalar kernels (reference, and the only variant on SHARC)
+ *============================================================================*/
+
+static void scalar_to_q16_16(const unsigned char* input, int32_t* output, int size) {
+    #pragma SIMD_for
+    for (int i = 0; i < size; i++) {
+        output[i] = ((int32_t)input[i]) << 16;
+    }
+}
+
+static void scalar_from_q16_16(const int32_t* input, unsigned char* output, int size) {
+    #pragma SIMD_for
+    for (int i = 0; i < size; i++) {
+        int32_t val = (input[i] + (1 << 15)) >> 16; // Add rounding offset
+        output[i] = (val < 0) ? 0 : (val > 255 ? 255 : val);
+    }
+}
+
+static void scalar_subtract_mean_envelope(int32_t* signal, const int32_t* upper, const int32_t* lower,
+                                          int size, int64_t* sum_mean_sq, int64_t* sum_h_sq) {
+    if (sum_mean_sq == NULL || sum_h_sq == NULL) {
+        #pragma vector_for
+        for (int i = 0; i < size; i++) {
+            signal[i] -= (upper[i] + lower[i]) >> 1;
+        }
+        return;
+    }
+
+    int64_t mean_sq = 0;
+    int64_t h_sq = 0;
+    #pragma vector_for
+    for (int i = 0; i < size; i++) {
+        int32_t mean = (upper[i] + lower[i]) >> 1;
+        mean_sq += ((int64_t)mean * mean) >> 16;
+        h_sq += ((int64_t)signal[i] * signal[i]) >> 16;
+        signal[i] -= mean;
+    }
+    *sum_mean_sq = mean_sq;
+    *sum_h_sq = h_sq;
+}
+
+static void scalar_mask_select(const unsigned char* imgA, const unsigned char* imgB, const char* alpha_mask,
+                               unsigned char* fused_img, int size) {
+    #pragma vector_for
+    for (int i = 0; i < size; i++) {
+        switch (alpha_mask[i]) {
+            case ALPHA_A:
+                fused_img[i] = imgA[i];
+                break;
+            case ALPHA_B:
+                fused_img[i] = imgB[i];
+                break;
+            case ALPHA_AVG:
+                fused_img[i] = (imgA[i] + imgB[i] + 1) >> 1;
+                break;
+        }
+    }
+}
+
+static void scalar_mask_select_rgb(const unsigned char* rgbA, const unsigned char* rgbB, const char* alpha_mask,
+                                   unsigned char* fused_rgb, int size, unsigned char* min_val,
+                                   unsigned char* max_val) {
+    unsigned char lo = 255;
+    unsigned char hi = 0;
+    for (int i = 0; i < size; i++) {
+        const int decision = alpha_mask[i];
+        for (int c = 3 * i; c < 3 * i + 3; c++) {
+            unsigned char val = (decision == ALPHA_A) ? rgbA[c] :
+                                (decision == ALPHA_B) ? rgbB[c] :
+                                (unsigned char)((rgbA[c] + rgbB[c] + 1) >> 1);
+            fused_rgb[c] = val;
+            if (val < lo) {
+                lo = val;
+            }
+            if (val > hi) {
+                hi = val;
+            }
+        }
+    }
+    *min_val = lo;
+    *max_val = hi;
+}
+
+static void scalar_min_max(const unsigned char* img, int size, unsigned char* min_val, unsigned char* max_val) {
+    unsigned char lo = 255;
+    unsigned char hi = 0;
+    for (int i = 0; i < size; i++) {
+        unsigned char val = img[i];
+        if (val < lo) {
+            lo = val;
+        }
+        if (val > hi) {
+            hi = val;
+        }
+    }
+    *min_val = lo;
+    *max_val = hi;
+}
+
+static void scalar_stretch(unsigned char* img, int size, unsigned char min_val, int range) {
+    #pragma vector_for
+    for (int i = 0; i < size; i++) {
+        int val = (img[i] - min_val) * 255 / range;
+        if (val < 0)   val = 0;
+        if (val > 255) val = 255;
+        img[i] = (unsigned char)val;
+    }
+}
+
+static void scalar_fuse_min_max(const unsigned char* imgA, const unsigned char* imgB, const int32_t* var1,
+                                const int32_t* var2, int32_t adaptive_epsilon, unsigned char* fused_img,
+                                int size, unsigned char* min_val, unsigned char* max_val) {
+    unsigned char lo = 255;
+    unsigned char hi = 0;
+    for (int i = 0; i < size; i++) {
+        // Same decision as generate_decision_mask_eps(), without storing the mask.
+        const int32_t diff = (var1[i] - var2[i] + 0x8000) >> 16;
+        unsigned char val = (diff > adaptive_epsilon)  ? imgA[i] :
+                            (diff < -adaptive_epsilon) ? imgB[i] :
+                            (unsigned char)((imgA[i] + imgB[i] + 1) >> 1);
+        fused_img[i] = val;
+        if (val < lo) {
+            lo = val;
+        }
+        if (val > hi) {
+            hi = val;
+        }
+    }
+    *min_val = lo;
+    *max_val = hi;
+}
+
+/**
+ * Extrema among samples [begin, end) of a signal, with 0 < begin and end < length.
+ * Every sample is written to the next slot of both lists and only the count of a
+ * list it belongs to advances, so the loop has no data-dependent branch.
+ */
+static void scalar_extrema_range(const int32_t* signal, int begin, int end, int32_t* max_pos, int32_t* max_val,
+                                 int32_t* min_pos, int32_t* min_val, int* num_max, int* num_min) {
+    int n_max = *num_max;
+    int n_min = *num_min;
+    for (int i = begin; i < end; i++) {
+        int32_t prev = signal[i - 1];
+        int32_t cur = signal[i];
+        int32_t next = signal[i + 1];
+        max_pos[n_max] = i;
+        max_val[n_max] = cur;
+        min_pos[n_min] = i;
+        min_val[n_min] = cur;
+        n_max += (cur > prev) & (cur > next);
+        n_min += (cur < prev) & (cur < next);
+    }
+    *num_max = n_max;
+    *num_min = n_min;
+}
+
+/** Endpoint pos of a signal, an extremum when it differs from its only neighbour. */
+static void scalar_extrema_endpoint(int32_t value, int32_t neighbour, int pos, int32_t* max_pos, int32_t* max_val,
+                                    int32_t* min_pos, int32_t* min_val, int* num_max, int* num_min) {
+    max_pos[*num_max] = pos;
+    max_val[*num_max] = value;
+    min_pos[*num_min] = pos;
+    min_val[*num_min] = value;
+    *num_max += value > neighbour;
+    *num_min += value < neighbour;
+}
+
+static void scalar_find_extrema(const int32_t* signal, int length, int32_t* max_pos, int32_t* max_val,
+                                int32_t* min_pos, int32_t* min_val, int* num_max, int* num_min) {
+    *num_max = 0;
+    *num_min = 0;
+    if (length < 2) {
+        return;
+    }
+    scalar_extrema_endpoint(signal[0], signal[1], 0, max_pos, max_val, min_pos, min_val, num_max, num_min);
+    scalar_extrema_range(signal, 1, length - 1, max_pos, max_val, min_pos, min_val, num_max, num_min);
+    scalar_extrema_endpoint(signal[length - 1], signal[length - 2], length - 1, max_pos, max_val, min_pos, min_val,
+                            num_max, num_min);
+}
+
+static const pixel_kernels scalar_kernels = {
+    "scalar",
+    scalar_to_q16_16,
+    scalar_from_q16_16,
+    scalar_subtract_mean_envelope,
+    scalar_mask_select,
+    scalar_min_max,
+    scalar_stretch,
+    scalar_fuse_min_max,
+    scalar_find_extrema,
+    scalar_mask_select_rgb
+};
+
+#if PIXEL_KERNELS_X86
+
+/*==============================================================================
+ * SSE4.1 kernels
+ *============================================================================*/
+
+#define SSE41 __attribute__((target("sse4.1")))
+#define AVX2  __attribute__((target("avx2")))
+
+SSE41 static void sse41_to_q16_16(const unsigned char* input, int32_t* output, int size) {
+    int i = 0;
+    for (; i + 4 <= size; i += 4) {
+        int32_t packed;
+        memcpy(&packed, input + i, sizeof(packed));
+        __m128i v = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed));
+        _mm_storeu_si128((__m128i*)(output + i), _mm_slli_epi32(v, 16));
+    }
+    scalar_to_q16_16(input + i, output + i, size - i);
+}
+
+SSE41 static void sse41_from_q16_16(const int32_t* input, unsigned char* output, int size) {
+    const __m128i round = _mm_set1_epi32(1 << 15);
+    int i = 0;
+    for (; i + 4 <= size; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(input + i));
+        v = _mm_srai_epi32(_mm_add_epi32(v, round), 16);
+        // Saturating packs clamp to [0..255] exactly like the scalar code.
+        __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(v, v), _mm_setzero_si128());
+        int32_t packed = _mm_cvtsi128_si32(bytes);
+        memcpy(output + i, &packed, sizeof(packed));
+    }
+    scalar_from_q16_16(input + i, output + i, size - i);
+}
+
+/** Add (v * v) >> 16 for all four int32 lanes of v to two int64 accumulator lanes. */
+SSE41 static inline __m128i sse41_accumulate_sq(__m128i acc, __m128i v) {
+    __m128i even = _mm_mul_epi32(v, v);
+    __m128i odd_v = _mm_srli_epi64(v, 32);
+    __m128i odd = _mm_mul_epi32(odd_v, odd_v);
+    // Squares are non-negative, so a logical shift matches the scalar arithmetic one.
+    acc = _mm_add_epi64(acc, _mm_srli_epi64(even, 16));
+    return _mm_add_epi64(acc, _mm_srli_epi64(odd, 16));
+}
+
+SSE41 static void sse41_subtract_mean_envelope(int32_t* signal, const int32_t* upper, const int32_t* lower,
+                                               int size, int64_t* sum_mean_sq, int64_t* sum_h_sq) {
+    const int with_sums = (sum_mean_sq != NULL && sum_h_sq != NULL);
+    __m128i acc_mean = _mm_setzero_si128();
+    __m128i acc_h = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 4 <= size; i += 4) {
+        __m128i u = _mm_loadu_si128((const __m128i*)(upper + i));
+        __m128i l = _mm_loadu_si128((const __m128i*)(lower + i));
+        __m128i h = _mm_loadu_si128((const __m128i*)(signal + i));
+        __m128i mean = _mm_srai_epi32(_mm_add_epi32(u, l), 1);
+        if (with_sums) {
+            acc_mean = sse41_accumulate_sq(acc_mean, mean);
+            acc_h = sse41_accumulate_sq(acc_h, h);
+        }
+        _mm_storeu_si128((__m128i*)(signal + i), _mm_sub_epi32(h, mean));
+    }
+
+    int64_t tail_mean_sq = 0, tail_h_sq = 0;
+    scalar_subtract_mean_envelope(signal + i, upper + i, lower + i, size - i,
+                                  with_sums ? &tail_mean_sq : NULL, with_sums ? &tail_h_sq : NULL);
+    if (with_sums) {
+        int64_t lanes[2];
+        _mm_storeu_si128((__m128i*)lanes, acc_mean);
+        *sum_mean_sq = lanes[0] + lanes[1] + tail_mean_sq;
+        _mm_storeu_si128((__m128i*)lanes, acc_h);
+        *sum_h_sq = lanes[0] + lanes[1] + tail_h_sq;
+    }
+}
+
+SSE41 static void sse41_mask_select(const unsigned char* imgA, const unsigned char* imgB, const char* alpha_mask,
+                                    unsigned char* fused_img, int size) {
+    const __m128i code_a = _mm_set1_epi8(ALPHA_A);
+    const __m128i code_b = _mm_set1_epi8(ALPHA_B);
+    int i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(imgA + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(imgB + i));
+        __m128i m = _mm_loadu_si128((const __m128i*)(alpha_mask + i));
+        // _mm_avg_epu8 is (a + b + 1) >> 1, the ALPHA_AVG rule.
+        __m128i r = _mm_avg_epu8(a, b);
+        r = _mm_blendv_epi8(r, b, _mm_cmpeq_epi8(m, code_b));
+        r = _mm_blendv_epi8(r, a, _mm_cmpeq_epi8(m, code_a));
+        _mm_storeu_si128((__m128i*)(fused_img + i), r);
+    }
+    scalar_mask_select(imgA + i, imgB + i, alpha_mask + i, fused_img + i, size - i);
+}
+
+/** Reduce 16 bytes to their minimum and maximum. */
+SSE41 static inline void sse41_reduce_min_max(__m128i lo, __m128i hi, unsigned char* min_val, unsigned char* max_val) {
+    lo = _mm_min_epu8(lo, _mm_srli_si128(lo, 8));
+    lo = _mm_min_epu8(lo, _mm_srli_si128(lo, 4));
+    lo = _mm_min_epu8(lo, _mm_srli_si128(lo, 2));
+    lo = _mm_min_epu8(lo, _mm_srli_si128(lo, 1));
+    hi = _mm_max_epu8(hi, _mm_srli_si128(hi, 8));
+    hi = _mm_max_epu8(hi, _mm_srli_si128(hi, 4));
+    hi = _mm_max_epu8(hi, _mm_srli_si128(hi, 2));
+    hi = _mm_max_epu8(hi, _mm_srli_si128(hi, 1));
+    *min_val = (unsigned char)_mm_extract_epi8(lo, 0);
+    *max_val = (unsigned char)_mm_extract_epi8(hi, 0);
+}
+
+SSE41 static void sse41_min_max(const unsigned char* img, int size, unsigned char* min_val, unsigned char* max_val) {
+    __m128i lo = _mm_set1_epi8((char)0xFF);
+    __m128i hi = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(img + i));
+        lo = _mm_min_epu8(lo, v);
+        hi = _mm_max_epu8(hi, v);
+    }
+    unsigned char vec_lo, vec_hi, tail_lo, tail_hi;
+    sse41_reduce_min_max(lo, hi, &vec_lo, &vec_hi);
+    scalar_min_max(img + i, size - i, &tail_lo, &tail_hi);
+    *min_val = (tail_lo < vec_lo) ? tail_lo : vec_lo;
+    *max_val = (tail_hi > vec_hi) ? tail_hi : vec_hi;
+}
+
+/**
+ * pshufb controls that repeat each of 16 mask bytes three times: vector j covers
+ * bytes 16 * j .. 16 * j + 15 of the 48 interleaved RGB bytes of 16 pixels.
+ */
+static const unsigned char rgb_expand[3][16] = {
+    { 0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5 },
+    { 5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10 },
+    { 10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15 }
+};
+
+SSE41 static void sse41_mask_select_rgb(const unsigned char* rgbA, const unsigned char* rgbB, const char* alpha_mask,
+                                        unsigned char* fused_rgb, int size, unsigned char* min_val,
+                                        unsigned char* max_val) {
+    const __m128i code_a = _mm_set1_epi8(ALPHA_A);
+    const __m128i code_b = _mm_set1_epi8(ALPHA_B);
+    __m128i lo = _mm_set1_epi8((char)0xFF);
+    __m128i hi = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 16 <= size; i += 16) {
+        // Spread each mask byte over its pixel's three channels, then compare the codes.
+        __m128i m = _mm_loadu_si128((const __m128i*)(alpha_mask + i));
+        for (int j = 0; j < 3; j++) {
+            const __m128i expand = _mm_loadu_si128((const __m128i*)rgb_expand[j]);
+            const int offset = 3 * i + 16 * j;
+            __m128i spread = _mm_shuffle_epi8(m, expand);
+            __m128i a = _mm_loadu_si128((const __m128i*)(rgbA + offset));
+            __m128i b = _mm_loadu_si128((const __m128i*)(rgbB + offset));
+            __m128i r = _mm_avg_epu8(a, b);
+            r = _mm_blendv_epi8(r, b, _mm_cmpeq_epi8(spread, code_b));
+            r = _mm_blendv_epi8(r, a, _mm_cmpeq_epi8(spread, code_a));
+            _mm_storeu_si128((__m128i*)(fused_rgb + offset), r);
+            lo = _mm_min_epu8(lo, r);
+            hi = _mm_max_epu8(hi, r);
+        }
+    }
+    unsigned char vec_lo, vec_hi, tail_lo = 255, tail_hi = 0;
+    sse41_reduce_min_max(lo, hi, &vec_lo, &vec_hi);
+    if (i < size) {
+        scalar_mask_select_rgb(rgbA + 3 * i, rgbB + 3 * i, alpha_mask + i, fused_rgb + 3 * i, size - i,
+                               &tail_lo, &tail_hi);
+    }
+    *min_val = (tail_lo < vec_lo) ? tail_lo : vec_lo;
+    *max_val = (tail_hi > vec_hi) ? tail_hi : vec_hi;
+}
+
+/**
+ * (p - min) * 255 / range for four lanes without an integer divide: a float
+ * reciprocal gives a quotient within one of the exact one, and one integer
+ * remainder check corrects it. Negative numerators clamp to 0 either way.
+ */
+SSE41 static inline __m128i sse41_stretch_lanes(__m128i p, __m128i min_v, __m128i range_v, __m128 inv) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i n = _mm_mullo_epi32(_mm_sub_epi32(p, min_v), _mm_set1_epi32(255));
+    __m128i q = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(n), inv));
+    __m128i r = _mm_sub_epi32(n, _mm_mullo_epi32(q, range_v));
+    q = _mm_sub_epi32(q, _mm_cmpgt_epi32(r, _mm_sub_epi32(range_v, _mm_set1_epi32(1))));
+    q = _mm_add_epi32(q, _mm_cmpgt_epi32(zero, r));
+    return _mm_min_epi32(_mm_max_epi32(q, zero), _mm_set1_epi32(255));
+}
+
+SSE41 static void sse41_stretch(unsigned char* img, int size, unsigned char min_val, int range) {
+    const __m128i min_v = _mm_set1_epi32(min_val);
+    const __m128i range_v = _mm_set1_epi32(range);
+    const __m128 inv = _mm_set1_ps(1.0f / (float)range);
+    int i = 0;
+    for (; i + 4 <= size; i += 4) {
+        int32_t packed;
+        memcpy(&packed, img + i, sizeof(packed));
+        __m128i q = sse41_stretch_lanes(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed)), min_v, range_v, inv);
+        packed = _mm_cvtsi128_si32(_mm_packus_epi16(_mm_packs_epi32(q, q), _mm_setzero_si128()));
+        memcpy(img + i, &packed, sizeof(packed));
+    }
+    scalar_stretch(img + i, size - i, min_val, range);
+}
+
+/** Decision codes of four pixels: all-ones lanes where diff > eps (gt) and diff < -eps (lt). */
+SSE41 static inline void sse41_decide_lanes(const int32_t* var1, const int32_t* var2, __m128i eps, __m128i neg_eps,
+                                            __m128i* gt, __m128i* lt) {
+    const __m128i round = _mm_set1_epi32(0x8000);
+    __m128i v1 = _mm_loadu_si128((const __m128i*)var1);
+    __m128i v2 = _mm_loadu_si128((const __m128i*)var2);
+    __m128i diff = _mm_srai_epi32(_mm_add_epi32(_mm_sub_epi32(v1, v2), round), 16);
+    *gt = _mm_cmpgt_epi32(diff, eps);
+    *lt = _mm_cmplt_epi32(diff, neg_eps);
+}
+
+SSE41 static void sse41_fuse_min_max(const unsigned char* imgA, const unsigned char* imgB, const int32_t* var1,
+                                     const int32_t* var2, int32_t adaptive_epsilon, unsigned char* fused_img,
+                                     int size, unsigned char* min_val, unsigned char* max_val) {
+    const __m128i eps = _mm_set1_epi32(adaptive_epsilon);
+    const __m128i neg_eps = _mm_set1_epi32(-adaptive_epsilon);
+    __m128i lo = _mm_set1_epi8((char)0xFF);
+    __m128i hi = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i gt[4], lt[4];
+        for (int k = 0; k < 4; k++) {
+            sse41_decide_lanes(var1 + i + 4 * k, var2 + i + 4 * k, eps, neg_eps, &gt[k], &lt[k]);
+        }
+        // Signed saturating packs keep all-ones and zero lanes intact, in pixel order.
+        __m128i take_a = _mm_packs_epi16(_mm_packs_epi32(gt[0], gt[1]), _mm_packs_epi32(gt[2], gt[3]));
+        __m128i take_b = _mm_packs_epi16(_mm_packs_epi32(lt[0], lt[1]), _mm_packs_epi32(lt[2], lt[3]));
+
+        __m128i a = _mm_loadu_si128((const __m128i*)(imgA + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(imgB + i));
+        __m128i r = _mm_avg_epu8(a, b);
+        r = _mm_blendv_epi8(r, b, take_b);
+        r = _mm_blendv_epi8(r, a, take_a);
+        _mm_storeu_si128((__m128i*)(fused_img + i), r);
+        lo = _mm_min_epu8(lo, r);
+        hi = _mm_max_epu8(hi, r);
+    }
+    unsigned char vec_lo, vec_hi, tail_lo, tail_hi;
+    sse41_reduce_min_max(lo, hi, &vec_lo, &vec_hi);
+    scalar_fuse_min_max(imgA + i, imgB + i, var1 + i, var2 + i, adaptive_epsilon, fused_img + i, size - i,
+                        &tail_lo, &tail_hi);
+    *min_val = (tail_lo < vec_lo) ? tail_lo : vec_lo;
+    *max_val = (tail_hi > vec_hi) ? tail_hi : vec_hi;
+}
+
+/** Set bits of a 4-bit mask, read from a nibble-packed table. */
+#define MASK_BITS4(mask) ((int)((0x4332322132212110ull >> (4 * (mask))) & 0xF))
+
+/** pshufb controls that move the int32 lanes set in a 4-bit mask to the front. */
+static const unsigned char left_pack_sse41[16][16] = {
+    {  0,  1,  2,  3,  0,  1,  2,  3,  0,  1,  2,  3,  0,  1,  2,  3 },
+    {  0,  1,  2,  3,  0,  1,  2,  3,  0,  1,  2,  3,  0,  1,  2,  3 },
+    {  4,  5,  6,  7,  0,  1,  2,  3,  0,  1,  2,  3,  0,  1,  2,  3 },
+    {  0,  1,  2,  3,  4,  5,  6,  7,  0,  1,  2,  3,  0,  1,  2,  3 },
+    {  8,  9, 10, 11,  0,  1,  2,  3,  0,  1,  2,  3,  0,  1,  2,  3 },
+    {  0,  1,  2,  3,  8,  9, 10, 11,  0,  1,  2,  3,  0,  1,  2,  3 },
+    {  4,  5,  6,  7,  8,  9, 10, 11,  0,  1,  2,  3,  0,  1,  2,  3 },
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11,  0,  1,  2,  3 },
+    { 12, 13, 14, 15,  0,  1,  2,  3,  0,  1,  2,  3,  0,  1,  2,  3 },
+    {  0,  1,  2,  3, 12, 13, 14, 15,  0,  1,  2,  3,  0,  1,  2,  3 },
+    {  4,  5,  6,  7, 12, 13, 14, 15,  0,  1,  2,  3,  0,  1,  2,  3 },
+    {  0,  1,  2,  3,  4,  5,  6,  7, 12, 13, 14, 15,  0,  1,  2,  3 },
+    {  8,  9, 10, 11, 12, 13, 14, 15,  0,  1,  2,  3,  0,  1,  2,  3 },
+    {  0,  1,  2,  3,  8,  9, 10, 11, 12, 13, 14, 15,  0,  1,  2,  3 },
+    {  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15,  0,  1,  2,  3 },
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 }
+};
+
+/**
+ * Compare four samples with both neighbours, then left-pack the positions and values
+ * of the maxima and minima with pshufb and advance each list by its popcount. Blocks
+ * without an extremum, most of a smooth signal, skip the stores; that one branch per
+ * block predicts well on smooth and noisy signals alike.
+ */
+SSE41 static void sse41_find_extrema(const int32_t* signal, int length, int32_t* max_pos, int32_t* max_val,
+                                     int32_t* min_pos, int32_t* min_val, int* num_max, int* num_min) {
+    const __m128i lanes = _mm_setr_epi32(0, 1, 2, 3);
+    int n_max = 0;
+    int n_min = 0;
+    int i = 1;
+
+    *num_max = 0;
+    *num_min = 0;
+    if (length < 2) {
+        return;
+    }
+    scalar_extrema_endpoint(signal[0], signal[1], 0, max_pos, max_val, min_pos, min_val, &n_max, &n_min);
+    // Samples i..i+3 need signal[i + 4], so the block stops before the last sample.
+    for (; i + 4 < length; i += 4) {
+        __m128i prev = _mm_loadu_si128((const __m128i*)(signal + i - 1));
+        __m128i cur = _mm_loadu_si128((const __m128i*)(signal + i));
+        __m128i next = _mm_loadu_si128((const __m128i*)(signal + i + 1));
+        __m128i pos = _mm_add_epi32(_mm_set1_epi32(i), lanes);
+        int is_max = _mm_movemask_ps(_mm_castsi128_ps(
+            _mm_and_si128(_mm_cmpgt_epi32(cur, prev), _mm_cmpgt_epi32(cur, next))));
+        int is_min = _mm_movemask_ps(_mm_castsi128_ps(
+            _mm_and_si128(_mm_cmplt_epi32(cur, prev), _mm_cmplt_epi32(cur, next))));
+        if ((is_max | is_min) == 0) {
+            continue;
+        }
+        __m128i pack_max = _mm_loadu_si128((const __m128i*)left_pack_sse41[is_max]);
+        __m128i pack_min = _mm_loadu_si128((const __m128i*)left_pack_sse41[is_min]);
+
+        _mm_storeu_si128((__m128i*)(max_pos + n_max), _mm_shuffle_epi8(pos, pack_max));
+        _mm_storeu_si128((__m128i*)(max_val + n_max), _mm_shuffle_epi8(cur, pack_max));
+        _mm_storeu_si128((__m128i*)(min_pos + n_min), _mm_shuffle_epi8(pos, pack_min));
+        _mm_storeu_si128((__m128i*)(min_val + n_min), _mm_shuffle_epi8(cur, pack_min));
+        n_max += MASK_BITS4(is_max);
+        n_min += MASK_BITS4(is_min);
+    }
+    scalar_extrema_range(signal, i, length - 1, max_pos, max_val, min_pos, min_val, &n_max, &n_min);
+    scalar_extrema_endpoint(signal[length - 1], signal[length - 2], length - 1, max_pos, max_val, min_pos, min_val,
+                            &n_max, &n_min);
+    *num_max = n_max;
+    *num_min = n_min;
+}
+
+static const pixel_kernels sse41_kernels = {
+    "sse4.1",
+    sse41_to_q16_16,
+    sse41_from_q16_16,
+    sse41_subtract_mean_envelope,
+    sse41_mask_select,
+    sse41_min_max,
+    sse41_stretch,
+    sse41_fuse_min_max,
+    sse41_find_extrema,
+    sse41_mask_select_rgb
+};
+
+/*==============================================================================
+ * AVX2 kernels
+ *============================================================================*/
+
+AVX2 static void avx2_to_q16_16(const unsigned char* input, int32_t* output, int size) {
+    int i = 0;
+    for (; i + 8 <= size; i += 8) {
+        __m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(input + i)));
+        _mm256_storeu_si256((__m256i*)(output + i), _mm256_slli_epi32(v, 16));
+    }
+    scalar_to_q16_16(input + i, output + i, size - i);
+}
+
+/** Saturate eight int32 lanes to bytes and store them. */
+AVX2 static inline void avx2_store_bytes(unsigned char* dst, __m256i v) {
+    __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    _mm_storel_epi64((__m128i*)dst, _mm_packus_epi16(words, words));
+}
+
+AVX2 static void avx2_from_q16_16(const int32_t* input, unsigned char* output, int size) {
+    const __m256i round = _mm256_set1_epi32(1 << 15);
+    int i = 0;
+    for (; i + 8 <= size; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(input + i));
+        avx2_store_bytes(output + i, _mm256_srai_epi32(_mm256_add_epi32(v, round), 16));
+    }
+    scalar_from_q16_16(input + i, output + i, size - i);
+}
+
+/** Add (v * v) >> 16 for all eight int32 lanes of v to four int64 accumulator lanes. */
+AVX2 static inline __m256i avx2_accumulate_sq(__m256i acc, __m256i v) {
+    __m256i even = _mm256_mul_epi32(v, v);
+    __m256i odd_v = _mm256_srli_epi64(v, 32);
+    __m256i odd = _mm256_mul_epi32(odd_v, odd_v);
+    acc = _mm256_add_epi64(acc, _mm256_srli_epi64(even, 16));
+    return _mm256_add_epi64(acc, _mm256_srli_epi64(odd, 16));
+}
+
+AVX2 static void avx2_subtract_mean_envelope(int32_t* signal, const int32_t* upper, const int32_t* lower,
+                                             int size, int64_t* sum_mean_sq, int64_t* sum_h_sq) {
+    const int with_sums = (sum_mean_sq != NULL && sum_h_sq != NULL);
+    __m256i acc_mean = _mm256_setzero_si256();
+    __m256i acc_h = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 8 <= size; i += 8) {
+        __m256i u = _mm256_loadu_si256((const __m256i*)(upper + i));
+        __m256i l = _mm256_loadu_si256((const __m256i*)(lower + i));
+        __m256i h = _mm256_loadu_si256((const __m256i*)(signal + i));
+        __m256i mean = _mm256_srai_epi32(_mm256_add_epi32(u, l), 1);
+        if (with_sums) {
+            acc_mean = avx2_accumulate_sq(acc_mean, mean);
+            acc_h = avx2_accumulate_sq(acc_h, h);
+        }
+        _mm256_storeu_si256((__m256i*)(signal + i), _mm256_sub_epi32(h, mean));
+    }
+
+    int64_t tail_mean_sq = 0, tail_h_sq = 0;
+    scalar_subtract_mean_envelope(signal + i, upper + i, lower + i, size - i,
+                                  with_sums ? &tail_mean_sq : NULL, with_sums ? &tail_h_sq : NULL);
+    if (with_sums) {
+        int64_t lanes[4];
+        _mm256_storeu_si256((__m256i*)lanes, acc_mean);
+        *sum_mean_sq = lanes[0] + lanes[1] + lanes[2] + lanes[3] + tail_mean_sq;
+        _mm256_storeu_si256((__m256i*)lanes, acc_h);
+        *sum_h_sq = lanes[0] + lanes[1] + lanes[2] + lanes[3] + tail_h_sq;
+    }
+}
+
+AVX2 static void avx2_mask_select(const unsigned char* imgA, const unsigned char* imgB, const char* alpha_mask,
+                                  unsigned char* fused_img, int size) {
+    const __m256i code_a = _mm256_set1_epi8(ALPHA_A);
+    const __m256i code_b = _mm256_set1_epi8(ALPHA_B);
+    int i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(imgA + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(imgB + i));
+        __m256i m = _mm256_loadu_si256((const __m256i*)(alpha_mask + i));
+        __m256i r = _mm256_avg_epu8(a, b);
+        r = _mm256_blendv_epi8(r, b, _mm256_cmpeq_epi8(m, code_b));
+        r = _mm256_blendv_epi8(r, a, _mm256_cmpeq_epi8(m, code_a));
+        _mm256_storeu_si256((__m256i*)(fused_img + i), r);
+    }
+    scalar_mask_select(imgA + i, imgB + i, alpha_mask + i, fused_img + i, size - i);
+}
+
+AVX2 static void avx2_min_max(const unsigned char* img, int size, unsigned char* min_val, unsigned char* max_val) {
+    __m256i lo = _mm256_set1_epi8((char)0xFF);
+    __m256i hi = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(img + i));
+        lo = _mm256_min_epu8(lo, v);
+        hi = _mm256_max_epu8(hi, v);
+    }
+    unsigned char vec_lo, vec_hi, tail_lo, tail_hi;
+    sse41_reduce_min_max(_mm_min_epu8(_mm256_castsi256_si128(lo), _mm256_extracti128_si256(lo, 1)),
+                         _mm_max_epu8(_mm256_castsi256_si128(hi), _mm256_extracti128_si256(hi, 1)),
+                         &vec_lo, &vec_hi);
+    scalar_min_max(img + i, size - i, &tail_lo, &tail_hi);
+    *min_val = (tail_lo < vec_lo) ? tail_lo : vec_lo;
+    *max_val = (tail_hi > vec_hi) ? tail_hi : vec_hi;
+}
+
+/**
+ * 32 pixels per iteration, 96 RGB bytes in three vectors. The 128-bit lanes of
+ * those vectors need mask bytes 0-15 (twice), 0-15 and 16-31, and 16-31 (twice),
+ * so the mask is lane-permuted into those three arrangements and spread with
+ * the rgb_expand controls of the lanes.
+ */
+AVX2 static void avx2_mask_select_rgb(const unsigned char* rgbA, const unsigned char* rgbB, const char* alpha_mask,
+                                      unsigned char* fused_rgb, int size, unsigned char* min_val,
+                                      unsigned char* max_val) {
+    const __m256i code_a = _mm256_set1_epi8(ALPHA_A);
+    const __m256i code_b = _mm256_set1_epi8(ALPHA_B);
+    const __m128i e0 = _mm_loadu_si128((const __m128i*)rgb_expand[0]);
+    const __m128i e1 = _mm_loadu_si128((const __m128i*)rgb_expand[1]);
+    const __m128i e2 = _mm_loadu_si128((const __m128i*)rgb_expand[2]);
+    const __m256i expand[3] = { _mm256_set_m128i(e1, e0), _mm256_set_m128i(e0, e2), _mm256_set_m128i(e2, e1) };
+    __m256i lo = _mm256_set1_epi8((char)0xFF);
+    __m256i hi = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i m = _mm256_loadu_si256((const __m256i*)(alpha_mask + i));
+        __m256i lanes[3] = { _mm256_permute2x128_si256(m, m, 0x00), m, _mm256_permute2x128_si256(m, m, 0x11) };
+        for (int j = 0; j < 3; j++) {
+            const int offset = 3 * i + 32 * j;
+            __m256i spread = _mm256_shuffle_epi8(lanes[j], expand[j]);
+            __m256i a = _mm256_loadu_si256((const __m256i*)(rgbA + offset));
+            __m256i b = _mm256_loadu_si256((const __m256i*)(rgbB + offset));
+            __m256i r = _mm256_avg_epu8(a, b);
+            r = _mm256_blendv_epi8(r, b, _mm256_cmpeq_epi8(spread, code_b));
+            r = _mm256_blendv_epi8(r, a, _mm256_cmpeq_epi8(spread, code_a));
+            _mm256_storeu_si256((__m256i*)(fused_rgb + offset), r);
+            lo = _mm256_min_epu8(lo, r);
+            hi = _mm256_max_epu8(hi, r);
+        }
+    }
+    unsigned char vec_lo, vec_hi, tail_lo = 255, tail_hi = 0;
+    sse41_reduce_min_max(_mm_min_epu8(_mm256_castsi256_si128(lo), _mm256_extracti128_si256(lo, 1)),
+                         _mm_max_epu8(_mm256_castsi256_si128(hi), _mm256_extracti128_si256(hi, 1)),
+                         &vec_lo, &vec_hi);
+    if (i < size) {
+        sse41_mask_select_rgb(rgbA + 3 * i, rgbB + 3 * i, alpha_mask + i, fused_rgb + 3 * i, size - i,
+                              &tail_lo, &tail_hi);
+    }
+    *min_val = (tail_lo < vec_lo) ? tail_lo : vec_lo;
+    *max_val = (tail_hi > vec_hi) ? tail_hi : vec_hi;
+}
+
+AVX2 static void avx2_stretch(unsigned char* img, int size, unsigned char min_val, int range) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i min_v = _mm256_set1_epi32(min_val);
+    const __m256i range_v = _mm256_set1_epi32(range);
+    const __m256i range_m1 = _mm256_set1_epi32(range - 1);
+    const __m256i max_out = _mm256_set1_epi32(255);
+    const __m256 inv = _mm256_set1_ps(1.0f / (float)range);
+    int i = 0;
+    for (; i + 8 <= size; i += 8) {
+        __m256i p = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(img + i)));
+        __m256i n = _mm256_mullo_epi32(_mm256_sub_epi32(p, min_v), max_out);
+        __m256i q = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(n), inv));
+        __m256i r = _mm256_sub_epi32(n, _mm256_mullo_epi32(q, range_v));
+        q = _mm256_sub_epi32(q, _mm256_cmpgt_epi32(r, range_m1));
+        q = _mm256_add_epi32(q, _mm256_cmpgt_epi32(zero, r));
+        avx2_store_bytes(img + i, _mm256_min_epi32(_mm256_max_epi32(q, zero), max_out));
+    }
+    scalar_stretch(img + i, size - i, min_val, range);
+}
+
+/** Decision codes of eight pixels, as sse41_decide_lanes(). */
+AVX2 static inline void avx2_decide_lanes(const int32_t* var1, const int32_t* var2, __m256i eps, __m256i neg_eps,
+                                          __m256i* gt, __m256i* lt) {
+    const __m256i round = _mm256_set1_epi32(0x8000);
+    __m256i v1 = _mm256_loadu_si256((const __m256i*)var1);
+    __m256i v2 = _mm256_loadu_si256((const __m256i*)var2);
+    __m256i diff = _mm256_srai_epi32(_mm256_add_epi32(_mm256_sub_epi32(v1, v2), round), 16);
+    *gt = _mm256_cmpgt_epi32(diff, eps);
+    *lt = _mm256_cmpgt_epi32(neg_eps, diff);
+}
+
+/** Pack four vectors of 32-bit lane masks to one vector of byte masks in pixel order. */
+AVX2 static inline __m256i avx2_pack_masks(const __m256i m[4]) {
+    // The packs work per 128-bit lane, leaving the dwords in the order 0 2 4 6 1 3 5 7.
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    __m256i packed = _mm256_packs_epi16(_mm256_packs_epi32(m[0], m[1]), _mm256_packs_epi32(m[2], m[3]));
+    return _mm256_permutevar8x32_epi32(packed, order);
+}
+
+AVX2 static void avx2_fuse_min_max(const unsigned char* imgA, const unsigned char* imgB, const int32_t* var1,
+                                   const int32_t* var2, int32_t adaptive_epsilon, unsigned char* fused_img,
+                                   int size, unsigned char* min_val, unsigned char* max_val) {
+    const __m256i eps = _mm256_set1_epi32(adaptive_epsilon);
+    const __m256i neg_eps = _mm256_set1_epi32(-adaptive_epsilon);
+    __m256i lo = _mm256_set1_epi8((char)0xFF);
+    __m256i hi = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i gt[4], lt[4];
+        for (int k = 0; k < 4; k++) {
+            avx2_decide_lanes(var1 + i + 8 * k, var2 + i + 8 * k, eps, neg_eps, &gt[k], &lt[k]);
+        }
+        __m256i take_a = avx2_pack_masks(gt);
+        __m256i take_b = avx2_pack_masks(lt);
+
+        __m256i a = _mm256_loadu_si256((const __m256i*)(imgA + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(imgB + i));
+        __m256i r = _mm256_avg_epu8(a, b);
+        r = _mm256_blendv_epi8(r, b, take_b);
+        r = _mm256_blendv_epi8(r, a, take_a);
+        _mm256_storeu_si256((__m256i*)(fused_img + i), r);
+        lo = _mm256_min_epu8(lo, r);
+        hi = _mm256_max_epu8(hi, r);
+    }
+    unsigned char vec_lo, vec_hi, tail_lo, tail_hi;
+    sse41_reduce_min_max(_mm_min_epu8(_mm256_castsi256_si128(lo), _mm256_extracti128_si256(lo, 1)),
+                         _mm_max_epu8(_mm256_castsi256_si128(hi), _mm256_extracti128_si256(hi, 1)),
+                         &vec_lo, &vec_hi);
+    scalar_fuse_min_max(imgA + i, imgB + i, var1 + i, var2 + i, adaptive_epsilon, fused_img + i, size - i,
+                        &tail_lo, &tail_hi);
+    *min_val = (tail_lo < vec_lo) ? tail_lo : vec_lo;
+    *max_val = (tail_hi > vec_hi) ? tail_hi : vec_hi;
+}
+
+/** Lane indices of the bits set in a 4-bit mask, one byte each from the lowest. */
+static const uint32_t left_pack_lanes[16] = {
+    0x00000000, 0x00000000, 0x00000001, 0x00000100, 0x00000002, 0x00000200, 0x00000201, 0x00020100,
+    0x00000003, 0x00000300, 0x00000301, 0x00030100, 0x00000302, 0x00030200, 0x00030201, 0x03020100
+};
+
+/** vpermd indices that move the int32 lanes set in an 8-bit mask to the front. */
+AVX2 static inline __m256i avx2_left_pack(int mask) {
+    int low = mask & 0xF;
+    int high = mask >> 4;
+    // The upper half's lanes are 4..7 and follow the lanes kept from the lower half.
+    uint64_t bytes = left_pack_lanes[low] |
+                     ((uint64_t)(left_pack_lanes[high] + 0x04040404u) << (8 * MASK_BITS4(low)));
+    return _mm256_cvtepu8_epi32(_mm_set_epi64x(0, (long long)bytes));
+}
+
+/** As sse41_find_extrema(), eight samples at a time with vpermd. */
+AVX2 static void avx2_find_extrema(const int32_t* signal, int length, int32_t* max_pos, int32_t* max_val,
+                                   int32_t* min_pos, int32_t* min_val, int* num_max, int* num_min) {
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    int n_max = 0;
+    int n_min = 0;
+    int i = 1;
+
+    *num_max = 0;
+    *num_min = 0;
+    if (length < 2) {
+        return;
+    }
+    scalar_extrema_endpoint(signal[0], signal[1], 0, max_pos, max_val, min_pos, min_val, &n_max, &n_min);
+    for (; i + 8 < length; i += 8) {
+        __m256i prev = _mm256_loadu_si256((const __m256i*)(signal + i - 1));
+        __m256i cur = _mm256_loadu_si256((const __m256i*)(signal + i));
+        __m256i next = _mm256_loadu_si256((const __m256i*)(signal + i + 1));
+        __m256i pos = _mm256_add_epi32(_mm256_set1_epi32(i), lanes);
+        int is_max = _mm256_movemask_ps(_mm256_castsi256_ps(
+            _mm256_and_si256(_mm256_cmpgt_epi32(cur, prev), _mm256_cmpgt_epi32(cur, next))));
+        int is_min = _mm256_movemask_ps(_mm256_castsi256_ps(
+            _mm256_and_si256(_mm256_cmpgt_epi32(prev, cur), _mm256_cmpgt_epi32(next, cur))));
+        if ((is_max | is_min) == 0) {
+            continue;
+        }
+        __m256i pack_max = avx2_left_pack(is_max);
+        __m256i pack_min = avx2_left_pack(is_min);
+
+        _mm256_storeu_si256((__m256i*)(max_pos + n_max), _mm256_permutevar8x32_epi32(pos, pack_max));
+        _mm256_storeu_si256((__m256i*)(max_val + n_max), _mm256_permutevar8x32_epi32(cur, pack_max));
+        _mm256_storeu_si256((__m256i*)(min_pos + n_min), _mm256_permutevar8x32_epi32(pos, pack_min));
+        _mm256_storeu_si256((__m256i*)(min_val + n_min), _mm256_permutevar8x32_epi32(cur, pack_min));
+        n_max += MASK_BITS4(is_max & 0xF) + MASK_BITS4(is_max >> 4);
+        n_min += MASK_BITS4(is_min & 0xF) + MASK_BITS4(is_min >> 4);
+    }
+    scalar_extrema_range(signal, i, length - 1, max_pos, max_val, min_pos, min_val, &n_max, &n_min);
+    scalar_extrema_endpoint(signal[length - 1], signal[length - 2], length - 1, max_pos, max_val, min_pos, min_val,
+                            &n_max, &n_min);
+    *num_max = n_max;
+    *num_min = n_min;
+}
+
+static const pixel_kernels avx2_kernels = {
+    "avx2",
+    avx2_to_q16_16,
+    avx2_from_q16_16,
+    avx2_subtract_mean_envelope,
+    avx2_mask_select,
+    avx2_min_max,
+    avx2_stretch,
+    avx2_fuse_min_max,
+    avx2_find_extrema,
+    avx2_mask_select_rgb
+};
+
+#endif /* PIXEL_KERNELS_X86 */
+
+/*==============================================================================
+ * Dispatch
+ *============================================================================*/
+
+static const pixel_kernels* selected_kernels = NULL;
+
+#if !defined(__ADSP21000__)
+static pthread_once_t select_once = PTHREAD_ONCE_INIT;
+#endif
+
+const pixel_kernels* pixel_kernels_variant(int variant) {
+    switch (variant) {
+        case PIXEL_KERNELS_SCALAR:
+            return &scalar_kernels;
+#if PIXEL_KERNELS_X86
+        case PIXEL_KERNELS_SSE41:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("sse4.1") ? &sse41_kernels : NULL;
+        case PIXEL_KERNELS_AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2") ? &avx2_kernels : NULL;
+#endif
+        default:
+            return NULL;
+    }
+}
+
+/** Pick the widest variant the CPU reports through CPUID. */
+static void select_kernels(void) {
+    const pixel_kernels* kernels = NULL;
+    for (int variant = PIXEL_KERNELS_COUNT - 1; variant >= 0 && kernels == NULL; variant--) {
+        kernels = pixel_kernels_variant(variant);
+    }
+    selected_kernels = kernels;
+}
+
+const pixel_kernels* pixel_kernels_get(void) {
+#if defined(__ADSP21000__)
+    if (selected_kernels == NULL) {
+        select_kernels();
+    }
+#else
+    // Threads of a batch or a parallel fusion may make the first call together.
+    pthread_once(&select_once, select_kernels);
+#endif
+    return selected_kernels;
+}
+
+/*==============================================================================
+ * Verification against the scalar kernels
+ *============================================================================*/
+
+/** Lengths that cover empty input, vector tails and several full vectors. */
+static const int verify_lengths[] = { 0, 1, 3, 7, 15, 31, 33, 64, 1001 };
+
+#define VERIFY_MAX_LEN 1001
+
+static unsigned char verify_a[VERIFY_MAX_LEN];
+static unsigned char verify_b[VERIFY_MAX_LEN];
+static char verify_mask[VERIFY_MAX_LEN];
+static int32_t verify_q16[VERIFY_MAX_LEN];
+static int32_t verify_upper[VERIFY_MAX_LEN];
+static int32_t verify_lower[VERIFY_MAX_LEN];
+static int32_t verify_var1[VERIFY_MAX_LEN];
+static int32_t verify_var2[VERIFY_MAX_LEN];
+static unsigned char verify_out_ref[VERIFY_MAX_LEN];
+static unsigned char verify_out[VERIFY_MAX_LEN];
+static unsigned char verify_rgb_a[3 * VERIFY_MAX_LEN];
+static unsigned char verify_rgb_b[3 * VERIFY_MAX_LEN];
+static unsigned char verify_rgb_ref[3 * VERIFY_MAX_LEN];
+static unsigned char verify_rgb_out[3 * VERIFY_MAX_LEN];
+static int32_t verify_q16_ref[VERIFY_MAX_LEN];
+static int32_t verify_q16_out[VERIFY_MAX_LEN];
+static int32_t verify_extrema_ref[4][VERIFY_MAX_LEN];
+static int32_t verify_extrema_out[4][VERIFY_MAX_LEN];
+
+/** Compare the extrema lists of a variant with the scalar kernel on one signal; returns 1 on a mismatch. */
+static int verify_extrema(const pixel_kernels* ref, const pixel_kernels* k, const int32_t* signal, int n) {
+    int32_t (*r)[VERIFY_MAX_LEN] = verify_extrema_ref;
+    int32_t (*o)[VERIFY_MAX_LEN] = verify_extrema_out;
+    int ref_max, ref_min, out_max, out_min;
+
+    ref->find_extrema(signal, n, r[0], r[1], r[2], r[3], &ref_max, &ref_min);
+    k->find_extrema(signal, n, o[0], o[1], o[2], o[3], &out_max, &out_min);
+    return ref_max != out_max || ref_min != out_min ||
+           memcmp(r[0], o[0], ref_max * sizeof(int32_t)) != 0 || memcmp(r[1], o[1], ref_max * sizeof(int32_t)) != 0 ||
+           memcmp(r[2], o[2], ref_min * sizeof(int32_t)) != 0 || memcmp(r[3], o[3], ref_min * sizeof(int32_t)) != 0;
+}
+
+static int verify_variant(const pixel_kernels* k) {
+    const pixel_kernels* ref = &scalar_kernels;
+    int failures = 0;
+
+    for (size_t t = 0; t < sizeof(verify_lengths) / sizeof(verify_lengths[0]); t++) {
+        int n = verify_lengths[t];
+        for (int i = 0; i < n; i++) {
+            verify_a[i] = (unsigned char)(rand() & 0xFF);
+            verify_b[i] = (unsigned char)(rand() & 0xFF);
+            verify_mask[i] = (char)(rand() % 3);
+            verify_q16[i] = (int32_t)((rand() % (300 << 16)) - (20 << 16));
+            verify_upper[i] = (int32_t)((rand() % (256 << 16)) - (128 << 16));
+            verify_lower[i] = (int32_t)((rand() % (256 << 16)) - (128 << 16));
+            verify_var1[i] = (int32_t)(rand() % (64 << 16));
+            verify_var2[i] = (int32_t)(rand() % (64 << 16));
+        }
+
+        ref->to_q16_16(verify_a, verify_q16_ref, n);
+        k->to_q16_16(verify_a, verify_q16_out, n);
+        if (memcmp(verify_q16_ref, verify_q16_out, n * sizeof(int32_t)) != 0) {
+            printf("Mismatch: %s to_q16_16 (n=%d)\n", k->name, n);
+            failures++;
+        }
+
+        ref->from_q16_16(verify_q16, verify_out_ref, n);
+        k->from_q16_16(verify_q16, verify_out, n);
+        if (memcmp(verify_out_ref, verify_out, n) != 0) {
+            printf("Mismatch: %s from_q16_16 (n=%d)\n", k->name, n);
+            failures++;
+        }
+
+        int64_t ref_mean_sq, ref_h_sq, out_mean_sq, out_h_sq;
+        memcpy(verify_q16_ref, verify_q16, n * sizeof(int32_t));
+        memcpy(verify_q16_out, verify_q16, n * sizeof(int32_t));
+        ref->subtract_mean_envelope(verify_q16_ref, verify_upper, verify_lower, n, &ref_mean_sq, &ref_h_sq);
+        k->subtract_mean_envelope(verify_q16_out, verify_upper, verify_lower, n, &out_mean_sq, &out_h_sq);
+        if (memcmp(verify_q16_ref, verify_q16_out, n * sizeof(int32_t)) != 0 ||
+            ref_mean_sq != out_mean_sq || ref_h_sq != out_h_sq) {
+            printf("Mismatch: %s subtract_mean_envelope (n=%d)\n", k->name, n);
+            failures++;
+        }
+
+        ref->mask_select(verify_a, verify_b, verify_mask, verify_out_ref, n);
+        k->mask_select(verify_a, verify_b, verify_mask, verify_out, n);
+        if (memcmp(verify_out_ref, verify_out, n) != 0) {
+            printf("Mismatch: %s mask_select (n=%d)\n", k->name, n);
+            failures++;
+        }
+
+        if (n > 0) {
+            unsigned char ref_lo, ref_hi, out_lo, out_hi;
+            for (int i = 0; i < 3 * n; i++) {
+                verify_rgb_a[i] = (unsigned char)(rand() & 0xFF);
+                verify_rgb_b[i] = (unsigned char)(rand() & 0xFF);
+            }
+            ref->mask_select_rgb(verify_rgb_a, verify_rgb_b, verify_mask, verify_rgb_ref, n, &ref_lo, &ref_hi);
+            k->mask_select_rgb(verify_rgb_a, verify_rgb_b, verify_mask, verify_rgb_out, n, &out_lo, &out_hi);
+            if (memcmp(verify_rgb_ref, verify_rgb_out, 3 * (size_t)n) != 0 || ref_lo != out_lo || ref_hi != out_hi) {
+                printf("Mismatch: %s mask_select_rgb (n=%d)\n", k->name, n);
+                failures++;
+            }
+        }
+
+        if (n > 0) {
+            unsigned char ref_lo, ref_hi, out_lo, out_hi;
+            ref->min_max(verify_a, n, &ref_lo, &ref_hi);
+            k->min_max(verify_a, n, &out_lo, &out_hi);
+            if (ref_lo != out_lo || ref_hi != out_hi) {
+                printf("Mismatch: %s min_max (n=%d)\n", k->name, n);
+                failures++;
+            }
+        }
+
+        if (n > 0) {
+            // Thresholds around the variance spread so that all three decisions occur.
+            for (int32_t eps = -2; eps <= 40; eps += 7) {
+                unsigned char ref_lo, ref_hi, out_lo, out_hi;
+                ref->fuse_min_max(verify_a, verify_b, verify_var1, verify_var2, eps, verify_out_ref, n,
+                                  &ref_lo, &ref_hi);
+                k->fuse_min_max(verify_a, verify_b, verify_var1, verify_var2, eps, verify_out, n,
+                                &out_lo, &out_hi);
+                if (memcmp(verify_out_ref, verify_out, n) != 0 || ref_lo != out_lo || ref_hi != out_hi) {
+                    printf("Mismatch: %s fuse_min_max (n=%d, eps=%d)\n", k->name, n, (int)eps);
+                    failures++;
+                    break;
+                }
+            }
+        }
+
+        // Noisy Q16.16 samples, and pixels whose frequent ties make plateaus that are not extrema.
+        if (verify_extrema(ref, k, verify_q16, n) != 0) {
+            printf("Mismatch: %s find_extrema (n=%d)\n", k->name, n);
+            failures++;
+        }
+        for (int i = 0; i < n; i++) {
+            verify_q16_ref[i] = (int32_t)(verify_a[i] & 0x3) << 16;
+        }
+        if (verify_extrema(ref, k, verify_q16_ref, n) != 0) {
+            printf("Mismatch: %s find_extrema plateaus (n=%d)\n", k->name, n);
+            failures++;
+        }
+
+        // Every range, with pixels on both sides of [min..min+range] to exercise the clamps.
+        for (int range = 1; range <= 255; range++) {
+            unsigned char min_val = (unsigned char)(rand() % (256 - range));
+            memcpy(verify_out_ref, verify_a, n);
+            memcpy(verify_out, verify_a, n);
+            ref->stretch(verify_out_ref, n, min_val, range);
+            k->stretch(verify_out, n, min_val, range);
+            if (memcmp(verify_out_ref, verify_out, n) != 0) {
+                printf("Mismatch: %s stretch (n=%d, range=%d)\n", k->name, n, range);
+                failures++;
+                break;
+            }
+        }
+    }
+
+    return failures;
+}
+
+int pixel_kernels_verify(void) {
+    int failures = 0;
+    for (int variant = PIXEL_KERNELS_SCALAR + 1; variant < PIXEL_KERNELS_COUNT; variant++) {
+        const pixel_kernels* k = pixel_kernels_variant(variant);
+        if (k != NULL) {
+            failures += verify_variant(k);
+        }
+    }
+    return failures;
+}
@@ -0,0 +1,119 @@
+/*
+ * pixel_kernels.h
+ *
+ * @brief Header file for the per-pixel kernels and their runtime dispatch.
+ *
+ * The per-pixel stages of the pipeline (Q16.16 conversions, envelope-mean
+ * subtraction, mask selection, min/max reduction, histogram stretch and the
+ * fused decide/select/min-max pass) and the 1-D extrema search of the EMD are
+ * collected in a kernel table. On the
+ * SHARC target only the scalar table exists and the compiler vectorises it
+ * through the SIMD_for/vector_for pragmas. On x86 hosts SSE4.1 and AVX2 tables
+ * are also built, and the widest one the CPU supports (queried through CPUID)
+ * is selected on first use.
+ */
+
+#ifndef PIXEL_KERNELS_H_
+#define PIXEL_KERNELS_H_
+
+#include <stdint.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(__ADSP21000__)
+/** @brief Set when x86 SIMD kernel variants are compiled in. */
+#define PIXEL_KERNELS_X86 1
+#else
+#define PIXEL_KERNELS_X86 0
+#endif
+
+/** @brief Kernel variant identifiers. */
+#define PIXEL_KERNELS_SCALAR 0
+#define PIXEL_KERNELS_SSE41  1
+#define PIXEL_KERNELS_AVX2   2
+#define PIXEL_KERNELS_COUNT  3
+
+/**
+ * @brief Table of per-pixel kernels of one instruction-set variant.
+ */
+typedef struct {
+    const char* name;
+
+    /** Convert 8-bit pixels to Q16.16 (see convert_to_q16_16()). */
+    void (*to_q16_16)(const unsigned char* input, int32_t* output, int size);
+
+    /** Convert Q16.16 to 8-bit pixels with rounding and clamping (see convert_from_q16_16()). */
+    void (*from_q16_16)(const int32_t* input, unsigned char* output, int size);
+
+    /**
+     * signal[i] -= (upper[i] + lower[i]) >> 1. When sum_mean_sq/sum_h_sq are not NULL
+     * they receive sum((mean^2) >> 16) and sum((signal^2) >> 16) taken before the update.
+     */
+    void (*subtract_mean_envelope)(int32_t* signal, const int32_t* upper, const int32_t* lower,
+                                   int size, int64_t* sum_mean_sq, int64_t* sum_h_sq);
+
+    /** Select A, B or their rounded average per pixel from a 0/1/2 mask (see fuse_images()). */
+    void (*mask_select)(const unsigned char* imgA, const unsigned char* imgB, const char* alpha_mask,
+                        unsigned char* fused_img, int size);
+
+    /** Find the minimum and maximum of 8-bit pixels (size > 0). */
+    void (*min_max)(const unsigned char* img, int size, unsigned char* min_val, unsigned char* max_val);
+
+    /** img[i] = clamp((img[i] - min_val) * 255 / range) with range > 0. */
+    void (*stretch)(unsigned char* img, int size, unsigned char min_val, int range);
+
+    /**
+     * Decide, select and reduce in one pass: fused_img[i] is imgA[i], imgB[i] or their rounded
+     * average by the generate_decision_mask_eps() rule on var1/var2, without storing the mask,
+     * and min_val/max_val receive the range of the fused pixels (size > 0).
+     */
+    void (*fuse_min_max)(const unsigned char* imgA, const unsigned char* imgB, const int32_t* var1,
+                         const int32_t* var2, int32_t adaptive_epsilon, unsigned char* fused_img,
+                         int size, unsigned char* min_val, unsigned char* max_val);
+
+    /**
+     * Strict local maxima and minima of a signal in ascending position order, the two
+     * endpoints compared with their only neighbour (see find_extrema() in emd.c). Each
+     * output list holds EMD_MAX_EXTREMA(length) entries: the kernels compact positions
+     * and values without branches and may write up to EMD_EXTREMA_PAD entries past the
+     * last extremum.
+     */
+    void (*find_extrema)(const int32_t* signal, int length, int32_t* max_pos, int32_t* max_val,
+                         int32_t* min_pos, int32_t* min_val, int* num_max, int* num_min);
+
+    /**
+     * mask_select() on interleaved RGB: the three channels of pixel i follow alpha_mask[i],
+     * and min_val/max_val receive the range over all channels (size pixels, size > 0).
+     */
+    void (*mask_select_rgb)(const unsigned char* rgbA, const unsigned char* rgbB, const char* alpha_mask,
+                            unsigned char* fused_rgb, int size, unsigned char* min_val, unsigned char* max_val);
+} pixel_kernels;
+
+/**
+ * @brief Get the kernel table selected for this CPU.
+ *
+ * The selection is made once, on the first call. On hosted builds it runs
+ * under pthread_once(), so threads may make the first call concurrently.
+ *
+ * @return Pointer to the selected kernel table.
+ */
+const pixel_kernels* pixel_kernels_get(void);
+
+/**
+ * @brief Get a specific kernel variant.
+ *
+ * @param variant PIXEL_KERNELS_SCALAR, PIXEL_KERNELS_SSE41 or PIXEL_KERNELS_AVX2.
+ * @return Pointer to the kernel table, or NULL if the variant is not compiled in
+ *         or not supported by this CPU.
+ */
+const pixel_kernels* pixel_kernels_variant(int variant);
+
+/**
+ * @brief Check every supported variant against the scalar kernels.
+ *
+ * Each kernel runs on pseudo-random input with lengths that exercise the
+ * vector tails, and its output must be bit-identical to the scalar result.
+ *
+ * @return Number of mismatching kernels (0 when all variants agree).
+ */
+int pixel_kernels_verify(void);
+
+#endif /* PIXEL_KERNELS_H_ */
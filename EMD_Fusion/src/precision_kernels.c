@@ -0,0 +1,136 @@
+/*
+ * precision_kernels.c
+ *
+ */
+
+#include "precision_kernels.h"
+#include <string.h>
+#include "decision_mask.h"
+#include "fusion.h"
+#include "trace.h"
+
+// Q16.16: the tuned pipeline's arithmetic.
+#define PK_SUFFIX q16
+#define PK_NAME   "q16.16"
+#define PK_T      int32_t
+#define PK_ACC    int64_t
+#define PK_VAR    int32_t
+#define PK_FIXED  1
+#define PK_FRAC   16
+#define PK_BIAS   0
+#define PK_MIN    INT32_MIN
+#define PK_MAX    INT32_MAX
+#include "precision_kernels_template.h"
+#undef PK_SUFFIX
+#undef PK_NAME
+#undef PK_T
+#undef PK_ACC
+#undef PK_VAR
+#undef PK_FIXED
+#undef PK_FRAC
+#undef PK_BIAS
+#undef PK_MIN
+#undef PK_MAX
+
+// Q8.8 in 16 bits: twice the samples per vector; pixels are centred so that 255 fits.
+#define PK_SUFFIX q8
+#define PK_NAME   "q8.8"
+#define PK_T      int16_t
+#define PK_ACC    int64_t
+#define PK_VAR    int32_t
+#define PK_FIXED  1
+#define PK_FRAC   8
+#define PK_BIAS   128
+#define PK_MIN    INT16_MIN
+#define PK_MAX    INT16_MAX
+#include "precision_kernels_template.h"
+#undef PK_SUFFIX
+#undef PK_NAME
+#undef PK_T
+#undef PK_ACC
+#undef PK_VAR
+#undef PK_FIXED
+#undef PK_FRAC
+#undef PK_BIAS
+#undef PK_MIN
+#undef PK_MAX
+
+// Single precision, for hosts where floating point is as fast as integers.
+#define PK_SUFFIX f32
+#define PK_NAME   "float"
+#define PK_T      float
+#define PK_ACC    float
+#define PK_VAR    float
+#define PK_FIXED  0
+#include "precision_kernels_template.h"
+#undef PK_SUFFIX
+#undef PK_NAME
+#undef PK_T
+#undef PK_ACC
+#undef PK_VAR
+#undef PK_FIXED
+
+// Double precision reference.
+#define PK_SUFFIX f64
+#define PK_NAME   "double"
+#define PK_T      double
+#define PK_ACC    double
+#define PK_VAR    double
+#define PK_FIXED  0
+#include "precision_kernels_template.h"
+#undef PK_SUFFIX
+#undef PK_NAME
+#undef PK_T
+#undef PK_ACC
+#undef PK_VAR
+#undef PK_FIXED
+
+static const precision_kernels* const precision_table[EMD_PRECISION_COUNT] = {
+    &kernels_q16,
+    &kernels_q8,
+    &kernels_f32,
+    &kernels_f64
+};
+
+const precision_kernels* precision_kernels_get(int precision) {
+    if (precision < 0 || precision >= EMD_PRECISION_COUNT) {
+        return NULL;
+    }
+    return precision_table[precision];
+}
+
+size_t precision_work_bytes(const precision_kernels* kernels, int n) {
+    // Two envelopes and two extrema value lists of samples, two extrema position lists.
+    return (size_t)n * (4 * kernels->sample_bytes + 2 * sizeof(int32_t));
+}
+
+void precision_fusion_run(const precision_kernels* kernels, const unsigned char* imgA,
+                          const unsigned char* imgB, int width, int height, void* const signal[2],
+                          void* const var_map[2], void* sums, void* work, unsigned char* fused_img) {
+    const unsigned char* img[2] = { imgA, imgB };
+    int num_pixels = width * height;
+    double sum_var = 0;
+    unsigned char min_val, max_val;
+
+    for (int i = 0; i < 2; i++) {
+        TRACE_BEGIN(TRACE_STAGE_CONVERT);
+        kernels->to_samples(img[i], signal[i], num_pixels);
+        TRACE_END(TRACE_STAGE_CONVERT);
+        TRACE_BEGIN(TRACE_STAGE_EMD);
+        kernels->sift(signal[i], num_pixels, work);
+        TRACE_END(TRACE_STAGE_EMD);
+    }
+
+    TRACE_BEGIN(TRACE_STAGE_VARIANCE);
+    for (int i = 0; i < 2; i++) {
+        sum_var += kernels->variance_rows(signal[i], width, height, WINDOW_SIZE, 0, height, var_map[i], sums);
+    }
+    TRACE_END(TRACE_STAGE_VARIANCE);
+
+    TRACE_BEGIN(TRACE_STAGE_DECISION);
+    kernels->fuse(imgA, imgB, var_map[0], var_map[1], num_pixels, sum_var, 2 * (int64_t)num_pixels,
+                  fused_img, &min_val, &max_val);
+    TRACE_END(TRACE_STAGE_DECISION);
+
+    histogram_stretch_lut(fused_img, num_pixels, min_val, max_val);
+}
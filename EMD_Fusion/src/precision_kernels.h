@@ -0,0 +1,120 @@
+/*
+ * precision_kernels.h
+ *
+ * @brief Header file for the EMD, variance and decision kernels of each numeric type.
+ *
+ * The tuned pipeline (emd.c, decision_mask.c, pixel_kernels.c) works on Q16.16
+ * int32_t samples. The kernels here are generated from one source,
+ * precision_kernels_template.h, for several sample types:
+ *   - Q16.16 in int32_t: the same arithmetic as the tuned pipeline, so its
+ *     output is bit-identical to it (checked by bench_precision.c);
+ *   - Q8.8 in int16_t: pixels are centred on 128 so that they fit, samples
+ *     saturate, and variance is still Q16.16 (the square of Q8.8);
+ *   - float: samples and variance in pixel units;
+ *   - double: the reference the other types are measured against.
+ * Only the 1-D EMD with the linear envelope is generated; the 2-D mode and
+ * the spline stay Q16.16-only.
+ *
+ * A variant is chosen at run time through precision_kernels_get(), e.g. by
+ * emd_fusion_config.precision, or at build time through EMD_PRECISION in main.c.
+ */
+
+#ifndef PRECISION_KERNELS_H_
+#define PRECISION_KERNELS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** @brief Numeric types. */
+#define EMD_PRECISION_Q16   0  /**< Q16.16 in int32_t (the tuned pipeline's type). */
+#define EMD_PRECISION_Q8    1  /**< Q8.8 in int16_t, pixels centred on 128. */
+#define EMD_PRECISION_F32   2  /**< float. */
+#define EMD_PRECISION_F64   3  /**< double, the accuracy reference. */
+#define EMD_PRECISION_COUNT 4
+
+/** @brief Bytes of sifting work memory for signals of up to n samples of any type. */
+#define PRECISION_WORK_BYTES(n) ((size_t)(n) * (4 * sizeof(double) + 2 * sizeof(int32_t)))
+
+/**
+ * @brief Kernels of one numeric type. Signals, envelopes and variance maps are
+ *        arrays of the variant's types, passed as void pointers.
+ */
+typedef struct {
+    const char* name;
+    size_t sample_bytes;     /**< Bytes per signal sample. */
+    size_t variance_bytes;   /**< Bytes per variance map entry. */
+
+    /** Convert 8-bit pixels to samples. */
+    void (*to_samples)(const unsigned char* input, void* output, int size);
+
+    /**
+     * One linear-envelope sifting iteration in place, the 1-D EMD of
+     * emd_decompose_image(). work holds precision_work_bytes() bytes.
+     * Returns 0, leaving the signal unchanged, when it is monotonic.
+     */
+    int (*sift)(void* signal, int length, void* work);
+
+    /**
+     * Local variance of rows [y_begin, y_end), as calculate_local_variance_rows();
+     * sums holds 2 * width accumulators (at most 16 * width bytes).
+     * Returns the sum of the map entries.
+     */
+    double (*variance_rows)(const void* signal, int width, int height, int window_size,
+                            int y_begin, int y_end, void* variance_map, void* sums);
+
+    /**
+     * Decision mask (ALPHA_A/B/AVG) with the threshold derived from sum_var, the
+     * variance sum of both maps over count entries.
+     */
+    void (*decide)(const void* var1, const void* var2, int num_pixels, double sum_var, int64_t count,
+                   char* alpha_mask);
+
+    /** Decide and fuse in one pass, as fuse_images_var(), returning the range for the stretch. */
+    void (*fuse)(const unsigned char* imgA, const unsigned char* imgB, const void* var1, const void* var2,
+                 int num_pixels, double sum_var, int64_t count, unsigned char* fused_img,
+                 unsigned char* min_val, unsigned char* max_val);
+
+    /** Sample i of a sifted signal (an IMF, free of the pixel offset) in pixel units. */
+    double (*sample_value)(const void* signal, int i);
+
+    /** Entry i of a variance map in pixel units squared. */
+    double (*variance_value)(const void* variance_map, int i);
+} precision_kernels;
+
+/**
+ * @brief Get the kernels of one numeric type.
+ *
+ * @param precision EMD_PRECISION_Q16, _Q8, _F32 or _F64.
+ * @return Kernel table, or NULL for an unknown type.
+ */
+const precision_kernels* precision_kernels_get(int precision);
+
+/**
+ * @brief Bytes of sifting work memory of one type for signals of n samples.
+ *
+ * @param kernels Kernel table.
+ * @param n       Signal length.
+ * @return Size in bytes, at most PRECISION_WORK_BYTES(n).
+ */
+size_t precision_work_bytes(const precision_kernels* kernels, int n);
+
+/**
+ * @brief Fuse one frame pair with the kernels of one type: conversion, 1-D EMD,
+ *        local variance, decision, fusion and histogram stretch.
+ *
+ * @param kernels   Kernel table.
+ * @param imgA      First 8-bit image.
+ * @param imgB      Second 8-bit image.
+ * @param width     Frame width.
+ * @param height    Frame height.
+ * @param signal    Two signal buffers of width * height samples.
+ * @param var_map   Two variance maps of width * height entries.
+ * @param sums      Variance sums, 16 * width bytes.
+ * @param work      Sifting work memory, precision_work_bytes() bytes.
+ * @param fused_img Output stretched fused image.
+ */
+void precision_fusion_run(const precision_kernels* kernels, const unsigned char* imgA,
+                          const unsigned char* imgB, int width, int height, void* const signal[2],
+                          void* const var_map[2], void* sums, void* work, unsigned char* fused_img);
+
+#endif /* PRECISION_KERNELS_H_ */
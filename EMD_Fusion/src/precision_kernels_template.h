@@ -0,0 +1,299 @@
+/*
+ * precision_kernels_template.h
+ *
+ * @brief Single source of the EMD, variance and decision kernels, included once
+ *        per numeric type by precision_kernels.c.
+ *
+ * No include guard: every inclusion generates one variant. Before including,
+ * define:
+ *   PK_SUFFIX  name suffix of the generated functions and table (e.g. q16)
+ *   PK_NAME    name of the variant reported by the table
+ *   PK_T       sample type of signals and envelopes
+ *   PK_ACC     accumulator type of the variance sums
+ *   PK_VAR     variance map type
+ *   PK_FIXED   1 for fixed point, 0 for floating point
+ *   PK_FRAC    fractional bits (fixed point only)
+ *   PK_BIAS    pixel value subtracted before scaling (fixed point only), so
+ *              that narrow types keep 8 bit pixels in range
+ *   PK_MIN, PK_MAX  saturation limits of PK_T (fixed point only)
+ *
+ * Fixed-point variance maps are Q16.16 whatever PK_FRAC is, so every fixed
+ * variant decides with decision_mask_epsilon() exactly like the Q16.16
+ * pipeline. Floating-point maps are in pixel units squared and decide with
+ * the unrounded 20% threshold.
+ */
+
+#define PK_CAT2(a, b) a##_##b
+#define PK_CAT(a, b) PK_CAT2(a, b)
+#define PK_FN(name) PK_CAT(name, PK_SUFFIX)
+
+static void PK_FN(to_samples)(const unsigned char* input, void* output, int size) {
+    PK_T* out = (PK_T*)output;
+    #pragma SIMD_for
+    for (int i = 0; i < size; i++) {
+#if PK_FIXED
+        out[i] = (PK_T)(((int32_t)input[i] - PK_BIAS) * (1 << PK_FRAC));
+#else
+        out[i] = (PK_T)input[i];
+#endif
+    }
+}
+
+/** Linear envelope through the extrema, as linear_interp_simd() in emd.c. */
+static void PK_FN(interp)(const int32_t* pos, const PK_T* val, int num, PK_T* env, int length) {
+    int i;
+
+    for (i = 0; i < pos[0] && i < length; i++) {
+        env[i] = val[0];
+    }
+    for (int seg = 0; seg < num - 1; seg++) {
+        int p1 = pos[seg];
+        int seg_length = pos[seg + 1] - p1;
+        PK_T v1 = val[seg];
+        if (seg_length <= 0) {
+            continue;
+        }
+#if PK_FIXED
+        int64_t slope = ((int64_t)(val[seg + 1] - v1) << 16) / seg_length;
+        #pragma SIMD_for
+        for (int j = 0; j < seg_length; j++) {
+            env[p1 + j] = (PK_T)(v1 + (int32_t)((slope * j) >> 16));
+        }
+#else
+        PK_T slope = (val[seg + 1] - v1) / (PK_T)seg_length;
+        #pragma SIMD_for
+        for (int j = 0; j < seg_length; j++) {
+            env[p1 + j] = v1 + slope * (PK_T)j;
+        }
+#endif
+    }
+    for (i = pos[num - 1]; i < length; i++) {
+        env[i] = val[num - 1];
+    }
+}
+
+/**
+ * One linear-envelope sifting iteration in place, as sift_iteration() in emd.c.
+ * work holds precision_work_bytes() bytes. Returns 0 for a monotonic signal.
+ */
+static int PK_FN(sift)(void* signal, int length, void* work) {
+    PK_T* h = (PK_T*)signal;
+    PK_T* upper = (PK_T*)work;
+    PK_T* lower = upper + length;
+    PK_T* max_val = lower + length;
+    PK_T* min_val = max_val + length;
+    int32_t* max_pos = (int32_t*)(min_val + length);
+    int32_t* min_pos = max_pos + length;
+    int num_max = 0, num_min = 0;
+
+    if (length > 1) {
+        if (h[0] > h[1]) {
+            max_pos[num_max] = 0;
+            max_val[num_max++] = h[0];
+        } else if (h[0] < h[1]) {
+            min_pos[num_min] = 0;
+            min_val[num_min++] = h[0];
+        }
+    }
+    for (int i = 1; i < length - 1; i++) {
+        if (h[i] > h[i - 1] && h[i] > h[i + 1]) {
+            max_pos[num_max] = i;
+            max_val[num_max++] = h[i];
+        } else if (h[i] < h[i - 1] && h[i] < h[i + 1]) {
+            min_pos[num_min] = i;
+            min_val[num_min++] = h[i];
+        }
+    }
+    if (length > 1) {
+        if (h[length - 1] > h[length - 2]) {
+            max_pos[num_max] = length - 1;
+            max_val[num_max++] = h[length - 1];
+        } else if (h[length - 1] < h[length - 2]) {
+            min_pos[num_min] = length - 1;
+            min_val[num_min++] = h[length - 1];
+        }
+    }
+    if (num_max == 0 || num_min == 0 || num_max + num_min < 3) {
+        return 0;
+    }
+
+    PK_FN(interp)(max_pos, max_val, num_max, upper, length);
+    PK_FN(interp)(min_pos, min_val, num_min, lower, length);
+
+    #pragma vector_for
+    for (int i = 0; i < length; i++) {
+#if PK_FIXED
+        int32_t v = (int32_t)h[i] - (((int32_t)upper[i] + lower[i]) >> 1);
+        h[i] = (PK_T)((v < PK_MIN) ? PK_MIN : (v > PK_MAX ? PK_MAX : v));
+#else
+        h[i] -= (upper[i] + lower[i]) * (PK_T)0.5;
+#endif
+    }
+    return 1;
+}
+
+/** Add (sign = 1) or remove (sign = -1) one row from the column sums of values and squares. */
+static void PK_FN(column_sums)(const PK_T* row, int width, int sign, PK_ACC* sums, PK_ACC* sums_sq) {
+    #pragma SIMD_for
+    for (int x = 0; x < width; x++) {
+#if PK_FIXED
+        int64_t v = row[x];
+        sums[x] += sign * v;
+        sums_sq[x] += sign * ((v * v) >> (2 * PK_FRAC - 16));
+#else
+        PK_ACC v = row[x];
+        sums[x] += sign * v;
+        sums_sq[x] += sign * v * v;
+#endif
+    }
+}
+
+/**
+ * Local variance of rows [y_begin, y_end), as calculate_local_variance_rows().
+ * sums holds 2 * width accumulators. Returns the sum of the map values.
+ */
+static double PK_FN(variance_rows)(const void* signal, int width, int height, int window_size,
+                                   int y_begin, int y_end, void* variance_map, void* sums) {
+    const PK_T* imf = (const PK_T*)signal;
+    PK_VAR* var_map = (PK_VAR*)variance_map;
+    PK_ACC* col_sum = (PK_ACC*)sums;
+    PK_ACC* col_sum_sq = col_sum + width;
+    const int half_window = window_size / 2;
+    const int prime_start = (y_begin - half_window < 0) ? 0 : (y_begin - half_window);
+    double var_sum = 0;
+
+    memset(col_sum, 0, 2 * (size_t)width * sizeof(PK_ACC));
+    for (int j = prime_start; j < y_begin + half_window && j < height; j++) {
+        PK_FN(column_sums)(imf + j * width, width, 1, col_sum, col_sum_sq);
+    }
+
+    for (int y = y_begin; y < y_end; y++) {
+        if (y + half_window < height) {
+            PK_FN(column_sums)(imf + (y + half_window) * width, width, 1, col_sum, col_sum_sq);
+        }
+        if (y - half_window - 1 >= prime_start) {
+            PK_FN(column_sums)(imf + (y - half_window - 1) * width, width, -1, col_sum, col_sum_sq);
+        }
+        int y_start = (y - half_window < 0) ? 0 : (y - half_window);
+        int y_last = (y + half_window >= height) ? (height - 1) : (y + half_window);
+        int rows = y_last - y_start + 1;
+
+        PK_ACC sum = 0;
+        PK_ACC sum_sq = 0;
+        for (int k = 0; k < half_window && k < width; k++) {
+            sum += col_sum[k];
+            sum_sq += col_sum_sq[k];
+        }
+        for (int x = 0; x < width; x++) {
+            if (x + half_window < width) {
+                sum += col_sum[x + half_window];
+                sum_sq += col_sum_sq[x + half_window];
+            }
+            if (x - half_window - 1 >= 0) {
+                sum -= col_sum[x - half_window - 1];
+                sum_sq -= col_sum_sq[x - half_window - 1];
+            }
+            int x_start = (x - half_window < 0) ? 0 : (x - half_window);
+            int x_end = (x + half_window >= width) ? (width - 1) : (x + half_window);
+            int count = rows * (x_end - x_start + 1);
+#if PK_FIXED
+            int32_t mean = (int32_t)(sum / count);
+            int32_t var = (int32_t)((sum_sq / count) - (((int64_t)mean * mean) >> (2 * PK_FRAC - 16)));
+#else
+            PK_VAR mean = sum / (PK_ACC)count;
+            PK_VAR var = sum_sq / (PK_ACC)count - mean * mean;
+#endif
+            var_map[y * width + x] = var;
+            var_sum += var;
+        }
+    }
+    return var_sum;
+}
+
+/** Decision of one pixel: ALPHA_A, ALPHA_B or ALPHA_AVG. */
+static inline int PK_FN(decide_one)(PK_VAR var1, PK_VAR var2, PK_VAR epsilon) {
+#if PK_FIXED
+    const int32_t diff = (var1 - var2 + 0x8000) >> 16;
+#else
+    const PK_VAR diff = var1 - var2;
+#endif
+    return (diff > epsilon) ? ALPHA_A : (diff < -epsilon) ? ALPHA_B : ALPHA_AVG;
+}
+
+/** Threshold of the decision from the variance sum of both maps. */
+static PK_VAR PK_FN(epsilon)(double sum_var, int64_t count) {
+#if PK_FIXED
+    return decision_mask_epsilon((int64_t)sum_var, count);
+#else
+    return (PK_VAR)(0.2 * sum_var / (double)count);
+#endif
+}
+
+static void PK_FN(decide)(const void* var1, const void* var2, int num_pixels, double sum_var,
+                          int64_t count, char* alpha_mask) {
+    const PK_VAR* v1 = (const PK_VAR*)var1;
+    const PK_VAR* v2 = (const PK_VAR*)var2;
+    PK_VAR epsilon = PK_FN(epsilon)(sum_var, count);
+
+    #pragma vector_for
+    for (int i = 0; i < num_pixels; i++) {
+        alpha_mask[i] = (char)PK_FN(decide_one)(v1[i], v2[i], epsilon);
+    }
+}
+
+static void PK_FN(fuse)(const unsigned char* imgA, const unsigned char* imgB, const void* var1,
+                        const void* var2, int num_pixels, double sum_var, int64_t count,
+                        unsigned char* fused_img, unsigned char* min_val, unsigned char* max_val) {
+    const PK_VAR* v1 = (const PK_VAR*)var1;
+    const PK_VAR* v2 = (const PK_VAR*)var2;
+    PK_VAR epsilon = PK_FN(epsilon)(sum_var, count);
+    unsigned char lo = 255;
+    unsigned char hi = 0;
+
+    for (int i = 0; i < num_pixels; i++) {
+        int decision = PK_FN(decide_one)(v1[i], v2[i], epsilon);
+        unsigned char val = (decision == ALPHA_A) ? imgA[i] :
+                            (decision == ALPHA_B) ? imgB[i] :
+                            (unsigned char)((imgA[i] + imgB[i] + 1) >> 1);
+        fused_img[i] = val;
+        if (val < lo) lo = val;
+        if (val > hi) hi = val;
+    }
+    *min_val = lo;
+    *max_val = hi;
+}
+
+/** Sample i of a sifted signal (an IMF, which has no offset) in pixel units. */
+static double PK_FN(sample_value)(const void* signal, int i) {
+#if PK_FIXED
+    return (double)((const PK_T*)signal)[i] / (1 << PK_FRAC);
+#else
+    return (double)((const PK_T*)signal)[i];
+#endif
+}
+
+/** Variance i of a map in pixel units squared. */
+static double PK_FN(variance_value)(const void* variance_map, int i) {
+#if PK_FIXED
+    return (double)((const PK_VAR*)variance_map)[i] / 65536.0;
+#else
+    return (double)((const PK_VAR*)variance_map)[i];
+#endif
+}
+
+static const precision_kernels PK_FN(kernels) = {
+    PK_NAME,
+    sizeof(PK_T),
+    sizeof(PK_VAR),
+    PK_FN(to_samples),
+    PK_FN(sift),
+    PK_FN(variance_rows),
+    PK_FN(decide),
+    PK_FN(fuse),
+    PK_FN(sample_value),
+    PK_FN(variance_value)
+};
+
+#undef PK_FN
+#undef PK_CAT
+#undef PK_CAT2
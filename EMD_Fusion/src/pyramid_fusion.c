@@ -0,0 +1,254 @@
+/*
+ * pyramid_fusion.c
+ *
+ */
+
+#include "pyramid_fusion.h"
+#include <string.h>
+#include "fusion.h"
+
+/** Reserve bytes at *offset, keeping every buffer 8-byte aligned; NULL when only measuring. */
+static void* carve(unsigned char* base, size_t* offset, size_t bytes) {
+    void* p = (base != NULL) ? base + *offset : NULL;
+    *offset += (bytes + 7) & ~(size_t)7;
+    return p;
+}
+
+/** Lay the buffers out from base and return their total size; with base == NULL only measure. */
+static size_t layout(pyramid_fusion* pf, unsigned char* base) {
+    size_t coarse_pixels = (size_t)(pf->width >> pf->levels) * (pf->height >> pf->levels);
+    size_t num_tiles = (size_t)((pf->width + PYRAMID_TILE - 1) / PYRAMID_TILE) *
+                       ((pf->height + PYRAMID_TILE - 1) / PYRAMID_TILE);
+    size_t region_pixels = (size_t)pf->width * (PYRAMID_TILE + 2 * PYRAMID_HALO);
+    size_t offset = 0;
+
+    pf->coarse_mask = carve(base, &offset, coarse_pixels);
+    pf->tiles = carve(base, &offset, num_tiles);
+    for (int i = 0; i < 2; i++) {
+        pf->region_var[i] = carve(base, &offset, region_pixels * sizeof(int32_t));
+    }
+    return offset;
+}
+
+size_t pyramid_fusion_memory_size(int width, int height, int levels) {
+    pyramid_fusion pf;
+
+    pf.width = width;
+    pf.height = height;
+    pf.levels = levels;
+    return layout(&pf, NULL);
+}
+
+void pyramid_fusion_bind(pyramid_fusion* pf, int width, int height, int levels, void* memory) {
+    pf->width = width;
+    pf->height = height;
+    pf->levels = levels;
+    pf->refined_pixels = 0;
+    pf->refined_tiles = 0;
+    layout(pf, (unsigned char*)memory);
+}
+
+/** Decide the coarse pair into pf->coarse_mask; returns -1 if the EMD fails. */
+static int coarse_decision(pyramid_fusion* pf, const unsigned char* img[2], int coarse_w, int coarse_h) {
+    const int levels = pf->levels;
+    const int factor = 1 << levels;
+    const int width = pf->width;
+    int coarse_pixels = coarse_w * coarse_h;
+    int64_t sum_var = 0;
+
+    for (int i = 0; i < 2; i++) {
+        int32_t* signal = pf->signal[i];
+
+        // Box average of factor x factor pixels, scaled straight to Q16.16.
+        for (int cy = 0; cy < coarse_h; cy++) {
+            for (int cx = 0; cx < coarse_w; cx++) {
+                const unsigned char* p = img[i] + (size_t)(cy * factor) * width + cx * factor;
+                int32_t sum = 0;
+                for (int dy = 0; dy < factor; dy++) {
+                    for (int dx = 0; dx < factor; dx++) {
+                        sum += p[dy * width + dx];
+                    }
+                }
+                signal[cy * coarse_w + cx] = sum << (16 - 2 * levels);
+            }
+        }
+        if (emd_decompose_image_scratch(signal, coarse_w, coarse_h, pf->emd_mode, pf->scratch) != 0) {
+            return -1;
+        }
+        sum_var += calculate_local_variance_rows(signal, coarse_w, coarse_h, WINDOW_SIZE, 0, coarse_h,
+                                                 pf->var_map[i], pf->column_sums, pf->column_sums + coarse_w);
+    }
+    generate_decision_mask_eps(pf->var_map[0], pf->var_map[1], coarse_pixels,
+                               decision_mask_epsilon(sum_var, 2 * (int64_t)coarse_pixels), pf->coarse_mask);
+    return 0;
+}
+
+/** Coarse cell of a full-resolution coordinate, clamped to the coarse frame. */
+static int coarse_cell(int x, int levels, int coarse_size) {
+    int c = x >> levels;
+    return (c < coarse_size) ? c : coarse_size - 1;
+}
+
+/** Classify every tile from the coarse mask cells under it, widened by one cell. */
+static void classify_tiles(pyramid_fusion* pf, int coarse_w, int coarse_h, int tiles_x, int tiles_y) {
+    for (int ty = 0; ty < tiles_y; ty++) {
+        int y1 = (ty + 1) * PYRAMID_TILE;
+        if (y1 > pf->height) y1 = pf->height;
+        int cy0 = coarse_cell(ty * PYRAMID_TILE, pf->levels, coarse_h) - 1;
+        int cy1 = coarse_cell(y1 - 1, pf->levels, coarse_h) + 1;
+        if (cy0 < 0) cy0 = 0;
+        if (cy1 > coarse_h - 1) cy1 = coarse_h - 1;
+
+        for (int tx = 0; tx < tiles_x; tx++) {
+            int x1 = (tx + 1) * PYRAMID_TILE;
+            if (x1 > pf->width) x1 = pf->width;
+            int cx0 = coarse_cell(tx * PYRAMID_TILE, pf->levels, coarse_w) - 1;
+            int cx1 = coarse_cell(x1 - 1, pf->levels, coarse_w) + 1;
+            if (cx0 < 0) cx0 = 0;
+            if (cx1 > coarse_w - 1) cx1 = coarse_w - 1;
+
+            // Votes per decision; averaged cells count against both images.
+            int votes[3] = { 0, 0, 0 };
+            for (int cy = cy0; cy <= cy1; cy++) {
+                const char* row = pf->coarse_mask + cy * coarse_w;
+                for (int cx = cx0; cx <= cx1; cx++) {
+                    votes[(int)row[cx]]++;
+                }
+            }
+            int cells = (cy1 - cy0 + 1) * (cx1 - cx0 + 1);
+            pf->tiles[ty * tiles_x + tx] =
+                (votes[ALPHA_A] * 100 >= PYRAMID_AGREEMENT * cells) ? PYRAMID_TILE_A :
+                (votes[ALPHA_B] * 100 >= PYRAMID_AGREEMENT * cells) ? PYRAMID_TILE_B : PYRAMID_TILE_REFINE;
+        }
+    }
+}
+
+/**
+ * Full-resolution EMD and variance of columns x0..x1-1 of rows y0..y1-1, with
+ * halo. The variance of those pixels lands in pf->var_map and its sum is added
+ * to *sum_var; returns -1 if the EMD fails.
+ */
+static int refine_region(pyramid_fusion* pf, const unsigned char* img[2], int x0, int x1, int y0, int y1,
+                         int64_t* sum_var) {
+    const int width = pf->width;
+    int rx0 = (x0 - PYRAMID_HALO < 0) ? 0 : x0 - PYRAMID_HALO;
+    int rx1 = (x1 + PYRAMID_HALO > width) ? width : x1 + PYRAMID_HALO;
+    int ry0 = (y0 - PYRAMID_HALO < 0) ? 0 : y0 - PYRAMID_HALO;
+    int ry1 = (y1 + PYRAMID_HALO > pf->height) ? pf->height : y1 + PYRAMID_HALO;
+    int region_w = rx1 - rx0;
+    int region_h = ry1 - ry0;
+
+    for (int i = 0; i < 2; i++) {
+        int32_t* signal = pf->signal[i];
+        int32_t* var = pf->region_var[i];
+
+        for (int r = 0; r < region_h; r++) {
+            convert_to_q16_16(img[i] + (size_t)(ry0 + r) * width + rx0, signal + r * region_w, region_w);
+        }
+        if (emd_decompose_image_scratch(signal, region_w, region_h, pf->emd_mode, pf->scratch) != 0) {
+            return -1;
+        }
+        *sum_var += calculate_local_variance_rows(signal, region_w, region_h, WINDOW_SIZE, y0 - ry0, y1 - ry0,
+                                                 var, pf->column_sums, pf->column_sums + region_w);
+
+        for (int y = y0; y < y1; y++) {
+            memcpy(pf->var_map[i] + (size_t)y * width + x0, var + (y - ry0) * region_w + (x0 - rx0),
+                   (size_t)(x1 - x0) * sizeof(int32_t));
+        }
+    }
+    return 0;
+}
+
+/** Copy n pixels and widen the running range. */
+static void copy_range(const unsigned char* src, int n, unsigned char* dst,
+                       unsigned char* min_val, unsigned char* max_val) {
+    unsigned char lo = *min_val;
+    unsigned char hi = *max_val;
+
+    for (int i = 0; i < n; i++) {
+        unsigned char v = src[i];
+        dst[i] = v;
+        if (v < lo) lo = v;
+        if (v > hi) hi = v;
+    }
+    *min_val = lo;
+    *max_val = hi;
+}
+
+int pyramid_fusion_run(pyramid_fusion* pf, const unsigned char* imgA, const unsigned char* imgB,
+                       unsigned char* fused_img) {
+    const unsigned char* img[2] = { imgA, imgB };
+    const int width = pf->width;
+    const int height = pf->height;
+    int coarse_w = width >> pf->levels;
+    int coarse_h = height >> pf->levels;
+    int tiles_x = (width + PYRAMID_TILE - 1) / PYRAMID_TILE;
+    int tiles_y = (height + PYRAMID_TILE - 1) / PYRAMID_TILE;
+    int64_t sum_var = 0;
+    int64_t refined = 0;
+    unsigned char min_val = 255;
+    unsigned char max_val = 0;
+
+    // Coarse decision and tile classification; a frame too small to downsample is refined everywhere.
+    if (coarse_w > 0 && coarse_h > 0) {
+        if (coarse_decision(pf, img, coarse_w, coarse_h) != 0) {
+            return -1;
+        }
+        classify_tiles(pf, coarse_w, coarse_h, tiles_x, tiles_y);
+    } else {
+        memset(pf->tiles, PYRAMID_TILE_REFINE, (size_t)tiles_x * tiles_y);
+    }
+
+    // Full-resolution variance over each run of refined tiles in a tile row.
+    pf->refined_tiles = 0;
+    for (int ty = 0; ty < tiles_y; ty++) {
+        const unsigned char* tiles = pf->tiles + ty * tiles_x;
+        int y0 = ty * PYRAMID_TILE;
+        int y1 = (y0 + PYRAMID_TILE > height) ? height : y0 + PYRAMID_TILE;
+
+        for (int tx = 0; tx < tiles_x; tx++) {
+            if (tiles[tx] != PYRAMID_TILE_REFINE) {
+                continue;
+            }
+            int run_end = tx;
+            while (run_end + 1 < tiles_x && tiles[run_end + 1] == PYRAMID_TILE_REFINE) {
+                run_end++;
+            }
+            int x0 = tx * PYRAMID_TILE;
+            int x1 = ((run_end + 1) * PYRAMID_TILE > width) ? width : (run_end + 1) * PYRAMID_TILE;
+
+            if (refine_region(pf, img, x0, x1, y0, y1, &sum_var) != 0) {
+                return -1;
+            }
+            refined += (int64_t)(x1 - x0) * (y1 - y0);
+            pf->refined_tiles += run_end - tx + 1;
+            tx = run_end;
+        }
+    }
+    pf->refined_pixels = (int)refined;
+    int32_t adaptive_epsilon = (refined > 0) ? decision_mask_epsilon(sum_var, 2 * refined) : 0;
+
+    // Fuse refined tiles from their variance and copy the others, row by row.
+    for (int y = 0; y < height; y++) {
+        const unsigned char* tiles = pf->tiles + (y / PYRAMID_TILE) * tiles_x;
+        size_t row = (size_t)y * width;
+
+        for (int tx = 0; tx < tiles_x; tx++) {
+            int x0 = tx * PYRAMID_TILE;
+            int n = (x0 + PYRAMID_TILE > width) ? width - x0 : PYRAMID_TILE;
+
+            if (tiles[tx] == PYRAMID_TILE_REFINE) {
+                unsigned char lo, hi;
+                fuse_images_var(imgA + row + x0, imgB + row + x0, pf->var_map[0] + row + x0,
+                                pf->var_map[1] + row + x0, n, adaptive_epsilon, fused_img + row + x0, &lo, &hi);
+                if (lo < min_val) min_val = lo;
+                if (hi > max_val) max_val = hi;
+            } else {
+                copy_range(img[tiles[tx]] + row + x0, n, fused_img + row + x0, &min_val, &max_val);
+            }
+        }
+    }
+
+    histogram_stretch_lut(fused_img, width * height, min_val, max_val);
+    return 0;
+}
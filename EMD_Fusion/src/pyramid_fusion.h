@@ -0,0 +1,126 @@
+/*
+ * pyramid_fusion.h
+ *
+ * @brief Header file for the coarse-to-fine (pyramid) decision mode.
+ *
+ * The pair is first box-downsampled by 2^levels and decided at that scale:
+ * EMD, local variance and the decision mask of the coarse pair. The frame is
+ * then split into PYRAMID_TILE x PYRAMID_TILE tiles. A tile where at least
+ * PYRAMID_AGREEMENT percent of the coarse cells, widened by one cell on every
+ * side, chose image A (or image B) is copied from that image. Every other
+ * tile, i.e. one that is mixed or largely averaged, is refined:
+ * full-resolution EMD, variance and decision run over each run of
+ * neighbouring refined tiles in a tile row, plus PYRAMID_HALO pixels on every
+ * side for the variance window and the EMD.
+ * The refined threshold is the one of decision_mask_epsilon() over the
+ * refined pixels only.
+ *
+ * The output matches the full-frame path inside refined tiles, up to the
+ * boundary effects of the smaller EMD regions (the 1-D EMD flattens each
+ * region with its own width), and in copied tiles wherever the full-frame
+ * decision would have chosen the same image. The two differ where the
+ * full-frame path averages a pixel of a copied tile, or picks the other image
+ * there against the surrounding decision. A pair whose focus changes at the
+ * scale of a few pixels everywhere is refined everywhere and costs the
+ * coarse pass on top of the full-frame path.
+ */
+
+#ifndef PYRAMID_FUSION_H_
+#define PYRAMID_FUSION_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "emd.h"
+#include "decision_mask.h"
+
+/** @brief Deepest pyramid level: 2 downsamples by 4 in each direction. */
+#define PYRAMID_MAX_LEVELS 2
+
+/** @brief Side of a refinement tile in full-resolution pixels. */
+#define PYRAMID_TILE 32
+
+/**
+ * @brief Percentage of coarse cells that must agree for a tile to be copied.
+ *
+ * The variance decision is noisy even inside one focus region, so requiring
+ * every cell to agree would refine nearly every tile of a textured frame.
+ */
+#define PYRAMID_AGREEMENT 90
+
+/** @brief Pixels of context around a refined region, as the strip halo (see strip_fusion.h). */
+#define PYRAMID_HALO (WINDOW_SIZE / 2 + 2)
+
+/** @brief Tile decisions. */
+#define PYRAMID_TILE_A      ALPHA_A     /**< Copied from image A. */
+#define PYRAMID_TILE_B      ALPHA_B     /**< Copied from image B. */
+#define PYRAMID_TILE_REFINE ALPHA_AVG   /**< Fused at full resolution. */
+
+/**
+ * @brief Upper bound of pyramid_fusion_memory_size() for frames of up to
+ *        num_pixels pixels and width columns, in sizeof units: the coarse mask
+ *        (a quarter of the pixels at most), one byte per tile and the two
+ *        region variance maps.
+ */
+#define PYRAMID_FUSION_MEMORY_BYTES(width, num_pixels) \
+    ((size_t)(num_pixels) / 4 + (size_t)(num_pixels) / PYRAMID_TILE + (size_t)(width) + \
+     2 * (size_t)(width) * (PYRAMID_TILE + 2 * PYRAMID_HALO) * sizeof(int32_t) + 64)
+
+/**
+ * @brief State of the pyramid mode, reusable across frames of one size.
+ *
+ * The signals, variance maps, column sums and EMD scratch are borrowed from
+ * the owner (see emd_fusion.h), which sizes them for the full frame.
+ */
+typedef struct {
+    int width;                  /**< Frame width. */
+    int height;                 /**< Frame height. */
+    int levels;                 /**< Downsampling levels, 1..PYRAMID_MAX_LEVELS. */
+    int emd_mode;               /**< EMD_MODE_1D or EMD_MODE_2D. */
+    int32_t* signal[2];         /**< Borrowed full-size signal buffers. */
+    int32_t* var_map[2];        /**< Borrowed full-size variance maps. */
+    int64_t* column_sums;       /**< Borrowed column sums, 2 * width. */
+    const emd_scratch* scratch; /**< Borrowed EMD scratch for width * height samples. */
+    char* coarse_mask;          /**< Decision mask of the coarse pair. */
+    unsigned char* tiles;       /**< PYRAMID_TILE_ decision per tile. */
+    int32_t* region_var[2];     /**< Variance of one refined region per image. */
+    int refined_pixels;         /**< Pixels refined by the last frame. */
+    int refined_tiles;          /**< Tiles refined by the last frame. */
+} pyramid_fusion;
+
+/**
+ * @brief Bytes of memory needed by pyramid_fusion_bind().
+ *
+ * @param width  Frame width.
+ * @param height Frame height.
+ * @param levels Downsampling levels, 1..PYRAMID_MAX_LEVELS.
+ * @return Size in bytes, at most PYRAMID_FUSION_MEMORY_BYTES(width, width * height).
+ */
+size_t pyramid_fusion_memory_size(int width, int height, int levels);
+
+/**
+ * @brief Lay the pyramid buffers out in memory of pyramid_fusion_memory_size() bytes.
+ *
+ * The borrowed buffers (signal, var_map, column_sums, scratch) and emd_mode are
+ * set by the caller afterwards.
+ *
+ * @param pf     State to initialize.
+ * @param width  Frame width.
+ * @param height Frame height.
+ * @param levels Downsampling levels, 1..PYRAMID_MAX_LEVELS.
+ * @param memory 8-byte aligned memory.
+ */
+void pyramid_fusion_bind(pyramid_fusion* pf, int width, int height, int levels, void* memory);
+
+/**
+ * @brief Fuse one frame pair coarse-to-fine, including the histogram stretch.
+ *
+ * @param pf        Bound state.
+ * @param imgA      First 8-bit image, width * height pixels.
+ * @param imgB      Second 8-bit image, width * height pixels.
+ * @param fused_img Output stretched fused image, width * height pixels.
+ * @return 0 on success, -1 if the EMD could not decompose the coarse pair or a region.
+ */
+int pyramid_fusion_run(pyramid_fusion* pf, const unsigned char* imgA, const unsigned char* imgB,
+                       unsigned char* fused_img);
+
+#endif /* PYRAMID_FUSION_H_ */
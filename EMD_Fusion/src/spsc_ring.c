@@ -0,0 +1,52 @@
+/*
+ * spsc_ring.c
+ *
+ */
+
+#include "spsc_ring.h"
+#include <stdlib.h>
+#include <string.h>
+
+int spsc_ring_init(spsc_ring* ring, unsigned int capacity) {
+    unsigned int size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+
+    memset(ring, 0, sizeof(*ring));
+    ring->slots = calloc(size, sizeof(void*));
+    if (ring->slots == NULL) {
+        return -1;
+    }
+    ring->mask = size - 1;
+    return 0;
+}
+
+int spsc_ring_push(spsc_ring* ring, void* item) {
+    unsigned int head = ring->head;
+    unsigned int tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+    if (head - tail > ring->mask) {
+        return -1;
+    }
+    ring->slots[head & ring->mask] = item;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void* spsc_ring_pop(spsc_ring* ring) {
+    unsigned int tail = ring->tail;
+    unsigned int head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+    if (tail == head) {
+        return NULL;
+    }
+    void* item = ring->slots[tail & ring->mask];
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+    return item;
+}
+
+void spsc_ring_free(spsc_ring* ring) {
+    free(ring->slots);
+    memset(ring, 0, sizeof(*ring));
+}
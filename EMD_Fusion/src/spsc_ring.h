@@ -0,0 +1,64 @@
+/*
+ * spsc_ring.h
+ *
+ * @brief Header file for a lock-free single-producer/single-consumer ring of pointers.
+ *
+ * Exactly one thread may push and exactly one thread may pop. The head and tail
+ * indices live on separate cache lines and are published with release/acquire
+ * ordering, so the item a pointer refers to is visible to the consumer once the
+ * pointer is.
+ */
+
+#ifndef SPSC_RING_H_
+#define SPSC_RING_H_
+
+/** @brief Cache line size used to keep the producer and consumer indices apart. */
+#define SPSC_CACHE_LINE 64
+
+/**
+ * @brief SPSC ring of pointers.
+ */
+typedef struct {
+    void** slots;            /**< capacity entries. */
+    unsigned int mask;       /**< capacity - 1 (capacity is a power of two). */
+    char pad0[SPSC_CACHE_LINE];
+    unsigned int head;       /**< Next slot to write, owned by the producer. */
+    char pad1[SPSC_CACHE_LINE];
+    unsigned int tail;       /**< Next slot to read, owned by the consumer. */
+    char pad2[SPSC_CACHE_LINE];
+} spsc_ring;
+
+/**
+ * @brief Allocate a ring.
+ *
+ * @param ring     Ring to initialize.
+ * @param capacity Number of slots, rounded up to a power of two.
+ * @return 0 on success, -1 on allocation failure.
+ */
+int spsc_ring_init(spsc_ring* ring, unsigned int capacity);
+
+/**
+ * @brief Push an item (producer thread only).
+ *
+ * @param ring Ring.
+ * @param item Non-NULL pointer to enqueue.
+ * @return 0 on success, -1 if the ring is full.
+ */
+int spsc_ring_push(spsc_ring* ring, void* item);
+
+/**
+ * @brief Pop an item (consumer thread only).
+ *
+ * @param ring Ring.
+ * @return The oldest item, or NULL if the ring is empty.
+ */
+void* spsc_ring_pop(spsc_ring* ring);
+
+/**
+ * @brief Release the ring storage.
+ *
+ * @param ring Ring.
+ */
+void spsc_ring_free(spsc_ring* ring);
+
+#endif /* SPSC_RING_H_ */
@@ -0,0 +1,100 @@
+/*
+ * strip_fusion.c
+ *
+ */
+
+#include "strip_fusion.h"
+#include "fusion.h"
+
+/** Reserve bytes at *offset, keeping every buffer 8-byte aligned. */
+static void* carve(unsigned char* base, size_t* offset, size_t bytes) {
+    void* p = base + *offset;
+    *offset += (bytes + 7) & ~(size_t)7;
+    return p;
+}
+
+int fuse_images_strips(int width, int height, int strip_rows, int emd_mode, void* memory, size_t memory_size,
+                       strip_read_fn read_rows, strip_write_fn write_rows, void* user,
+                       unsigned char* out_min, unsigned char* out_max) {
+    const int halo = STRIP_HALO_ROWS;
+    unsigned char min_val = 255;
+    unsigned char max_val = 0;
+    int64_t sum_var = 0;
+    int64_t var_count = 0;
+
+    if (strip_rows <= 0 || width > VARIANCE_MAX_WIDTH ||
+        memory_size < STRIP_FUSION_MEMORY_BYTES(width, strip_rows)) {
+        printf("Error: Strip of %d rows x %d pixels does not fit %lu bytes.\n", strip_rows, width,
+               (unsigned long)memory_size);
+        return -1;
+    }
+
+    // Lay the strip buffers and the EMD scratch out over the caller's memory.
+    size_t band_capacity = STRIP_BAND_PIXELS(width, strip_rows);
+    size_t offset = 0;
+    unsigned char* base = (unsigned char*)memory;
+    unsigned char* strip_raw_a = carve(base, &offset, band_capacity);
+    unsigned char* strip_raw_b = carve(base, &offset, band_capacity);
+    int32_t* strip_signal_a = carve(base, &offset, band_capacity * sizeof(int32_t));
+    int32_t* strip_signal_b = carve(base, &offset, band_capacity * sizeof(int32_t));
+    int32_t* strip_var_a = carve(base, &offset, band_capacity * sizeof(int32_t));
+    int32_t* strip_var_b = carve(base, &offset, band_capacity * sizeof(int32_t));
+    int64_t* strip_col_sums = carve(base, &offset, 2 * (size_t)width * sizeof(int64_t));
+    unsigned char* strip_fused = carve(base, &offset, (size_t)width * strip_rows);
+    emd_scratch scratch;
+    emd_scratch_bind(&scratch, (int)band_capacity, carve(base, &offset, EMD_SCRATCH_BYTES(band_capacity)));
+
+    for (int y0 = 0; y0 < height; y0 += strip_rows) {
+        int rows   = (y0 + strip_rows > height) ? (height - y0) : strip_rows;
+        int top    = (y0 - halo < 0) ? 0 : (y0 - halo);
+        int bottom = (y0 + rows + halo > height) ? height : (y0 + rows + halo);
+        int band   = bottom - top;
+        int band_pixels = band * width;
+        int core_offset = (y0 - top) * width;
+        int core_pixels = rows * width;
+
+        // Read the strip plus halo rows of both images.
+        if (read_rows(user, 0, top, band, strip_raw_a) != 0 ||
+            read_rows(user, 1, top, band, strip_raw_b) != 0) {
+            printf("Error: Failed to read rows %d..%d.\n", top, bottom - 1);
+            return -1;
+        }
+
+        // EMD over the whole band.
+        convert_to_q16_16(strip_raw_a, strip_signal_a, band_pixels);
+        convert_to_q16_16(strip_raw_b, strip_signal_b, band_pixels);
+        if (emd_decompose_image_scratch(strip_signal_a, width, band, emd_mode, &scratch) != 0 ||
+            emd_decompose_image_scratch(strip_signal_b, width, band, emd_mode, &scratch) != 0) {
+            return -1;
+        }
+
+        // Variance of the core rows only; the halo rows supply their windows.
+        sum_var += calculate_local_variance_rows(strip_signal_a, width, band, WINDOW_SIZE, y0 - top,
+                                                 y0 - top + rows, strip_var_a, strip_col_sums,
+                                                 strip_col_sums + width);
+        sum_var += calculate_local_variance_rows(strip_signal_b, width, band, WINDOW_SIZE, y0 - top,
+                                                 y0 - top + rows, strip_var_b, strip_col_sums,
+                                                 strip_col_sums + width);
+
+        // Running threshold over the core rows of all strips so far.
+        var_count += 2 * (int64_t)core_pixels;
+        int32_t adaptive_epsilon = decision_mask_epsilon(sum_var, var_count);
+
+        // Decide, fuse and find the range of the core rows in one pass.
+        unsigned char strip_min, strip_max;
+        fuse_images_var(strip_raw_a + core_offset, strip_raw_b + core_offset, strip_var_a + core_offset,
+                        strip_var_b + core_offset, core_pixels, adaptive_epsilon, strip_fused,
+                        &strip_min, &strip_max);
+        if (strip_min < min_val) min_val = strip_min;
+        if (strip_max > max_val) max_val = strip_max;
+
+        if (write_rows(user, y0, rows, strip_fused) != 0) {
+            printf("Error: Failed to write rows %d..%d.\n", y0, y0 + rows - 1);
+            return -1;
+        }
+    }
+
+    *out_min = min_val;
+    *out_max = max_val;
+    return 0;
+}
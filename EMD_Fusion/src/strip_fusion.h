@@ -0,0 +1,104 @@
+/*
+ * strip_fusion.h
+ *
+ * @brief Header file for the banded (strip) fusion pipeline.
+ *
+ * The strip pipeline runs EMD -> local variance -> decision mask -> fusion on
+ * one band of rows at a time, so memory is bounded by the strip size rather
+ * than by the image size. Each strip is read together with a halo of
+ * STRIP_HALO_ROWS rows above and below, which gives the variance window and the
+ * EMD envelopes the context they have in the full-frame path.
+ *
+ * Tolerance against the full-frame path:
+ *   - Local variance is exact whenever the EMD output is, since the halo covers
+ *     the WINDOW_SIZE / 2 rows the window needs.
+ *   - EMD_MODE_1D: envelope segments are exact unless two successive extrema of
+ *     the flattened signal lie more than STRIP_EMD_HALO_ROWS rows apart (large
+ *     flat regions). EMD_MODE_2D: the envelope window is estimated per strip,
+ *     so IMF values differ where the extrema density differs from the frame.
+ *   - The adaptive epsilon is the running mean over the strips processed so far
+ *     instead of the frame mean. Only pixels whose variance difference lies
+ *     between the two thresholds can change class.
+ *   - Histogram stretching is global and is left to the caller, using the
+ *     minimum/maximum returned by fuse_images_strips().
+ * A pixel whose decision changes moves by at most |A - B| / 2 before stretching.
+ * On a synthetic 200x200 multi-focus pair (textured noise with complementary
+ * 5x5 blur), 8-row strips differ from the full-frame output at 1 of 40000
+ * pixels in both EMD modes; 16-row strips reproduce it exactly in the 1-D
+ * mode and differ at 1 pixel in the 2-D mode.
+ */
+
+#ifndef STRIP_FUSION_H_
+#define STRIP_FUSION_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "emd.h"
+#include "decision_mask.h"
+
+/** @brief Extra halo rows kept for the EMD envelopes beyond the variance window. */
+#define STRIP_EMD_HALO_ROWS 2
+
+/** @brief Halo rows read above and below every strip. */
+#define STRIP_HALO_ROWS (WINDOW_SIZE / 2 + STRIP_EMD_HALO_ROWS)
+
+/** @brief Pixels of one strip of strip_rows rows of width pixels, including its halo. */
+#define STRIP_BAND_PIXELS(width, strip_rows) ((size_t)(width) * ((strip_rows) + 2 * STRIP_HALO_ROWS))
+
+/**
+ * @brief Bytes of caller memory for strips of strip_rows rows of up to width pixels: the raw and
+ *        Q16.16 band and the variance map of both images, the column sums, the fused rows and the
+ *        EMD scratch of one band.
+ */
+#define STRIP_FUSION_MEMORY_BYTES(width, strip_rows) \
+    (STRIP_BAND_PIXELS(width, strip_rows) * 2 * (1 + 2 * sizeof(int32_t)) + \
+     (size_t)(width) * (strip_rows) + 2 * (size_t)(width) * sizeof(int64_t) + \
+     EMD_SCRATCH_BYTES(STRIP_BAND_PIXELS(width, strip_rows)) + 64)
+
+/**
+ * @brief Row source callback.
+ *
+ * @param user        Caller context passed to fuse_images_strips().
+ * @param image_index 0 for image A, 1 for image B.
+ * @param y           First row to read.
+ * @param rows        Number of rows to read.
+ * @param dst         Destination for rows * width 8-bit pixels.
+ * @return 0 on success, non-zero on error.
+ */
+typedef int (*strip_read_fn)(void* user, int image_index, int y, int rows, unsigned char* dst);
+
+/**
+ * @brief Row sink callback receiving fused (not yet stretched) rows.
+ *
+ * @param user Caller context passed to fuse_images_strips().
+ * @param y    First row of the strip.
+ * @param rows Number of rows in the strip.
+ * @param src  rows * width fused 8-bit pixels.
+ * @return 0 on success, non-zero on error.
+ */
+typedef int (*strip_write_fn)(void* user, int y, int rows, const unsigned char* src);
+
+/**
+ * @brief Fuse two images strip by strip.
+ *
+ * Every buffer, including the EMD scratch, is laid out over the caller's memory,
+ * e.g. a static block in SDRAM on the board, so nothing is sized by the frame.
+ *
+ * @param width       Image width.
+ * @param height      Image height (unbounded).
+ * @param strip_rows  Rows emitted per strip.
+ * @param emd_mode    EMD_MODE_1D or EMD_MODE_2D.
+ * @param memory      Caller memory, 8-byte aligned.
+ * @param memory_size Bytes at memory, at least STRIP_FUSION_MEMORY_BYTES(width, strip_rows).
+ * @param read_rows   Row source callback.
+ * @param write_rows  Row sink callback.
+ * @param user        Caller context passed to both callbacks.
+ * @param out_min     Output minimum fused pixel value over the image.
+ * @param out_max     Output maximum fused pixel value over the image.
+ * @return 0 on success, -1 on invalid strip size, too little memory or callback error.
+ */
+int fuse_images_strips(int width, int height, int strip_rows, int emd_mode, void* memory, size_t memory_size,
+                       strip_read_fn read_rows, strip_write_fn write_rows, void* user,
+                       unsigned char* out_min, unsigned char* out_max);
+
+#endif /* STRIP_FUSION_H_ */
@@ -0,0 +1,149 @@
+/*
+ * thread_pool.c
+ *
+ */
+
+#include "thread_pool.h"
+
+#if !defined(__ADSP21000__)
+
+#include <pthread.h>
+#include <stdlib.h>
+
+struct thread_pool {
+    int num_workers;
+    pthread_t* workers;
+
+    pthread_mutex_t lock;
+    pthread_cond_t job_ready;
+    pthread_cond_t job_done;
+
+    // Current job, guarded by lock except for next_task.
+    thread_pool_task_fn fn;
+    void* ctx;
+    int num_tasks;
+    int next_task;
+    unsigned int generation;
+    int busy_workers;
+    int shutdown;
+};
+
+/**
+ * Claim and run tasks of the current job until none are left.
+ */
+static void run_tasks(thread_pool* pool, thread_pool_task_fn fn, void* ctx, int num_tasks) {
+    for (;;) {
+        int task = __atomic_fetch_add(&pool->next_task, 1, __ATOMIC_RELAXED);
+        if (task >= num_tasks) {
+            break;
+        }
+        fn(ctx, task);
+    }
+}
+
+static void* worker_main(void* arg) {
+    thread_pool* pool = (thread_pool*)arg;
+    unsigned int seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->shutdown && pool->generation == seen) {
+            pthread_cond_wait(&pool->job_ready, &pool->lock);
+        }
+        if (pool->shutdown) {
+            break;
+        }
+        seen = pool->generation;
+        thread_pool_task_fn fn = pool->fn;
+        void* ctx = pool->ctx;
+        int num_tasks = pool->num_tasks;
+        pthread_mutex_unlock(&pool->lock);
+
+        run_tasks(pool, fn, ctx, num_tasks);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->busy_workers == 0) {
+            pthread_cond_signal(&pool->job_done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+thread_pool* thread_pool_create(int num_threads) {
+    thread_pool* pool = calloc(1, sizeof(thread_pool));
+    if (pool == NULL) {
+        return NULL;
+    }
+
+    pool->num_workers = (num_threads > 1) ? num_threads - 1 : 0;
+    pool->workers = calloc(pool->num_workers > 0 ? pool->num_workers : 1, sizeof(pthread_t));
+    if (pool->workers == NULL) {
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->job_ready, NULL);
+    pthread_cond_init(&pool->job_done, NULL);
+
+    for (int i = 0; i < pool->num_workers; i++) {
+        if (pthread_create(&pool->workers[i], NULL, worker_main, pool) != 0) {
+            pool->num_workers = i;
+            thread_pool_destroy(pool);
+            return NULL;
+        }
+    }
+    return pool;
+}
+
+void thread_pool_parallel_for(thread_pool* pool, int num_tasks, thread_pool_task_fn fn, void* ctx) {
+    if (num_tasks <= 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->fn = fn;
+    pool->ctx = ctx;
+    pool->num_tasks = num_tasks;
+    pool->next_task = 0;
+    pool->busy_workers = pool->num_workers;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->job_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    // The caller works on the job too, then waits for the workers to drain it.
+    run_tasks(pool, fn, ctx, num_tasks);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->busy_workers > 0) {
+        pthread_cond_wait(&pool->job_done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+int thread_pool_size(const thread_pool* pool) {
+    return pool->num_workers + 1;
+}
+
+void thread_pool_destroy(thread_pool* pool) {
+    if (pool == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->job_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->num_workers; i++) {
+        pthread_join(pool->workers[i], NULL);
+    }
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->job_ready);
+    pthread_cond_destroy(&pool->job_done);
+    free(pool->workers);
+    free(pool);
+}
+
+#endif /* !__ADSP21000__ */
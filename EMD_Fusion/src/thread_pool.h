@@ -0,0 +1,63 @@
+/*
+ * thread_pool.h
+ *
+ * @brief Header file for a minimal POSIX thread pool (hosted builds only).
+ *
+ * The pool runs blocking parallel-for jobs: a job of N tasks is split among the
+ * worker threads and the calling thread, and thread_pool_parallel_for() returns
+ * once every task has finished.
+ */
+
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#if !defined(__ADSP21000__)
+
+/**
+ * @brief Task callback.
+ *
+ * @param ctx  Job context passed to thread_pool_parallel_for().
+ * @param task Task index in [0, num_tasks).
+ */
+typedef void (*thread_pool_task_fn)(void* ctx, int task);
+
+/** @brief Opaque thread pool. */
+typedef struct thread_pool thread_pool;
+
+/**
+ * @brief Create a thread pool.
+ *
+ * @param num_threads Total number of threads running tasks, including the caller
+ *                    of thread_pool_parallel_for(); num_threads - 1 workers are started.
+ * @return New pool, or NULL on failure.
+ */
+thread_pool* thread_pool_create(int num_threads);
+
+/**
+ * @brief Run num_tasks tasks in parallel and wait for all of them.
+ *
+ * @param pool      Thread pool.
+ * @param num_tasks Number of tasks.
+ * @param fn        Task callback.
+ * @param ctx       Context passed to every task.
+ */
+void thread_pool_parallel_for(thread_pool* pool, int num_tasks, thread_pool_task_fn fn, void* ctx);
+
+/**
+ * @brief Get the number of threads running tasks (workers plus caller).
+ *
+ * @param pool Thread pool.
+ * @return Thread count.
+ */
+int thread_pool_size(const thread_pool* pool);
+
+/**
+ * @brief Stop the workers and release the pool.
+ *
+ * @param pool Thread pool (may be NULL).
+ */
+void thread_pool_destroy(thread_pool* pool);
+
+#endif /* !__ADSP21000__ */
+
+#endif /* THREAD_POOL_H_ */
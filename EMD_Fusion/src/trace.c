@@ -0,0 +1,194 @@
+/*
+ * trace.c
+ *
+ */
+
+#include "trace.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "led.h"
+
+#if !defined(__ADSP21000__)
+#include <pthread.h>
+#endif
+
+static trace_sink trace_sinks[TRACE_MAX_SINKS];
+static int trace_num_sinks;
+
+static const char* const stage_names[TRACE_NUM_STAGES] = {
+    "read", "convert", "emd", "variance", "decision", "stretch", "save"
+};
+
+static const char* const counter_names[TRACE_NUM_COUNTERS] = {
+    "maxima", "minima", "sifts", "mask_a", "mask_b", "mask_avg"
+};
+
+#if !defined(__ADSP21000__)
+static __thread int trace_thread_id = -1;
+static int trace_next_thread;
+
+static int current_thread(void) {
+    if (trace_thread_id < 0) {
+        trace_thread_id = __atomic_fetch_add(&trace_next_thread, 1, __ATOMIC_RELAXED);
+    }
+    return trace_thread_id;
+}
+#else
+static int current_thread(void) {
+    return 0;
+}
+#endif
+
+int trace_register(const trace_sink* sink) {
+    if (trace_num_sinks == TRACE_MAX_SINKS) {
+        printf("Error: Too many trace sinks.\n");
+        return -1;
+    }
+    trace_sinks[trace_num_sinks++] = *sink;
+    return 0;
+}
+
+void trace_unregister_all(void) {
+    trace_num_sinks = 0;
+}
+
+uint64_t trace_timestamp(void) {
+#if !defined(__ADSP21000__)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#else
+    return (uint64_t)clock(); // Core clock cycles on SHARC.
+#endif
+}
+
+void trace_emit(int type, int id, int64_t value) {
+    if (trace_num_sinks == 0) {
+        return;
+    }
+    trace_event event;
+    event.type = type;
+    event.id = id;
+    event.value = value;
+    event.timestamp = trace_timestamp();
+    event.thread = current_thread();
+    for (int i = 0; i < trace_num_sinks; i++) {
+        trace_sinks[i].emit(trace_sinks[i].user, &event);
+    }
+}
+
+const char* trace_stage_name(int stage) {
+    return (stage >= 0 && stage < TRACE_NUM_STAGES) ? stage_names[stage] : "?";
+}
+
+const char* trace_counter_name(int counter) {
+    return (counter >= 0 && counter < TRACE_NUM_COUNTERS) ? counter_names[counter] : "?";
+}
+
+static void led_emit(void* user, const trace_event* event) {
+    (void)user;
+    if (event->type != TRACE_EVENT_END) {
+        return;
+    }
+    // LED8 for the first stage down to LED2 for the save, then LED1 once the image is out.
+    led_on(NUM_LEDS - 1 - event->id);
+    if (event->id == TRACE_STAGE_SAVE) {
+        led_on(0);
+    }
+}
+
+trace_sink trace_led_sink(void) {
+    trace_sink sink = { led_emit, NULL };
+    return sink;
+}
+
+static void stderr_emit(void* user, const trace_event* event) {
+    (void)user;
+    if (event->type == TRACE_EVENT_COUNTER) {
+        fprintf(stderr, "[trace %llu t%d] %s = %lld\n", (unsigned long long)event->timestamp, event->thread,
+                trace_counter_name(event->id), (long long)event->value);
+    } else {
+        fprintf(stderr, "[trace %llu t%d] %s %s\n", (unsigned long long)event->timestamp, event->thread,
+                event->type == TRACE_EVENT_BEGIN ? "begin" : "end", trace_stage_name(event->id));
+    }
+}
+
+trace_sink trace_stderr_sink(void) {
+    trace_sink sink = { stderr_emit, NULL };
+    return sink;
+}
+
+static void memory_emit(void* user, const trace_event* event) {
+    trace_memory* memory = (trace_memory*)user;
+#if !defined(__ADSP21000__)
+    int slot = __atomic_fetch_add(&memory->count, 1, __ATOMIC_RELAXED);
+#else
+    int slot = memory->count++;
+#endif
+    if (slot < memory->capacity) {
+        memory->events[slot] = *event;
+    }
+}
+
+trace_sink trace_memory_sink(trace_memory* memory, trace_event* events, int capacity) {
+    trace_sink sink = { memory_emit, memory };
+    memory->events = events;
+    memory->capacity = capacity;
+    memory->count = 0;
+    return sink;
+}
+
+#if !defined(__ADSP21000__)
+
+static FILE* chrome_file;
+static int chrome_records;
+static pthread_mutex_t chrome_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void chrome_emit(void* user, const trace_event* event) {
+    double ts_us = event->timestamp / 1e3;
+    (void)user;
+
+    pthread_mutex_lock(&chrome_lock);
+    if (chrome_file != NULL) {
+        fputs(chrome_records++ ? ",\n" : "\n", chrome_file);
+        if (event->type == TRACE_EVENT_COUNTER) {
+            fprintf(chrome_file, "{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"tid\":%d,"
+                    "\"args\":{\"value\":%lld}}", trace_counter_name(event->id), ts_us, event->thread,
+                    (long long)event->value);
+        } else {
+            fprintf(chrome_file, "{\"name\":\"%s\",\"ph\":\"%s\",\"ts\":%.3f,\"pid\":1,\"tid\":%d}",
+                    trace_stage_name(event->id), event->type == TRACE_EVENT_BEGIN ? "B" : "E", ts_us,
+                    event->thread);
+        }
+    }
+    pthread_mutex_unlock(&chrome_lock);
+}
+
+int trace_chrome_open(const char* path, trace_sink* sink) {
+    FILE* fp = fopen(path, "w");
+    if (fp == NULL) {
+        printf("Error: Cannot open file %s for writing.\n", path);
+        return -1;
+    }
+    fputc('[', fp);
+    pthread_mutex_lock(&chrome_lock);
+    chrome_file = fp;
+    chrome_records = 0;
+    pthread_mutex_unlock(&chrome_lock);
+    sink->emit = chrome_emit;
+    sink->user = NULL;
+    return 0;
+}
+
+void trace_chrome_close(void) {
+    pthread_mutex_lock(&chrome_lock);
+    if (chrome_file != NULL) {
+        fputs("\n]\n", chrome_file);
+        fclose(chrome_file);
+        chrome_file = NULL;
+    }
+    pthread_mutex_unlock(&chrome_lock);
+}
+
+#endif /* !__ADSP21000__ */
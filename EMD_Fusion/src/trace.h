@@ -0,0 +1,161 @@
+/*
+ * trace.h
+ *
+ * @brief Header file for progress and instrumentation hooks.
+ *
+ * The pipeline reports stage begin/end events and counters through the
+ * TRACE_BEGIN(), TRACE_END() and TRACE_COUNT() macros. Every event carries a
+ * timestamp (clock_gettime() on hosted builds, clock() cycles on SHARC) and
+ * the id of the thread that emitted it. Sinks are registered at run time:
+ *   - LED: one LED per finished stage, LED8 down to LED1 (the former save progress),
+ *   - stderr: one line per event,
+ *   - memory: events appended to a caller buffer,
+ *   - Chrome trace (hosted): a JSON file for chrome://tracing or Perfetto,
+ *     which shows how the stages of the threaded and streaming modes overlap.
+ *
+ * The macros compile to nothing unless the build sets EMD_TRACE=1, so
+ * production builds pay nothing. With EMD_TRACE=1 and no sink registered an
+ * event costs one load and branch. Sinks must be registered before the
+ * pipeline starts. The LED, stderr and memory sinks are not synchronised
+ * (the memory sink reserves slots atomically on hosted builds); the Chrome
+ * sink serialises writes and may be used from any thread.
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdint.h>
+
+/** @brief 1 compiles the hooks in, 0 (default) removes them. */
+#ifndef EMD_TRACE
+#define EMD_TRACE 0
+#endif
+
+/** @brief Sinks that can be registered at the same time. */
+#define TRACE_MAX_SINKS 4
+
+#define TRACE_EVENT_BEGIN   0
+#define TRACE_EVENT_END     1
+#define TRACE_EVENT_COUNTER 2
+
+/** @brief Pipeline stages, in pipeline order. */
+#define TRACE_STAGE_READ     0  /**< Loading a frame pair (streaming mode). */
+#define TRACE_STAGE_CONVERT  1  /**< convert_to_q16_16(). */
+#define TRACE_STAGE_EMD      2  /**< EMD or BEMD of one image. */
+#define TRACE_STAGE_VARIANCE 3  /**< Local variance. */
+#define TRACE_STAGE_DECISION 4  /**< Decision mask and fusion. */
+#define TRACE_STAGE_STRETCH  5  /**< Histogram stretch. */
+#define TRACE_STAGE_SAVE     6  /**< Writing the fused image. */
+#define TRACE_NUM_STAGES     7
+
+/** @brief Counters. */
+#define TRACE_COUNTER_MAXIMA     0  /**< Maxima found by one sift. */
+#define TRACE_COUNTER_MINIMA     1  /**< Minima found by one sift. */
+#define TRACE_COUNTER_SIFTS      2  /**< Sifting iterations of one IMF. */
+#define TRACE_COUNTER_MASK_A     3  /**< Pixels taken from image A. */
+#define TRACE_COUNTER_MASK_B     4  /**< Pixels taken from image B. */
+#define TRACE_COUNTER_MASK_AVG   5  /**< Pixels averaged. */
+#define TRACE_NUM_COUNTERS       6
+
+/**
+ * @brief One instrumentation event.
+ */
+typedef struct {
+    int type;            /**< TRACE_EVENT_BEGIN, TRACE_EVENT_END or TRACE_EVENT_COUNTER. */
+    int id;              /**< Stage or counter id. */
+    int64_t value;       /**< Counter value, 0 for stage events. */
+    uint64_t timestamp;  /**< Nanoseconds (hosted) or cycles (SHARC). */
+    int thread;          /**< Small per-thread id, 0 for the first thread that emits. */
+} trace_event;
+
+/**
+ * @brief Event consumer.
+ */
+typedef struct {
+    void (*emit)(void* user, const trace_event* event); /**< Called for every event. */
+    void* user;                                         /**< Sink state. */
+} trace_sink;
+
+/**
+ * @brief Events recorded by the memory sink.
+ */
+typedef struct {
+    trace_event* events; /**< Caller buffer. */
+    int capacity;        /**< Entries in events. */
+    int count;           /**< Events offered; entries past capacity are dropped. */
+} trace_memory;
+
+#if EMD_TRACE
+#define TRACE_BEGIN(stage)          trace_emit(TRACE_EVENT_BEGIN, (stage), 0)
+#define TRACE_END(stage)            trace_emit(TRACE_EVENT_END, (stage), 0)
+#define TRACE_COUNT(counter, value) trace_emit(TRACE_EVENT_COUNTER, (counter), (value))
+#else
+#define TRACE_BEGIN(stage)          ((void)0)
+#define TRACE_END(stage)            ((void)0)
+#define TRACE_COUNT(counter, value) ((void)0)
+#endif
+
+/**
+ * @brief Register a sink. The sink structure is copied.
+ *
+ * @return 0 on success, -1 if TRACE_MAX_SINKS are already registered.
+ */
+int trace_register(const trace_sink* sink);
+
+/**
+ * @brief Remove all sinks.
+ */
+void trace_unregister_all(void);
+
+/**
+ * @brief Deliver an event to every registered sink (used by the macros).
+ */
+void trace_emit(int type, int id, int64_t value);
+
+/**
+ * @brief Current timestamp: nanoseconds on hosted builds, processor cycles on SHARC.
+ */
+uint64_t trace_timestamp(void);
+
+/** @brief Name of a stage, e.g. "emd". */
+const char* trace_stage_name(int stage);
+
+/** @brief Name of a counter, e.g. "maxima". */
+const char* trace_counter_name(int counter);
+
+/**
+ * @brief LED sink: the LED of a stage lights when the stage ends.
+ */
+trace_sink trace_led_sink(void);
+
+/**
+ * @brief stderr sink: one text line per event.
+ */
+trace_sink trace_stderr_sink(void);
+
+/**
+ * @brief Memory sink appending to a caller buffer.
+ *
+ * @param memory   Buffer state, count is reset to 0.
+ * @param events   Storage for the events.
+ * @param capacity Entries in events.
+ */
+trace_sink trace_memory_sink(trace_memory* memory, trace_event* events, int capacity);
+
+#if !defined(__ADSP21000__)
+/**
+ * @brief Open a Chrome trace JSON file and return its sink (hosted builds only).
+ *
+ * @param path Output file.
+ * @param sink Output sink to register.
+ * @return 0 on success, -1 if the file cannot be created.
+ */
+int trace_chrome_open(const char* path, trace_sink* sink);
+
+/**
+ * @brief Finish and close the Chrome trace file opened by trace_chrome_open().
+ */
+void trace_chrome_close(void);
+#endif
+
+#endif /* TRACE_H_ */